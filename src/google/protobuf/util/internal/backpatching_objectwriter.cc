@@ -0,0 +1,1117 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <google/protobuf/util/internal/backpatching_objectwriter.h>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <google/protobuf/stubs/statusor.h>
+#include <google/protobuf/util/internal/constants.h>
+#include <google/protobuf/util/internal/location_tracker.h>
+#include <google/protobuf/util/internal/utility.h>
+#include <google/protobuf/util/internal/xml_well_known_types.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+using ::google::protobuf::internal::WireFormatLite;
+
+namespace {
+
+const char kWellKnownTypePrefix[] = "google.protobuf.";
+
+// A tag and the largest scalar value.
+const int kMaxScalarSize = 15;
+
+// The fields of google.protobuf.Any.
+const int kAnyTypeUrlFieldNumber = 1;
+const int kAnyValueFieldNumber = 2;
+
+// A location already rendered as a string.
+class PathLocation : public LocationTrackerInterface {
+ public:
+  explicit PathLocation(std::string path) : path_(std::move(path)) {}
+  ~PathLocation() override {}
+
+  std::string ToString() const override { return path_; }
+
+ private:
+  const std::string path_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(PathLocation);
+};
+
+// Passes on the errors of the ProtoStreamObjectWriter writing a well-known
+// type, prefixing their locations with the location of the value it writes.
+class PrefixingErrorListener : public ErrorListener {
+ public:
+  PrefixingErrorListener(ErrorListener* listener, std::string prefix)
+      : listener_(listener), prefix_(std::move(prefix)) {}
+  ~PrefixingErrorListener() override {}
+
+  void InvalidName(const LocationTrackerInterface& loc,
+                   StringPiece invalid_name, StringPiece message) override {
+    listener_->InvalidName(PathLocation(Prefix(loc)), invalid_name, message);
+  }
+
+  void InvalidValue(const LocationTrackerInterface& loc,
+                    StringPiece type_name, StringPiece value) override {
+    listener_->InvalidValue(PathLocation(Prefix(loc)), type_name, value);
+  }
+
+  void MissingField(const LocationTrackerInterface& loc,
+                    StringPiece missing_name) override {
+    listener_->MissingField(PathLocation(Prefix(loc)), missing_name);
+  }
+
+ private:
+  std::string Prefix(const LocationTrackerInterface& loc) const {
+    std::string path = loc.ToString();
+    if (path.empty()) return prefix_;
+    if (prefix_.empty()) return path;
+    return StrCat(prefix_, path[0] == '[' ? "" : ".", path);
+  }
+
+  ErrorListener* listener_;
+  const std::string prefix_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(PrefixingErrorListener);
+};
+
+bool IsMessageKind(const google::protobuf::Field& field) {
+  return field.kind() == google::protobuf::Field::TYPE_MESSAGE ||
+         field.kind() == google::protobuf::Field::TYPE_GROUP;
+}
+
+const google::protobuf::Field* FindFieldByNumber(
+    const google::protobuf::Type& type, int number) {
+  for (const google::protobuf::Field& field : type.fields()) {
+    if (field.number() == number) return &field;
+  }
+  return nullptr;
+}
+
+// Whether a null value is written to |field| rather than ignored, as
+// ProtoStreamObjectWriter decides.
+bool AcceptsNull(const google::protobuf::Field& field) {
+  return field.type_url() == kStructValueTypeUrl ||
+         field.type_url() == kStructNullValueTypeUrl;
+}
+
+// Writes |value| as a varint of exactly kLengthSlotSize bytes.
+void EncodeLength(uint32_t value, char* target) {
+  for (int i = 0; i < BackpatchingObjectWriter::kLengthSlotSize - 1; ++i) {
+    target[i] = static_cast<char>((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  target[BackpatchingObjectWriter::kLengthSlotSize - 1] =
+      static_cast<char>(value);
+}
+
+// FNV-1a, for the keys of maps.
+size_t HashKey(StringPiece key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : key) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+  }
+  return static_cast<size_t>(hash);
+}
+
+uint32_t DecodeLength(const char* source) {
+  uint32_t value = 0;
+  for (int i = 0; i < BackpatchingObjectWriter::kLengthSlotSize; ++i) {
+    value |= static_cast<uint32_t>(static_cast<uint8_t>(source[i]) & 0x7F)
+             << (7 * i);
+  }
+  return value;
+}
+
+}  // namespace
+
+bool BackpatchingObjectWriter::MapKeySet::Insert(StringPiece key) {
+  // At most half of the buckets are used.
+  if (starts_.size() * 2 >= buckets_.size()) {
+    Rehash(std::max<size_t>(16, buckets_.size() * 2));
+  }
+  const size_t mask = buckets_.size() - 1;
+  for (size_t i = HashKey(key) & mask;; i = (i + 1) & mask) {
+    if (buckets_[i] == 0) {
+      if (starts_.empty()) starts_.push_back(0);
+      keys_.append(key.data(), key.size());
+      starts_.push_back(static_cast<uint32_t>(keys_.size()));
+      buckets_[i] = static_cast<uint32_t>(starts_.size() - 1);
+      return true;
+    }
+    if (Key(buckets_[i] - 1) == key) return false;
+  }
+}
+
+void BackpatchingObjectWriter::MapKeySet::Rehash(size_t size) {
+  buckets_.assign(size, 0);
+  const size_t mask = size - 1;
+  for (uint32_t index = 0; index + 1 < starts_.size(); ++index) {
+    size_t i = HashKey(Key(index)) & mask;
+    while (buckets_[i] != 0) i = (i + 1) & mask;
+    buckets_[i] = index + 1;
+  }
+}
+
+BackpatchingObjectWriter::BackpatchingObjectWriter(
+    TypeResolver* type_resolver, const google::protobuf::Type& type,
+    strings::ByteSink* output, ErrorListener* listener,
+    const ProtoStreamObjectWriter::Options& options)
+    : type_resolver_(type_resolver),
+      type_info_(TypeInfo::NewTypeInfo(type_resolver)),
+      type_(type),
+      output_(output),
+      listener_(listener),
+      options_(options),
+      compact_lengths_(true),
+      invalid_depth_(0),
+      done_(false),
+      delegate_depth_(0),
+      delegate_slot_(kNoSlot),
+      delegate_entry_slot_(kNoSlot),
+      deferred_any_field_(nullptr),
+      deferred_any_type_(nullptr),
+      deferred_any_entry_slot_(kNoSlot) {}
+
+BackpatchingObjectWriter::~BackpatchingObjectWriter() {}
+
+BackpatchingObjectWriter* BackpatchingObjectWriter::StartObject(
+    StringPiece name) {
+  if (deferred_any_field_ != nullptr) StartDeferredAny(nullptr);
+  if (delegate_depth_ > 0) {
+    delegate_->StartObject(name);
+    ++delegate_depth_;
+    return this;
+  }
+  if (invalid_depth_ > 0) {
+    ++invalid_depth_;
+    return this;
+  }
+  if (frames_.empty()) {
+    if (!name.empty()) {
+      InvalidName(name, "Root element should not be named.");
+    }
+    if (IsWellKnownType(type_)) {
+      StartWellKnownType("", nullptr, type_, kNoSlot);
+      delegate_->StartObject("");
+      delegate_depth_ = 1;
+      return this;
+    }
+    frames_.emplace_back(Frame::MESSAGE, &type_, nullptr);
+    InitMessage(&frames_.back());
+    return this;
+  }
+
+  if (frames_.back().kind == Frame::MAP) {
+    const google::protobuf::Field* value_field = frames_.back().value_field;
+    const google::protobuf::Type* value_type =
+        value_field != nullptr && IsMessageKind(*value_field)
+            ? LookupType(name, *value_field)
+            : nullptr;
+    if (value_type == nullptr) {
+      if (value_field != nullptr && !IsMessageKind(*value_field)) {
+        InvalidName(name,
+                    "Proto field is not a message, cannot start object.");
+      }
+      ++invalid_depth_;
+      return this;
+    }
+    size_t entry_slot;
+    if (!StartMapEntry(name, &entry_slot)) {
+      ++invalid_depth_;
+      return this;
+    }
+    if (value_type->name() == kAnyType) {
+      DeferAny(name, *value_field, *value_type, entry_slot);
+      return this;
+    }
+    if (IsWellKnownType(*value_type)) {
+      StartWellKnownType(MapValueName(), value_field, *value_type,
+                         entry_slot);
+      delegate_->StartObject("");
+      delegate_depth_ = 1;
+      return this;
+    }
+    const int index = frames_.back().size - 1;
+    StartMessage(*value_field, *value_type, entry_slot);
+    frames_.back().index = index;
+    return this;
+  }
+
+  const google::protobuf::Field* field = Lookup(name);
+  if (field == nullptr) {
+    ++invalid_depth_;
+    return this;
+  }
+  if (!IsMessageKind(*field)) {
+    InvalidName(name, "Proto field is not a message, cannot start object.");
+    ++invalid_depth_;
+    return this;
+  }
+  const google::protobuf::Type* type = LookupType(name, *field);
+  if (type == nullptr) {
+    ++invalid_depth_;
+    return this;
+  }
+  if (frames_.back().kind == Frame::MESSAGE && IsMap(*field, *type)) {
+    frames_.emplace_back(Frame::MAP, type, field);
+    // Map field numbers are key = 1 and value = 2.
+    frames_.back().key_field = FindFieldByNumber(*type, 1);
+    frames_.back().value_field = FindFieldByNumber(*type, 2);
+    return this;
+  }
+  if (!SetField(name, *field)) {
+    ++invalid_depth_;
+    return this;
+  }
+  if (type->name() == kAnyType) {
+    DeferAny(name, *field, *type, kNoSlot);
+    return this;
+  }
+  if (IsWellKnownType(*type)) {
+    StartWellKnownType(ElementName(name), field, *type, kNoSlot);
+    delegate_->StartObject("");
+    delegate_depth_ = 1;
+    return this;
+  }
+  StartMessage(*field, *type, kNoSlot);
+  return this;
+}
+
+BackpatchingObjectWriter* BackpatchingObjectWriter::EndObject() {
+  if (deferred_any_field_ != nullptr) StartDeferredAny(nullptr);
+  if (delegate_depth_ > 0) {
+    delegate_->EndObject();
+    if (--delegate_depth_ == 0) FinishWellKnownType();
+    return this;
+  }
+  EndFrame();
+  return this;
+}
+
+BackpatchingObjectWriter* BackpatchingObjectWriter::StartList(
+    StringPiece name) {
+  if (deferred_any_field_ != nullptr) StartDeferredAny(nullptr);
+  if (delegate_depth_ > 0) {
+    delegate_->StartList(name);
+    ++delegate_depth_;
+    return this;
+  }
+  if (invalid_depth_ > 0) {
+    ++invalid_depth_;
+    return this;
+  }
+  if (frames_.empty()) {
+    if (!name.empty()) {
+      InvalidName(name, "Root element should not be named.");
+      ++invalid_depth_;
+      return this;
+    }
+    if (IsWellKnownType(type_)) {
+      StartWellKnownType("", nullptr, type_, kNoSlot);
+      delegate_->StartList("");
+      delegate_depth_ = 1;
+      return this;
+    }
+    InvalidName(name, "Root element must be a message.");
+    ++invalid_depth_;
+    return this;
+  }
+
+  if (frames_.back().kind == Frame::MAP) {
+    // Only map values of well-known types, such as google.protobuf.Value,
+    // may be written as lists.
+    const google::protobuf::Field* value_field = frames_.back().value_field;
+    const google::protobuf::Type* value_type =
+        value_field != nullptr && IsMessageKind(*value_field)
+            ? LookupType(name, *value_field)
+            : nullptr;
+    size_t entry_slot;
+    if (value_type == nullptr || !IsWellKnownType(*value_type)) {
+      InvalidValue("", "Map", "Cannot have repeated items in a map.");
+      ++invalid_depth_;
+    } else if (!StartMapEntry(name, &entry_slot)) {
+      ++invalid_depth_;
+    } else {
+      StartWellKnownType(MapValueName(), value_field, *value_type,
+                         entry_slot);
+      delegate_->StartList("");
+      delegate_depth_ = 1;
+    }
+    return this;
+  }
+
+  const google::protobuf::Field* field = Lookup(name);
+  if (field == nullptr) {
+    ++invalid_depth_;
+    return this;
+  }
+  const google::protobuf::Type* type = nullptr;
+  if (IsMessageKind(*field)) {
+    type = LookupType(name, *field);
+    if (type == nullptr) {
+      ++invalid_depth_;
+      return this;
+    }
+  }
+  const bool well_known = type != nullptr && IsWellKnownType(*type);
+  // A list given for a single value, or for an element of a list, is only
+  // valid for types such as google.protobuf.ListValue.
+  if (frames_.back().kind == Frame::LIST
+          ? well_known
+          : field->cardinality() !=
+                google::protobuf::Field::CARDINALITY_REPEATED) {
+    if (!well_known) {
+      InvalidName(name, "Proto field is not repeating, cannot start list.");
+      ++invalid_depth_;
+      return this;
+    }
+    if (!SetField(name, *field)) {
+      ++invalid_depth_;
+      return this;
+    }
+    StartWellKnownType(ElementName(name), field, *type, kNoSlot);
+    delegate_->StartList("");
+    delegate_depth_ = 1;
+    return this;
+  }
+  if (type != nullptr && IsMap(*field, *type)) {
+    InvalidValue("", "Map",
+                 StrCat("Cannot bind a list to map for field '", name, "'."));
+    ++invalid_depth_;
+    return this;
+  }
+  // A list within a list of the same field adds to it, as with
+  // ProtoStreamObjectWriter.
+  frames_.emplace_back(Frame::LIST, type, field);
+  return this;
+}
+
+BackpatchingObjectWriter* BackpatchingObjectWriter::EndList() {
+  if (deferred_any_field_ != nullptr) StartDeferredAny(nullptr);
+  if (delegate_depth_ > 0) {
+    delegate_->EndList();
+    if (--delegate_depth_ == 0) FinishWellKnownType();
+    return this;
+  }
+  EndFrame();
+  return this;
+}
+
+BackpatchingObjectWriter* BackpatchingObjectWriter::RenderDataPiece(
+    StringPiece name, const DataPiece& data) {
+  if (deferred_any_field_ != nullptr &&
+      StartDeferredAny(name == "@type" ? &data : nullptr)) {
+    return this;
+  }
+  if (delegate_depth_ > 0) {
+    ObjectWriter::RenderDataPieceTo(data, name, delegate_.get());
+    return this;
+  }
+  if (invalid_depth_ > 0) return this;
+  if (frames_.empty()) {
+    if (IsWellKnownType(type_)) {
+      StartWellKnownType("", nullptr, type_, kNoSlot);
+      ObjectWriter::RenderDataPieceTo(data, name, delegate_.get());
+      FinishWellKnownType();
+      return this;
+    }
+    InvalidName(name, "Root element must be a message.");
+    return this;
+  }
+  if (frames_.back().kind == Frame::MAP) {
+    RenderMapEntry(name, data);
+    return this;
+  }
+  const google::protobuf::Field* field = Lookup(name);
+  if (field == nullptr) return this;
+  const google::protobuf::Type* type = nullptr;
+  if (IsMessageKind(*field)) {
+    type = LookupType(name, *field);
+    if (type == nullptr) return this;
+  }
+  // Explicit nulls mean absence, except for google.protobuf.Value and
+  // NullValue.
+  if (data.type() == DataPiece::TYPE_NULL && !AcceptsNull(*field)) {
+    return this;
+  }
+  if (!SetField(name, *field)) return this;
+  const std::string element_name = ElementName(name);
+  if (type != nullptr &&
+      RenderWellKnownValue(name, element_name, *field, *type, data)) {
+    return this;
+  }
+  if (type != nullptr && IsWellKnownType(*type)) {
+    StartWellKnownType(element_name, field, *type, kNoSlot);
+    ObjectWriter::RenderDataPieceTo(data, "", delegate_.get());
+    FinishWellKnownType();
+    return this;
+  }
+  RenderValue(element_name, *field, data);
+  return this;
+}
+
+void BackpatchingObjectWriter::RenderMapEntry(StringPiece key,
+                                              const DataPiece& data) {
+  const google::protobuf::Field* value_field = frames_.back().value_field;
+  if (value_field == nullptr) return;
+  if (options_.ignore_null_value_map_entry &&
+      data.type() == DataPiece::TYPE_NULL &&
+      value_field->type_url() != kStructNullValueTypeUrl) {
+    return;
+  }
+  if (!IsMessageKind(*value_field)) {
+    RenderScalarMapEntry(key, data);
+    return;
+  }
+  const google::protobuf::Type* value_type = LookupType(key, *value_field);
+  if (value_type == nullptr) return;
+  size_t entry_slot;
+  if (!StartMapEntry(key, &entry_slot)) return;
+  const std::string value_name = MapValueName();
+  if (RenderWellKnownValue(key, value_name, *value_field, *value_type, data)) {
+    PatchLength(entry_slot);
+    return;
+  }
+  if (IsWellKnownType(*value_type)) {
+    StartWellKnownType(value_name, value_field, *value_type, entry_slot);
+    ObjectWriter::RenderDataPieceTo(data, "", delegate_.get());
+    FinishWellKnownType();
+    return;
+  }
+  // Like for fields, a null value leaves the value out; the entry is still
+  // written.
+  if (data.type() != DataPiece::TYPE_NULL || AcceptsNull(*value_field)) {
+    RenderValue(value_name, *value_field, data);
+  }
+  PatchLength(entry_slot);
+}
+
+void BackpatchingObjectWriter::RenderScalarMapEntry(StringPiece key,
+                                                    const DataPiece& data) {
+  if (!AddMapKey(key)) return;
+  Frame& frame = frames_.back();
+  const int index = frame.size++;
+  AppendTag(frame.field->number(), WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+  // Most entries are shorter than 128 bytes, so one byte is set aside for
+  // the length, and the entry moved along in the rare case it needs more.
+  const size_t start = buffer_.size();
+  buffer_.push_back('\0');
+  WriteMapKey(key, index);
+  // Like for fields, a null value leaves the value out; the entry is still
+  // written.
+  if (data.type() != DataPiece::TYPE_NULL || AcceptsNull(*frame.value_field)) {
+    util::Status status = WriteScalar(*frame.value_field, data);
+    if (!status.ok()) InvalidScalar(MapValueName(), *frame.value_field, status);
+  }
+  const uint32_t length = static_cast<uint32_t>(buffer_.size() - start - 1);
+  const int length_size = io::CodedOutputStream::VarintSize32(length);
+  if (length_size > 1) buffer_.insert(start + 1, length_size - 1, '\0');
+  io::CodedOutputStream::WriteVarint32ToArray(
+      length, reinterpret_cast<uint8_t*>(&buffer_[start]));
+}
+
+void BackpatchingObjectWriter::RenderValue(
+    StringPiece name, const google::protobuf::Field& field,
+    const DataPiece& data) {
+  if (IsMessageKind(field)) {
+    InvalidValue(name, field.type_url(), data.ValueAsStringOrDefault(""));
+    return;
+  }
+  util::Status status = WriteScalar(field, data);
+  if (!status.ok()) InvalidScalar(name, field, status);
+}
+
+void BackpatchingObjectWriter::InvalidScalar(
+    StringPiece name, const google::protobuf::Field& field,
+    const util::Status& status) {
+  InvalidValue(name,
+               field.type_url().empty()
+                   ? google::protobuf::Field_Kind_Name(field.kind())
+                   : field.type_url(),
+               status.message());
+}
+
+bool BackpatchingObjectWriter::RenderWellKnownValue(
+    StringPiece name, StringPiece element_name,
+    const google::protobuf::Field& field, const google::protobuf::Type& type,
+    const DataPiece& data) {
+  const XmlWellKnownType well_known_type = GetXmlWellKnownType(type);
+  if (well_known_type != XML_TIMESTAMP && well_known_type != XML_DURATION &&
+      well_known_type != XML_WRAPPER) {
+    return false;
+  }
+  // As from ProtoStreamObjectWriter, a null or invalid value leaves an empty
+  // message.
+  const size_t slot = StartLengthDelimited(field);
+  if (data.type() != DataPiece::TYPE_NULL) {
+    if (well_known_type == XML_WRAPPER) {
+      RenderValue(StrCat(element_name, ".value"), type.fields(0), data);
+    } else {
+      util::Status status =
+          WriteSecondsAndNanos(well_known_type == XML_TIMESTAMP, data);
+      if (!status.ok()) {
+        InvalidValue(element_name, field.type_url(),
+                     StrCat("Field '", name, "', ", status.message()));
+      }
+    }
+  }
+  PatchLength(slot);
+  return true;
+}
+
+util::Status BackpatchingObjectWriter::WriteSecondsAndNanos(
+    bool timestamp, const DataPiece& data) {
+  if (data.type() != DataPiece::TYPE_STRING) {
+    return util::InvalidArgumentError(
+        StrCat("Invalid data type for ", timestamp ? "timestamp" : "duration",
+               ", value is ", data.ValueAsStringOrDefault("")));
+  }
+  int64_t seconds = 0;
+  int32_t nanos = 0;
+  if (timestamp) {
+    if (!ParseXmlTimestamp(data.str(), &seconds, &nanos)) {
+      return util::InvalidArgumentError(
+          StrCat("Invalid time format: ", data.str()));
+    }
+  } else {
+    util::Status status = ParseXmlDuration(data.str(), &seconds, &nanos);
+    if (!status.ok()) return status;
+  }
+  // Both fields are written even when zero, as ProtoStreamObjectWriter does.
+  uint8_t scratch[2 * kMaxScalarSize];
+  uint8_t* target = WireFormatLite::WriteInt64ToArray(1, seconds, scratch);
+  target = WireFormatLite::WriteInt32ToArray(2, nanos, target);
+  buffer_.append(reinterpret_cast<const char*>(scratch), target - scratch);
+  return util::Status();
+}
+
+const google::protobuf::Field* BackpatchingObjectWriter::Lookup(
+    StringPiece name) {
+  const Frame& frame = frames_.back();
+  // Elements of a list are unnamed and take the field of the list.
+  if (frame.kind == Frame::LIST && name.empty()) return frame.field;
+  if (name.empty()) {
+    InvalidName(name, "Proto fields must have a name.");
+    return nullptr;
+  }
+  const google::protobuf::Field* field =
+      frame.kind == Frame::MESSAGE ? type_info_->FindField(frame.type, name)
+                                   : nullptr;
+  if (field == nullptr && !options_.ignore_unknown_fields) {
+    InvalidName(name, "Cannot find field.");
+  }
+  return field;
+}
+
+const google::protobuf::Type* BackpatchingObjectWriter::LookupType(
+    StringPiece name, const google::protobuf::Field& field) {
+  const google::protobuf::Type* type =
+      type_info_->GetTypeByTypeUrl(field.type_url());
+  if (type == nullptr) {
+    InvalidName(name,
+                StrCat("Missing descriptor for field: ", field.type_url()));
+  }
+  return type;
+}
+
+bool BackpatchingObjectWriter::SetField(StringPiece name,
+                                        const google::protobuf::Field& field) {
+  Frame& frame = frames_.back();
+  if (frame.kind != Frame::MESSAGE) return true;
+  const int oneof_index = field.oneof_index();
+  if (oneof_index > 0) {
+    if (frame.oneofs_set[oneof_index]) {
+      InvalidValue("", "oneof",
+                   StrCat("oneof field '", frame.type->oneofs(oneof_index - 1),
+                          "' is already set. Cannot set '", name, "'"));
+      return false;
+    }
+    frame.oneofs_set[oneof_index] = true;
+  }
+  if (!frame.required_fields.empty()) frame.required_fields.erase(&field);
+  return true;
+}
+
+void BackpatchingObjectWriter::InitMessage(Frame* frame) {
+  if (frame->type->oneofs_size() > 0) {
+    frame->oneofs_set.assign(frame->type->oneofs_size() + 1, false);
+  }
+  if (frame->type->syntax() != google::protobuf::SYNTAX_PROTO3) {
+    for (const google::protobuf::Field& field : frame->type->fields()) {
+      if (field.cardinality() ==
+          google::protobuf::Field::CARDINALITY_REQUIRED) {
+        frame->required_fields.insert(&field);
+      }
+    }
+  }
+}
+
+size_t BackpatchingObjectWriter::StartLengthDelimited(int number) {
+  uint8_t tag[kMaxScalarSize];
+  const uint8_t* end = WireFormatLite::WriteTagToArray(
+      number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, tag);
+  buffer_.append(reinterpret_cast<const char*>(tag), end - tag);
+  const size_t slot = buffer_.size();
+  buffer_.resize(slot + kLengthSlotSize);
+  // A valid length until patched, should the message not be ended.
+  EncodeLength(0, &buffer_[slot]);
+  length_slots_.push_back(slot);
+  if (compact_lengths_) savings_.push_back(0);
+  return slot;
+}
+
+void BackpatchingObjectWriter::PatchLength(size_t slot) {
+  size_t length = buffer_.size() - slot - kLengthSlotSize;
+  GOOGLE_DCHECK_LE(length, static_cast<size_t>(kint32max));
+  if (compact_lengths_) {
+    // Lengths are stored as they will be once the nested lengths are
+    // compacted, and what compacting this one saves is passed on to the
+    // enclosing one.
+    const size_t nested_savings = savings_.back();
+    savings_.pop_back();
+    length -= nested_savings;
+    if (!savings_.empty()) {
+      savings_.back() +=
+          nested_savings + kLengthSlotSize -
+          io::CodedOutputStream::VarintSize32(static_cast<uint32_t>(length));
+    }
+  }
+  EncodeLength(static_cast<uint32_t>(length), &buffer_[slot]);
+}
+
+void BackpatchingObjectWriter::AppendTag(
+    int number, WireFormatLite::WireType wire_type) {
+  uint8_t tag[kMaxScalarSize];
+  const uint8_t* end = WireFormatLite::WriteTagToArray(number, wire_type, tag);
+  buffer_.append(reinterpret_cast<const char*>(tag), end - tag);
+}
+
+void BackpatchingObjectWriter::StartMessage(
+    const google::protobuf::Field& field, const google::protobuf::Type& type,
+    size_t entry_slot) {
+  Frame frame(Frame::MESSAGE, &type, &field);
+  if (field.kind() == google::protobuf::Field::TYPE_GROUP) {
+    AppendTag(field.number(), WireFormatLite::WIRETYPE_START_GROUP);
+  } else {
+    frame.length_slot = StartLengthDelimited(field);
+  }
+  frame.entry_slot = entry_slot;
+  if (frames_.back().kind == Frame::LIST) frame.index = frames_.back().size++;
+  frames_.push_back(std::move(frame));
+  InitMessage(&frames_.back());
+}
+
+void BackpatchingObjectWriter::EndFrame() {
+  if (invalid_depth_ > 0) {
+    --invalid_depth_;
+    return;
+  }
+  if (frames_.empty()) return;
+  const Frame& frame = frames_.back();
+  const bool any_payload = frame.any_payload;
+  if (frame.kind == Frame::MESSAGE) {
+    for (const google::protobuf::Field* field : frame.required_fields) {
+      MissingField(options_.use_json_name_in_missing_fields
+                       ? field->json_name()
+                       : field->name());
+    }
+    if (frame.field != nullptr &&
+        frame.field->kind() == google::protobuf::Field::TYPE_GROUP) {
+      AppendTag(frame.field->number(), WireFormatLite::WIRETYPE_END_GROUP);
+    }
+    if (any_payload &&
+        buffer_.size() == frame.length_slot + kLengthSlotSize) {
+      // An empty payload is left out, as ProtoStreamObjectWriter does.
+      buffer_.resize(frame.length_slot -
+                     WireFormatLite::TagSize(kAnyValueFieldNumber,
+                                             WireFormatLite::TYPE_BYTES));
+      length_slots_.pop_back();
+      if (compact_lengths_) savings_.pop_back();
+    } else if (frame.length_slot != kNoSlot) {
+      PatchLength(frame.length_slot);
+    }
+    if (frame.entry_slot != kNoSlot) PatchLength(frame.entry_slot);
+  }
+  frames_.pop_back();
+  // The end of the payload is also the end of its Any.
+  if (any_payload) {
+    EndFrame();
+    return;
+  }
+  if (frames_.empty()) WriteRootMessage();
+}
+
+bool BackpatchingObjectWriter::StartMapEntry(StringPiece key,
+                                             size_t* entry_slot) {
+  if (!AddMapKey(key)) return false;
+  Frame& frame = frames_.back();
+  const int index = frame.size++;
+  *entry_slot = StartLengthDelimited(*frame.field);
+  WriteMapKey(key, index);
+  return true;
+}
+
+bool BackpatchingObjectWriter::AddMapKey(StringPiece key) {
+  Frame& frame = frames_.back();
+  if (frame.map_keys.Insert(key)) return true;
+  // Located, like ProtoStreamObjectWriter does, at the last entry.
+  const PathLocation location(Location(
+      frame.size > 0 ? StrCat("[", frame.size - 1, "]") : std::string()));
+  listener_->InvalidName(
+      location, key, StrCat("Repeated map key: '", key, "' is already set."));
+  return false;
+}
+
+void BackpatchingObjectWriter::WriteMapKey(StringPiece key, int index) {
+  const google::protobuf::Field* key_field = frames_.back().key_field;
+  if (key_field == nullptr) return;
+  // The key is converted from the string it is given as without copying it;
+  // its location is only built for errors.
+  util::Status status =
+      WriteScalar(*key_field, DataPiece(key, use_strict_base64_decoding()));
+  if (!status.ok()) {
+    InvalidScalar(StrCat("[", index, "].key"), *key_field, status);
+  }
+}
+
+util::Status BackpatchingObjectWriter::WriteScalar(
+    const google::protobuf::Field& field, const DataPiece& data) {
+  const int number = field.number();
+  uint8_t scratch[kMaxScalarSize];
+  uint8_t* target = scratch;
+  switch (field.kind()) {
+    case google::protobuf::Field::TYPE_INT32: {
+      util::StatusOr<int32_t> value = data.ToInt32();
+      if (!value.ok()) return value.status();
+      target = WireFormatLite::WriteInt32ToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_SFIXED32: {
+      util::StatusOr<int32_t> value = data.ToInt32();
+      if (!value.ok()) return value.status();
+      target =
+          WireFormatLite::WriteSFixed32ToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_SINT32: {
+      util::StatusOr<int32_t> value = data.ToInt32();
+      if (!value.ok()) return value.status();
+      target =
+          WireFormatLite::WriteSInt32ToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_FIXED32: {
+      util::StatusOr<uint32_t> value = data.ToUint32();
+      if (!value.ok()) return value.status();
+      target =
+          WireFormatLite::WriteFixed32ToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_UINT32: {
+      util::StatusOr<uint32_t> value = data.ToUint32();
+      if (!value.ok()) return value.status();
+      target =
+          WireFormatLite::WriteUInt32ToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_INT64: {
+      util::StatusOr<int64_t> value = data.ToInt64();
+      if (!value.ok()) return value.status();
+      target = WireFormatLite::WriteInt64ToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_SFIXED64: {
+      util::StatusOr<int64_t> value = data.ToInt64();
+      if (!value.ok()) return value.status();
+      target =
+          WireFormatLite::WriteSFixed64ToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_SINT64: {
+      util::StatusOr<int64_t> value = data.ToInt64();
+      if (!value.ok()) return value.status();
+      target =
+          WireFormatLite::WriteSInt64ToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_FIXED64: {
+      util::StatusOr<uint64_t> value = data.ToUint64();
+      if (!value.ok()) return value.status();
+      target =
+          WireFormatLite::WriteFixed64ToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_UINT64: {
+      util::StatusOr<uint64_t> value = data.ToUint64();
+      if (!value.ok()) return value.status();
+      target =
+          WireFormatLite::WriteUInt64ToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_DOUBLE: {
+      util::StatusOr<double> value = data.ToDouble();
+      if (!value.ok()) return value.status();
+      target =
+          WireFormatLite::WriteDoubleToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_FLOAT: {
+      util::StatusOr<float> value = data.ToFloat();
+      if (!value.ok()) return value.status();
+      target = WireFormatLite::WriteFloatToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_BOOL: {
+      util::StatusOr<bool> value = data.ToBool();
+      if (!value.ok()) return value.status();
+      target = WireFormatLite::WriteBoolToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_ENUM: {
+      bool is_unknown_enum_value = false;
+      util::StatusOr<int> value = data.ToEnum(
+          type_info_->GetEnumByTypeUrl(field.type_url()),
+          options_.use_lower_camel_for_enums,
+          options_.case_insensitive_enum_parsing,
+          options_.ignore_unknown_enum_values, &is_unknown_enum_value);
+      if (!value.ok()) return value.status();
+      if (is_unknown_enum_value) return util::Status();
+      target = WireFormatLite::WriteEnumToArray(number, value.value(), target);
+      break;
+    }
+    case google::protobuf::Field::TYPE_STRING: {
+      // Strings, which is what the parsers render, need no conversion.
+      if (data.type() == DataPiece::TYPE_STRING) {
+        WriteLengthDelimited(number, data.str());
+        return util::Status();
+      }
+      util::StatusOr<std::string> value = data.ToString();
+      if (!value.ok()) return value.status();
+      WriteLengthDelimited(number, value.value());
+      return util::Status();
+    }
+    case google::protobuf::Field::TYPE_BYTES: {
+      util::StatusOr<std::string> value = data.ToBytes();
+      if (!value.ok()) return value.status();
+      WriteLengthDelimited(number, value.value());
+      return util::Status();
+    }
+    default:  // TYPE_GROUP, TYPE_MESSAGE, TYPE_UNKNOWN.
+      return util::InvalidArgumentError(data.ValueAsStringOrDefault(""));
+  }
+  buffer_.append(reinterpret_cast<const char*>(scratch), target - scratch);
+  return util::Status();
+}
+
+void BackpatchingObjectWriter::WriteLengthDelimited(int number,
+                                                    StringPiece value) {
+  uint8_t scratch[kMaxScalarSize];
+  uint8_t* target = WireFormatLite::WriteTagToArray(
+      number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, scratch);
+  target = io::CodedOutputStream::WriteVarint32ToArray(
+      static_cast<uint32_t>(value.size()), target);
+  buffer_.append(reinterpret_cast<const char*>(scratch), target - scratch);
+  buffer_.append(value.data(), value.size());
+}
+
+void BackpatchingObjectWriter::StartWellKnownType(
+    StringPiece name, const google::protobuf::Field* field,
+    const google::protobuf::Type& type, size_t entry_slot) {
+  delegate_slot_ = field != nullptr ? StartLengthDelimited(*field) : kNoSlot;
+  delegate_entry_slot_ = entry_slot;
+  delegate_output_.clear();
+  delegate_sink_.reset(new strings::StringByteSink(&delegate_output_));
+  delegate_listener_.reset(
+      new PrefixingErrorListener(listener_, Location(name)));
+  delegate_.reset(new ProtoStreamObjectWriter(type_resolver_, type,
+                                              delegate_sink_.get(),
+                                              delegate_listener_.get(),
+                                              options_));
+  delegate_->set_use_strict_base64_decoding(use_strict_base64_decoding());
+}
+
+void BackpatchingObjectWriter::FinishWellKnownType() {
+  delegate_.reset();
+  delegate_sink_.reset();
+  delegate_listener_.reset();
+  delegate_depth_ = 0;
+  buffer_.append(delegate_output_);
+  if (delegate_slot_ != kNoSlot) PatchLength(delegate_slot_);
+  if (delegate_entry_slot_ != kNoSlot) PatchLength(delegate_entry_slot_);
+  if (frames_.empty()) WriteRootMessage();
+}
+
+void BackpatchingObjectWriter::DeferAny(StringPiece name,
+                                        const google::protobuf::Field& field,
+                                        const google::protobuf::Type& type,
+                                        size_t entry_slot) {
+  deferred_any_field_ = &field;
+  deferred_any_type_ = &type;
+  deferred_any_name_.assign(name.data(), name.size());
+  deferred_any_entry_slot_ = entry_slot;
+}
+
+bool BackpatchingObjectWriter::StartDeferredAny(const DataPiece* type_url) {
+  const google::protobuf::Field& field = *deferred_any_field_;
+  const google::protobuf::Type& type = *deferred_any_type_;
+  const size_t entry_slot = deferred_any_entry_slot_;
+  deferred_any_field_ = nullptr;
+  const google::protobuf::Type* payload_type =
+      type_url != nullptr && type_url->type() == DataPiece::TYPE_STRING
+          ? ResolveAnyPayload(type_url->str())
+          : nullptr;
+  if (payload_type == nullptr) {
+    StartWellKnownType(entry_slot != kNoSlot
+                           ? MapValueName()
+                           : ElementName(deferred_any_name_),
+                       &field, type, entry_slot);
+    delegate_->StartObject("");
+    delegate_depth_ = 1;
+    return false;
+  }
+  const int index = frames_.back().size - 1;
+  StartMessage(field, type, entry_slot);
+  if (entry_slot != kNoSlot) frames_.back().index = index;
+  WriteLengthDelimited(kAnyTypeUrlFieldNumber, type_url->str());
+  Frame payload(Frame::MESSAGE, payload_type, nullptr);
+  payload.length_slot = StartLengthDelimited(kAnyValueFieldNumber);
+  payload.any_payload = true;
+  frames_.push_back(std::move(payload));
+  InitMessage(&frames_.back());
+  return true;
+}
+
+const google::protobuf::Type* BackpatchingObjectWriter::ResolveAnyPayload(
+    StringPiece type_url) {
+  // type_info_ keeps the types it resolved, so every type URL is resolved
+  // once. Unknown types are reported, and payloads of well-known types given
+  // in their special forms, by ProtoStreamObjectWriter.
+  util::StatusOr<const google::protobuf::Type*> type =
+      type_info_->ResolveTypeUrl(type_url);
+  if (!type.ok() || IsWellKnownType(*type.value())) return nullptr;
+  return type.value();
+}
+
+void BackpatchingObjectWriter::WriteRootMessage() {
+  if (compact_lengths_) CompactLengths();
+  output_->Append(buffer_.data(), buffer_.size());
+  output_->Flush();
+  buffer_.clear();
+  length_slots_.clear();
+  savings_.clear();
+  done_ = true;
+}
+
+void BackpatchingObjectWriter::CompactLengths() {
+  if (length_slots_.empty()) return;
+  // Minimal varints are never longer than the slots, so the bytes only ever
+  // move towards the front and the buffer can be rewritten in place.
+  char* data = &buffer_[0];
+  size_t read = 0;
+  size_t write = 0;
+  for (size_t slot : length_slots_) {
+    std::memmove(data + write, data + read, slot - read);
+    write += slot - read;
+    uint8_t* end = io::CodedOutputStream::WriteVarint32ToArray(
+        DecodeLength(data + slot), reinterpret_cast<uint8_t*>(data + write));
+    write = reinterpret_cast<char*>(end) - data;
+    read = slot + kLengthSlotSize;
+  }
+  std::memmove(data + write, data + read, buffer_.size() - read);
+  write += buffer_.size() - read;
+  buffer_.resize(write);
+}
+
+std::string BackpatchingObjectWriter::ElementName(StringPiece name) {
+  Frame& frame = frames_.back();
+  if (frame.kind != Frame::LIST) return std::string(name);
+  return StrCat("[", frame.size++, "]");
+}
+
+std::string BackpatchingObjectWriter::MapValueName() const {
+  return StrCat("[", frames_.back().size - 1, "].value");
+}
+
+std::string BackpatchingObjectWriter::Location(StringPiece name) const {
+  std::string location;
+  auto append = [&location](StringPiece part) {
+    if (part.empty()) return;
+    if (!location.empty() && !part.starts_with("[")) location.append(".");
+    location.append(part.data(), part.size());
+  };
+  for (const Frame& frame : frames_) {
+    if (frame.any_payload) location.clear();
+    if (frame.field == nullptr) continue;
+    // Elements of lists are located by index; map values by the index of
+    // their entry followed by the name of the value field.
+    if (frame.index >= 0) append(StrCat("[", frame.index, "]"));
+    if (frame.index < 0 || frame.entry_slot != kNoSlot) {
+      append(frame.field->name());
+    }
+  }
+  append(name);
+  return location;
+}
+
+void BackpatchingObjectWriter::InvalidName(StringPiece name,
+                                           StringPiece message) {
+  listener_->InvalidName(PathLocation(Location("")), name, message);
+}
+
+void BackpatchingObjectWriter::InvalidValue(StringPiece name,
+                                            StringPiece type_name,
+                                            StringPiece value) {
+  listener_->InvalidValue(PathLocation(Location(name)), type_name, value);
+}
+
+void BackpatchingObjectWriter::MissingField(StringPiece name) {
+  listener_->MissingField(PathLocation(Location("")), name);
+}
+
+bool BackpatchingObjectWriter::IsWellKnownType(
+    const google::protobuf::Type& type) {
+  return HasPrefixString(type.name(), kWellKnownTypePrefix);
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
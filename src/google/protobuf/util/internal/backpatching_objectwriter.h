@@ -0,0 +1,399 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef GOOGLE_PROTOBUF_UTIL_INTERNAL_BACKPATCHING_OBJECTWRITER_H__
+#define GOOGLE_PROTOBUF_UTIL_INTERNAL_BACKPATCHING_OBJECTWRITER_H__
+
+#include <google/protobuf/type.pb.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <google/protobuf/stubs/bytestream.h>
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/internal/datapiece.h>
+#include <google/protobuf/util/internal/error_listener.h>
+#include <google/protobuf/util/internal/object_writer.h>
+#include <google/protobuf/util/internal/protostream_objectwriter.h>
+#include <google/protobuf/util/internal/type_info.h>
+#include <google/protobuf/util/type_resolver.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// clang-format off
+#include <google/protobuf/port_def.inc>
+// clang-format on
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// An ObjectWriter that encodes the events it receives as protobuf binary, as
+// ProtoStreamObjectWriter does, without copying nested messages.
+//
+// The length of a nested message comes before its contents, but is only known
+// once the message ends. Instead of holding the contents back until then,
+// this writer reserves a five byte varint for the length, the most a 32-bit
+// length needs, writes the contents right after it and fills the length in
+// when the message ends. Every byte is written once, however deep the
+// nesting. Unless set_compact_lengths(false) was called, the length filled in
+// is the one the message will have once the lengths within it are rewritten
+// as minimal varints, which is done in a single pass over the output when the
+// root message ends. The result is then appended to the output sink.
+//
+// Values are converted and checked exactly like ProtoStreamObjectWriter does,
+// and errors are reported with the same messages and locations. Timestamps,
+// durations and wrappers given as a single value are parsed and written in
+// place. So is an Any whose first event is its "@type", as the XML parser
+// renders it from the start tag, when the payload is not of a well-known type:
+// its type is resolved once per writer, and the payload is written like any
+// other nested message instead of being buffered until "@type" is known.
+// Other messages of well-known types (Struct, ...) are handed to a
+// ProtoStreamObjectWriter for their type, so that their special forms are
+// accepted, and its output is copied in.
+//
+// Sample usage:
+//   BackpatchingObjectWriter writer(resolver, type, &sink, &listener);
+//   XmlStreamParser parser(&writer);
+//   parser.Parse(xml);
+//   parser.FinishParse();
+class PROTOBUF_EXPORT BackpatchingObjectWriter : public ObjectWriter {
+ public:
+  // Size of a reserved length, the largest varint32.
+  static const int kLengthSlotSize = 5;
+
+  BackpatchingObjectWriter(TypeResolver* type_resolver,
+                           const google::protobuf::Type& type,
+                           strings::ByteSink* output, ErrorListener* listener,
+                           const ProtoStreamObjectWriter::Options& options =
+                               ProtoStreamObjectWriter::Options::Defaults());
+  ~BackpatchingObjectWriter() override;
+
+  // Whether to rewrite the reserved lengths as minimal varints before writing
+  // the message out. Defaults to true. Without it the output is still valid
+  // protobuf, but every nested message length takes five bytes, except those
+  // of map entries with scalar values, which are always minimal. Must be
+  // called before the first event.
+  void set_compact_lengths(bool compact_lengths) {
+    compact_lengths_ = compact_lengths;
+  }
+
+  // Returns true once the root message has been written to the output.
+  bool done() const { return done_; }
+
+  // ObjectWriter methods.
+  BackpatchingObjectWriter* StartObject(StringPiece name) override;
+  BackpatchingObjectWriter* EndObject() override;
+  BackpatchingObjectWriter* StartList(StringPiece name) override;
+  BackpatchingObjectWriter* EndList() override;
+  BackpatchingObjectWriter* RenderBool(StringPiece name, bool value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  BackpatchingObjectWriter* RenderInt32(StringPiece name,
+                                        int32_t value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  BackpatchingObjectWriter* RenderUint32(StringPiece name,
+                                         uint32_t value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  BackpatchingObjectWriter* RenderInt64(StringPiece name,
+                                        int64_t value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  BackpatchingObjectWriter* RenderUint64(StringPiece name,
+                                         uint64_t value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  BackpatchingObjectWriter* RenderDouble(StringPiece name,
+                                         double value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  BackpatchingObjectWriter* RenderFloat(StringPiece name,
+                                        float value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  BackpatchingObjectWriter* RenderString(StringPiece name,
+                                         StringPiece value) override {
+    return RenderDataPiece(name,
+                           DataPiece(value, use_strict_base64_decoding()));
+  }
+  BackpatchingObjectWriter* RenderBytes(StringPiece name,
+                                        StringPiece value) override {
+    return RenderDataPiece(
+        name, DataPiece(value, false, use_strict_base64_decoding()));
+  }
+  BackpatchingObjectWriter* RenderNull(StringPiece name) override {
+    return RenderDataPiece(name, DataPiece::NullData());
+  }
+
+  // Renders |data| into the field called |name|.
+  BackpatchingObjectWriter* RenderDataPiece(StringPiece name,
+                                            const DataPiece& data);
+
+ private:
+  // The keys of a map seen so far, to find repeated ones. The keys are copied
+  // into one string and found through an open addressing table of their
+  // offsets, so that adding a key rarely allocates.
+  class MapKeySet {
+   public:
+    MapKeySet() {}
+
+    // Adds |key|, returning false if it was added before.
+    bool Insert(StringPiece key);
+
+   private:
+    StringPiece Key(uint32_t index) const {
+      return StringPiece(keys_.data() + starts_[index],
+                         starts_[index + 1] - starts_[index]);
+    }
+    void Rehash(size_t size);
+
+    std::string keys_;
+    // Where each key starts in keys_, followed by where the last one ends.
+    std::vector<uint32_t> starts_;
+    // For every bucket, one plus the index of the key in it, or zero.
+    std::vector<uint32_t> buckets_;
+  };
+
+  struct Frame {
+    enum Kind {
+      MESSAGE,
+      LIST,
+      MAP,
+    };
+
+    Frame(Kind kind, const google::protobuf::Type* type,
+          const google::protobuf::Field* field)
+        : kind(kind),
+          type(type),
+          field(field),
+          key_field(nullptr),
+          value_field(nullptr),
+          length_slot(kNoSlot),
+          entry_slot(kNoSlot),
+          index(-1),
+          size(0),
+          any_payload(false) {}
+
+    Kind kind;
+    // The message type of MESSAGE frames, the map entry type of MAP frames.
+    const google::protobuf::Type* type;
+    // The field of the enclosing message whose value the frame is, null for
+    // the root message.
+    const google::protobuf::Field* field;
+    // For MAP frames, the key and value fields of the map entry type.
+    const google::protobuf::Field* key_field;
+    const google::protobuf::Field* value_field;
+    // Offsets in buffer_ of the reserved lengths of the message and, for map
+    // values, of the map entry holding it.
+    size_t length_slot;
+    size_t entry_slot;
+    // For elements of a list, the position in it; for map values, the
+    // position of their entry in the map.
+    int index;
+    // For LIST and MAP frames, the number of elements or entries so far.
+    int size;
+    // For MESSAGE frames, whether the message is the payload of an Any, which
+    // ends with it.
+    bool any_payload;
+    // For MESSAGE frames, the oneofs set so far, by oneof_index, and the
+    // required proto2 fields not seen yet. For MAP frames, the keys seen.
+    std::vector<bool> oneofs_set;
+    std::set<const google::protobuf::Field*> required_fields;
+    MapKeySet map_keys;
+  };
+
+  static const size_t kNoSlot = static_cast<size_t>(-1);
+
+  // Initializes the oneof and required field bookkeeping of a MESSAGE frame.
+  void InitMessage(Frame* frame);
+  // Pops the current frame, finishing its message. Writes the output once
+  // the root message ends.
+  void EndFrame();
+
+  // Returns the field |name| of the current message, or the field of the
+  // current list if |name| is empty, reporting an error if there is none.
+  const google::protobuf::Field* Lookup(StringPiece name);
+  // Returns the type of the message field |field|, reporting an error if it
+  // cannot be resolved.
+  const google::protobuf::Type* LookupType(
+      StringPiece name, const google::protobuf::Field& field);
+  // Marks |field| as set in the current message. Returns false, after
+  // reporting an error, if another field of its oneof was set already.
+  bool SetField(StringPiece name, const google::protobuf::Field& field);
+
+  // Writes the tag of |field| and reserves the length of its value, returning
+  // the offset of the reserved length.
+  size_t StartLengthDelimited(const google::protobuf::Field& field) {
+    return StartLengthDelimited(field.number());
+  }
+  size_t StartLengthDelimited(int number);
+  // Fills in the length of what was written after |slot|.
+  void PatchLength(size_t slot);
+  void AppendTag(int number, internal::WireFormatLite::WireType wire_type);
+  void WriteLengthDelimited(int number, StringPiece value);
+
+  // Writes the tag of the message field |field| and pushes its frame. For map
+  // values, |entry_slot| is the length of the map entry, patched along.
+  void StartMessage(const google::protobuf::Field& field,
+                    const google::protobuf::Type& type, size_t entry_slot);
+  // Writes the tag and key of a map entry of the current map, leaving the
+  // value to write. Returns false, after reporting an error, if the key was
+  // seen before.
+  bool StartMapEntry(StringPiece key, size_t* entry_slot);
+  // Adds |key| to the keys of the current map. Returns false, after reporting
+  // an error, if it was seen before.
+  bool AddMapKey(StringPiece key);
+  // Converts |key| to the type of the map key and writes it.
+  void WriteMapKey(StringPiece key, int index);
+  void RenderMapEntry(StringPiece key, const DataPiece& data);
+  // Writes the entry of the current map mapping |key| to the scalar |data|.
+  // The entry is small, so its length is written once it is known instead of
+  // being reserved.
+  void RenderScalarMapEntry(StringPiece key, const DataPiece& data);
+  // Writes |data| into the non-message field |field|, reporting an error
+  // located at |name| if it does not convert.
+  void RenderValue(StringPiece name, const google::protobuf::Field& field,
+                   const DataPiece& data);
+  util::Status WriteScalar(const google::protobuf::Field& field,
+                           const DataPiece& data);
+  // Reports that WriteScalar() failed for |field| with |status|.
+  void InvalidScalar(StringPiece name, const google::protobuf::Field& field,
+                     const util::Status& status);
+  // Writes |data| as the value of |field| if |type| is a timestamp, duration
+  // or wrapper, reporting errors as ProtoStreamObjectWriter does: for the
+  // field |name|, located at |element_name|. Returns false, having written
+  // nothing, for the other types.
+  bool RenderWellKnownValue(StringPiece name, StringPiece element_name,
+                            const google::protobuf::Field& field,
+                            const google::protobuf::Type& type,
+                            const DataPiece& data);
+  // Writes the seconds and nanos of a timestamp or duration.
+  util::Status WriteSecondsAndNanos(bool timestamp, const DataPiece& data);
+
+  // Creates the ProtoStreamObjectWriter writing a value of the well-known
+  // type |type|: the value of |field|, or the root message if |field| is
+  // null. The caller passes it the first event and sets delegate_depth_.
+  // |name| is where its errors are located.
+  void StartWellKnownType(StringPiece name,
+                          const google::protobuf::Field* field,
+                          const google::protobuf::Type& type,
+                          size_t entry_slot);
+  // Copies in what the ProtoStreamObjectWriter wrote and patches the lengths.
+  void FinishWellKnownType();
+
+  // Remembers the Any value of |field| just started, to be written once its
+  // first event is known. |name| is the name it was started with.
+  void DeferAny(StringPiece name, const google::protobuf::Field& field,
+                const google::protobuf::Type& type, size_t entry_slot);
+  // Starts the deferred Any on its first event, given |type_url| if that is
+  // its "@type". If the payload can be written in place, writes the type URL
+  // and pushes the frame of the payload, returning true. Otherwise hands the
+  // Any to a ProtoStreamObjectWriter, to which the event is then forwarded.
+  bool StartDeferredAny(const DataPiece* type_url);
+  // Returns the type of the payload named by |type_url| if it can be written
+  // in place, null otherwise.
+  const google::protobuf::Type* ResolveAnyPayload(StringPiece type_url);
+
+  // Compacts the lengths if asked to and writes buffer_ to the output.
+  void WriteRootMessage();
+  void CompactLengths();
+
+  // Returns the name locating a value of the current frame: |name|, or the
+  // next index for lists.
+  std::string ElementName(StringPiece name);
+  // Returns the name locating the value of the last map entry started.
+  std::string MapValueName() const;
+  // Returns the location of the current message followed by |name|. Within
+  // the payload of an Any, locations start at the payload, as they do with
+  // ProtoStreamObjectWriter.
+  std::string Location(StringPiece name) const;
+  void InvalidName(StringPiece name, StringPiece message);
+  void InvalidValue(StringPiece name, StringPiece type_name,
+                    StringPiece value);
+  void MissingField(StringPiece name);
+
+  static bool IsWellKnownType(const google::protobuf::Type& type);
+
+  TypeResolver* type_resolver_;
+  std::unique_ptr<TypeInfo> type_info_;
+  const google::protobuf::Type& type_;
+  strings::ByteSink* output_;
+  ErrorListener* listener_;
+  const ProtoStreamObjectWriter::Options options_;
+  bool compact_lengths_;
+
+  // The message written so far, and the offsets of the reserved lengths in it
+  // in increasing order.
+  std::string buffer_;
+  std::vector<size_t> length_slots_;
+  // When compacting, for every length not patched yet, by how much the
+  // lengths patched within it will shrink.
+  std::vector<size_t> savings_;
+  std::vector<Frame> frames_;
+  // Nesting depth of the events ignored after an error.
+  int invalid_depth_;
+  bool done_;
+
+  // The writer of the well-known type value being written, and what it
+  // writes. delegate_depth_ is the nesting depth of the events forwarded to
+  // it, zero once it is done.
+  std::unique_ptr<ErrorListener> delegate_listener_;
+  std::unique_ptr<strings::StringByteSink> delegate_sink_;
+  std::unique_ptr<ProtoStreamObjectWriter> delegate_;
+  std::string delegate_output_;
+  int delegate_depth_;
+  size_t delegate_slot_;
+  size_t delegate_entry_slot_;
+
+  // The Any value started but not written yet, see DeferAny().
+  const google::protobuf::Field* deferred_any_field_;
+  const google::protobuf::Type* deferred_any_type_;
+  std::string deferred_any_name_;
+  size_t deferred_any_entry_slot_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(BackpatchingObjectWriter);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_INTERNAL_BACKPATCHING_OBJECTWRITER_H__
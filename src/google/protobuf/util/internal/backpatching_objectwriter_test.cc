@@ -0,0 +1,499 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/internal/backpatching_objectwriter.h>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/stubs/bytestream.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/internal/protostream_objectwriter.h>
+#include <google/protobuf/util/internal/recording_objectwriter.h>
+#include <google/protobuf/util/json_format_proto3.pb.h>
+#include <google/protobuf/util/message_differencer.h>
+#include <google/protobuf/util/type_resolver.h>
+#include <google/protobuf/util/type_resolver_util.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+namespace {
+
+using ::proto3::TestAny;
+using ::proto3::TestDuration;
+using ::proto3::TestMap;
+using ::proto3::TestMessage;
+using ::proto3::TestOneof;
+using ::proto3::TestStruct;
+using ::proto3::TestTimestamp;
+using ::proto3::TestWrapper;
+
+const char kTypeUrlPrefix[] = "type.googleapis.com";
+
+// Writes every error it is given as a line of text.
+class CollectingErrorListener : public ErrorListener {
+ public:
+  CollectingErrorListener() {}
+  ~CollectingErrorListener() override {}
+
+  const std::vector<std::string>& errors() const { return errors_; }
+
+  void InvalidName(const LocationTrackerInterface& loc,
+                   StringPiece invalid_name, StringPiece message) override {
+    errors_.push_back(
+        StrCat("(", loc.ToString(), ") ", invalid_name, ": ", message));
+  }
+
+  void InvalidValue(const LocationTrackerInterface& loc, StringPiece type_name,
+                    StringPiece value) override {
+    errors_.push_back(StrCat("(", loc.ToString(), "): invalid value ", value,
+                             " for type ", type_name));
+  }
+
+  void MissingField(const LocationTrackerInterface& loc,
+                    StringPiece missing_name) override {
+    errors_.push_back(
+        StrCat("(", loc.ToString(), "): missing field ", missing_name));
+  }
+
+ private:
+  std::vector<std::string> errors_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(CollectingErrorListener);
+};
+
+// The writer must produce exactly what ProtoStreamObjectWriter produces, so
+// every test records the events once, replays them into both writers and
+// compares the bytes and the errors.
+class BackpatchingObjectWriterTest : public ::testing::Test {
+ protected:
+  BackpatchingObjectWriterTest()
+      : resolver_(NewTypeResolverForDescriptorPool(
+            kTypeUrlPrefix, DescriptorPool::generated_pool())) {}
+
+  google::protobuf::Type ResolveType(const Descriptor* descriptor) {
+    google::protobuf::Type type;
+    EXPECT_TRUE(resolver_
+                    ->ResolveMessageType(
+                        StrCat(kTypeUrlPrefix, "/", descriptor->full_name()),
+                        &type)
+                    .ok());
+    return type;
+  }
+
+  // Returns what BackpatchingObjectWriter writes for the recorded events.
+  std::string Backpatch(const Descriptor* descriptor, bool compact_lengths,
+                        std::vector<std::string>* errors) {
+    const google::protobuf::Type type = ResolveType(descriptor);
+    std::string output;
+    strings::StringByteSink sink(&output);
+    CollectingErrorListener listener;
+    BackpatchingObjectWriter writer(resolver_.get(), type, &sink, &listener,
+                                    options_);
+    writer.set_compact_lengths(compact_lengths);
+    recorder_.Replay(&writer);
+    EXPECT_TRUE(writer.done());
+    *errors = listener.errors();
+    return output;
+  }
+
+  void ExpectSameOutput(const Descriptor* descriptor) {
+    const google::protobuf::Type type = ResolveType(descriptor);
+    std::string expected;
+    std::vector<std::string> expected_errors;
+    {
+      strings::StringByteSink sink(&expected);
+      CollectingErrorListener listener;
+      ProtoStreamObjectWriter writer(resolver_.get(), type, &sink, &listener,
+                                     options_);
+      recorder_.Replay(&writer);
+      expected_errors = listener.errors();
+    }
+
+    std::vector<std::string> errors;
+    EXPECT_EQ(expected, Backpatch(descriptor, true, &errors));
+    EXPECT_EQ(expected_errors, errors);
+
+    // Without compaction the bytes differ, but not the message they encode.
+    const std::string loose = Backpatch(descriptor, false, &errors);
+    EXPECT_EQ(expected_errors, errors);
+    if (expected_errors.empty()) {
+      const Message* prototype =
+          MessageFactory::generated_factory()->GetPrototype(descriptor);
+      std::unique_ptr<Message> expected_message(prototype->New());
+      std::unique_ptr<Message> message(prototype->New());
+      ASSERT_TRUE(expected_message->ParseFromString(expected));
+      ASSERT_TRUE(message->ParseFromString(loose));
+      EXPECT_TRUE(MessageDifferencer::Equals(*expected_message, *message));
+    }
+  }
+
+  std::unique_ptr<TypeResolver> resolver_;
+  ProtoStreamObjectWriter::Options options_;
+  RecordingObjectWriter recorder_;
+};
+
+TEST_F(BackpatchingObjectWriterTest, Scalars) {
+  recorder_.StartObject("")
+      ->RenderString("boolValue", "true")
+      ->RenderString("int32Value", "-12345")
+      ->RenderString("int64Value", "-1234567890123")
+      ->RenderString("uint32Value", "4294967295")
+      ->RenderString("uint64Value", "18446744073709551615")
+      ->RenderString("floatValue", "1.5")
+      ->RenderString("doubleValue", "-0.25")
+      ->RenderString("stringValue", "hello")
+      ->RenderString("bytesValue", "AAEC")
+      ->RenderString("enumValue", "BAR")
+      ->EndObject();
+  ExpectSameOutput(TestMessage::descriptor());
+}
+
+TEST_F(BackpatchingObjectWriterTest, NestedMessagesAndLists) {
+  recorder_.StartObject("")
+      ->StartObject("messageValue")
+      ->RenderString("value", "1")
+      ->EndObject()
+      ->StartList("repeatedInt32Value")
+      ->RenderString("", "1")
+      ->RenderString("", "-1")
+      ->EndList()
+      ->StartList("repeatedStringValue")
+      ->RenderString("", "")
+      ->RenderString("", "abc")
+      ->EndList()
+      ->StartList("repeatedMessageValue")
+      ->StartObject("")
+      ->RenderString("value", "2")
+      ->EndObject()
+      ->StartObject("")
+      ->EndObject()
+      ->EndList()
+      ->EndObject();
+  ExpectSameOutput(TestMessage::descriptor());
+}
+
+TEST_F(BackpatchingObjectWriterTest, LongNestedMessage) {
+  // Lengths of more than one byte, which compaction shrinks.
+  recorder_.StartObject("")->StartList("repeatedMessageValue");
+  for (int i = 0; i < 100; ++i) {
+    recorder_.StartObject("")->RenderString("value", StrCat(i * 1000))
+        ->EndObject();
+  }
+  recorder_.EndList()
+      ->StartList("repeatedStringValue")
+      ->RenderString("", std::string(20000, 'x'))
+      ->EndList()
+      ->EndObject();
+  ExpectSameOutput(TestMessage::descriptor());
+}
+
+TEST_F(BackpatchingObjectWriterTest, Maps) {
+  recorder_.StartObject("")
+      ->StartObject("boolMap")
+      ->RenderString("true", "1")
+      ->RenderString("false", "2")
+      ->EndObject()
+      ->StartObject("int32Map")
+      ->RenderString("-5", "5")
+      ->EndObject()
+      ->StartObject("stringMap")
+      ->RenderString("b", "2")
+      ->RenderString("a", "1")
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestMap::descriptor());
+}
+
+TEST_F(BackpatchingObjectWriterTest, ManyMapEntries) {
+  // Enough keys to rehash the key set several times, and entries whose
+  // lengths need more than one byte.
+  recorder_.StartObject("")->StartObject("stringMap");
+  for (int i = 0; i < 5000; ++i) {
+    recorder_.RenderString(StrCat("k", i), StrCat(i * 7919));
+  }
+  recorder_.RenderString(std::string(300, 'x'), "1")
+      ->RenderString(std::string(20000, 'y'), "-1")
+      ->EndObject()
+      ->StartObject("int32Map")
+      ->RenderString("2147483647", "-2147483648")
+      ->RenderString("-1", "0")
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestMap::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->StartObject("stringMap")
+      ->RenderString(std::string(300, 'x'), "1")
+      ->RenderString(std::string(300, 'x'), "2")
+      ->RenderString(std::string(200, 'z'), "abc")
+      ->RenderString("k", "3")
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestMap::descriptor());
+}
+
+TEST_F(BackpatchingObjectWriterTest, WellKnownTypes) {
+  recorder_.StartObject("")
+      ->RenderString("value", "1970-01-01T00:00:10.5Z")
+      ->EndObject();
+  ExpectSameOutput(TestTimestamp::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->RenderString("boolValue", "true")
+      ->RenderString("int32Value", "-7")
+      ->EndObject();
+  ExpectSameOutput(TestWrapper::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->StartObject("value")
+      ->RenderString("name", "x")
+      ->StartList("list")
+      ->RenderString("", "1")
+      ->EndList()
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestStruct::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->StartObject("value")
+      ->RenderString("@type", "type.googleapis.com/proto3.MessageType")
+      ->RenderString("value", "3")
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestAny::descriptor());
+}
+
+TEST_F(BackpatchingObjectWriterTest, TimestampsDurationsAndWrappers) {
+  recorder_.StartObject("")
+      ->RenderString("value", "2015-05-20T13:29:35.120-08:00")
+      ->StartList("repeatedValue")
+      ->RenderString("", "0001-01-01T00:00:00Z")
+      ->RenderString("", "9999-12-31T23:59:59.999999999Z")
+      ->RenderString("", "2015-05-20T13:29:35Z")
+      ->EndList()
+      ->EndObject();
+  ExpectSameOutput(TestTimestamp::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->RenderString("value", "-1.500s")
+      ->StartList("repeatedValue")
+      ->RenderString("", "0s")
+      ->RenderString("", "0.000120s")
+      ->RenderString("", "315576000000.999999999s")
+      ->EndList()
+      ->EndObject();
+  ExpectSameOutput(TestDuration::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->RenderString("boolValue", "false")
+      ->RenderString("int64Value", "-9876543210123")
+      ->RenderString("uint64Value", "18000000000000000000")
+      ->RenderString("doubleValue", "-2.25")
+      ->RenderString("stringValue", "text")
+      ->RenderString("bytesValue", "YWL/")
+      ->StartList("repeatedInt32Value")
+      ->RenderString("", "1")
+      ->RenderString("", "0")
+      ->EndList()
+      ->EndObject();
+  ExpectSameOutput(TestWrapper::descriptor());
+
+  // Invalid values leave empty messages and are reported like
+  // ProtoStreamObjectWriter reports them.
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->RenderString("value", "2015-02-30T00:00:00Z")
+      ->StartList("repeatedValue")
+      ->RenderString("", "2015-05-20T13:29:35")
+      ->RenderBool("", true)
+      ->EndList()
+      ->EndObject();
+  ExpectSameOutput(TestTimestamp::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->RenderString("value", "1")
+      ->StartList("repeatedValue")
+      ->RenderString("", "1.0000000001s")
+      ->RenderString("", "315576000001s")
+      ->RenderString("", "abc.5s")
+      ->EndList()
+      ->EndObject();
+  ExpectSameOutput(TestDuration::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->RenderString("int32Value", "abc")
+      ->StartList("repeatedInt32Value")
+      ->RenderString("", "1.5")
+      ->EndList()
+      ->EndObject();
+  ExpectSameOutput(TestWrapper::descriptor());
+}
+
+TEST_F(BackpatchingObjectWriterTest, AnyPayloads) {
+  // "@type" first: the payload is written in place.
+  recorder_.StartObject("")
+      ->StartObject("value")
+      ->RenderString("@type", "type.googleapis.com/proto3.TestMessage")
+      ->RenderString("int32Value", "5")
+      ->StartObject("messageValue")
+      ->RenderString("value", "7")
+      ->EndObject()
+      ->StartList("repeatedStringValue")
+      ->RenderString("", std::string(200, 'x'))
+      ->EndList()
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestAny::descriptor());
+
+  // An empty payload has no value field.
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->StartObject("value")
+      ->RenderString("@type", "type.googleapis.com/proto3.TestMessage")
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestAny::descriptor());
+
+  // Errors within the payload are located from the payload.
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->StartObject("value")
+      ->RenderString("@type", "type.googleapis.com/proto3.TestMessage")
+      ->StartObject("messageValue")
+      ->RenderString("value", "abc")
+      ->EndObject()
+      ->RenderString("@type", "type.googleapis.com/proto3.TestMessage")
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestAny::descriptor());
+
+  // Otherwise the Any is buffered until "@type" is known.
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->StartObject("value")
+      ->RenderString("int32Value", "5")
+      ->RenderString("@type", "type.googleapis.com/proto3.TestMessage")
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestAny::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->StartObject("value")
+      ->RenderString("@type", "type.googleapis.com/proto3.Unknown")
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestAny::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->StartObject("value")
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestAny::descriptor());
+}
+
+TEST_F(BackpatchingObjectWriterTest, Oneof) {
+  recorder_.StartObject("")
+      ->StartObject("oneofMessageValue")
+      ->RenderString("value", "1")
+      ->EndObject()
+      ->EndObject();
+  ExpectSameOutput(TestOneof::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->RenderString("oneofInt32Value", "1")
+      ->RenderString("oneofStringValue", "a")
+      ->EndObject();
+  ExpectSameOutput(TestOneof::descriptor());
+}
+
+TEST_F(BackpatchingObjectWriterTest, Errors) {
+  recorder_.StartObject("")
+      ->RenderString("int32Value", "abc")
+      ->RenderString("unknownField", "1")
+      ->StartObject("messageValue")
+      ->RenderString("value", "1.5")
+      ->EndObject()
+      ->StartList("repeatedEnumValue")
+      ->RenderString("", "BAZ")
+      ->EndList()
+      ->EndObject();
+  ExpectSameOutput(TestMessage::descriptor());
+
+  recorder_.Clear();
+  recorder_.StartObject("")
+      ->StartObject("int32Map")
+      ->RenderString("x", "1")
+      ->RenderString("2", "y")
+      ->RenderString("3", "3")
+      ->RenderString("3", "4")
+      ->EndObject()
+      ->StartList("stringMap")
+      ->EndList()
+      ->EndObject();
+  ExpectSameOutput(TestMap::descriptor());
+}
+
+TEST_F(BackpatchingObjectWriterTest, IgnoreUnknownFields) {
+  options_.ignore_unknown_fields = true;
+  recorder_.StartObject("")
+      ->RenderString("unknownField", "1")
+      ->StartObject("unknownMessage")
+      ->RenderString("value", "1")
+      ->StartList("values")
+      ->RenderString("", "1")
+      ->EndList()
+      ->EndObject()
+      ->RenderString("int32Value", "1")
+      ->EndObject();
+  ExpectSameOutput(TestMessage::descriptor());
+}
+
+}  // namespace
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
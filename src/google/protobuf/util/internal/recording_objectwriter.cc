@@ -0,0 +1,319 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <google/protobuf/util/internal/recording_objectwriter.h>
+
+#include <google/protobuf/stubs/logging.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+namespace {
+
+// Reads what the Append*() methods of RecordingObjectWriter wrote. The
+// recording is trusted, so reads are not bounds checked beyond debug checks.
+class RecordingReader {
+ public:
+  explicit RecordingReader(StringPiece buffer)
+      : p_(buffer.data()), end_(buffer.data() + buffer.size()) {}
+
+  bool done() const { return p_ == end_; }
+
+  uint8_t ReadByte() {
+    GOOGLE_DCHECK(p_ < end_);
+    return static_cast<uint8_t>(*p_++);
+  }
+
+  uint64_t ReadVarint() {
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+      const uint8_t byte = ReadByte();
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) return value;
+    }
+  }
+
+  uint32_t ReadFixed32() {
+    uint32_t value;
+    Read(&value, sizeof(value));
+    return value;
+  }
+
+  uint64_t ReadFixed64() {
+    uint64_t value;
+    Read(&value, sizeof(value));
+    return value;
+  }
+
+  StringPiece ReadString() {
+    const size_t size = ReadVarint();
+    GOOGLE_DCHECK_LE(size, static_cast<size_t>(end_ - p_));
+    StringPiece value(p_, size);
+    p_ += size;
+    return value;
+  }
+
+ private:
+  void Read(void* value, size_t size) {
+    GOOGLE_DCHECK_LE(size, static_cast<size_t>(end_ - p_));
+    memcpy(value, p_, size);
+    p_ += size;
+  }
+
+  const char* p_;
+  const char* const end_;
+};
+
+}  // namespace
+
+RecordingObjectWriter::RecordingObjectWriter() : events_(0) {}
+
+RecordingObjectWriter::~RecordingObjectWriter() {}
+
+RecordingObjectWriter* RecordingObjectWriter::StartObject(StringPiece name) {
+  AppendEvent(START_OBJECT, name);
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::EndObject() {
+  AppendEvent(END_OBJECT);
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::StartList(StringPiece name) {
+  AppendEvent(START_LIST, name);
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::EndList() {
+  AppendEvent(END_LIST);
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::RenderBool(StringPiece name,
+                                                         bool value) {
+  AppendEvent(RENDER_BOOL, name);
+  buffer_.push_back(value ? 1 : 0);
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::RenderInt32(StringPiece name,
+                                                          int32_t value) {
+  AppendEvent(RENDER_INT32, name);
+  AppendFixed32(static_cast<uint32_t>(value));
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::RenderUint32(StringPiece name,
+                                                           uint32_t value) {
+  AppendEvent(RENDER_UINT32, name);
+  AppendFixed32(value);
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::RenderInt64(StringPiece name,
+                                                          int64_t value) {
+  AppendEvent(RENDER_INT64, name);
+  AppendFixed64(static_cast<uint64_t>(value));
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::RenderUint64(StringPiece name,
+                                                           uint64_t value) {
+  AppendEvent(RENDER_UINT64, name);
+  AppendFixed64(value);
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::RenderDouble(StringPiece name,
+                                                           double value) {
+  AppendEvent(RENDER_DOUBLE, name);
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  AppendFixed64(bits);
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::RenderFloat(StringPiece name,
+                                                          float value) {
+  AppendEvent(RENDER_FLOAT, name);
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  AppendFixed32(bits);
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::RenderString(StringPiece name,
+                                                           StringPiece value) {
+  AppendEvent(RENDER_STRING, name);
+  AppendVarint(value.size());
+  buffer_.append(value.data(), value.size());
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::RenderBytes(StringPiece name,
+                                                          StringPiece value) {
+  AppendEvent(RENDER_BYTES, name);
+  AppendVarint(value.size());
+  buffer_.append(value.data(), value.size());
+  return this;
+}
+
+RecordingObjectWriter* RecordingObjectWriter::RenderNull(StringPiece name) {
+  AppendEvent(RENDER_NULL, name);
+  return this;
+}
+
+void RecordingObjectWriter::Replay(ObjectWriter* ow) const {
+  RecordingReader reader(buffer_);
+  while (!reader.done()) {
+    const EventType type = static_cast<EventType>(reader.ReadByte());
+    if (type == END_OBJECT) {
+      ow->EndObject();
+      continue;
+    }
+    if (type == END_LIST) {
+      ow->EndList();
+      continue;
+    }
+    const StringPiece name = names_[reader.ReadVarint()];
+    switch (type) {
+      case START_OBJECT:
+        ow->StartObject(name);
+        break;
+      case START_LIST:
+        ow->StartList(name);
+        break;
+      case RENDER_BOOL:
+        ow->RenderBool(name, reader.ReadByte() != 0);
+        break;
+      case RENDER_INT32:
+        ow->RenderInt32(name, static_cast<int32_t>(reader.ReadFixed32()));
+        break;
+      case RENDER_UINT32:
+        ow->RenderUint32(name, reader.ReadFixed32());
+        break;
+      case RENDER_INT64:
+        ow->RenderInt64(name, static_cast<int64_t>(reader.ReadFixed64()));
+        break;
+      case RENDER_UINT64:
+        ow->RenderUint64(name, reader.ReadFixed64());
+        break;
+      case RENDER_DOUBLE: {
+        const uint64_t bits = reader.ReadFixed64();
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        ow->RenderDouble(name, value);
+        break;
+      }
+      case RENDER_FLOAT: {
+        const uint32_t bits = reader.ReadFixed32();
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        ow->RenderFloat(name, value);
+        break;
+      }
+      case RENDER_STRING:
+        ow->RenderString(name, reader.ReadString());
+        break;
+      case RENDER_BYTES:
+        ow->RenderBytes(name, reader.ReadString());
+        break;
+      case RENDER_NULL:
+        ow->RenderNull(name);
+        break;
+      case END_OBJECT:
+      case END_LIST:
+        break;
+    }
+  }
+}
+
+size_t RecordingObjectWriter::SpaceUsed() const {
+  size_t space = buffer_.capacity();
+  for (const std::string& name : names_) space += name.capacity();
+  return space;
+}
+
+void RecordingObjectWriter::Clear() {
+  buffer_.clear();
+  name_ids_.clear();
+  names_.clear();
+  events_ = 0;
+}
+
+void RecordingObjectWriter::AppendEvent(EventType type) {
+  ++events_;
+  buffer_.push_back(static_cast<char>(type));
+}
+
+void RecordingObjectWriter::AppendEvent(EventType type, StringPiece name) {
+  AppendEvent(type);
+  auto it = name_ids_.find(name);
+  if (it == name_ids_.end()) {
+    names_.push_back(std::string(name));
+    it = name_ids_
+             .emplace(StringPiece(names_.back()),
+                      static_cast<uint32_t>(names_.size() - 1))
+             .first;
+  }
+  AppendVarint(it->second);
+}
+
+void RecordingObjectWriter::AppendVarint(uint64_t value) {
+  while (value >= 0x80) {
+    buffer_.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  buffer_.push_back(static_cast<char>(value));
+}
+
+void RecordingObjectWriter::AppendFixed32(uint32_t value) {
+  char bytes[sizeof(value)];
+  memcpy(bytes, &value, sizeof(value));
+  buffer_.append(bytes, sizeof(bytes));
+}
+
+void RecordingObjectWriter::AppendFixed64(uint64_t value) {
+  char bytes[sizeof(value)];
+  memcpy(bytes, &value, sizeof(value));
+  buffer_.append(bytes, sizeof(bytes));
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,152 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef GOOGLE_PROTOBUF_UTIL_INTERNAL_RECORDING_OBJECTWRITER_H__
+#define GOOGLE_PROTOBUF_UTIL_INTERNAL_RECORDING_OBJECTWRITER_H__
+
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/internal/object_writer.h>
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <map>
+
+// clang-format off
+#include <google/protobuf/port_def.inc>
+// clang-format on
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// An ObjectWriter that records the events it receives, so that they can be
+// replayed into other ObjectWriters later, any number of times. This makes it
+// possible to time one stage of a conversion pipeline apart from the others:
+// record what ProtoStreamObjectSource or XmlStreamParser emits for a message
+// once, then replay the recording into XmlObjectWriter or
+// ProtoStreamObjectWriter alone.
+//
+// The recording is compact: every event is a one byte type, followed by the
+// id of its interned name and its value stored inline, all in a single
+// buffer. Replaying reads the buffer front to back and makes no allocations.
+//
+// Sample usage:
+//   RecordingObjectWriter recorder;
+//   proto_source.WriteTo(&recorder);
+//   for (...) {
+//     XmlObjectWriter writer("", &out_stream);
+//     recorder.Replay(&writer);
+//   }
+class PROTOBUF_EXPORT RecordingObjectWriter : public ObjectWriter {
+ public:
+  RecordingObjectWriter();
+  ~RecordingObjectWriter() override;
+
+  // ObjectWriter methods.
+  RecordingObjectWriter* StartObject(StringPiece name) override;
+  RecordingObjectWriter* EndObject() override;
+  RecordingObjectWriter* StartList(StringPiece name) override;
+  RecordingObjectWriter* EndList() override;
+  RecordingObjectWriter* RenderBool(StringPiece name, bool value) override;
+  RecordingObjectWriter* RenderInt32(StringPiece name, int32_t value) override;
+  RecordingObjectWriter* RenderUint32(StringPiece name,
+                                      uint32_t value) override;
+  RecordingObjectWriter* RenderInt64(StringPiece name, int64_t value) override;
+  RecordingObjectWriter* RenderUint64(StringPiece name,
+                                      uint64_t value) override;
+  RecordingObjectWriter* RenderDouble(StringPiece name, double value) override;
+  RecordingObjectWriter* RenderFloat(StringPiece name, float value) override;
+  RecordingObjectWriter* RenderString(StringPiece name,
+                                      StringPiece value) override;
+  RecordingObjectWriter* RenderBytes(StringPiece name,
+                                     StringPiece value) override;
+  RecordingObjectWriter* RenderNull(StringPiece name) override;
+
+  // Sends the recorded events to |ow|, in the order they were received. The
+  // names and string values passed to |ow| point into the recording.
+  void Replay(ObjectWriter* ow) const;
+
+  // Number of events recorded.
+  int64_t events() const { return events_; }
+
+  // Bytes used by the recorded events and the interned names.
+  size_t SpaceUsed() const;
+
+  // Discards the recording.
+  void Clear();
+
+ private:
+  enum EventType {
+    START_OBJECT,
+    END_OBJECT,
+    START_LIST,
+    END_LIST,
+    RENDER_BOOL,
+    RENDER_INT32,
+    RENDER_UINT32,
+    RENDER_INT64,
+    RENDER_UINT64,
+    RENDER_DOUBLE,
+    RENDER_FLOAT,
+    RENDER_STRING,
+    RENDER_BYTES,
+    RENDER_NULL,
+  };
+
+  // Appends the type of an event and, for events that have one, its name.
+  void AppendEvent(EventType type);
+  void AppendEvent(EventType type, StringPiece name);
+  void AppendVarint(uint64_t value);
+  void AppendFixed32(uint32_t value);
+  void AppendFixed64(uint64_t value);
+
+  // The events, as described in the class comment.
+  std::string buffer_;
+  // Interned names, indexed by id. A deque, so that the keys of name_ids_
+  // stay valid as names are added.
+  std::deque<std::string> names_;
+  std::map<StringPiece, uint32_t> name_ids_;
+  int64_t events_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(RecordingObjectWriter);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_INTERNAL_RECORDING_OBJECTWRITER_H__
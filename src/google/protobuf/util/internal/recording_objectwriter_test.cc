@@ -0,0 +1,147 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <google/protobuf/util/internal/recording_objectwriter.h>
+
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/internal/expecting_objectwriter.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+class RecordingObjectWriterTest : public ::testing::Test {
+ protected:
+  RecordingObjectWriterTest() : mock_(), ow_(&mock_) {}
+  ~RecordingObjectWriterTest() override {}
+
+#ifndef _MSC_VER
+  ::testing::InSequence in_sequence_;
+#endif  // !_MSC_VER
+  MockObjectWriter mock_;
+  ExpectingObjectWriter ow_;
+  RecordingObjectWriter recorder_;
+};
+
+TEST_F(RecordingObjectWriterTest, ReplaysAllEventTypes) {
+  const std::string binary("a\0b\xff", 4);
+  recorder_.StartObject("")
+      ->RenderBool("bool", true)
+      ->RenderInt32("int32", std::numeric_limits<int32_t>::min())
+      ->RenderUint32("uint32", std::numeric_limits<uint32_t>::max())
+      ->RenderInt64("int64", std::numeric_limits<int64_t>::min())
+      ->RenderUint64("uint64", std::numeric_limits<uint64_t>::max())
+      ->RenderDouble("double", -0.5)
+      ->RenderFloat("float", 1.5f)
+      ->RenderString("string", "value")
+      ->RenderBytes("bytes", binary)
+      ->RenderNull("null")
+      ->StartList("list")
+      ->RenderString("", "")
+      ->EndList()
+      ->EndObject();
+  EXPECT_EQ(15, recorder_.events());
+
+  ow_.StartObject("")
+      ->RenderBool("bool", true)
+      ->RenderInt32("int32", std::numeric_limits<int32_t>::min())
+      ->RenderUint32("uint32", std::numeric_limits<uint32_t>::max())
+      ->RenderInt64("int64", std::numeric_limits<int64_t>::min())
+      ->RenderUint64("uint64", std::numeric_limits<uint64_t>::max())
+      ->RenderDouble("double", -0.5)
+      ->RenderFloat("float", 1.5f)
+      ->RenderString("string", "value")
+      ->RenderBytes("bytes", binary)
+      ->RenderNull("null")
+      ->StartList("list")
+      ->RenderString("", "")
+      ->EndList()
+      ->EndObject();
+  recorder_.Replay(&mock_);
+}
+
+TEST_F(RecordingObjectWriterTest, ReplaysRepeatedly) {
+  recorder_.StartObject("")->RenderInt32("value", 1)->EndObject();
+  for (int i = 0; i < 3; ++i) {
+    ow_.StartObject("")->RenderInt32("value", 1)->EndObject();
+  }
+  for (int i = 0; i < 3; ++i) recorder_.Replay(&mock_);
+}
+
+TEST_F(RecordingObjectWriterTest, InternsNames) {
+  // More names than fit in a one byte id.
+  const int kNames = 300;
+  const int kRepeats = 10;
+  recorder_.StartList("items");
+  for (int repeat = 0; repeat < kRepeats; ++repeat) {
+    for (int i = 0; i < kNames; ++i) {
+      recorder_.RenderInt32(StrCat("a_rather_long_field_name_", i), i);
+    }
+  }
+  recorder_.EndList();
+
+  ow_.StartList("items");
+  for (int repeat = 0; repeat < kRepeats; ++repeat) {
+    for (int i = 0; i < kNames; ++i) {
+      ow_.RenderInt32(StrCat("a_rather_long_field_name_", i), i);
+    }
+  }
+  ow_.EndList();
+  recorder_.Replay(&mock_);
+
+  // Each name is stored once, so the recording is smaller than the names
+  // would be on their own.
+  const size_t name_bytes =
+      kRepeats * kNames * strlen("a_rather_long_field_name_");
+  EXPECT_GT(name_bytes, recorder_.SpaceUsed());
+}
+
+TEST_F(RecordingObjectWriterTest, Clear) {
+  recorder_.StartObject("")->RenderBool("old", true)->EndObject();
+  recorder_.Clear();
+  EXPECT_EQ(0, recorder_.events());
+  recorder_.StartObject("")->RenderBool("new", false)->EndObject();
+
+  ow_.StartObject("")->RenderBool("new", false)->EndObject();
+  recorder_.Replay(&mock_);
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
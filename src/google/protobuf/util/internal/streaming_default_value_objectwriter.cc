@@ -0,0 +1,587 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <google/protobuf/util/internal/streaming_default_value_objectwriter.h>
+
+#include <google/protobuf/wire_format_lite.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/internal/utility.h>
+
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+using ::google::protobuf::internal::WireFormatLite;
+
+namespace {
+
+const char kAnyTypeName[] = "google.protobuf.Any";
+const char kWellKnownTypePrefix[] = "google.protobuf.";
+
+// Mirrors ProtoStreamObjectSource::IsPackable().
+bool IsPackable(const google::protobuf::Field& field) {
+  return field.cardinality() ==
+             google::protobuf::Field::CARDINALITY_REPEATED &&
+         field.kind() != google::protobuf::Field::TYPE_STRING &&
+         field.kind() != google::protobuf::Field::TYPE_BYTES &&
+         field.kind() != google::protobuf::Field::TYPE_MESSAGE &&
+         field.kind() != google::protobuf::Field::TYPE_GROUP;
+}
+
+// Returns the field of |type| that |tag| is for, or null if
+// ProtoStreamObjectSource skips it: unknown fields and fields with the wrong
+// wire type. Mirrors ProtoStreamObjectSource::FindAndVerifyField().
+const google::protobuf::Field* FindAndVerifyField(
+    const google::protobuf::Type& type, uint32_t tag) {
+  const google::protobuf::Field* field = FindFieldInTypeByNumberOrNull(
+      &type, WireFormatLite::GetTagFieldNumber(tag));
+  if (field == nullptr) return nullptr;
+  const WireFormatLite::WireType wire_type =
+      WireFormatLite::GetTagWireType(tag);
+  if (wire_type != WireFormatLite::WireTypeForFieldType(
+                       static_cast<WireFormatLite::FieldType>(field->kind())) &&
+      (!IsPackable(*field) ||
+       wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED)) {
+    return nullptr;
+  }
+  return field;
+}
+
+// Reads a map key of |field| from |input| into |key|, in a form that is the
+// same for keys ProtoStreamObjectSource renders the same.
+bool ReadMapKey(const google::protobuf::Field& field,
+                io::CodedInputStream* input, std::string* key) {
+  uint32_t value32 = 0;
+  uint64_t value64 = 0;
+  switch (field.kind()) {
+    case google::protobuf::Field::TYPE_BOOL:
+      if (!input->ReadVarint64(&value64)) return false;
+      key->assign(value64 != 0 ? "1" : "0");
+      return true;
+    case google::protobuf::Field::TYPE_INT32:
+    case google::protobuf::Field::TYPE_UINT32:
+    case google::protobuf::Field::TYPE_SINT32:
+      if (!input->ReadVarint32(&value32)) return false;
+      *key = StrCat(value32);
+      return true;
+    case google::protobuf::Field::TYPE_INT64:
+    case google::protobuf::Field::TYPE_UINT64:
+    case google::protobuf::Field::TYPE_SINT64:
+      if (!input->ReadVarint64(&value64)) return false;
+      *key = StrCat(value64);
+      return true;
+    case google::protobuf::Field::TYPE_FIXED32:
+    case google::protobuf::Field::TYPE_SFIXED32:
+      if (!input->ReadLittleEndian32(&value32)) return false;
+      *key = StrCat(value32);
+      return true;
+    case google::protobuf::Field::TYPE_FIXED64:
+    case google::protobuf::Field::TYPE_SFIXED64:
+      if (!input->ReadLittleEndian64(&value64)) return false;
+      *key = StrCat(value64);
+      return true;
+    case google::protobuf::Field::TYPE_STRING:
+      return input->ReadVarint32(&value32) && input->ReadString(key, value32);
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+StreamingDefaultValueObjectWriter::StreamingDefaultValueObjectWriter(
+    TypeResolver* type_resolver, const google::protobuf::Type& type,
+    ObjectWriter* ow)
+    : type_info_(TypeInfo::NewTypeInfo(type_resolver)),
+      root_type_(type),
+      ow_(ow),
+      preserve_proto_field_names_(false),
+      use_ints_for_enums_(false) {}
+
+StreamingDefaultValueObjectWriter::~StreamingDefaultValueObjectWriter() {}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::StartObject(StringPiece name) {
+  BeforeField(name);
+  ow_->StartObject(name);
+  Push(name, false);
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::EndObject() {
+  if (!frames_.empty()) {
+    const Frame& frame = frames_.back();
+    if (frame.type != nullptr) {
+      for (int i = frame.first_unwritten; i < frame.type->fields_size(); ++i) {
+        if (!written_[frame.written_begin + i]) {
+          WriteDefault(frame.type->fields(i));
+        }
+      }
+    }
+    written_.resize(frame.written_begin);
+    frames_.pop_back();
+  }
+  ow_->EndObject();
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::StartList(StringPiece name) {
+  BeforeField(name);
+  ow_->StartList(name);
+  Push(name, true);
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::EndList() {
+  if (!frames_.empty()) {
+    written_.resize(frames_.back().written_begin);
+    frames_.pop_back();
+  }
+  ow_->EndList();
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::RenderBool(StringPiece name, bool value) {
+  BeforeField(name);
+  ow_->RenderBool(name, value);
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::RenderInt32(StringPiece name,
+                                               int32_t value) {
+  BeforeField(name);
+  ow_->RenderInt32(name, value);
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::RenderUint32(StringPiece name,
+                                                uint32_t value) {
+  BeforeField(name);
+  ow_->RenderUint32(name, value);
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::RenderInt64(StringPiece name,
+                                               int64_t value) {
+  BeforeField(name);
+  ow_->RenderInt64(name, value);
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::RenderUint64(StringPiece name,
+                                                uint64_t value) {
+  BeforeField(name);
+  ow_->RenderUint64(name, value);
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::RenderDouble(StringPiece name,
+                                                double value) {
+  BeforeField(name);
+  ow_->RenderDouble(name, value);
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::RenderFloat(StringPiece name,
+                                               float value) {
+  BeforeField(name);
+  ow_->RenderFloat(name, value);
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::RenderString(StringPiece name,
+                                                StringPiece value) {
+  BeforeField(name);
+  ow_->RenderString(name, value);
+  // ProtoStreamObjectSource writes the type of an Any before its fields.
+  if (!frames_.empty() && frames_.back().is_any && name == "@type") {
+    Frame* frame = &frames_.back();
+    frame->is_any = false;
+    frame->any_type = type_info_->GetTypeByTypeUrl(value);
+  }
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::RenderBytes(StringPiece name,
+                                               StringPiece value) {
+  BeforeField(name);
+  ow_->RenderBytes(name, value);
+  return this;
+}
+
+StreamingDefaultValueObjectWriter*
+StreamingDefaultValueObjectWriter::RenderNull(StringPiece name) {
+  BeforeField(name);
+  ow_->RenderNull(name);
+  return this;
+}
+
+void StreamingDefaultValueObjectWriter::Push(StringPiece name, bool is_list) {
+  Frame frame;
+  frame.type = nullptr;
+  frame.child_type = nullptr;
+  frame.is_any = false;
+  frame.any_type = nullptr;
+  frame.written_begin = written_.size();
+  frame.first_unwritten = 0;
+  const google::protobuf::Type* type = nullptr;
+  if (frames_.empty()) {
+    type = &root_type_;
+  } else if (frames_.back().type == nullptr) {
+    // An item of a list or a value of a map.
+    type = frames_.back().child_type;
+  } else {
+    const google::protobuf::Field* field =
+        type_info_->FindField(frames_.back().type, name);
+    if (field != nullptr) type = MessageType(*field);
+    if (type != nullptr && !is_list && IsMap(*field, *type)) {
+      const google::protobuf::Field* value =
+          FindFieldInTypeOrNull(type, "value");
+      frame.child_type = value != nullptr ? MessageType(*value) : nullptr;
+      type = nullptr;
+    }
+  }
+  if (is_list) {
+    frame.child_type = type;
+  } else if (type != nullptr && type->name() == kAnyTypeName) {
+    frame.is_any = true;
+  } else {
+    SetFrameType(type, &frame);
+  }
+  frames_.push_back(frame);
+}
+
+void StreamingDefaultValueObjectWriter::SetFrameType(
+    const google::protobuf::Type* type, Frame* frame) {
+  // Well-known types are not rendered field by field.
+  if (type != nullptr && HasPrefixString(type->name(), kWellKnownTypePrefix)) {
+    type = nullptr;
+  }
+  frame->type = type;
+  frame->first_unwritten = 0;
+  written_.resize(frame->written_begin);
+  if (type != nullptr) {
+    written_.resize(frame->written_begin + type->fields_size(), false);
+  }
+}
+
+void StreamingDefaultValueObjectWriter::BeforeField(StringPiece name) {
+  if (frames_.empty()) return;
+  Frame& frame = frames_.back();
+  // Like DefaultValueObjectWriter, fill in the packed message only once it
+  // has a field.
+  if (frame.any_type != nullptr) {
+    SetFrameType(frame.any_type, &frame);
+    frame.any_type = nullptr;
+  }
+  if (frame.type == nullptr || name.empty()) return;
+  const google::protobuf::Field* field =
+      type_info_->FindField(frame.type, name);
+  if (field == nullptr) return;
+  const int size = frame.type->fields_size();
+  int index = frame.first_unwritten;
+  while (index < size && &frame.type->fields(index) != field) ++index;
+  // Not found past first_unwritten: the field was written already.
+  if (index == size || written_[frame.written_begin + index]) return;
+  // The fields declared before this one with smaller numbers would have
+  // arrived by now, so they can get their defaults.
+  for (int i = frame.first_unwritten; i < index; ++i) {
+    const google::protobuf::Field& previous = frame.type->fields(i);
+    if (!written_[frame.written_begin + i] &&
+        previous.number() < field->number()) {
+      WriteDefault(previous);
+      written_[frame.written_begin + i] = true;
+    }
+  }
+  written_[frame.written_begin + index] = true;
+  while (frame.first_unwritten < size &&
+         written_[frame.written_begin + frame.first_unwritten]) {
+    ++frame.first_unwritten;
+  }
+}
+
+void StreamingDefaultValueObjectWriter::WriteDefault(
+    const google::protobuf::Field& field) {
+  // Fields in a oneof have no default, not even in the group's first field.
+  if (field.oneof_index() != 0) return;
+  const std::string& name =
+      preserve_proto_field_names_ ? field.name() : field.json_name();
+  if (field.cardinality() == google::protobuf::Field::CARDINALITY_REPEATED) {
+    const google::protobuf::Type* type = MessageType(field);
+    if (type != nullptr && IsMap(field, *type)) {
+      ow_->StartObject(name)->EndObject();
+    } else {
+      ow_->StartList(name)->EndList();
+    }
+    return;
+  }
+  const std::string& value = field.default_value();
+  switch (field.kind()) {
+    case google::protobuf::Field::TYPE_BOOL:
+      ow_->RenderBool(name, value == "true");
+      break;
+    case google::protobuf::Field::TYPE_INT32:
+    case google::protobuf::Field::TYPE_SINT32:
+    case google::protobuf::Field::TYPE_SFIXED32: {
+      int32_t number = 0;
+      if (!value.empty()) safe_strto32(value, &number);
+      ow_->RenderInt32(name, number);
+      break;
+    }
+    case google::protobuf::Field::TYPE_INT64:
+    case google::protobuf::Field::TYPE_SINT64:
+    case google::protobuf::Field::TYPE_SFIXED64: {
+      int64_t number = 0;
+      if (!value.empty()) safe_strto64(value, &number);
+      ow_->RenderInt64(name, number);
+      break;
+    }
+    case google::protobuf::Field::TYPE_UINT32:
+    case google::protobuf::Field::TYPE_FIXED32: {
+      uint32_t number = 0;
+      if (!value.empty()) safe_strtou32(value, &number);
+      ow_->RenderUint32(name, number);
+      break;
+    }
+    case google::protobuf::Field::TYPE_UINT64:
+    case google::protobuf::Field::TYPE_FIXED64: {
+      uint64_t number = 0;
+      if (!value.empty()) safe_strtou64(value, &number);
+      ow_->RenderUint64(name, number);
+      break;
+    }
+    case google::protobuf::Field::TYPE_DOUBLE: {
+      double number = 0;
+      if (!value.empty()) safe_strtod(value, &number);
+      ow_->RenderDouble(name, number);
+      break;
+    }
+    case google::protobuf::Field::TYPE_FLOAT: {
+      float number = 0;
+      if (!value.empty()) safe_strtof(value, &number);
+      ow_->RenderFloat(name, number);
+      break;
+    }
+    case google::protobuf::Field::TYPE_STRING:
+      ow_->RenderString(name, value);
+      break;
+    case google::protobuf::Field::TYPE_BYTES:
+      // TypeResolver C-escapes the default of bytes fields.
+      ow_->RenderBytes(name, UnescapeCEscapeString(value));
+      break;
+    case google::protobuf::Field::TYPE_ENUM: {
+      if (!value.empty() && !use_ints_for_enums_) {
+        ow_->RenderString(name, value);
+        break;
+      }
+      const google::protobuf::Enum* enum_type =
+          type_info_->GetEnumByTypeUrl(field.type_url());
+      if (!value.empty()) {
+        // The default is given by name.
+        const google::protobuf::EnumValue* enum_value =
+            enum_type != nullptr ? FindEnumValueByNameOrNull(enum_type, value)
+                                 : nullptr;
+        if (enum_value == nullptr) {
+          ow_->RenderNull(name);
+        } else {
+          ow_->RenderInt32(name, enum_value->number());
+        }
+        break;
+      }
+      // The first value is the default if none is specified.
+      if (enum_type == nullptr || enum_type->enumvalue_size() == 0) {
+        ow_->RenderNull(name);
+      } else if (use_ints_for_enums_) {
+        ow_->RenderInt32(name, enum_type->enumvalue(0).number());
+      } else {
+        ow_->RenderString(name, enum_type->enumvalue(0).name());
+      }
+      break;
+    }
+    default:
+      // Singular messages are only written when present.
+      break;
+  }
+}
+
+bool StreamingDefaultValueObjectWriter::MatchesDefaultValueObjectWriter()
+    const {
+  std::set<std::string> seen;
+  return MatchesDefaultValueObjectWriter(root_type_, &seen);
+}
+
+bool StreamingDefaultValueObjectWriter::MatchesDefaultValueObjectWriter(
+    const google::protobuf::Type& type, std::set<std::string>* seen) const {
+  if (HasPrefixString(type.name(), kWellKnownTypePrefix)) return false;
+  if (!seen->insert(type.name()).second) return true;
+  for (int i = 0; i < type.fields_size(); ++i) {
+    const google::protobuf::Field& field = type.fields(i);
+    if (i > 0 && field.number() < type.fields(i - 1).number()) return false;
+    if (field.kind() == google::protobuf::Field::TYPE_GROUP) return false;
+    if (field.kind() != google::protobuf::Field::TYPE_MESSAGE) continue;
+    const google::protobuf::Type* field_type = MessageType(field);
+    if (field_type == nullptr ||
+        !MatchesDefaultValueObjectWriter(*field_type, seen)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool StreamingDefaultValueObjectWriter::MatchesDefaultValueObjectWriter(
+    StringPiece binary) const {
+  if (binary.size() > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    return false;
+  }
+  io::CodedInputStream input(reinterpret_cast<const uint8_t*>(binary.data()),
+                             static_cast<int>(binary.size()));
+  return HasFieldsInOrder(root_type_, &input);
+}
+
+bool StreamingDefaultValueObjectWriter::HasFieldsInOrder(
+    const google::protobuf::Type& type, io::CodedInputStream* input) const {
+  uint32_t last_tag = 0;
+  int last_number = 0;
+  std::set<std::string> map_keys;
+  for (uint32_t tag = input->ReadTag(); tag != 0; tag = input->ReadTag()) {
+    const google::protobuf::Field* field = FindAndVerifyField(type, tag);
+    if (field == nullptr) {
+      if (!WireFormatLite::SkipField(input, tag)) return false;
+      continue;
+    }
+    // Only the items of an unpacked repeated field may follow each other
+    // with the same number: ProtoStreamObjectSource starts a new list for
+    // every packed chunk.
+    if (field->number() < last_number) return false;
+    if (field->number() == last_number &&
+        (field->cardinality() !=
+             google::protobuf::Field::CARDINALITY_REPEATED ||
+         tag != last_tag ||
+         WireFormatLite::GetTagWireType(tag) !=
+             WireFormatLite::WireTypeForFieldType(
+                 static_cast<WireFormatLite::FieldType>(field->kind())))) {
+      return false;
+    }
+    if (field->number() != last_number) map_keys.clear();
+    last_tag = tag;
+    last_number = field->number();
+    if (field->kind() == google::protobuf::Field::TYPE_MESSAGE) {
+      if (!HasMessageInOrder(*field, input, &map_keys)) return false;
+    } else if (!WireFormatLite::SkipField(input, tag)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool StreamingDefaultValueObjectWriter::HasMessageInOrder(
+    const google::protobuf::Field& field, io::CodedInputStream* input,
+    std::set<std::string>* map_keys) const {
+  const google::protobuf::Type* type = MessageType(field);
+  uint32_t length = 0;
+  if (type == nullptr || !input->ReadVarint32(&length) ||
+      !input->IncrementRecursionDepth()) {
+    return false;
+  }
+  const io::CodedInputStream::Limit limit = input->PushLimit(length);
+  bool in_order;
+  if (IsMap(field, *type)) {
+    std::string key;
+    in_order = HasMapEntryInOrder(*type, input, &key) &&
+               map_keys->insert(key).second;
+  } else {
+    in_order = HasFieldsInOrder(*type, input);
+  }
+  in_order = in_order && input->BytesUntilLimit() == 0;
+  input->PopLimit(limit);
+  input->DecrementRecursionDepth();
+  return in_order;
+}
+
+bool StreamingDefaultValueObjectWriter::HasMapEntryInOrder(
+    const google::protobuf::Type& type, io::CodedInputStream* input,
+    std::string* key) const {
+  const google::protobuf::Field* key_field =
+      FindFieldInTypeByNumberOrNull(&type, 1);
+  if (key_field == nullptr) return false;
+  // An absent key is the default. ProtoStreamObjectSource renders a value
+  // with the key read before it, so the key must come first.
+  key->assign(key_field->kind() == google::protobuf::Field::TYPE_STRING ? ""
+                                                                        : "0");
+  int last_number = 0;
+  for (uint32_t tag = input->ReadTag(); tag != 0; tag = input->ReadTag()) {
+    const google::protobuf::Field* field = FindAndVerifyField(type, tag);
+    if (field == nullptr) {
+      if (!WireFormatLite::SkipField(input, tag)) return false;
+      continue;
+    }
+    if (field->number() <= last_number) return false;
+    last_number = field->number();
+    if (field == key_field) {
+      if (!ReadMapKey(*field, input, key)) return false;
+    } else if (field->kind() == google::protobuf::Field::TYPE_MESSAGE) {
+      // Not a map: the values of a map are not repeated.
+      if (!HasMessageInOrder(*field, input, nullptr)) return false;
+    } else if (!WireFormatLite::SkipField(input, tag)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const google::protobuf::Type* StreamingDefaultValueObjectWriter::MessageType(
+    const google::protobuf::Field& field) const {
+  if (field.kind() != google::protobuf::Field::TYPE_MESSAGE) return nullptr;
+  return type_info_->GetTypeByTypeUrl(field.type_url());
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,226 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef GOOGLE_PROTOBUF_UTIL_INTERNAL_STREAMING_DEFAULT_VALUE_OBJECTWRITER_H__
+#define GOOGLE_PROTOBUF_UTIL_INTERNAL_STREAMING_DEFAULT_VALUE_OBJECTWRITER_H__
+
+#include <google/protobuf/type.pb.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/internal/object_writer.h>
+#include <google/protobuf/util/internal/type_info.h>
+#include <google/protobuf/util/type_resolver.h>
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// clang-format off
+#include <google/protobuf/port_def.inc>
+// clang-format on
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// An ObjectWriter that fills in the default values of the fields missing from
+// the objects it forwards, like DefaultValueObjectWriter, but without
+// buffering the message: every event is passed on as soon as it arrives.
+//
+// For each open object it keeps one bit per field of the object's type, set
+// once the field has been written. When a field arrives, the defaults of the
+// unwritten fields declared before it and having a smaller field number are
+// written first; the remaining ones are written at EndObject. Sources such as
+// ProtoStreamObjectSource emit fields in the order they are on the wire, which
+// is field number order for serialized messages, so when fields are also
+// declared in that order the output is the same as DefaultValueObjectWriter's:
+// fields in declaration order, defaults included. Otherwise the fields keep
+// the order they arrived in, and a field that arrives twice is written twice
+// where DefaultValueObjectWriter keeps one. The two
+// MatchesDefaultValueObjectWriter() methods tell whether the output is the
+// same for every message of the root type, and for a given binary.
+//
+// Which fields get a default also follows DefaultValueObjectWriter:
+// primitive fields get their default value, repeated fields an empty list and
+// map fields an empty object, while fields in a oneof and singular message
+// fields are left out. The fields of the message packed in an Any are filled
+// in from its first field after "@type" on. Objects of other well-known
+// types, such as Struct, are passed on unchanged.
+//
+// Sample usage:
+//   StreamingDefaultValueObjectWriter writer(resolver, type, &xml_writer);
+//   proto_source.WriteTo(&writer);
+class PROTOBUF_EXPORT StreamingDefaultValueObjectWriter : public ObjectWriter {
+ public:
+  StreamingDefaultValueObjectWriter(TypeResolver* type_resolver,
+                                    const google::protobuf::Type& type,
+                                    ObjectWriter* ow);
+  ~StreamingDefaultValueObjectWriter() override;
+
+  // ObjectWriter methods.
+  StreamingDefaultValueObjectWriter* StartObject(StringPiece name) override;
+  StreamingDefaultValueObjectWriter* EndObject() override;
+  StreamingDefaultValueObjectWriter* StartList(StringPiece name) override;
+  StreamingDefaultValueObjectWriter* EndList() override;
+  StreamingDefaultValueObjectWriter* RenderBool(StringPiece name,
+                                                bool value) override;
+  StreamingDefaultValueObjectWriter* RenderInt32(StringPiece name,
+                                                 int32_t value) override;
+  StreamingDefaultValueObjectWriter* RenderUint32(StringPiece name,
+                                                  uint32_t value) override;
+  StreamingDefaultValueObjectWriter* RenderInt64(StringPiece name,
+                                                 int64_t value) override;
+  StreamingDefaultValueObjectWriter* RenderUint64(StringPiece name,
+                                                  uint64_t value) override;
+  StreamingDefaultValueObjectWriter* RenderDouble(StringPiece name,
+                                                  double value) override;
+  StreamingDefaultValueObjectWriter* RenderFloat(StringPiece name,
+                                                 float value) override;
+  StreamingDefaultValueObjectWriter* RenderString(StringPiece name,
+                                                  StringPiece value) override;
+  StreamingDefaultValueObjectWriter* RenderBytes(StringPiece name,
+                                                 StringPiece value) override;
+  StreamingDefaultValueObjectWriter* RenderNull(StringPiece name) override;
+
+  // Whether the defaults are named with the original proto field names
+  // instead of their lowerCamelCase JSON names. Should match the source.
+  void set_preserve_proto_field_names(bool value) {
+    preserve_proto_field_names_ = value;
+  }
+
+  // Whether enum defaults are written as ints instead of names.
+  void set_print_enums_as_ints(bool value) { use_ints_for_enums_ = value; }
+
+  // Whether the output is the same as DefaultValueObjectWriter's for every
+  // message of the root type, written by a source in field number order.
+  // DefaultValueObjectWriter orders fields by declaration and moves fields of
+  // well-known types rendered as values, e.g. Timestamp, to the end of their
+  // object, so this requires every message type the root type reaches to
+  // declare its fields in field number order, with no groups, no Any and no
+  // well-known types.
+  bool MatchesDefaultValueObjectWriter() const;
+
+  // Whether the output is the same as DefaultValueObjectWriter's for
+  // |binary|, a message of the root type written by ProtoStreamObjectSource,
+  // given MatchesDefaultValueObjectWriter(). DefaultValueObjectWriter merges a
+  // field that arrives again into its first occurrence, so this requires the
+  // fields of every message in |binary| to be in field number order, with
+  // no singular field repeated, the items of a repeated field in one run, in
+  // one packed chunk or unpacked, and no map key repeated. Serialized
+  // messages pass; concatenated ones and hand-built ones may not.
+  bool MatchesDefaultValueObjectWriter(StringPiece binary) const;
+
+ private:
+  // An open object or list.
+  struct Frame {
+    // Type whose missing fields are filled in, or null for lists, maps,
+    // well-known types and objects of unknown type.
+    const google::protobuf::Type* type;
+    // Type of the children without a field of their own: the items of a list
+    // or the values of a map. Null if they are not messages.
+    const google::protobuf::Type* child_type;
+    // Whether the object is an Any whose "@type" has not been seen yet.
+    bool is_any;
+    // Type of the message packed in an Any, from its "@type" until the first
+    // field after it, which sets the frame's type. The fields of a packed
+    // message without fields get no defaults.
+    const google::protobuf::Type* any_type;
+    // Offset of the bits of this frame's fields in written_.
+    size_t written_begin;
+    // Declaration index of the first field that may still be unwritten.
+    int first_unwritten;
+  };
+
+  // Opens a frame for an object or list named |name| in the current frame.
+  void Push(StringPiece name, bool is_list);
+
+  // Sets the type of |frame| and clears the bits of its fields.
+  void SetFrameType(const google::protobuf::Type* type, Frame* frame);
+
+  // Marks the field named |name| of the current object written, after
+  // writing the defaults that must precede it.
+  void BeforeField(StringPiece name);
+
+  // Writes the default of |field|, if it gets one.
+  void WriteDefault(const google::protobuf::Field& field);
+
+  // Checks |type| and the message types it reaches for
+  // MatchesDefaultValueObjectWriter(). |seen| holds the names of the types
+  // checked already.
+  bool MatchesDefaultValueObjectWriter(const google::protobuf::Type& type,
+                                       std::set<std::string>* seen) const;
+
+  // Checks the fields of a message of |type| read from |input| for
+  // MatchesDefaultValueObjectWriter(StringPiece).
+  bool HasFieldsInOrder(const google::protobuf::Type& type,
+                        io::CodedInputStream* input) const;
+
+  // Checks the message of |field| read from |input|, length first. If it is
+  // a map entry, its key is added to |map_keys|, the keys of the map so far.
+  bool HasMessageInOrder(const google::protobuf::Field& field,
+                         io::CodedInputStream* input,
+                         std::set<std::string>* map_keys) const;
+
+  // Checks a map entry of |type| read from |input| and stores its key in
+  // |key|, so that repeated keys can be found.
+  bool HasMapEntryInOrder(const google::protobuf::Type& type,
+                          io::CodedInputStream* input,
+                          std::string* key) const;
+
+  // Returns the message type of |field|, or null if it is not a message.
+  const google::protobuf::Type* MessageType(
+      const google::protobuf::Field& field) const;
+
+  std::unique_ptr<TypeInfo> type_info_;
+  const google::protobuf::Type& root_type_;
+  ObjectWriter* ow_;
+  bool preserve_proto_field_names_;
+  bool use_ints_for_enums_;
+  std::vector<Frame> frames_;
+  // The written bits of all open objects, innermost last. Kept in one vector
+  // so that opening an object does not allocate once it has grown.
+  std::vector<bool> written_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(StreamingDefaultValueObjectWriter);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_INTERNAL_STREAMING_DEFAULT_VALUE_OBJECTWRITER_H__
@@ -0,0 +1,490 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <google/protobuf/util/internal/streaming_default_value_objectwriter.h>
+
+#include <google/protobuf/any.pb.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/text_format.h>
+#include <google/protobuf/util/internal/default_value_objectwriter.h>
+#include <google/protobuf/util/internal/expecting_objectwriter.h>
+#include <google/protobuf/util/internal/protostream_objectsource.h>
+#include <google/protobuf/util/internal/testdata/default_value_test.pb.h>
+#include <google/protobuf/util/internal/xml_objectwriter.h>
+#include <google/protobuf/util/type_resolver.h>
+#include <google/protobuf/util/type_resolver_util.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+using proto_util_converter::testing::DefaultValueTest;
+
+class StreamingDefaultValueObjectWriterTest : public ::testing::Test {
+ protected:
+  StreamingDefaultValueObjectWriterTest()
+      : resolver_(NewTypeResolverForDescriptorPool(
+            "type.googleapis.com", DescriptorPool::generated_pool())),
+        mock_(),
+        expects_(&mock_) {
+    const std::string type_url =
+        "type.googleapis.com/" + DefaultValueTest::descriptor()->full_name();
+    GOOGLE_CHECK(resolver_->ResolveMessageType(type_url, &type_).ok());
+    testing_.reset(
+        new StreamingDefaultValueObjectWriter(resolver_.get(), type_, &mock_));
+  }
+  ~StreamingDefaultValueObjectWriterTest() override {}
+
+  std::unique_ptr<TypeResolver> resolver_;
+  google::protobuf::Type type_;
+#ifndef _MSC_VER
+  ::testing::InSequence in_sequence_;
+#endif  // !_MSC_VER
+  MockObjectWriter mock_;
+  ExpectingObjectWriter expects_;
+  std::unique_ptr<StreamingDefaultValueObjectWriter> testing_;
+};
+
+TEST_F(StreamingDefaultValueObjectWriterTest, Empty) {
+  expects_.StartObject("")
+      ->RenderDouble("doubleValue", 0.0)
+      ->StartList("repeatedDouble")
+      ->EndList()
+      ->RenderFloat("floatValue", 0.0)
+      ->RenderInt64("int64Value", 0)
+      ->RenderUint64("uint64Value", 0)
+      ->RenderInt32("int32Value", 0)
+      ->RenderUint32("uint32Value", 0)
+      ->RenderBool("boolValue", false)
+      ->RenderString("stringValue", "")
+      ->RenderBytes("bytesValue", "")
+      ->RenderString("enumValue", "ENUM_FIRST")
+      ->EndObject();
+
+  testing_->StartObject("")->EndObject();
+}
+
+TEST_F(StreamingDefaultValueObjectWriterTest, DefaultsPrecedeLaterFields) {
+  // Every default is written as soon as a later field arrives, so that
+  // nothing is held back.
+  expects_.StartObject("")
+      ->RenderDouble("doubleValue", 0.0)
+      ->StartList("repeatedDouble")
+      ->RenderDouble("", 2.0)
+      ->EndList()
+      ->RenderFloat("floatValue", 0.0)
+      ->RenderInt64("int64Value", 0)
+      ->RenderUint64("uint64Value", 0)
+      ->RenderInt32("int32Value", 5);
+  testing_->StartObject("")
+      ->StartList("repeatedDouble")
+      ->RenderDouble("", 2.0)
+      ->EndList()
+      ->RenderInt32("int32Value", 5);
+
+  expects_.RenderUint32("uint32Value", 0)
+      ->RenderBool("boolValue", false)
+      ->RenderString("stringValue", "string")
+      ->RenderBytes("bytesValue", "")
+      ->RenderString("enumValue", "ENUM_FIRST")
+      ->EndObject();
+  testing_->RenderString("stringValue", "string")->EndObject();
+}
+
+TEST_F(StreamingDefaultValueObjectWriterTest, AllFieldsPresent) {
+  expects_.StartObject("")
+      ->RenderDouble("doubleValue", 1.0)
+      ->StartList("repeatedDouble")
+      ->EndList()
+      ->RenderFloat("floatValue", 2.0f)
+      ->RenderInt64("int64Value", -3)
+      ->RenderUint64("uint64Value", 4)
+      ->RenderInt32("int32Value", -5)
+      ->RenderUint32("uint32Value", 6)
+      ->RenderBool("boolValue", true)
+      ->RenderString("stringValue", "7")
+      ->RenderBytes("bytesValue", "8")
+      ->RenderString("enumValue", "ENUM_THIRD")
+      ->EndObject();
+
+  testing_->StartObject("")
+      ->RenderDouble("doubleValue", 1.0)
+      ->StartList("repeatedDouble")
+      ->EndList()
+      ->RenderFloat("floatValue", 2.0f)
+      ->RenderInt64("int64Value", -3)
+      ->RenderUint64("uint64Value", 4)
+      ->RenderInt32("int32Value", -5)
+      ->RenderUint32("uint32Value", 6)
+      ->RenderBool("boolValue", true)
+      ->RenderString("stringValue", "7")
+      ->RenderBytes("bytesValue", "8")
+      ->RenderString("enumValue", "ENUM_THIRD")
+      ->EndObject();
+}
+
+TEST_F(StreamingDefaultValueObjectWriterTest, ProtoNamesAndEnumsAsInts) {
+  testing_->set_preserve_proto_field_names(true);
+  testing_->set_print_enums_as_ints(true);
+  expects_.StartObject("")
+      ->RenderDouble("double_value", 0.0)
+      ->StartList("repeated_double")
+      ->EndList()
+      ->RenderFloat("float_value", 0.0)
+      ->RenderInt64("int64_value", 0)
+      ->RenderUint64("uint64_value", 0)
+      ->RenderInt32("int32_value", 0)
+      ->RenderUint32("uint32_value", 0)
+      ->RenderBool("bool_value", true)
+      ->RenderString("string_value", "")
+      ->RenderBytes("bytes_value", "")
+      ->RenderInt32("enum_value", 0)
+      ->EndObject();
+
+  testing_->StartObject("")->RenderBool("bool_value", true)->EndObject();
+}
+
+// Types of the differential tests below. InOrder and Leaf declare their
+// fields in field number order; the others do not, or reach types that
+// DefaultValueObjectWriter reorders.
+const char kDiffSchema[] =
+    "name: 'streaming_default_value_diff.proto' package: 'diff'"
+    "dependency: 'google/protobuf/any.proto'"
+    "dependency: 'google/protobuf/timestamp.proto'"
+    "enum_type { name: 'Color'"
+    "  value { name: 'RED' number: 0 } value { name: 'GREEN' number: 1 }"
+    "  value { name: 'BLUE' number: 2 } }"
+    "message_type { name: 'Leaf'"
+    "  field { name: 'a' number: 1 label: LABEL_OPTIONAL type: TYPE_INT32 }"
+    "  field { name: 'b' number: 2 label: LABEL_REPEATED type: TYPE_STRING }"
+    "  field { name: 'color' number: 3 label: LABEL_OPTIONAL type: TYPE_ENUM"
+    "          type_name: '.diff.Color' default_value: 'BLUE' } }"
+    "message_type { name: 'InOrder'"
+    "  field { name: 'flag' number: 1 label: LABEL_OPTIONAL type: TYPE_BOOL }"
+    "  field { name: 'count' number: 2 label: LABEL_OPTIONAL type: TYPE_INT32"
+    "          default_value: '7' }"
+    "  field { name: 'color' number: 3 label: LABEL_OPTIONAL type: TYPE_ENUM"
+    "          type_name: '.diff.Color' default_value: 'GREEN' }"
+    "  field { name: 'leaf' number: 4 label: LABEL_OPTIONAL type: TYPE_MESSAGE"
+    "          type_name: '.diff.Leaf' }"
+    "  field { name: 'leaves' number: 5 label: LABEL_REPEATED"
+    "          type: TYPE_MESSAGE type_name: '.diff.Leaf' }"
+    "  field { name: 'leaf_map' number: 6 label: LABEL_REPEATED"
+    "          type: TYPE_MESSAGE type_name: '.diff.InOrder.LeafMapEntry' }"
+    "  field { name: 'name' number: 7 label: LABEL_OPTIONAL type: TYPE_STRING }"
+    "  nested_type { name: 'LeafMapEntry' options { map_entry: true }"
+    "    field { name: 'key' number: 1 label: LABEL_OPTIONAL"
+    "            type: TYPE_STRING }"
+    "    field { name: 'value' number: 2 label: LABEL_OPTIONAL"
+    "            type: TYPE_MESSAGE type_name: '.diff.Leaf' } } }"
+    "message_type { name: 'OutOfOrder'"
+    "  field { name: 'late' number: 2 label: LABEL_OPTIONAL type: TYPE_STRING }"
+    "  field { name: 'early' number: 1 label: LABEL_OPTIONAL"
+    "          type: TYPE_STRING }"
+    "  field { name: 'leaf' number: 4 label: LABEL_OPTIONAL type: TYPE_MESSAGE"
+    "          type_name: '.diff.Leaf' }"
+    "  field { name: 'mid' number: 3 label: LABEL_OPTIONAL type: TYPE_INT32 } }"
+    "message_type { name: 'OutOfOrderInMap'"
+    "  field { name: 'x' number: 1 label: LABEL_OPTIONAL type: TYPE_INT32 }"
+    "  field { name: 'inner_map' number: 2 label: LABEL_REPEATED"
+    "          type: TYPE_MESSAGE"
+    "          type_name: '.diff.OutOfOrderInMap.InnerMapEntry' }"
+    "  nested_type { name: 'InnerMapEntry' options { map_entry: true }"
+    "    field { name: 'key' number: 1 label: LABEL_OPTIONAL"
+    "            type: TYPE_STRING }"
+    "    field { name: 'value' number: 2 label: LABEL_OPTIONAL"
+    "            type: TYPE_MESSAGE type_name: '.diff.OutOfOrder' } } }"
+    "message_type { name: 'WithAny'"
+    "  field { name: 'x' number: 1 label: LABEL_OPTIONAL type: TYPE_INT32 }"
+    "  field { name: 'any' number: 2 label: LABEL_OPTIONAL type: TYPE_MESSAGE"
+    "          type_name: '.google.protobuf.Any' }"
+    "  field { name: 'y' number: 3 label: LABEL_OPTIONAL type: TYPE_INT32 } }"
+    "message_type { name: 'WithTimestamp'"
+    "  field { name: 'x' number: 1 label: LABEL_OPTIONAL type: TYPE_INT32 }"
+    "  field { name: 'time' number: 2 label: LABEL_OPTIONAL"
+    "          type: TYPE_MESSAGE type_name: '.google.protobuf.Timestamp' }"
+    "  field { name: 'y' number: 3 label: LABEL_OPTIONAL type: TYPE_INT32 } }";
+
+// Compares the XML written through StreamingDefaultValueObjectWriter with the
+// XML written through DefaultValueObjectWriter, for messages rendered by
+// ProtoStreamObjectSource.
+class StreamingDefaultValueObjectWriterDiffTest : public ::testing::Test {
+ protected:
+  StreamingDefaultValueObjectWriterDiffTest()
+      : pool_(DescriptorPool::generated_pool()),
+        factory_(&pool_),
+        use_ints_for_enums_(false) {
+    // Make sure the types the schema depends on are in the generated pool.
+    google::protobuf::Any::descriptor();
+    FileDescriptorProto file;
+    GOOGLE_CHECK(TextFormat::ParseFromString(kDiffSchema, &file));
+    GOOGLE_CHECK(pool_.BuildFile(file) != nullptr);
+    resolver_.reset(NewTypeResolverForDescriptorPool("type.googleapis.com",
+                                                     &pool_));
+  }
+
+  // Returns a message of type diff.|type_name| parsed from |text|.
+  std::unique_ptr<Message> Parse(const std::string& type_name,
+                                 const std::string& text) {
+    const Descriptor* descriptor =
+        pool_.FindMessageTypeByName("diff." + type_name);
+    GOOGLE_CHECK(descriptor != nullptr);
+    std::unique_ptr<Message> message(factory_.GetPrototype(descriptor)->New());
+    GOOGLE_CHECK(TextFormat::ParseFromString(text, message.get()));
+    return message;
+  }
+
+  // Returns a diff.WithAny whose any field packs |packed|.
+  std::unique_ptr<Message> PackInAny(const Message& packed) {
+    google::protobuf::Any any;
+    any.set_type_url("type.googleapis.com/" +
+                     packed.GetDescriptor()->full_name());
+    any.set_value(packed.SerializeAsString());
+    std::unique_ptr<Message> message = Parse("WithAny", "x: 1");
+    Message* any_field = message->GetReflection()->MutableMessage(
+        message.get(), message->GetDescriptor()->FindFieldByName("any"));
+    GOOGLE_CHECK(any_field->ParseFromString(any.SerializeAsString()));
+    return message;
+  }
+
+  // Whether StreamingDefaultValueObjectWriter claims the same output as
+  // DefaultValueObjectWriter for every message of type diff.|type_name|.
+  bool Matches(const std::string& type_name) {
+    google::protobuf::Type type;
+    GOOGLE_CHECK(resolver_
+                     ->ResolveMessageType(
+                         "type.googleapis.com/diff." + type_name, &type)
+                     .ok());
+    MockObjectWriter unused;
+    StreamingDefaultValueObjectWriter writer(resolver_.get(), type, &unused);
+    return writer.MatchesDefaultValueObjectWriter();
+  }
+
+  // Whether StreamingDefaultValueObjectWriter claims the same output as
+  // DefaultValueObjectWriter for |binary|, a diff.|type_name|.
+  bool Matches(const std::string& type_name, const std::string& binary) {
+    google::protobuf::Type type;
+    GOOGLE_CHECK(resolver_
+                     ->ResolveMessageType(
+                         "type.googleapis.com/diff." + type_name, &type)
+                     .ok());
+    MockObjectWriter unused;
+    StreamingDefaultValueObjectWriter writer(resolver_.get(), type, &unused);
+    return writer.MatchesDefaultValueObjectWriter(binary);
+  }
+
+  // Converts |message| to XML, filling in defaults with the streaming writer
+  // if |streaming|, else with DefaultValueObjectWriter.
+  std::string ToXml(const Message& message, bool streaming) {
+    return ToXml(message.GetDescriptor()->full_name(),
+                 message.SerializeAsString(), streaming);
+  }
+
+  // Converts |binary|, a message of type |type_name|, to XML like ToXml()
+  // above.
+  std::string ToXml(const std::string& type_name, const std::string& binary,
+                    bool streaming) {
+    google::protobuf::Type type;
+    GOOGLE_CHECK(resolver_
+                     ->ResolveMessageType("type.googleapis.com/" + type_name,
+                                          &type)
+                     .ok());
+    io::ArrayInputStream input_stream(binary.data(), binary.size());
+    io::CodedInputStream in(&input_stream);
+    ProtoStreamObjectSource::RenderOptions render_options;
+    render_options.use_ints_for_enums = use_ints_for_enums_;
+    ProtoStreamObjectSource source(&in, resolver_.get(), type,
+                                   render_options);
+    std::string xml;
+    {
+      io::StringOutputStream output_stream(&xml);
+      io::CodedOutputStream out(&output_stream);
+      XmlObjectWriter xml_writer("", &out);
+      if (streaming) {
+        StreamingDefaultValueObjectWriter writer(resolver_.get(), type,
+                                                 &xml_writer);
+        writer.set_print_enums_as_ints(use_ints_for_enums_);
+        EXPECT_TRUE(source.WriteTo(&writer).ok());
+      } else {
+        DefaultValueObjectWriter writer(resolver_.get(), type, &xml_writer);
+        writer.set_print_enums_as_ints(use_ints_for_enums_);
+        EXPECT_TRUE(source.WriteTo(&writer).ok());
+      }
+    }
+    return xml;
+  }
+
+  // Expects the same XML from both writers, with enums as names and as ints.
+  void ExpectSameXml(const Message& message) {
+    for (bool use_ints_for_enums : {false, true}) {
+      SCOPED_TRACE(use_ints_for_enums);
+      use_ints_for_enums_ = use_ints_for_enums;
+      EXPECT_EQ(ToXml(message, false), ToXml(message, true));
+    }
+  }
+
+  // Expects |binary|, a diff.|type_name|, to match if |matches|, and then the
+  // same XML from both writers.
+  void ExpectMatches(const std::string& type_name, const std::string& binary,
+                     bool matches) {
+    EXPECT_EQ(matches, Matches(type_name, binary));
+    if (matches) {
+      EXPECT_EQ(ToXml("diff." + type_name, binary, false),
+                ToXml("diff." + type_name, binary, true));
+    }
+  }
+
+  DescriptorPool pool_;
+  DynamicMessageFactory factory_;
+  std::unique_ptr<TypeResolver> resolver_;
+  bool use_ints_for_enums_;
+};
+
+TEST_F(StreamingDefaultValueObjectWriterDiffTest, TypesInFieldNumberOrder) {
+  EXPECT_TRUE(Matches("Leaf"));
+  EXPECT_TRUE(Matches("InOrder"));
+
+  ExpectSameXml(*Parse("InOrder", ""));
+  ExpectSameXml(*Parse("InOrder", "count: 3 name: 'x'"));
+  // Nested messages, lists of them and map message values get defaults too.
+  ExpectSameXml(*Parse("InOrder",
+                       "leaf {} leaves { a: 1 } leaves {}"
+                       "leaf_map { key: 'k' value {} }"));
+  // Explicit proto2 enum defaults.
+  ExpectSameXml(*Parse("Leaf", "a: 1"));
+  ExpectSameXml(*Parse("Leaf", "color: RED"));
+}
+
+TEST_F(StreamingDefaultValueObjectWriterDiffTest, BinariesInFieldNumberOrder) {
+  ExpectMatches("InOrder", "", true);
+  ExpectMatches("InOrder",
+                Parse("InOrder",
+                      "flag: true count: 3 leaf { a: 1 b: 'x' b: 'y' }"
+                      "leaves { a: 1 } leaves {}"
+                      "leaf_map { key: 'k' value { color: RED } }"
+                      "leaf_map { key: 'l' value {} } name: 'n'")
+                    ->SerializeAsString(),
+                true);
+  // The items of a repeated field and the entries of a map may come from
+  // different messages, as long as they stay together and keys differ.
+  ExpectMatches("InOrder",
+                Parse("InOrder", "count: 3 leaves { a: 1 }")
+                        ->SerializeAsString() +
+                    Parse("InOrder", "leaves { a: 2 }")->SerializeAsString(),
+                true);
+  ExpectMatches("InOrder",
+                Parse("InOrder", "leaf_map { key: 'k' value {} }")
+                        ->SerializeAsString() +
+                    Parse("InOrder", "leaf_map { key: 'l' value {} }")
+                        ->SerializeAsString(),
+                true);
+}
+
+TEST_F(StreamingDefaultValueObjectWriterDiffTest,
+       BinariesOutOfFieldNumberOrder) {
+  // name (7) before count (2): the default of count would be written before
+  // name, and then count once more.
+  const std::string out_of_order =
+      Parse("InOrder", "name: 'n'")->SerializeAsString() +
+      Parse("InOrder", "count: 3")->SerializeAsString();
+  ExpectMatches("InOrder", out_of_order, false);
+  EXPECT_NE(ToXml("diff.InOrder", out_of_order, false),
+            ToXml("diff.InOrder", out_of_order, true));
+  // Out of order in a nested message.
+  ExpectMatches("InOrder",
+                Parse("InOrder", "leaf { b: 'x' }")->SerializeAsString() +
+                    Parse("InOrder", "leaf { a: 1 }")->SerializeAsString(),
+                false);
+
+  // Two serialized messages, concatenated: DefaultValueObjectWriter merges
+  // the second count and leaf into the first.
+  const std::string concatenated =
+      Parse("InOrder", "count: 3 leaf { a: 1 }")->SerializeAsString() +
+      Parse("InOrder", "count: 4 leaf { a: 2 }")->SerializeAsString();
+  ExpectMatches("InOrder", concatenated, false);
+  EXPECT_NE(ToXml("diff.InOrder", concatenated, false),
+            ToXml("diff.InOrder", concatenated, true));
+  // A singular field repeated right away, and a repeated field split in two.
+  ExpectMatches("Leaf",
+                Parse("Leaf", "a: 1")->SerializeAsString() +
+                    Parse("Leaf", "a: 2")->SerializeAsString(),
+                false);
+  ExpectMatches("InOrder",
+                Parse("InOrder", "leaves {} name: 'n'")->SerializeAsString() +
+                    Parse("InOrder", "leaves {}")->SerializeAsString(),
+                false);
+  // A map key repeated.
+  ExpectMatches("InOrder",
+                Parse("InOrder", "leaf_map { key: 'k' value { a: 1 } }")
+                        ->SerializeAsString() +
+                    Parse("InOrder", "leaf_map { key: 'k' value {} }")
+                        ->SerializeAsString(),
+                false);
+}
+
+TEST_F(StreamingDefaultValueObjectWriterDiffTest, PackedInAny) {
+  // The fields of an empty packed message get no defaults.
+  ExpectSameXml(*PackInAny(*Parse("InOrder", "")));
+  ExpectSameXml(*PackInAny(*Parse("InOrder", "leaf { b: 'x' } name: 'y'")));
+  // The packed type can be anything, so types reaching Any do not match.
+  EXPECT_FALSE(Matches("WithAny"));
+  EXPECT_NE(ToXml(*PackInAny(*Parse("OutOfOrder", "early: 'e'")), false),
+            ToXml(*PackInAny(*Parse("OutOfOrder", "early: 'e'")), true));
+}
+
+TEST_F(StreamingDefaultValueObjectWriterDiffTest, OtherTypesDoNotMatch) {
+  EXPECT_FALSE(Matches("OutOfOrder"));
+  EXPECT_FALSE(Matches("OutOfOrderInMap"));
+  EXPECT_FALSE(Matches("WithTimestamp"));
+
+  // DefaultValueObjectWriter writes fields in declaration order, and fields
+  // rendered as values after the others.
+  std::unique_ptr<Message> out_of_order =
+      Parse("OutOfOrder", "early: 'e' mid: 1 leaf {}");
+  EXPECT_NE(ToXml(*out_of_order, false), ToXml(*out_of_order, true));
+  std::unique_ptr<Message> with_timestamp =
+      Parse("WithTimestamp", "time { seconds: 1 } y: 2");
+  EXPECT_NE(ToXml(*with_timestamp, false), ToXml(*with_timestamp, true));
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,169 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <google/protobuf/util/internal/xml_incremental_printer.h>
+
+#include <google/protobuf/wire_format_lite.h>
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/util/internal/xml_well_known_types.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+using ::google::protobuf::internal::WireFormatLite;
+
+namespace {
+
+const uint8_t* Bytes(StringPiece binary) {
+  return reinterpret_cast<const uint8_t*>(binary.data());
+}
+
+int Size(StringPiece binary) { return static_cast<int>(binary.size()); }
+
+}  // namespace
+
+XmlIncrementalPrinter::XmlIncrementalPrinter(
+    TypeResolver* resolver, const google::protobuf::Type& type,
+    const Options& options, StringPiece binary)
+    : type_(type),
+      binary_(binary),
+      walker_(resolver, type, options.walker_options),
+      pending_offset_(0),
+      output_stream_(&pending_),
+      out_(&output_stream_),
+      writer_(options.indent_string, &out_),
+      position_(0),
+      list_tag_(0),
+      started_(false),
+      finished_(false) {
+  GOOGLE_CHECK_LE(binary.size(),
+                  static_cast<size_t>(std::numeric_limits<int>::max()));
+  // Gives back the buffer the stream has taken ahead of any output.
+  out_.Trim();
+}
+
+XmlIncrementalPrinter::~XmlIncrementalPrinter() {
+  // A printer may be dropped before the end, e.g. when the connection it
+  // serves is closed. The writer is closed into the discarded buffer.
+  if (status_.ok() && started_ && !finished_) {
+    if (list_tag_ != 0) writer_.EndList();
+    writer_.EndObject();
+  }
+}
+
+util::Status XmlIncrementalPrinter::Step(size_t max_output_bytes,
+                                         std::string* output) {
+  GOOGLE_CHECK_GT(max_output_bytes, 0);
+  size_t remaining = max_output_bytes;
+  while (remaining > 0 && status_.ok()) {
+    if (pending_offset_ == pending_.size()) {
+      if (finished_) break;
+      pending_.clear();
+      pending_offset_ = 0;
+      // The stream's byte count only goes up between two clears.
+      const int64_t start = out_.ByteCount();
+      while (status_.ok() && !finished_ &&
+             static_cast<size_t>(out_.ByteCount() - start) < remaining) {
+        status_ = RenderPiece();
+      }
+      out_.Trim();
+      if (!status_.ok()) break;
+    }
+    const size_t length =
+        std::min(remaining, pending_.size() - pending_offset_);
+    output->append(pending_, pending_offset_, length);
+    pending_offset_ += length;
+    remaining -= length;
+  }
+  return status_;
+}
+
+util::Status XmlIncrementalPrinter::RenderPiece() {
+  if (!started_) {
+    started_ = true;
+    if (GetXmlWellKnownType(type_) != XML_NOT_WELL_KNOWN) {
+      // Renders as a scalar or a list, in one piece.
+      finished_ = true;
+      io::CodedInputStream input(Bytes(binary_), Size(binary_));
+      return walker_.WriteTo(&input, &writer_);
+    }
+    writer_.StartObject("");
+    return util::Status();
+  }
+  if (position_ == binary_.size()) {
+    if (list_tag_ != 0) writer_.EndList();
+    writer_.EndObject();
+    finished_ = true;
+    return util::Status();
+  }
+
+  const StringPiece rest = binary_.substr(position_);
+  io::CodedInputStream input(Bytes(rest), Size(rest));
+  const uint32_t tag = input.ReadTag();
+  if (list_tag_ != 0 && tag != list_tag_) {
+    writer_.EndList();
+    list_tag_ = 0;
+  }
+  if (list_tag_ == 0 && !walker_.SplittableListName(tag).empty()) {
+    writer_.StartList(walker_.SplittableListName(tag));
+    list_tag_ = tag;
+  }
+  // The piece ends after one item of a list, and otherwise after the last
+  // consecutive value of the field. Malformed input is left to the walker to
+  // report, together with the rest of the message.
+  size_t end = binary_.size();
+  if (tag != 0) {
+    uint32_t next_tag = tag;
+    while (next_tag == tag && WireFormatLite::SkipField(&input, tag)) {
+      end = position_ + static_cast<size_t>(input.CurrentPosition());
+      if (list_tag_ != 0) break;
+      next_tag = input.ReadTag();
+    }
+  }
+  const StringPiece piece = binary_.substr(position_, end - position_);
+  position_ = end;
+  io::CodedInputStream piece_input(Bytes(piece), Size(piece));
+  return list_tag_ != 0
+             ? walker_.WriteListItems(&piece_input, list_tag_, &writer_)
+             : walker_.WriteFields(&piece_input, &writer_);
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
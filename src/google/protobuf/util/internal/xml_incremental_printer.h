@@ -0,0 +1,137 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_INCREMENTAL_PRINTER_H__
+#define GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_INCREMENTAL_PRINTER_H__
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/type.pb.h>
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/stringpiece.h>
+#include <google/protobuf/util/internal/xml_objectwriter.h>
+#include <google/protobuf/util/internal/xml_wire_walker.h>
+#include <google/protobuf/util/type_resolver.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// clang-format off
+#include <google/protobuf/port_def.inc>
+// clang-format on
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// Converts one message from binary to XML a step at a time, producing exactly
+// the XML an XmlWireWalker writes to an XmlObjectWriter, so that a caller
+// that must not block for long, e.g. an event loop serving other connections,
+// can convert a large message in slices.
+//
+// The message is rendered piece by piece into a buffer kept between steps,
+// together with the XmlObjectWriter and the position in the binary. A piece
+// is the consecutive values of one top-level field, or one item of a
+// top-level repeated message field, e.g. one person of an address book. A
+// step renders pieces until it has enough XML, so the work done by a step is
+// bounded by its output plus the largest piece.
+//
+// Sample usage:
+//   XmlIncrementalPrinter printer(resolver, type, options, binary);
+//   while (!printer.done()) {
+//     std::string chunk;
+//     util::Status status = printer.Step(64 * 1024, &chunk);
+//     if (!status.ok()) return status;
+//     Send(chunk);
+//   }
+class PROTOBUF_EXPORT XmlIncrementalPrinter {
+ public:
+  struct Options {
+    XmlWireWalker::Options walker_options;
+    // Passed to the XmlObjectWriter.
+    std::string indent_string;
+  };
+
+  // |resolver|, |type| and |binary|, a message of type |type|, must outlive
+  // the printer.
+  XmlIncrementalPrinter(TypeResolver* resolver,
+                        const google::protobuf::Type& type,
+                        const Options& options, StringPiece binary);
+  ~XmlIncrementalPrinter();
+
+  // Appends the next at most |max_output_bytes| bytes of the XML to |output|,
+  // and fewer only at the end. Fails where a single walker fails; the XML
+  // returned by earlier steps is then incomplete, and so are the steps after.
+  util::Status Step(size_t max_output_bytes, std::string* output);
+
+  // Whether all of the XML has been returned, or a step has failed.
+  bool done() const {
+    return !status_.ok() || (finished_ && pending_offset_ == pending_.size());
+  }
+
+ private:
+  // Renders the next piece of the message into pending_.
+  util::Status RenderPiece();
+
+  const google::protobuf::Type& type_;
+  const StringPiece binary_;
+  XmlWireWalker walker_;
+
+  // XML rendered but not yet returned starts at pending_offset_.
+  std::string pending_;
+  size_t pending_offset_;
+  io::StringOutputStream output_stream_;
+  io::CodedOutputStream out_;
+  XmlObjectWriter writer_;
+
+  // Offset of the next piece in binary_.
+  size_t position_;
+  // Tag of the top-level list open in writer_, or 0.
+  uint32_t list_tag_;
+  bool started_;
+  // Whether the whole message has been rendered.
+  bool finished_;
+  util::Status status_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(XmlIncrementalPrinter);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_INCREMENTAL_PRINTER_H__
@@ -0,0 +1,198 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <google/protobuf/util/internal/xml_incremental_printer.h>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/internal/xml_objectwriter.h>
+#include <google/protobuf/util/internal/xml_wire_walker.h>
+#include <google/protobuf/util/json_format_proto3.pb.h>
+#include <google/protobuf/util/type_resolver.h>
+#include <google/protobuf/util/type_resolver_util.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+namespace {
+
+using ::proto3::TestMessage;
+using ::proto3::TestTimestamp;
+
+const char kTypeUrlPrefix[] = "type.googleapis.com";
+
+// The steps must add up to exactly what a single XmlWireWalker produces, so
+// every test converts the same binary both ways and compares.
+class XmlIncrementalPrinterTest : public ::testing::Test {
+ protected:
+  XmlIncrementalPrinterTest()
+      : resolver_(NewTypeResolverForDescriptorPool(
+            kTypeUrlPrefix, DescriptorPool::generated_pool())) {}
+
+  google::protobuf::Type ResolveType(const Descriptor* descriptor) {
+    google::protobuf::Type type;
+    EXPECT_TRUE(resolver_
+                    ->ResolveMessageType(
+                        StrCat(kTypeUrlPrefix, "/", descriptor->full_name()),
+                        &type)
+                    .ok());
+    return type;
+  }
+
+  void ExpectSameXml(const Descriptor* descriptor, const std::string& binary) {
+    const google::protobuf::Type type = ResolveType(descriptor);
+    for (const char* indent : {"", " "}) {
+      std::string expected;
+      util::Status expected_status;
+      {
+        XmlWireWalker walker(resolver_.get(), type, XmlWireWalker::Options());
+        io::CodedInputStream input(
+            reinterpret_cast<const uint8_t*>(binary.data()),
+            static_cast<int>(binary.size()));
+        io::StringOutputStream output_stream(&expected);
+        io::CodedOutputStream out(&output_stream);
+        XmlObjectWriter writer(indent, &out);
+        expected_status = walker.WriteTo(&input, &writer);
+      }
+      for (size_t step : {1, 7, 100, 1 << 20}) {
+        XmlIncrementalPrinter::Options options;
+        options.indent_string = indent;
+        XmlIncrementalPrinter printer(resolver_.get(), type, options, binary);
+        // Appended to what is there.
+        std::string actual = "<!---->";
+        util::Status status;
+        while (!printer.done()) {
+          const size_t size = actual.size();
+          status = printer.Step(step, &actual);
+          if (!status.ok()) break;
+          // Only the last step may be short.
+          if (!printer.done()) {
+            EXPECT_EQ(step, actual.size() - size) << step;
+          }
+          EXPECT_LE(actual.size() - size, step) << step;
+        }
+        EXPECT_EQ(expected_status.ok(), status.ok()) << step;
+        if (expected_status.ok()) {
+          EXPECT_EQ("<!---->" + expected, actual) << step;
+        }
+      }
+    }
+  }
+
+  static TestMessage ManyItems(int count) {
+    TestMessage message;
+    message.set_int32_value(7);
+    message.set_string_value("before");
+    for (int i = 0; i < count; ++i) {
+      message.add_repeated_message_value()->set_value(i * 1000);
+      message.add_repeated_string_value(StrCat("s", i));
+    }
+    message.add_repeated_message_value();
+    message.mutable_message_value()->set_value(1);
+    return message;
+  }
+
+  std::unique_ptr<TypeResolver> resolver_;
+};
+
+TEST_F(XmlIncrementalPrinterTest, EmptyMessage) {
+  ExpectSameXml(TestMessage::descriptor(), "");
+}
+
+TEST_F(XmlIncrementalPrinterTest, RepeatedMessages) {
+  for (int count : {1, 2, 3, 10, 1000}) {
+    ExpectSameXml(TestMessage::descriptor(),
+                  ManyItems(count).SerializeAsString());
+  }
+}
+
+TEST_F(XmlIncrementalPrinterTest, SeparateRunsOfOneField) {
+  // The same field twice, with other fields in between and after: two lists.
+  TestMessage before = ManyItems(20);
+  TestMessage between;
+  between.set_bool_value(true);
+  for (int i = 0; i < 50; ++i) {
+    between.add_repeated_message_value()->set_value(-i);
+  }
+  const std::string binary = before.SerializeAsString() +
+                             between.SerializeAsString() +
+                             before.SerializeAsString();
+  ExpectSameXml(TestMessage::descriptor(), binary);
+}
+
+TEST_F(XmlIncrementalPrinterTest, WellKnownTypes) {
+  TestTimestamp message;
+  for (int i = 0; i < 100; ++i) {
+    message.add_repeated_value()->set_seconds(i * 86400);
+  }
+  ExpectSameXml(TestTimestamp::descriptor(), message.SerializeAsString());
+}
+
+TEST_F(XmlIncrementalPrinterTest, StepsAreBounded) {
+  const std::string binary = ManyItems(1000).SerializeAsString();
+  const google::protobuf::Type type = ResolveType(TestMessage::descriptor());
+  XmlIncrementalPrinter printer(resolver_.get(), type,
+                                XmlIncrementalPrinter::Options(), binary);
+  std::string xml;
+  ASSERT_TRUE(printer.Step(100, &xml).ok());
+  EXPECT_EQ(100, xml.size());
+  EXPECT_FALSE(printer.done());
+}
+
+TEST_F(XmlIncrementalPrinterTest, Errors) {
+  const std::string binary = ManyItems(100).SerializeAsString();
+  // Cut in the middle of the items.
+  ExpectSameXml(TestMessage::descriptor(), binary.substr(0, binary.size() / 2));
+
+  // A bad item among good ones.
+  TestMessage message;
+  for (int i = 0; i < 10; ++i) {
+    message.add_repeated_message_value()->set_value(i);
+  }
+  std::string bad = message.SerializeAsString();
+  // The last item's value becomes a length delimited field overrunning it.
+  bad[bad.size() - 2] = 0x0a;
+  ExpectSameXml(TestMessage::descriptor(), bad + message.SerializeAsString());
+}
+
+}  // namespace
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,261 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <google/protobuf/util/internal/xml_parallel_printer.h>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/util/internal/xml_objectwriter.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+using ::google::protobuf::internal::WireFormatLite;
+
+namespace {
+
+const uint8_t* Bytes(StringPiece binary) {
+  return reinterpret_cast<const uint8_t*>(binary.data());
+}
+
+int Size(StringPiece binary) { return static_cast<int>(binary.size()); }
+
+// The XML of a range of list items, written by a thread of its own. Only the
+// bytes [begin, end) of xml belong to the items.
+struct Piece {
+  std::string xml;
+  int64_t begin;
+  int64_t end;
+  util::Status status;
+
+  Piece() : begin(0), end(0) {}
+};
+
+// Writes |items|, values of the top-level field with |tag| listed as |name|,
+// into |piece| as they render in the middle of their list.
+void WriteListItems(TypeResolver* resolver,
+                    const google::protobuf::Type* type,
+                    const XmlParallelPrinter::Options* options, uint32_t tag,
+                    const std::string& name, StringPiece items, Piece* piece) {
+  XmlWireWalker walker(resolver, *type, options->walker_options);
+  io::StringOutputStream output_stream(&piece->xml);
+  io::CodedOutputStream out(&output_stream);
+  XmlObjectWriter writer(options->indent_string, &out);
+  // Leaves the writer as it is after the first item of the list.
+  writer.StartObject("")->StartList(name)->StartObject("")->EndObject();
+  piece->begin = out.ByteCount();
+  io::CodedInputStream input(Bytes(items), Size(items));
+  piece->status = walker.WriteListItems(&input, tag, &writer);
+  piece->end = out.ByteCount();
+  if (piece->status.ok()) writer.EndList()->EndObject();
+}
+
+// The body of a thread: WriteListItems(), with exceptions turned into the
+// status of |piece|, since they cannot cross into the calling thread.
+void PrintListItems(TypeResolver* resolver,
+                    const google::protobuf::Type* type,
+                    const XmlParallelPrinter::Options* options, uint32_t tag,
+                    std::string name, StringPiece items, Piece* piece) {
+#if PROTOBUF_USE_EXCEPTIONS
+  try {
+    WriteListItems(resolver, type, options, tag, name, items, piece);
+  } catch (const std::bad_alloc&) {
+    piece->status =
+        util::ResourceExhaustedError("Out of memory writing list items.");
+  } catch (...) {
+    piece->status = util::InternalError("Exception writing list items.");
+  }
+#else
+  WriteListItems(resolver, type, options, tag, name, items, piece);
+#endif
+}
+
+// Joins its threads on destruction, also when an exception leaves the
+// calling thread's share of the work.
+class ThreadGroup {
+ public:
+  explicit ThreadGroup(size_t size) { threads_.reserve(size); }
+  ~ThreadGroup() { Join(); }
+
+  template <typename... Args>
+  void Start(Args&&... args) {
+    threads_.emplace_back(std::forward<Args>(args)...);
+  }
+
+  void Join() {
+    for (std::thread& thread : threads_) {
+      if (thread.joinable()) thread.join();
+    }
+  }
+
+ private:
+  std::vector<std::thread> threads_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ThreadGroup);
+};
+
+}  // namespace
+
+XmlParallelPrinter::XmlParallelPrinter(TypeResolver* resolver,
+                                       const google::protobuf::Type& type,
+                                       const Options& options)
+    : resolver_(resolver),
+      type_(type),
+      options_(options),
+      walker_(resolver, type, options.walker_options) {}
+
+XmlParallelPrinter::~XmlParallelPrinter() {}
+
+util::Status XmlParallelPrinter::Print(StringPiece binary,
+                                       std::string* output) {
+  GOOGLE_CHECK_LE(binary.size(),
+                  static_cast<size_t>(std::numeric_limits<int>::max()));
+  Run run;
+  if (options_.max_threads <= 1 || !FindRun(binary, &run)) {
+    return PrintSerially(binary, output);
+  }
+  const int64_t run_size = static_cast<int64_t>(run.end - run.begin);
+  const int ranges = static_cast<int>(std::min<int64_t>(
+      options_.max_threads,
+      run_size / std::max<int64_t>(1, options_.min_bytes_per_thread)));
+  if (ranges <= 1) return PrintSerially(binary, output);
+
+  // Cuts the run at the first item boundaries past equal shares of it.
+  std::vector<size_t> bounds;
+  bounds.push_back(run.begin);
+  {
+    const StringPiece items = binary.substr(run.begin, run_size);
+    io::CodedInputStream input(Bytes(items), Size(items));
+    for (uint32_t tag = input.ReadTag(); tag != 0; tag = input.ReadTag()) {
+      WireFormatLite::SkipField(&input, tag);
+      const int64_t position = input.CurrentPosition();
+      if (position < run_size &&
+          position * ranges >= run_size * static_cast<int64_t>(bounds.size())) {
+        bounds.push_back(run.begin + position);
+      }
+    }
+  }
+  bounds.push_back(run.end);
+
+  std::vector<Piece> pieces(bounds.size() - 2);
+  ThreadGroup threads(pieces.size());
+  const std::string name(run.name.data(), run.name.size());
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    const StringPiece items =
+        binary.substr(bounds[i + 1], bounds[i + 2] - bounds[i + 1]);
+    threads.Start(PrintListItems, resolver_, &type_, &options_, run.tag, name,
+                  items, &pieces[i]);
+  }
+
+  io::StringOutputStream output_stream(output);
+  io::CodedOutputStream out(&output_stream);
+  XmlObjectWriter writer(options_.indent_string, &out);
+  writer.StartObject("");
+  const StringPiece head = binary.substr(0, run.begin);
+  io::CodedInputStream head_input(Bytes(head), Size(head));
+  util::Status status = walker_.WriteFields(&head_input, &writer);
+  if (status.ok()) {
+    writer.StartList(run.name);
+    const StringPiece first = binary.substr(bounds[0], bounds[1] - bounds[0]);
+    io::CodedInputStream first_input(Bytes(first), Size(first));
+    status = walker_.WriteListItems(&first_input, run.tag, &writer);
+  }
+  threads.Join();
+  for (const Piece& piece : pieces) {
+    if (!status.ok()) break;
+    out.WriteRaw(piece.xml.data() + piece.begin,
+                 static_cast<int>(piece.end - piece.begin));
+    status = piece.status;
+  }
+  if (status.ok()) {
+    writer.EndList();
+    const StringPiece tail = binary.substr(run.end);
+    io::CodedInputStream tail_input(Bytes(tail), Size(tail));
+    status = walker_.WriteFields(&tail_input, &writer);
+  }
+  if (status.ok()) writer.EndObject();
+  return status;
+}
+
+bool XmlParallelPrinter::FindRun(StringPiece binary, Run* run) {
+  io::CodedInputStream input(Bytes(binary), Size(binary));
+  uint32_t run_tag = 0;
+  size_t run_begin = 0;
+  size_t position = 0;
+  for (;;) {
+    const uint32_t tag = input.ReadTag();
+    if (tag != run_tag) {
+      if (run_tag != 0 && position - run_begin > run->end - run->begin) {
+        const StringPiece name = walker_.SplittableListName(run_tag);
+        if (!name.empty()) {
+          run->tag = run_tag;
+          run->name = name;
+          run->begin = run_begin;
+          run->end = position;
+        }
+      }
+      run_tag = tag;
+      run_begin = position;
+    }
+    if (tag == 0) break;
+    // Malformed input is left for a single walker to report.
+    if (!WireFormatLite::SkipField(&input, tag)) return false;
+    position = static_cast<size_t>(input.CurrentPosition());
+  }
+  return position == binary.size() && run->tag != 0;
+}
+
+util::Status XmlParallelPrinter::PrintSerially(StringPiece binary,
+                                               std::string* output) {
+  io::StringOutputStream output_stream(output);
+  io::CodedOutputStream out(&output_stream);
+  XmlObjectWriter writer(options_.indent_string, &out);
+  io::CodedInputStream input(Bytes(binary), Size(binary));
+  return walker_.WriteTo(&input, &writer);
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
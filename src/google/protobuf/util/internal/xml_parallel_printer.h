@@ -0,0 +1,132 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_PARALLEL_PRINTER_H__
+#define GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_PARALLEL_PRINTER_H__
+
+#include <google/protobuf/type.pb.h>
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/stringpiece.h>
+#include <google/protobuf/util/internal/xml_wire_walker.h>
+#include <google/protobuf/util/type_resolver.h>
+
+#include <cstdint>
+#include <string>
+
+// clang-format off
+#include <google/protobuf/port_def.inc>
+// clang-format on
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// Converts one message from binary to XML on several threads, producing
+// exactly the XML an XmlWireWalker writes to an XmlObjectWriter.
+//
+// The top-level fields are scanned first, which is cheap since every length
+// is in the wire data. The longest run of consecutive values of a top-level
+// repeated message field, e.g. the people of an address book, is cut at item
+// boundaries into ranges of about equal size. Each range but the first is
+// written by its own thread, walker and writer into a separate buffer, while
+// the calling thread writes the fields before the run and the first range.
+// The buffers are then copied in order between the first range and the end
+// of the list. An item other than the first of its list renders the same
+// whatever precedes it, so the result is what a single walker writes.
+//
+// Messages without such a run, or whose run is too short to be worth the
+// threads, are converted by a single walker on the calling thread.
+//
+// Sample usage:
+//   XmlParallelPrinter::Options options;
+//   options.max_threads = 8;
+//   XmlParallelPrinter printer(resolver, type, options);
+//   util::Status status = printer.Print(binary, &output);
+class PROTOBUF_EXPORT XmlParallelPrinter {
+ public:
+  struct Options {
+    XmlWireWalker::Options walker_options;
+    // Passed to every XmlObjectWriter.
+    std::string indent_string;
+    // Number of threads to use, counting the calling thread.
+    int max_threads;
+    // Least number of bytes of the run each thread is given.
+    int64_t min_bytes_per_thread;
+
+    Options() : max_threads(1), min_bytes_per_thread(64 * 1024) {}
+  };
+
+  // |resolver| and |type| must outlive the printer.
+  XmlParallelPrinter(TypeResolver* resolver,
+                     const google::protobuf::Type& type,
+                     const Options& options);
+  ~XmlParallelPrinter();
+
+  // Appends the XML of |binary|, a message of the printer's type, to
+  // |output|. On failure the status is that of a single walker, but the XML
+  // appended may stop earlier than a single walker's would.
+  util::Status Print(StringPiece binary, std::string* output);
+
+ private:
+  // The longest run of a splittable list, as offsets into the binary.
+  struct Run {
+    uint32_t tag;
+    StringPiece name;
+    size_t begin;
+    size_t end;
+
+    Run() : tag(0), begin(0), end(0) {}
+  };
+
+  // Finds the run to split, returning false if there is none.
+  bool FindRun(StringPiece binary, Run* run);
+  // Appends the XML of |binary| using a single walker.
+  util::Status PrintSerially(StringPiece binary, std::string* output);
+
+  TypeResolver* resolver_;
+  const google::protobuf::Type& type_;
+  const Options options_;
+  // Used by the calling thread.
+  XmlWireWalker walker_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(XmlParallelPrinter);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_PARALLEL_PRINTER_H__
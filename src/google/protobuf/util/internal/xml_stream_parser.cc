@@ -170,7 +170,10 @@ XmlStreamParser::XmlStreamParser(ObjectWriter* ow)
       text_(),
       tag_name_(),
       tag_name_stack_(),
-      element_type_stack_() {
+      element_type_stack_(),
+      stats_(nullptr),
+      bytes_received_(0),
+      chunk_end_(0) {
   // Initialize the stack with a single value to be parsed.
   stack_.push(BEGIN_ELEMENT);
 }
@@ -178,6 +181,20 @@ XmlStreamParser::XmlStreamParser(ObjectWriter* ow)
 XmlStreamParser::~XmlStreamParser() {}
 
 util::Status XmlStreamParser::Parse(StringPiece xml) {
+  bytes_received_ += xml.size();
+  if (stats_ == nullptr) return ParseWithLeftover(xml);
+  const size_t capacity = StorageCapacity();
+  util::Status status = ParseWithLeftover(xml);
+  const size_t new_capacity = StorageCapacity();
+  if (new_capacity > capacity) {
+    ++stats_->buffer_growths;
+    stats_->storage_high_water = std::max(
+        stats_->storage_high_water, static_cast<int64_t>(new_capacity));
+  }
+  return status;
+}
+
+util::Status XmlStreamParser::ParseWithLeftover(StringPiece xml) {
   StringPiece chunk = xml;
   // If we have leftovers from a previous chunk, append the new chunk to it
   // and create a new StringPiece pointing at the string's data. This could
@@ -188,6 +205,7 @@ util::Status XmlStreamParser::Parse(StringPiece xml) {
     // ParseChunk(chunk).
     chunk_storage_.swap(leftover_);
     StrAppend(&chunk_storage_, xml);
+    if (stats_ != nullptr) stats_->leftover_bytes_copied += xml.size();
     chunk = StringPiece(chunk_storage_);
   }
 
@@ -195,14 +213,17 @@ util::Status XmlStreamParser::Parse(StringPiece xml) {
   // Find the structurally valid UTF8 prefix and parse only that.
   int n = internal::UTF8SpnStructurallyValid(chunk);
   if (n > 0) {
+    chunk_end_ = bytes_received_ - static_cast<int64_t>(chunk.size() - n);
     util::Status status = ParseChunk(chunk.substr(0, n));
 
     // Any leftover characters are stashed in leftover_ for later parsing when
     // there is more data available.
     StrAppend(&leftover_, chunk.substr(n));
+    if (stats_ != nullptr) stats_->leftover_bytes_copied += chunk.size() - n;
     return status;
   } else {
     leftover_.assign(chunk.data(), chunk.size());
+    if (stats_ != nullptr) stats_->leftover_bytes_copied += chunk.size();
     return util::Status();
   }
 }
@@ -237,6 +258,7 @@ util::Status XmlStreamParser::FinishParse() {
   // Parse the remainder in finishing mode, which reports errors for things like
   // unterminated strings or unknown tokens that would normally be retried.
   finishing_ = true;
+  chunk_end_ = bytes_received_;
   util::Status result = RunParser();
   if (result.ok()) {
     SkipWhitespace();
@@ -274,6 +296,7 @@ util::Status XmlStreamParser::ParseChunk(StringPiece chunk) {
     // If we expect future data i.e. stack is non-empty, and we have some
     // unparsed data left, we save it for later parse.
     leftover_ = std::string(p_);
+    if (stats_ != nullptr) stats_->leftover_bytes_copied += p_.size();
   }
   return util::Status();
 }
@@ -341,10 +364,12 @@ util::Status XmlStreamParser::RunParser() {
       // If we were cancelled, save our state and try again later.
       if (!finishing_ && util::IsCancelled(result)) {
         stack_.push(type);
+        if (stats_ != nullptr) ++stats_->resumptions;
         // If we have a key we still need to render, make sure to save off the
         // contents in our own storage.
         if (!key_.empty() && key_storage_.empty()) {
           StrAppend(&key_storage_, key_);
+          if (stats_ != nullptr) stats_->leftover_bytes_copied += key_.size();
           key_ = StringPiece(key_storage_);
         }
         result = util::Status();
@@ -837,6 +862,9 @@ util::Status XmlStreamParser::ParseStringHelper() {
       // We're about to handle an escape, copy all bytes from last to data.
       if (last < data) {
         parsed_storage_.append(last, data - last);
+        if (stats_ != nullptr) {
+          stats_->parsed_storage_bytes_copied += data - last;
+        }
       }
       // If we ran out of string after the \, cancel or report an error
       // depending on if we expect more data later.
@@ -880,6 +908,7 @@ util::Status XmlStreamParser::ParseStringHelper() {
         default:
           parsed_storage_.push_back(data[1]);
       }
+      if (stats_ != nullptr) ++stats_->parsed_storage_bytes_copied;
       // We handled two characters, so advance past them and continue.
       p_.remove_prefix(2);
       last = p_.data();
@@ -893,6 +922,9 @@ util::Status XmlStreamParser::ParseStringHelper() {
       } else {
         if (last < data) {
           parsed_storage_.append(last, data - last);
+          if (stats_ != nullptr) {
+            stats_->parsed_storage_bytes_copied += data - last;
+          }
         }
         parsed_ = StringPiece(parsed_storage_);
       }
@@ -908,6 +940,9 @@ util::Status XmlStreamParser::ParseStringHelper() {
   // If we ran out of characters, copy over what we have so far.
   if (last < p_.data()) {
     parsed_storage_.append(last, p_.data() - last);
+    if (stats_ != nullptr) {
+      stats_->parsed_storage_bytes_copied += p_.data() - last;
+    }
   }
   // If we didn't find the closing quote but we expect more data, cancel for
   // now
@@ -991,6 +1026,7 @@ util::Status XmlStreamParser::ParseUnicodeEscape() {
   // Advance past the [final] code unit escape.
   p_.remove_prefix(kUnicodeEscapedLength);
   parsed_storage_.append(buf, len);
+  if (stats_ != nullptr) stats_->parsed_storage_bytes_copied += len;
   return util::Status();
 }
 
@@ -1068,6 +1104,11 @@ void XmlStreamParser::Advance() {
       p_.length(), UTF8FirstLetterNumBytes(p_.data(), p_.length())));
 }
 
+size_t XmlStreamParser::StorageCapacity() const {
+  return leftover_.capacity() + chunk_storage_.capacity() +
+         key_storage_.capacity() + parsed_storage_.capacity();
+}
+
 XmlStreamParser::TokenType XmlStreamParser::GetNextTokenType(ParseType type) {
   SkipWhitespace(type);
 
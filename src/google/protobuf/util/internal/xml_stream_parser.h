@@ -89,6 +89,43 @@ class PROTOBUF_EXPORT XmlStreamParser {
     max_recursion_depth_ = max_depth;
   }
 
+  // Counters describing the extra work done when tokens straddle chunk
+  // boundaries or strings need unescaping. They are only updated on those
+  // slow paths, and only when a struct has been given to set_stats().
+  struct Stats {
+    // Bytes copied into leftover_/chunk_storage_/key_storage_ to carry
+    // unparsed input over to the next chunk.
+    int64_t leftover_bytes_copied;
+    // Bytes copied into parsed_storage_.
+    int64_t parsed_storage_bytes_copied;
+    // Number of times parsing stopped mid-token and was resumed later.
+    int64_t resumptions;
+    // Number of Parse() calls during which the internal storage grew.
+    int64_t buffer_growths;
+    // Largest combined capacity of the internal storage after any Parse()
+    // call. Bounded by the largest token and chunk, not by the input size.
+    int64_t storage_high_water;
+
+    Stats()
+        : leftover_bytes_copied(0),
+          parsed_storage_bytes_copied(0),
+          resumptions(0),
+          buffer_growths(0),
+          storage_high_water(0) {}
+  };
+
+  // Adds the counters of the following Parse() and FinishParse() calls to
+  // |stats|, which must outlive them. When null, the default, none of the
+  // counting code runs.
+  void set_stats(Stats* stats) { stats_ = stats; }
+
+  // Offset, counted over all Parse() calls, of the first input byte the
+  // parser has not consumed yet. Meant to be called from the ObjectWriter
+  // while it receives an event, to attribute input bytes to events.
+  int64_t position() const {
+    return chunk_end_ - static_cast<int64_t>(p_.size());
+  }
+
   // Denotes the cause of error.
   enum ParseErrorType {
     INVALID_KEY,
@@ -179,6 +216,10 @@ class PROTOBUF_EXPORT XmlStreamParser {
     LIST,
   };
 
+  // Does the work of Parse(), prepending any leftover from the previous
+  // chunk to xml.
+  util::Status ParseWithLeftover(StringPiece xml);
+
   // Parses a single chunk of XML, returning an error if the XML was invalid.
   util::Status ParseChunk(StringPiece chunk);
 
@@ -262,6 +303,9 @@ class PROTOBUF_EXPORT XmlStreamParser {
   // Advance p_ one UTF-8 character
   void Advance();
 
+  // Returns the total capacity of the strings owned by the parser.
+  size_t StorageCapacity() const;
+
   // Return the type of the next token at p_.
   TokenType GetNextTokenType(ParseType type);
 
@@ -339,6 +383,14 @@ class PROTOBUF_EXPORT XmlStreamParser {
 
   std::stack<ElementType> element_type_stack_;
 
+  // Not owned; may be null.
+  Stats* stats_;
+
+  // Total bytes passed to Parse(), and the input offset of the end of the
+  // chunk RunParser() is working on.
+  int64_t bytes_received_;
+  int64_t chunk_end_;
+
   GOOGLE_DISALLOW_IMPLICIT_CONSTRUCTORS(XmlStreamParser);
 };
 
@@ -38,6 +38,8 @@
 #include <gtest/gtest.h>
 
 #include <cstdint>
+#include <string>
+#include <vector>
 
 namespace google {
 namespace protobuf {
@@ -905,6 +907,141 @@ TEST_F(XmlStreamParserTest, DeepNestXmlExceedLimit) {
               "Message too deep. Max recursion depth reached for tag 'nest23'");
 }
 
+TEST_F(XmlStreamParserTest, SlowPathStatsAreZeroForSingleChunk) {
+  StringPiece str = "<root test=\"Some String\"></root>";
+  ow_.StartObject("")->RenderString("test", "Some String")->EndObject();
+  XmlStreamParser parser(&mock_);
+  XmlStreamParser::Stats stats;
+  parser.set_stats(&stats);
+  EXPECT_TRUE(parser.Parse(str).ok());
+  EXPECT_TRUE(parser.FinishParse().ok());
+  EXPECT_EQ(0, stats.leftover_bytes_copied);
+  EXPECT_EQ(0, stats.parsed_storage_bytes_copied);
+  EXPECT_EQ(0, stats.resumptions);
+}
+
+TEST_F(XmlStreamParserTest, SlowPathStatsCountSplitString) {
+  StringPiece str = "<root test=\"Some String\"></root>";
+  ow_.StartObject("")->RenderString("test", "Some String")->EndObject();
+  XmlStreamParser parser(&mock_);
+  XmlStreamParser::Stats stats;
+  parser.set_stats(&stats);
+  // Split right after "Some" so the attribute value straddles both chunks.
+  EXPECT_TRUE(parser.Parse(str.substr(0, 16)).ok());
+  EXPECT_TRUE(parser.Parse(str.substr(16)).ok());
+  EXPECT_TRUE(parser.FinishParse().ok());
+  EXPECT_EQ(11, stats.parsed_storage_bytes_copied);
+  EXPECT_LE(1, stats.resumptions);
+  // The pending attribute key is kept across the chunk boundary.
+  EXPECT_LE(4, stats.leftover_bytes_copied);
+}
+
+TEST_F(XmlStreamParserTest, StorageHighWaterIsBoundedByChunkSize) {
+  const int kItems = 2000;
+  std::string str = "<root><_list_test>";
+  ow_.StartObject("")->StartList("test");
+  for (int i = 0; i < kItems; ++i) {
+    str += "<test>value</test>";
+    ow_.StartObject("")->RenderString("", "value")->EndObject();
+  }
+  str += "</_list_test></root>";
+  ow_.EndList()->EndObject();
+  XmlStreamParser parser(&mock_);
+  XmlStreamParser::Stats stats;
+  parser.set_stats(&stats);
+  // Every token straddles some chunk boundary, yet the storage only ever
+  // holds one token and one chunk.
+  for (size_t i = 0; i < str.size(); i += 7) {
+    EXPECT_TRUE(parser.Parse(StringPiece(str).substr(i, 7)).ok());
+  }
+  EXPECT_TRUE(parser.FinishParse().ok());
+  EXPECT_LT(0, stats.storage_high_water);
+  EXPECT_GE(256, stats.storage_high_water);
+}
+
+// Records the parser position at every event it receives.
+class PositionRecordingObjectWriter : public ObjectWriter {
+ public:
+  PositionRecordingObjectWriter() : parser_(nullptr) {}
+
+  void set_parser(const XmlStreamParser* parser) { parser_ = parser; }
+  const std::vector<int64_t>& positions() const { return positions_; }
+
+  ObjectWriter* StartObject(StringPiece name) override { return Record(); }
+  ObjectWriter* EndObject() override { return Record(); }
+  ObjectWriter* StartList(StringPiece name) override { return Record(); }
+  ObjectWriter* EndList() override { return Record(); }
+  ObjectWriter* RenderBool(StringPiece name, bool value) override {
+    return Record();
+  }
+  ObjectWriter* RenderInt32(StringPiece name, int32_t value) override {
+    return Record();
+  }
+  ObjectWriter* RenderUint32(StringPiece name, uint32_t value) override {
+    return Record();
+  }
+  ObjectWriter* RenderInt64(StringPiece name, int64_t value) override {
+    return Record();
+  }
+  ObjectWriter* RenderUint64(StringPiece name, uint64_t value) override {
+    return Record();
+  }
+  ObjectWriter* RenderDouble(StringPiece name, double value) override {
+    return Record();
+  }
+  ObjectWriter* RenderFloat(StringPiece name, float value) override {
+    return Record();
+  }
+  ObjectWriter* RenderString(StringPiece name, StringPiece value) override {
+    return Record();
+  }
+  ObjectWriter* RenderBytes(StringPiece name, StringPiece value) override {
+    return Record();
+  }
+  ObjectWriter* RenderNull(StringPiece name) override { return Record(); }
+
+ private:
+  ObjectWriter* Record() {
+    positions_.push_back(parser_->position());
+    return this;
+  }
+
+  const XmlStreamParser* parser_;
+  std::vector<int64_t> positions_;
+};
+
+TEST_F(XmlStreamParserTest, PositionTracksConsumedInput) {
+  const std::string str =
+      "<root a=\"1\"><_list_b><b>xx</b><b>yyyy</b></_list_b></root>";
+  std::vector<int64_t> whole;
+  for (int chunk_size : {static_cast<int>(str.size()), 3, 1}) {
+    PositionRecordingObjectWriter writer;
+    XmlStreamParser parser(&writer);
+    writer.set_parser(&parser);
+    for (size_t i = 0; i < str.size(); i += chunk_size) {
+      EXPECT_TRUE(parser.Parse(StringPiece(str).substr(i, chunk_size)).ok());
+    }
+    EXPECT_TRUE(parser.FinishParse().ok());
+    EXPECT_EQ(static_cast<int64_t>(str.size()), parser.position());
+    const std::vector<int64_t>& positions = writer.positions();
+    ASSERT_FALSE(positions.empty());
+    for (size_t i = 0; i < positions.size(); ++i) {
+      EXPECT_LE(0, positions[i]);
+      EXPECT_GE(static_cast<int64_t>(str.size()), positions[i]);
+      if (i > 0) {
+        EXPECT_LE(positions[i - 1], positions[i]);
+      }
+    }
+    // Events are reported at the same input offsets however the input is
+    // split.
+    if (whole.empty()) {
+      whole = positions;
+    } else {
+      EXPECT_EQ(whole, positions);
+    }
+  }
+}
+
 }  // namespace converter
 }  // namespace util
 }  // namespace protobuf
@@ -0,0 +1,347 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/internal/xml_well_known_types.h>
+
+#include <google/protobuf/stubs/time.h>
+#include <google/protobuf/util/internal/constants.h>
+
+#include <cstring>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+namespace {
+
+const char kWellKnownTypePrefix[] = "google.protobuf.";
+
+struct WellKnownTypeName {
+  const char* name;
+  XmlWellKnownType type;
+};
+
+// Names without the "google.protobuf." prefix.
+const WellKnownTypeName kWellKnownTypeNames[] = {
+    {"Timestamp", XML_TIMESTAMP},     {"Duration", XML_DURATION},
+    {"DoubleValue", XML_WRAPPER},     {"FloatValue", XML_WRAPPER},
+    {"Int64Value", XML_WRAPPER},      {"UInt64Value", XML_WRAPPER},
+    {"Int32Value", XML_WRAPPER},      {"UInt32Value", XML_WRAPPER},
+    {"BoolValue", XML_WRAPPER},       {"StringValue", XML_WRAPPER},
+    {"BytesValue", XML_WRAPPER},      {"FieldMask", XML_FIELD_MASK},
+    {"Struct", XML_STRUCT},           {"Value", XML_VALUE},
+    {"ListValue", XML_LIST_VALUE},
+};
+
+// Writes |value| as exactly |width| digits, zero padded, and returns the end.
+char* WriteDigits(uint32_t value, int width, char* out) {
+  for (int i = width - 1; i >= 0; --i) {
+    out[i] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  }
+  return out + width;
+}
+
+// Writes |value| with no padding and returns the end.
+char* WriteDecimal(uint64_t value, char* out) {
+  char digits[20];
+  int size = 0;
+  do {
+    digits[size++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  while (size > 0) *out++ = digits[--size];
+  return out;
+}
+
+// Writes a fraction of a second, "." and 3, 6 or 9 digits, with as few digits
+// as |nanos| needs. |precision_nanos| picks the number of digits; it differs
+// from |nanos| only for the durations ProtoStreamObjectSource renders from
+// an int32 cast to uint32.
+char* WriteNanos(uint32_t nanos, uint32_t precision_nanos, char* out) {
+  *out++ = '.';
+  if (precision_nanos % kNanosPerMicrosecond != 0) {
+    return WriteDigits(nanos, 9, out);
+  }
+  if (precision_nanos % kNanosPerMillisecond != 0) {
+    return WriteDigits(nanos / kNanosPerMicrosecond, 6, out);
+  }
+  return WriteDigits(nanos / kNanosPerMillisecond, 3, out);
+}
+
+// Reads the string as google::protobuf::internal::ParseTime() reads a C
+// string: past the end, and at an embedded NUL, it sees a NUL.
+class TimeReader {
+ public:
+  explicit TimeReader(StringPiece value)
+      : p_(value.data()), end_(value.data() + value.size()) {}
+
+  char Peek() const { return p_ < end_ ? *p_ : '\0'; }
+
+  bool Consume(char c) {
+    if (Peek() != c) return false;
+    ++p_;
+    return true;
+  }
+
+  // Reads up to |width| digits, at least one, into a value in
+  // [min_value, max_value].
+  bool ReadInt(int width, int min_value, int max_value, int* result) {
+    if (!ascii_isdigit(Peek())) return false;
+    int value = 0;
+    for (int i = 0; i < width && ascii_isdigit(Peek()); ++i, ++p_) {
+      value = value * 10 + (*p_ - '0');
+    }
+    if (value < min_value || value > max_value) return false;
+    *result = value;
+    return true;
+  }
+
+  // Reads one or more digits, of which only the first 9 count.
+  bool ReadNanos(int32_t* nanos) {
+    if (!ascii_isdigit(Peek())) return false;
+    int32_t value = 0;
+    int length = 0;
+    for (; ascii_isdigit(Peek()); ++p_, ++length) {
+      if (length < 9) value = value * 10 + (*p_ - '0');
+    }
+    for (; length < 9; ++length) value *= 10;
+    *nanos = value;
+    return true;
+  }
+
+  // Reads "HH:MM".
+  bool ReadTimezoneOffset(int64_t* offset) {
+    int hour;
+    int minute;
+    if (!ReadInt(2, 0, 23, &hour) || !Consume(':') ||
+        !ReadInt(2, 0, 59, &minute)) {
+      return false;
+    }
+    *offset = (hour * 60 + minute) * 60;
+    return true;
+  }
+
+ private:
+  const char* p_;
+  const char* const end_;
+};
+
+// The part of a duration after the ".", as GetNanosFromStringPiece() in
+// utility.cc reads it.
+util::Status ParseDurationNanos(StringPiece s_nanos, int32_t* nanos) {
+  *nanos = 0;
+  int num_leading_zeros = 0;
+  while (s_nanos.Consume("0")) ++num_leading_zeros;
+  int32_t i_nanos = 0;
+  if (!s_nanos.empty() && !safe_strto32(s_nanos, &i_nanos)) {
+    return util::InvalidArgumentError(
+        "Invalid duration format, failed to parse nano seconds");
+  }
+  if (i_nanos > kNanosPerSecond || i_nanos < 0) {
+    return util::InvalidArgumentError("Duration value exceeds limits");
+  }
+  if (s_nanos.find_first_not_of("0123456789") != StringPiece::npos) {
+    return util::InvalidArgumentError(
+        "Invalid duration format, failed to parse nano seconds");
+  }
+  if (i_nanos > 0) {
+    int scale = num_leading_zeros + static_cast<int>(s_nanos.size());
+    if (scale < 1 || scale > 9) {
+      return util::InvalidArgumentError("Duration value exceeds limits");
+    }
+    int32_t conversion = 1;
+    for (int i = scale; i < 9; ++i) conversion *= 10;
+    *nanos = i_nanos * conversion;
+  }
+  return util::Status();
+}
+
+}  // namespace
+
+XmlWellKnownType GetXmlWellKnownType(const google::protobuf::Type& type) {
+  StringPiece name(type.name());
+  if (!name.Consume(kWellKnownTypePrefix)) {
+    return XML_NOT_WELL_KNOWN;
+  }
+  for (const WellKnownTypeName& entry : kWellKnownTypeNames) {
+    if (name == entry.name) return entry.type;
+  }
+  return XML_OTHER_WELL_KNOWN;
+}
+
+util::Status FormatXmlTimestamp(int64_t seconds, int32_t nanos,
+                                StringPiece field_name, char* buffer,
+                                int* length) {
+  if (seconds > kTimestampMaxSeconds || seconds < kTimestampMinSeconds) {
+    return util::InternalError(
+        StrCat("Timestamp seconds exceeds limit for field: ", field_name));
+  }
+  if (nanos < 0 || nanos >= kNanosPerSecond) {
+    return util::InternalError(
+        StrCat("Timestamp nanos exceeds limit for field: ", field_name));
+  }
+  google::protobuf::internal::DateTime time;
+  if (!google::protobuf::internal::SecondsToDateTime(seconds, &time)) {
+    return util::InternalError(
+        StrCat("Timestamp seconds exceeds limit for field: ", field_name));
+  }
+  char* out = buffer;
+  out = WriteDigits(time.year, 4, out);
+  *out++ = '-';
+  out = WriteDigits(time.month, 2, out);
+  *out++ = '-';
+  out = WriteDigits(time.day, 2, out);
+  *out++ = 'T';
+  out = WriteDigits(time.hour, 2, out);
+  *out++ = ':';
+  out = WriteDigits(time.minute, 2, out);
+  *out++ = ':';
+  out = WriteDigits(time.second, 2, out);
+  if (nanos != 0) out = WriteNanos(nanos, nanos, out);
+  *out++ = 'Z';
+  *length = static_cast<int>(out - buffer);
+  return util::Status();
+}
+
+util::Status FormatXmlDuration(int64_t seconds, int32_t nanos,
+                               StringPiece field_name, char* buffer,
+                               int* length) {
+  if (seconds > kDurationMaxSeconds || seconds < kDurationMinSeconds) {
+    return util::InternalError(
+        StrCat("Duration seconds exceeds limit for field: ", field_name));
+  }
+  if (nanos <= -kNanosPerSecond || nanos >= kNanosPerSecond) {
+    return util::InternalError(
+        StrCat("Duration nanos exceeds limit for field: ", field_name));
+  }
+  char* out = buffer;
+  if (seconds < 0) {
+    if (nanos > 0) {
+      return util::InternalError(StrCat(
+          "Duration nanos is non-negative, but seconds is negative for field: ",
+          field_name));
+    }
+    *out++ = '-';
+    seconds = -seconds;
+    nanos = -nanos;
+  } else if (seconds == 0 && nanos < 0) {
+    *out++ = '-';
+    nanos = -nanos;
+  }
+  out = WriteDecimal(static_cast<uint64_t>(seconds), out);
+  // A positive duration with negative nanos is invalid, but
+  // ProtoStreamObjectSource renders it anyway, with the nanos read as
+  // unsigned, e.g. "1.294967291s" for {1, -5}; so does this.
+  uint32_t unsigned_nanos = static_cast<uint32_t>(nanos);
+  if (unsigned_nanos != 0) {
+    out = WriteNanos(unsigned_nanos % kNanosPerSecond, unsigned_nanos, out);
+  }
+  *out++ = 's';
+  *length = static_cast<int>(out - buffer);
+  return util::Status();
+}
+
+bool ParseXmlTimestamp(StringPiece value, int64_t* seconds, int32_t* nanos) {
+  TimeReader reader(value);
+  google::protobuf::internal::DateTime time;
+  if (!reader.ReadInt(4, 1, 9999, &time.year) || !reader.Consume('-') ||
+      !reader.ReadInt(2, 1, 12, &time.month) || !reader.Consume('-') ||
+      !reader.ReadInt(2, 1, 31, &time.day) || !reader.Consume('T') ||
+      !reader.ReadInt(2, 0, 23, &time.hour) || !reader.Consume(':') ||
+      !reader.ReadInt(2, 0, 59, &time.minute) || !reader.Consume(':') ||
+      !reader.ReadInt(2, 0, 59, &time.second)) {
+    return false;
+  }
+  if (!google::protobuf::internal::DateTimeToSeconds(time, seconds)) {
+    return false;
+  }
+  if (reader.Consume('.')) {
+    if (!reader.ReadNanos(nanos)) return false;
+  } else {
+    *nanos = 0;
+  }
+  if (!reader.Consume('Z')) {
+    int64_t offset;
+    if (reader.Consume('+')) {
+      if (!reader.ReadTimezoneOffset(&offset)) return false;
+      *seconds -= offset;
+    } else if (reader.Consume('-')) {
+      if (!reader.ReadTimezoneOffset(&offset)) return false;
+      *seconds += offset;
+    } else {
+      return false;
+    }
+  }
+  return reader.Peek() == '\0';
+}
+
+util::Status ParseXmlDuration(StringPiece value, int64_t* seconds,
+                              int32_t* nanos) {
+  if (!value.ConsumeFromEnd("s")) {
+    return util::InvalidArgumentError(
+        "Illegal duration format; duration must end with 's'");
+  }
+  int sign = 1;
+  if (value.Consume("-")) sign = -1;
+
+  StringPiece s_secs = value;
+  StringPiece s_nanos;
+  size_t dot = value.rfind('.');
+  if (dot != StringPiece::npos) {
+    s_secs = value.substr(0, dot);
+    s_nanos = value.substr(dot + 1);
+  }
+  uint64_t unsigned_seconds;
+  if (!safe_strtou64(s_secs, &unsigned_seconds)) {
+    return util::InvalidArgumentError(
+        "Invalid duration format, failed to parse seconds");
+  }
+  int32_t parsed_nanos;
+  util::Status status = ParseDurationNanos(s_nanos, &parsed_nanos);
+  if (!status.ok()) return status;
+
+  parsed_nanos = sign * parsed_nanos;
+  int64_t parsed_seconds = sign * static_cast<int64_t>(unsigned_seconds);
+  if (parsed_seconds > kDurationMaxSeconds ||
+      parsed_seconds < kDurationMinSeconds ||
+      parsed_nanos <= -kNanosPerSecond || parsed_nanos >= kNanosPerSecond) {
+    return util::InvalidArgumentError("Duration value exceeds limits");
+  }
+  *seconds = parsed_seconds;
+  *nanos = parsed_nanos;
+  return util::Status();
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
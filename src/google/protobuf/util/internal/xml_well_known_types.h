@@ -0,0 +1,113 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_WELL_KNOWN_TYPES_H__
+#define GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_WELL_KNOWN_TYPES_H__
+
+#include <google/protobuf/type.pb.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/strutil.h>
+
+#include <cstdint>
+
+// clang-format off
+#include <google/protobuf/port_def.inc>
+// clang-format on
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// The well-known types that the XML converters handle themselves instead of
+// going through the special type handlers of ProtoStreamObjectSource and
+// ProtoStreamObjectWriter. Timestamps and durations are formatted into and
+// parsed from caller-provided buffers, without temporary strings, with the
+// same results and error messages as those handlers.
+enum XmlWellKnownType {
+  XML_NOT_WELL_KNOWN = 0,
+  XML_TIMESTAMP,
+  XML_DURATION,
+  // google.protobuf.DoubleValue, Int32Value, ... and BytesValue.
+  XML_WRAPPER,
+  XML_FIELD_MASK,
+  XML_STRUCT,
+  XML_VALUE,
+  XML_LIST_VALUE,
+  // Any other type in the google.protobuf package, e.g. Any, left to
+  // ProtoStreamObjectSource and ProtoStreamObjectWriter.
+  XML_OTHER_WELL_KNOWN,
+};
+
+PROTOBUF_EXPORT XmlWellKnownType
+GetXmlWellKnownType(const google::protobuf::Type& type);
+
+// Large enough for any timestamp or duration FormatXmlTimestamp() and
+// FormatXmlDuration() accept, e.g. "9999-12-31T23:59:59.999999999Z".
+static const int kXmlTimeBufferSize = 32;
+
+// Writes a google.protobuf.Timestamp as an RFC 3339 date in UTC, with 0, 3, 6
+// or 9 fractional digits, and returns its length. Fails, like the
+// ProtoStreamObjectSource renderer, if seconds or nanos are out of range;
+// |field_name| only goes into the message.
+PROTOBUF_EXPORT util::Status FormatXmlTimestamp(int64_t seconds, int32_t nanos,
+                                                StringPiece field_name,
+                                                char* buffer, int* length);
+
+// Writes a google.protobuf.Duration as seconds with an "s" suffix, e.g.
+// "-1.500s", and returns its length. Same failure cases as the
+// ProtoStreamObjectSource renderer.
+PROTOBUF_EXPORT util::Status FormatXmlDuration(int64_t seconds, int32_t nanos,
+                                               StringPiece field_name,
+                                               char* buffer, int* length);
+
+// Parses an RFC 3339 date, e.g. "2015-05-20T13:29:35.120-08:00", accepting
+// exactly what google::protobuf::internal::ParseTime() accepts. Returns false
+// on any syntax error. Used by BackpatchingObjectWriter only, so only when
+// XmlParseOptions::backpatch_message_lengths is set; the same goes for
+// ParseXmlDuration().
+PROTOBUF_EXPORT bool ParseXmlTimestamp(StringPiece value, int64_t* seconds,
+                                       int32_t* nanos);
+
+// Parses a duration as ProtoStreamObjectWriter does, failing with its
+// messages.
+PROTOBUF_EXPORT util::Status ParseXmlDuration(StringPiece value,
+                                              int64_t* seconds,
+                                              int32_t* nanos);
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_WELL_KNOWN_TYPES_H__
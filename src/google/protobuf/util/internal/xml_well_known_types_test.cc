@@ -0,0 +1,208 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/internal/xml_well_known_types.h>
+
+#include <google/protobuf/type.pb.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/time.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+namespace {
+
+std::string Timestamp(int64_t seconds, int32_t nanos) {
+  char buffer[kXmlTimeBufferSize];
+  int length = 0;
+  util::Status status =
+      FormatXmlTimestamp(seconds, nanos, "field", buffer, &length);
+  if (!status.ok()) return std::string(status.message());
+  return std::string(buffer, length);
+}
+
+std::string Duration(int64_t seconds, int32_t nanos) {
+  char buffer[kXmlTimeBufferSize];
+  int length = 0;
+  util::Status status =
+      FormatXmlDuration(seconds, nanos, "field", buffer, &length);
+  if (!status.ok()) return std::string(status.message());
+  return std::string(buffer, length);
+}
+
+std::string ParseDuration(const std::string& value) {
+  int64_t seconds = 0;
+  int32_t nanos = 0;
+  util::Status status = ParseXmlDuration(value, &seconds, &nanos);
+  if (!status.ok()) return std::string(status.message());
+  return std::to_string(seconds) + "," + std::to_string(nanos);
+}
+
+TEST(XmlWellKnownTypesTest, ClassifiesTypesByName) {
+  google::protobuf::Type type;
+  type.set_name("google.protobuf.Timestamp");
+  EXPECT_EQ(XML_TIMESTAMP, GetXmlWellKnownType(type));
+  type.set_name("google.protobuf.Duration");
+  EXPECT_EQ(XML_DURATION, GetXmlWellKnownType(type));
+  type.set_name("google.protobuf.BytesValue");
+  EXPECT_EQ(XML_WRAPPER, GetXmlWellKnownType(type));
+  type.set_name("google.protobuf.FieldMask");
+  EXPECT_EQ(XML_FIELD_MASK, GetXmlWellKnownType(type));
+  type.set_name("google.protobuf.Struct");
+  EXPECT_EQ(XML_STRUCT, GetXmlWellKnownType(type));
+  type.set_name("google.protobuf.Value");
+  EXPECT_EQ(XML_VALUE, GetXmlWellKnownType(type));
+  type.set_name("google.protobuf.ListValue");
+  EXPECT_EQ(XML_LIST_VALUE, GetXmlWellKnownType(type));
+  type.set_name("google.protobuf.Any");
+  EXPECT_EQ(XML_OTHER_WELL_KNOWN, GetXmlWellKnownType(type));
+  type.set_name("proto3.Timestamp");
+  EXPECT_EQ(XML_NOT_WELL_KNOWN, GetXmlWellKnownType(type));
+}
+
+TEST(XmlWellKnownTypesTest, FormatsTimestampsAsFormatTime) {
+  const int64_t kSeconds[] = {-62135596800LL, -1, 0, 1, 951782400,
+                              1432128575,     253402300799LL};
+  const int32_t kNanos[] = {0, 1, 1000, 120000000, 120001000, 999999999};
+  for (int64_t seconds : kSeconds) {
+    for (int32_t nanos : kNanos) {
+      EXPECT_EQ(google::protobuf::internal::FormatTime(seconds, nanos),
+                Timestamp(seconds, nanos))
+          << seconds << " " << nanos;
+    }
+  }
+}
+
+TEST(XmlWellKnownTypesTest, RejectsTimestampsOutOfRange) {
+  EXPECT_EQ("Timestamp seconds exceeds limit for field: field",
+            Timestamp(253402300800LL, 0));
+  EXPECT_EQ("Timestamp seconds exceeds limit for field: field",
+            Timestamp(-62135596801LL, 0));
+  EXPECT_EQ("Timestamp nanos exceeds limit for field: field", Timestamp(0, -1));
+  EXPECT_EQ("Timestamp nanos exceeds limit for field: field",
+            Timestamp(0, 1000000000));
+}
+
+TEST(XmlWellKnownTypesTest, FormatsDurations) {
+  EXPECT_EQ("0s", Duration(0, 0));
+  EXPECT_EQ("1s", Duration(1, 0));
+  EXPECT_EQ("-1.500s", Duration(-1, -500000000));
+  EXPECT_EQ("-0.000000001s", Duration(0, -1));
+  EXPECT_EQ("0.000120s", Duration(0, 120000));
+  EXPECT_EQ("315576000000.999999999s", Duration(315576000000LL, 999999999));
+  EXPECT_EQ("-315576000000s", Duration(-315576000000LL, 0));
+  // Negative nanos with positive seconds are read as unsigned.
+  EXPECT_EQ("1.294967291s", Duration(1, -5));
+}
+
+TEST(XmlWellKnownTypesTest, RejectsDurationsOutOfRange) {
+  EXPECT_EQ("Duration seconds exceeds limit for field: field",
+            Duration(315576000001LL, 0));
+  EXPECT_EQ("Duration nanos exceeds limit for field: field",
+            Duration(0, -1000000000));
+  EXPECT_EQ(
+      "Duration nanos is non-negative, but seconds is negative for field: "
+      "field",
+      Duration(-1, 1));
+}
+
+TEST(XmlWellKnownTypesTest, ParsesTimestampsAsParseTime) {
+  const char* const kValues[] = {
+      "2015-05-20T13:29:35.120Z",
+      "2015-05-20T13:29:35.120-08:00",
+      "2015-05-20T13:29:35+23:59",
+      "0001-01-01T00:00:00Z",
+      "9999-12-31T23:59:59.999999999Z",
+      "2000-02-29T00:00:00.0000000001Z",
+      "2015-5-2T3:9:5Z",
+      "2015-05-20T13:29:35",
+      "2015-05-20T13:29:35.Z",
+      "2015-05-20T13:29:35Z ",
+      "2015-05-20t13:29:35Z",
+      "2015-02-30T00:00:00Z",
+      "2015-05-20T24:00:00Z",
+      "2015-05-20T13:29:35+24:00",
+      "2015-05-20T13:29:35-08",
+      "10000-01-01T00:00:00Z",
+      "0000-01-01T00:00:00Z",
+      "",
+  };
+  for (const char* value : kValues) {
+    int64_t expected_seconds = 0;
+    int32_t expected_nanos = 0;
+    bool expected = google::protobuf::internal::ParseTime(
+        value, &expected_seconds, &expected_nanos);
+    int64_t seconds = 0;
+    int32_t nanos = 0;
+    EXPECT_EQ(expected, ParseXmlTimestamp(value, &seconds, &nanos)) << value;
+    if (expected) {
+      EXPECT_EQ(expected_seconds, seconds) << value;
+      EXPECT_EQ(expected_nanos, nanos) << value;
+    }
+  }
+  // A NUL ends the value, as it does the C string ParseTime() reads.
+  int64_t seconds = 0;
+  int32_t nanos = 0;
+  EXPECT_TRUE(ParseXmlTimestamp(StringPiece("1970-01-01T00:00:00Z\0x", 22),
+                                &seconds, &nanos));
+  EXPECT_EQ(0, seconds);
+}
+
+TEST(XmlWellKnownTypesTest, ParsesDurations) {
+  EXPECT_EQ("0,0", ParseDuration("0s"));
+  EXPECT_EQ("1,500000000", ParseDuration("1.5s"));
+  EXPECT_EQ("-1,-500000000", ParseDuration("-1.500s"));
+  EXPECT_EQ("0,120000", ParseDuration("0.000120s"));
+  EXPECT_EQ("1,500000000", ParseDuration(" +1.5s"));
+  EXPECT_EQ("1,0", ParseDuration("1.s"));
+  EXPECT_EQ("315576000000,999999999",
+            ParseDuration("315576000000.999999999s"));
+  EXPECT_EQ("Illegal duration format; duration must end with 's'",
+            ParseDuration("1"));
+  EXPECT_EQ("Invalid duration format, failed to parse seconds",
+            ParseDuration("abc.5s"));
+  EXPECT_EQ("Invalid duration format, failed to parse seconds",
+            ParseDuration(".000000001s"));
+  EXPECT_EQ("Invalid duration format, failed to parse nano seconds",
+            ParseDuration("1.5as"));
+  EXPECT_EQ("Duration value exceeds limits", ParseDuration("1.0000000001s"));
+  EXPECT_EQ("Duration value exceeds limits", ParseDuration("315576000001s"));
+}
+
+}  // namespace
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,969 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <google/protobuf/util/internal/xml_wire_walker.h>
+
+#include <google/protobuf/wire_format_lite.h>
+#include <google/protobuf/stubs/casts.h>
+#include <google/protobuf/stubs/status_macros.h>
+#include <google/protobuf/util/internal/constants.h>
+#include <google/protobuf/util/internal/field_mask_utility.h>
+#include <google/protobuf/util/internal/utility.h>
+
+#include <algorithm>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+using ::google::protobuf::internal::WireFormatLite;
+
+namespace {
+
+// Field numbers below this are looked up in a flat array.
+const uint32_t kMaxDenseFieldNumber = 1024;
+
+// Mirrors ProtoStreamObjectSource::IsPackable().
+bool IsPackable(const google::protobuf::Field& field) {
+  return field.cardinality() ==
+             google::protobuf::Field::CARDINALITY_REPEATED &&
+         field.kind() != google::protobuf::Field::TYPE_STRING &&
+         field.kind() != google::protobuf::Field::TYPE_BYTES &&
+         field.kind() != google::protobuf::Field::TYPE_MESSAGE &&
+         field.kind() != google::protobuf::Field::TYPE_GROUP;
+}
+
+util::StatusOr<std::string> MapKeyDefaultValueAsString(
+    const google::protobuf::Field& field) {
+  switch (field.kind()) {
+    case google::protobuf::Field::TYPE_BOOL:
+      return std::string("false");
+    case google::protobuf::Field::TYPE_INT32:
+    case google::protobuf::Field::TYPE_INT64:
+    case google::protobuf::Field::TYPE_UINT32:
+    case google::protobuf::Field::TYPE_UINT64:
+    case google::protobuf::Field::TYPE_SINT32:
+    case google::protobuf::Field::TYPE_SINT64:
+    case google::protobuf::Field::TYPE_SFIXED32:
+    case google::protobuf::Field::TYPE_SFIXED64:
+    case google::protobuf::Field::TYPE_FIXED32:
+    case google::protobuf::Field::TYPE_FIXED64:
+      return std::string("0");
+    case google::protobuf::Field::TYPE_STRING:
+      return std::string();
+    default:
+      return util::InternalError("Invalid map key type.");
+  }
+}
+
+bool ReadVarint32(io::CodedInputStream* input, uint32_t* value) {
+  return input->ReadVarint32(value);
+}
+
+bool ReadVarint64(io::CodedInputStream* input, uint64_t* value) {
+  return input->ReadVarint64(value);
+}
+
+bool ReadFixed32(io::CodedInputStream* input, uint32_t* value) {
+  return input->ReadLittleEndian32(value);
+}
+
+bool ReadFixed64(io::CodedInputStream* input, uint64_t* value) {
+  return input->ReadLittleEndian64(value);
+}
+
+// Reads the values of a packed field up to the current limit with |read| and
+// passes each to |render|. Like ProtoStreamObjectSource, a value that fails
+// to decode on truncated input is still rendered, but the loop stops once a
+// read makes no progress instead of spinning.
+template <typename T, typename Read, typename Render>
+void ForEachPacked(io::CodedInputStream* input, Read read, Render render) {
+  while (input->BytesUntilLimit() > 0) {
+    const int position = input->CurrentPosition();
+    T value = 0;
+    const bool ok = read(input, &value);
+    render(value);
+    if (!ok && input->CurrentPosition() == position) break;
+  }
+}
+
+}  // namespace
+
+XmlWireWalker::XmlWireWalker(TypeResolver* type_resolver,
+                             const google::protobuf::Type& type,
+                             const Options& options)
+    : type_resolver_(type_resolver),
+      type_info_(TypeInfo::NewTypeInfo(type_resolver)),
+      type_(type),
+      options_(options),
+      input_(nullptr),
+      writer_(nullptr),
+      depth_(0) {}
+
+XmlWireWalker::~XmlWireWalker() {}
+
+util::Status XmlWireWalker::WriteTo(io::CodedInputStream* input,
+                                    XmlObjectWriter* writer) {
+  input_ = input;
+  writer_ = writer;
+  depth_ = 0;
+  const MessageTable* table = GetMessageTable(&type_);
+  util::Status status = table->well_known_type != XML_NOT_WELL_KNOWN
+                            ? WriteWellKnownType(*table, "")
+                            : WriteMessage(*table, "");
+  // The sources read from |input|, which may not outlive this call.
+  well_known_sources_.clear();
+  input_ = nullptr;
+  writer_ = nullptr;
+  return status;
+}
+
+StringPiece XmlWireWalker::SplittableListName(uint32_t tag) {
+  const MessageTable* table = GetMessageTable(&type_);
+  if (table->well_known_type != XML_NOT_WELL_KNOWN) return StringPiece();
+  const FieldEntry* entry = FindAndVerifyField(*table, tag);
+  if (entry == nullptr || !entry->repeated || entry->map ||
+      entry->kind != google::protobuf::Field::TYPE_MESSAGE) {
+    return StringPiece();
+  }
+  // Well-known types render as scalars or lists.
+  const MessageTable* item_table = GetMessageTable(*entry);
+  if (item_table == nullptr ||
+      item_table->well_known_type != XML_NOT_WELL_KNOWN) {
+    return StringPiece();
+  }
+  return entry->name;
+}
+
+util::Status XmlWireWalker::WriteFields(io::CodedInputStream* input,
+                                        XmlObjectWriter* writer) {
+  input_ = input;
+  writer_ = writer;
+  depth_ = 0;
+  util::Status status = WriteFields(*GetMessageTable(&type_));
+  well_known_sources_.clear();
+  input_ = nullptr;
+  writer_ = nullptr;
+  return status;
+}
+
+util::Status XmlWireWalker::WriteListItems(io::CodedInputStream* input,
+                                           uint32_t tag,
+                                           XmlObjectWriter* writer) {
+  const FieldEntry* entry = FindAndVerifyField(*GetMessageTable(&type_), tag);
+  GOOGLE_CHECK(entry != nullptr);
+  input_ = input;
+  writer_ = writer;
+  depth_ = 0;
+  util::Status status;
+  for (uint32_t next_tag = input_->ReadTag(); next_tag != 0 && status.ok();
+       next_tag = input_->ReadTag()) {
+    if (next_tag != tag) {
+      status = util::InternalError("Unexpected field among list items.");
+    } else {
+      status = RenderField(*entry, StringPiece());
+    }
+  }
+  well_known_sources_.clear();
+  input_ = nullptr;
+  writer_ = nullptr;
+  return status;
+}
+
+const XmlWireWalker::MessageTable* XmlWireWalker::GetMessageTable(
+    const google::protobuf::Type* type) {
+  std::unique_ptr<MessageTable>& table = message_tables_[type];
+  if (table != nullptr) return table.get();
+  table.reset(new MessageTable);
+  table->type = type;
+  table->well_known_type = GetXmlWellKnownType(*type);
+
+  uint32_t max_dense_number = 0;
+  table->fields.reserve(type->fields_size());
+  for (const google::protobuf::Field& field : type->fields()) {
+    FieldEntry entry;
+    entry.field = &field;
+    entry.name =
+        options_.preserve_proto_field_names ? field.name() : field.json_name();
+    entry.kind = field.kind();
+    entry.wire_type = WireFormatLite::WireTypeForFieldType(
+        static_cast<WireFormatLite::FieldType>(field.kind()));
+    entry.repeated =
+        field.cardinality() == google::protobuf::Field::CARDINALITY_REPEATED;
+    entry.packable = IsPackable(field);
+    entry.map = false;
+    entry.null_value = false;
+    entry.enum_values = nullptr;
+    entry.message = nullptr;
+    if (field.kind() == google::protobuf::Field::TYPE_MESSAGE) {
+      const google::protobuf::Type* field_type =
+          type_info_->GetTypeByTypeUrl(field.type_url());
+      entry.map = field_type != nullptr && IsMap(field, *field_type);
+    } else if (field.kind() == google::protobuf::Field::TYPE_ENUM) {
+      entry.null_value = field.type_url() == kStructNullValueTypeUrl;
+      const google::protobuf::Enum* enum_type =
+          type_info_->GetEnumByTypeUrl(field.type_url());
+      if (enum_type != nullptr) entry.enum_values = GetEnumTable(enum_type);
+    }
+    const uint32_t number = static_cast<uint32_t>(field.number());
+    if (number < kMaxDenseFieldNumber) {
+      max_dense_number = std::max(max_dense_number, number);
+    }
+    table->fields.push_back(entry);
+  }
+
+  table->dense.assign(max_dense_number + 1, 0);
+  for (uint32_t i = 0; i < table->fields.size(); ++i) {
+    const uint32_t number =
+        static_cast<uint32_t>(table->fields[i].field->number());
+    if (number < table->dense.size()) {
+      // As in ProtoStreamObjectSource, the first field with a number wins.
+      if (table->dense[number] == 0) table->dense[number] = i + 1;
+    } else {
+      table->sparse.push_back(std::make_pair(number, i));
+    }
+  }
+  std::stable_sort(
+      table->sparse.begin(), table->sparse.end(),
+      [](const std::pair<uint32_t, uint32_t>& a,
+         const std::pair<uint32_t, uint32_t>& b) { return a.first < b.first; });
+  return table.get();
+}
+
+const XmlWireWalker::MessageTable* XmlWireWalker::GetMessageTable(
+    const FieldEntry& entry) {
+  if (entry.message == nullptr) {
+    const google::protobuf::Type* type =
+        type_info_->GetTypeByTypeUrl(entry.field->type_url());
+    if (type != nullptr) entry.message = GetMessageTable(type);
+  }
+  return entry.message;
+}
+
+const XmlWireWalker::EnumTable* XmlWireWalker::GetEnumTable(
+    const google::protobuf::Enum* type) {
+  std::unique_ptr<EnumTable>& table = enum_tables_[type];
+  if (table != nullptr) return table.get();
+  table.reset(new EnumTable);
+  table->reserve(type->enumvalue_size());
+  for (const google::protobuf::EnumValue& value : type->enumvalue()) {
+    table->push_back(std::make_pair(value.number(), StringPiece(value.name())));
+  }
+  std::stable_sort(table->begin(), table->end(),
+                   [](const std::pair<int32_t, StringPiece>& a,
+                      const std::pair<int32_t, StringPiece>& b) {
+                     return a.first < b.first;
+                   });
+  return table.get();
+}
+
+const XmlWireWalker::FieldEntry* XmlWireWalker::FindField(
+    const MessageTable& table, uint32_t number) {
+  if (number < table.dense.size()) {
+    const uint32_t index = table.dense[number];
+    return index == 0 ? nullptr : &table.fields[index - 1];
+  }
+  auto it = std::lower_bound(
+      table.sparse.begin(), table.sparse.end(), number,
+      [](const std::pair<uint32_t, uint32_t>& a, uint32_t b) {
+        return a.first < b;
+      });
+  if (it == table.sparse.end() || it->first != number) return nullptr;
+  return &table.fields[it->second];
+}
+
+const XmlWireWalker::FieldEntry* XmlWireWalker::FindAndVerifyField(
+    const MessageTable& table, uint32_t tag) {
+  const FieldEntry* entry =
+      FindField(table, WireFormatLite::GetTagFieldNumber(tag));
+  if (entry == nullptr) return nullptr;
+  const uint32_t wire_type = WireFormatLite::GetTagWireType(tag);
+  if (wire_type != entry->wire_type &&
+      (!entry->packable ||
+       wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED)) {
+    return nullptr;
+  }
+  return entry;
+}
+
+util::Status XmlWireWalker::WriteMessage(const MessageTable& table,
+                                         StringPiece name) {
+  writer_->XmlObjectWriter::StartObject(name);
+  RETURN_IF_ERROR(WriteFields(table));
+  writer_->XmlObjectWriter::EndObject();
+  return util::Status();
+}
+
+util::Status XmlWireWalker::WriteFields(const MessageTable& table) {
+  uint32_t tag = input_->ReadTag();
+  // Different from tag, so that the first field is looked up.
+  uint32_t last_tag = tag + 1;
+  const FieldEntry* entry = nullptr;
+  while (tag != 0) {
+    if (tag != last_tag) {
+      last_tag = tag;
+      entry = FindAndVerifyField(table, tag);
+    }
+    if (entry == nullptr) {
+      WireFormatLite::SkipField(input_, tag);
+      tag = input_->ReadTag();
+      continue;
+    }
+    if (entry->repeated) {
+      if (entry->map) {
+        writer_->XmlObjectWriter::StartObject(entry->name);
+        ASSIGN_OR_RETURN(tag, RenderMap(*entry, tag));
+        writer_->XmlObjectWriter::EndObject();
+      } else {
+        ASSIGN_OR_RETURN(tag, RenderList(*entry, entry->name, tag));
+      }
+    } else {
+      RETURN_IF_ERROR(RenderField(*entry, entry->name));
+      tag = input_->ReadTag();
+    }
+  }
+  return util::Status();
+}
+
+util::Status XmlWireWalker::WriteWellKnownType(const MessageTable& table,
+                                               StringPiece name) {
+  switch (table.well_known_type) {
+    case XML_TIMESTAMP:
+      return RenderTimestamp(name);
+    case XML_DURATION:
+      return RenderDuration(name);
+    case XML_WRAPPER:
+      RenderWrapper(table, name);
+      return util::Status();
+    case XML_FIELD_MASK:
+      return RenderFieldMask(name);
+    case XML_STRUCT:
+      return RenderStruct(table, name);
+    case XML_VALUE:
+      return RenderStructValue(table, name);
+    case XML_LIST_VALUE:
+      return RenderStructListValue(table, name);
+    default:
+      break;
+  }
+  std::unique_ptr<ProtoStreamObjectSource>& source =
+      well_known_sources_[table.type];
+  if (source == nullptr) {
+    ProtoStreamObjectSource::RenderOptions render_options;
+    render_options.use_ints_for_enums = options_.use_ints_for_enums;
+    render_options.preserve_proto_field_names =
+        options_.preserve_proto_field_names;
+    source.reset(new ProtoStreamObjectSource(input_, type_resolver_,
+                                             *table.type, render_options));
+  }
+  source->set_max_recursion_depth(options_.max_recursion_depth - depth_);
+  return source->NamedWriteTo(name, writer_);
+}
+
+util::Status XmlWireWalker::RenderTimestamp(StringPiece name) {
+  int64_t seconds = 0;
+  int32_t nanos = 0;
+  ReadSecondsAndNanos(&seconds, &nanos);
+  char buffer[kXmlTimeBufferSize];
+  int length = 0;
+  RETURN_IF_ERROR(FormatXmlTimestamp(seconds, nanos, name, buffer, &length));
+  writer_->XmlObjectWriter::RenderString(name, StringPiece(buffer, length));
+  return util::Status();
+}
+
+util::Status XmlWireWalker::RenderDuration(StringPiece name) {
+  int64_t seconds = 0;
+  int32_t nanos = 0;
+  ReadSecondsAndNanos(&seconds, &nanos);
+  char buffer[kXmlTimeBufferSize];
+  int length = 0;
+  RETURN_IF_ERROR(FormatXmlDuration(seconds, nanos, name, buffer, &length));
+  writer_->XmlObjectWriter::RenderString(name, StringPiece(buffer, length));
+  return util::Status();
+}
+
+void XmlWireWalker::ReadSecondsAndNanos(int64_t* seconds, int32_t* nanos) {
+  static const uint32_t kSecondsTag =
+      WireFormatLite::MakeTag(1, WireFormatLite::WIRETYPE_VARINT);
+  static const uint32_t kNanosTag =
+      WireFormatLite::MakeTag(2, WireFormatLite::WIRETYPE_VARINT);
+  for (uint32_t tag = input_->ReadTag(); tag != 0; tag = input_->ReadTag()) {
+    if (tag == kSecondsTag) {
+      uint64_t value = 0;
+      input_->ReadVarint64(&value);
+      *seconds = bit_cast<int64_t>(value);
+    } else if (tag == kNanosTag) {
+      uint32_t value = 0;
+      input_->ReadVarint32(&value);
+      *nanos = bit_cast<int32_t>(value);
+    } else {
+      WireFormatLite::SkipField(input_, tag);
+    }
+  }
+}
+
+void XmlWireWalker::RenderWrapper(const MessageTable& table,
+                                  StringPiece name) {
+  // As in ProtoStreamObjectSource, the first field is read as the value
+  // whatever its tag, and anything after it fails the caller's check that
+  // the message was consumed.
+  const FieldEntry& value = table.fields[0];
+  if (input_->ReadTag() != 0) {
+    RenderScalarField(value, name);
+    input_->ReadTag();
+    return;
+  }
+  switch (value.kind) {
+    case google::protobuf::Field::TYPE_BOOL:
+      writer_->XmlObjectWriter::RenderBool(name, false);
+      break;
+    case google::protobuf::Field::TYPE_INT32:
+      writer_->XmlObjectWriter::RenderInt32(name, 0);
+      break;
+    case google::protobuf::Field::TYPE_INT64:
+      writer_->XmlObjectWriter::RenderInt64(name, 0);
+      break;
+    case google::protobuf::Field::TYPE_UINT32:
+      writer_->XmlObjectWriter::RenderUint32(name, 0);
+      break;
+    case google::protobuf::Field::TYPE_UINT64:
+      writer_->XmlObjectWriter::RenderUint64(name, 0);
+      break;
+    case google::protobuf::Field::TYPE_FLOAT:
+      writer_->XmlObjectWriter::RenderFloat(name, 0);
+      break;
+    case google::protobuf::Field::TYPE_DOUBLE:
+      writer_->XmlObjectWriter::RenderDouble(name, 0);
+      break;
+    case google::protobuf::Field::TYPE_STRING:
+      writer_->XmlObjectWriter::RenderString(name, StringPiece());
+      break;
+    case google::protobuf::Field::TYPE_BYTES:
+      writer_->XmlObjectWriter::RenderBytes(name, StringPiece());
+      break;
+    default:
+      break;
+  }
+}
+
+util::Status XmlWireWalker::RenderFieldMask(StringPiece name) {
+  static const uint32_t kPathsTag =
+      WireFormatLite::MakeTag(1, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+  std::string combined;
+  std::string path;
+  for (uint32_t tag = input_->ReadTag(); tag != 0; tag = input_->ReadTag()) {
+    if (tag != kPathsTag) {
+      return util::InternalError("Invalid FieldMask, unexpected field.");
+    }
+    uint32_t length = 0;
+    input_->ReadVarint32(&length);
+    input_->ReadString(&path, static_cast<int>(length));
+    if (!combined.empty()) combined.append(",");
+    combined.append(ConvertFieldMaskPath(path, &ToCamelCase));
+  }
+  writer_->XmlObjectWriter::RenderString(name, combined);
+  return util::Status();
+}
+
+util::Status XmlWireWalker::RenderStruct(const MessageTable& table,
+                                         StringPiece name) {
+  writer_->XmlObjectWriter::StartObject(name);
+  uint32_t tag = input_->ReadTag();
+  while (tag != 0) {
+    const FieldEntry* entry = FindAndVerifyField(table, tag);
+    if (entry == nullptr || !entry->map) {
+      WireFormatLite::SkipField(input_, tag);
+      tag = input_->ReadTag();
+      continue;
+    }
+    // The entries of the one map field are the members of the object.
+    ASSIGN_OR_RETURN(tag, RenderMap(*entry, tag));
+  }
+  writer_->XmlObjectWriter::EndObject();
+  return util::Status();
+}
+
+util::Status XmlWireWalker::RenderStructValue(const MessageTable& table,
+                                              StringPiece name) {
+  // Whichever kinds are set are all rendered under |name|.
+  for (uint32_t tag = input_->ReadTag(); tag != 0; tag = input_->ReadTag()) {
+    const FieldEntry* entry = FindAndVerifyField(table, tag);
+    if (entry == nullptr) {
+      WireFormatLite::SkipField(input_, tag);
+      continue;
+    }
+    RETURN_IF_ERROR(RenderField(*entry, name));
+  }
+  return util::Status();
+}
+
+util::Status XmlWireWalker::RenderStructListValue(const MessageTable& table,
+                                                  StringPiece name) {
+  uint32_t tag = input_->ReadTag();
+  if (tag == 0) {
+    writer_->XmlObjectWriter::StartList(name);
+    writer_->XmlObjectWriter::EndList();
+    return util::Status();
+  }
+  while (tag != 0) {
+    const FieldEntry* entry = FindAndVerifyField(table, tag);
+    if (entry == nullptr) {
+      WireFormatLite::SkipField(input_, tag);
+      tag = input_->ReadTag();
+      continue;
+    }
+    ASSIGN_OR_RETURN(tag, RenderList(*entry, name, tag));
+  }
+  return util::Status();
+}
+
+util::Status XmlWireWalker::RenderField(const FieldEntry& entry,
+                                        StringPiece name) {
+  if (entry.kind == google::protobuf::Field::TYPE_MESSAGE) {
+    return RenderMessageField(entry, name);
+  }
+  RenderScalarField(entry, name);
+  return util::Status();
+}
+
+util::Status XmlWireWalker::RenderMessageField(const FieldEntry& entry,
+                                               StringPiece name) {
+  uint32_t length = 0;
+  input_->ReadVarint32(&length);
+  const int old_limit = input_->PushLimit(length);
+  const MessageTable* table = GetMessageTable(entry);
+  if (table == nullptr) {
+    return util::InternalError(
+        StrCat("Invalid configuration. Could not find the type: ",
+               entry.field->type_url()));
+  }
+  if (++depth_ > options_.max_recursion_depth) {
+    return util::InvalidArgumentError(
+        StrCat("Message too deep. Max recursion depth reached for type '",
+               table->type->name(), "', field '", name, "'"));
+  }
+  if (table->well_known_type != XML_NOT_WELL_KNOWN) {
+    RETURN_IF_ERROR(WriteWellKnownType(*table, name));
+  } else {
+    RETURN_IF_ERROR(WriteMessage(*table, name));
+  }
+  --depth_;
+  if (!input_->ConsumedEntireMessage()) {
+    return util::InvalidArgumentError(
+        "Nested protocol message not parsed in its entirety.");
+  }
+  input_->PopLimit(old_limit);
+  return util::Status();
+}
+
+void XmlWireWalker::RenderScalarField(const FieldEntry& entry,
+                                      StringPiece name) {
+  uint32_t buffer32 = 0;
+  uint64_t buffer64 = 0;
+  switch (entry.kind) {
+    case google::protobuf::Field::TYPE_BOOL:
+      input_->ReadVarint64(&buffer64);
+      writer_->XmlObjectWriter::RenderBool(name, buffer64 != 0);
+      break;
+    case google::protobuf::Field::TYPE_INT32:
+      input_->ReadVarint32(&buffer32);
+      writer_->XmlObjectWriter::RenderInt32(name, bit_cast<int32_t>(buffer32));
+      break;
+    case google::protobuf::Field::TYPE_INT64:
+      input_->ReadVarint64(&buffer64);
+      writer_->XmlObjectWriter::RenderInt64(name, bit_cast<int64_t>(buffer64));
+      break;
+    case google::protobuf::Field::TYPE_UINT32:
+      input_->ReadVarint32(&buffer32);
+      writer_->XmlObjectWriter::RenderUint32(name, buffer32);
+      break;
+    case google::protobuf::Field::TYPE_UINT64:
+      input_->ReadVarint64(&buffer64);
+      writer_->XmlObjectWriter::RenderUint64(name, buffer64);
+      break;
+    case google::protobuf::Field::TYPE_SINT32:
+      input_->ReadVarint32(&buffer32);
+      writer_->XmlObjectWriter::RenderInt32(
+          name, WireFormatLite::ZigZagDecode32(buffer32));
+      break;
+    case google::protobuf::Field::TYPE_SINT64:
+      input_->ReadVarint64(&buffer64);
+      writer_->XmlObjectWriter::RenderInt64(
+          name, WireFormatLite::ZigZagDecode64(buffer64));
+      break;
+    case google::protobuf::Field::TYPE_SFIXED32:
+      input_->ReadLittleEndian32(&buffer32);
+      writer_->XmlObjectWriter::RenderInt32(name, bit_cast<int32_t>(buffer32));
+      break;
+    case google::protobuf::Field::TYPE_SFIXED64:
+      input_->ReadLittleEndian64(&buffer64);
+      writer_->XmlObjectWriter::RenderInt64(name, bit_cast<int64_t>(buffer64));
+      break;
+    case google::protobuf::Field::TYPE_FIXED32:
+      input_->ReadLittleEndian32(&buffer32);
+      writer_->XmlObjectWriter::RenderUint32(name, buffer32);
+      break;
+    case google::protobuf::Field::TYPE_FIXED64:
+      input_->ReadLittleEndian64(&buffer64);
+      writer_->XmlObjectWriter::RenderUint64(name, buffer64);
+      break;
+    case google::protobuf::Field::TYPE_FLOAT:
+      input_->ReadLittleEndian32(&buffer32);
+      writer_->XmlObjectWriter::RenderFloat(name, bit_cast<float>(buffer32));
+      break;
+    case google::protobuf::Field::TYPE_DOUBLE:
+      input_->ReadLittleEndian64(&buffer64);
+      writer_->XmlObjectWriter::RenderDouble(name, bit_cast<double>(buffer64));
+      break;
+    case google::protobuf::Field::TYPE_ENUM:
+      input_->ReadVarint32(&buffer32);
+      RenderEnum(entry, name, buffer32);
+      break;
+    case google::protobuf::Field::TYPE_STRING:
+    case google::protobuf::Field::TYPE_BYTES: {
+      input_->ReadVarint32(&buffer32);
+      // Render straight from the input buffer when the value is contiguous.
+      const void* data;
+      int size;
+      if (input_->GetDirectBufferPointer(&data, &size) &&
+          static_cast<uint32_t>(size) >= buffer32) {
+        const StringPiece value(static_cast<const char*>(data), buffer32);
+        if (entry.kind == google::protobuf::Field::TYPE_STRING) {
+          writer_->XmlObjectWriter::RenderString(name, value);
+        } else {
+          writer_->XmlObjectWriter::RenderBytes(name, value);
+        }
+        input_->Skip(static_cast<int>(buffer32));
+        break;
+      }
+      std::string value;
+      input_->ReadString(&value, static_cast<int>(buffer32));
+      if (entry.kind == google::protobuf::Field::TYPE_STRING) {
+        writer_->XmlObjectWriter::RenderString(name, value);
+      } else {
+        writer_->XmlObjectWriter::RenderBytes(name, value);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void XmlWireWalker::RenderEnum(const FieldEntry& entry, StringPiece name,
+                               uint32_t value) {
+  // An explicit NULL value.
+  if (entry.null_value) {
+    writer_->XmlObjectWriter::RenderNull(name);
+    return;
+  }
+  const int32_t number = bit_cast<int32_t>(value);
+  if (entry.enum_values != nullptr && !options_.use_ints_for_enums) {
+    const EnumTable& values = *entry.enum_values;
+    auto it = std::lower_bound(
+        values.begin(), values.end(), number,
+        [](const std::pair<int32_t, StringPiece>& a, int32_t b) {
+          return a.first < b;
+        });
+    if (it != values.end() && it->first == number) {
+      writer_->XmlObjectWriter::RenderString(name, it->second);
+      return;
+    }
+  }
+  // Unknown values are printed as integers.
+  writer_->XmlObjectWriter::RenderInt32(name, number);
+}
+
+util::StatusOr<uint32_t> XmlWireWalker::RenderList(const FieldEntry& entry,
+                                                   StringPiece name,
+                                                   uint32_t list_tag) {
+  uint32_t tag_to_return = 0;
+  writer_->XmlObjectWriter::StartList(name);
+  if (entry.packable &&
+      list_tag ==
+          WireFormatLite::MakeTag(entry.field->number(),
+                                  WireFormatLite::WIRETYPE_LENGTH_DELIMITED)) {
+    RenderPacked(entry);
+    // A packed list has a single tag.
+    tag_to_return = input_->ReadTag();
+  } else {
+    do {
+      RETURN_IF_ERROR(RenderField(entry, StringPiece()));
+    } while ((tag_to_return = input_->ReadTag()) == list_tag);
+  }
+  writer_->XmlObjectWriter::EndList();
+  return tag_to_return;
+}
+
+void XmlWireWalker::RenderPacked(const FieldEntry& entry) {
+  uint32_t length = 0;
+  input_->ReadVarint32(&length);
+  const int old_limit = input_->PushLimit(length);
+  XmlObjectWriter* const writer = writer_;
+  const StringPiece name;
+  // One loop per kind, so that the kind is not dispatched on per value.
+  switch (entry.kind) {
+    case google::protobuf::Field::TYPE_BOOL:
+      ForEachPacked<uint64_t>(input_, ReadVarint64, [=](uint64_t value) {
+        writer->XmlObjectWriter::RenderBool(name, value != 0);
+      });
+      break;
+    case google::protobuf::Field::TYPE_INT32:
+      ForEachPacked<uint32_t>(input_, ReadVarint32, [=](uint32_t value) {
+        writer->XmlObjectWriter::RenderInt32(name, bit_cast<int32_t>(value));
+      });
+      break;
+    case google::protobuf::Field::TYPE_INT64:
+      ForEachPacked<uint64_t>(input_, ReadVarint64, [=](uint64_t value) {
+        writer->XmlObjectWriter::RenderInt64(name, bit_cast<int64_t>(value));
+      });
+      break;
+    case google::protobuf::Field::TYPE_UINT32:
+      ForEachPacked<uint32_t>(input_, ReadVarint32, [=](uint32_t value) {
+        writer->XmlObjectWriter::RenderUint32(name, value);
+      });
+      break;
+    case google::protobuf::Field::TYPE_UINT64:
+      ForEachPacked<uint64_t>(input_, ReadVarint64, [=](uint64_t value) {
+        writer->XmlObjectWriter::RenderUint64(name, value);
+      });
+      break;
+    case google::protobuf::Field::TYPE_SINT32:
+      ForEachPacked<uint32_t>(input_, ReadVarint32, [=](uint32_t value) {
+        writer->XmlObjectWriter::RenderInt32(
+            name, WireFormatLite::ZigZagDecode32(value));
+      });
+      break;
+    case google::protobuf::Field::TYPE_SINT64:
+      ForEachPacked<uint64_t>(input_, ReadVarint64, [=](uint64_t value) {
+        writer->XmlObjectWriter::RenderInt64(
+            name, WireFormatLite::ZigZagDecode64(value));
+      });
+      break;
+    case google::protobuf::Field::TYPE_SFIXED32:
+      ForEachPacked<uint32_t>(input_, ReadFixed32, [=](uint32_t value) {
+        writer->XmlObjectWriter::RenderInt32(name, bit_cast<int32_t>(value));
+      });
+      break;
+    case google::protobuf::Field::TYPE_SFIXED64:
+      ForEachPacked<uint64_t>(input_, ReadFixed64, [=](uint64_t value) {
+        writer->XmlObjectWriter::RenderInt64(name, bit_cast<int64_t>(value));
+      });
+      break;
+    case google::protobuf::Field::TYPE_FIXED32:
+      ForEachPacked<uint32_t>(input_, ReadFixed32, [=](uint32_t value) {
+        writer->XmlObjectWriter::RenderUint32(name, value);
+      });
+      break;
+    case google::protobuf::Field::TYPE_FIXED64:
+      ForEachPacked<uint64_t>(input_, ReadFixed64, [=](uint64_t value) {
+        writer->XmlObjectWriter::RenderUint64(name, value);
+      });
+      break;
+    case google::protobuf::Field::TYPE_FLOAT:
+      ForEachPacked<uint32_t>(input_, ReadFixed32, [=](uint32_t value) {
+        writer->XmlObjectWriter::RenderFloat(name, bit_cast<float>(value));
+      });
+      break;
+    case google::protobuf::Field::TYPE_DOUBLE:
+      ForEachPacked<uint64_t>(input_, ReadFixed64, [=](uint64_t value) {
+        writer->XmlObjectWriter::RenderDouble(name, bit_cast<double>(value));
+      });
+      break;
+    case google::protobuf::Field::TYPE_ENUM:
+      ForEachPacked<uint32_t>(input_, ReadVarint32, [&](uint32_t value) {
+        RenderEnum(entry, name, value);
+      });
+      break;
+    default:
+      break;
+  }
+  input_->PopLimit(old_limit);
+}
+
+util::StatusOr<uint32_t> XmlWireWalker::RenderMap(const FieldEntry& entry,
+                                                  uint32_t list_tag) {
+  const MessageTable* entry_table = GetMessageTable(entry);
+  if (entry_table == nullptr) {
+    return util::InternalError(
+        StrCat("Invalid configuration. Could not find the type: ",
+               entry.field->type_url()));
+  }
+  // Map field numbers are key = 1 and value = 2. Their tags are compared
+  // directly, which leaves the table lookup to unexpected fields.
+  const FieldEntry* key_field = FindField(*entry_table, 1);
+  const FieldEntry* value_field = FindField(*entry_table, 2);
+  uint32_t key_tag = 0;
+  uint32_t value_tag = 0;
+  if (key_field != nullptr) {
+    key_tag = WireFormatLite::MakeTag(
+        1, static_cast<WireFormatLite::WireType>(key_field->wire_type));
+  }
+  if (value_field != nullptr) {
+    value_tag = WireFormatLite::MakeTag(
+        2, static_cast<WireFormatLite::WireType>(value_field->wire_type));
+  }
+  uint32_t tag_to_return = 0;
+  // Reused for every entry, so that keys are not allocated one by one.
+  std::string map_key;
+  do {
+    uint32_t length = 0;
+    input_->ReadVarint32(&length);
+    const int old_limit = input_->PushLimit(length);
+    map_key.clear();
+    for (uint32_t tag = input_->ReadTag(); tag != 0;
+         tag = input_->ReadTag()) {
+      const FieldEntry* field = nullptr;
+      if (tag == key_tag) {
+        field = key_field;
+      } else if (tag == value_tag) {
+        field = value_field;
+      } else {
+        field = FindAndVerifyField(*entry_table, tag);
+      }
+      if (field == nullptr) {
+        WireFormatLite::SkipField(input_, tag);
+        continue;
+      }
+      if (field == key_field) {
+        ReadMapKey(*field, &map_key);
+      } else if (field == value_field) {
+        if (map_key.empty()) {
+          // An absent map key is treated as the default.
+          if (key_field == nullptr) {
+            return util::InternalError("Invalid map entry.");
+          }
+          ASSIGN_OR_RETURN(map_key,
+                           MapKeyDefaultValueAsString(*key_field->field));
+        }
+        RETURN_IF_ERROR(RenderField(*field, map_key));
+      } else {
+        return util::InternalError("Invalid map entry.");
+      }
+    }
+    input_->PopLimit(old_limit);
+  } while ((tag_to_return = input_->ReadTag()) == list_tag);
+  return tag_to_return;
+}
+
+void XmlWireWalker::ReadMapKey(const FieldEntry& entry, std::string* key) {
+  // Integers are formatted into a buffer on the stack, which key reuses.
+  char buffer[kFastToBufferSize];
+  char* end = buffer;
+  uint32_t buffer32 = 0;
+  uint64_t buffer64 = 0;
+  switch (entry.kind) {
+    case google::protobuf::Field::TYPE_BOOL:
+      input_->ReadVarint64(&buffer64);
+      key->assign(buffer64 != 0 ? "true" : "false");
+      return;
+    case google::protobuf::Field::TYPE_INT32:
+      input_->ReadVarint32(&buffer32);
+      end = FastInt32ToBufferLeft(bit_cast<int32_t>(buffer32), buffer);
+      break;
+    case google::protobuf::Field::TYPE_INT64:
+      input_->ReadVarint64(&buffer64);
+      end = FastInt64ToBufferLeft(bit_cast<int64_t>(buffer64), buffer);
+      break;
+    case google::protobuf::Field::TYPE_UINT32:
+      input_->ReadVarint32(&buffer32);
+      end = FastUInt32ToBufferLeft(buffer32, buffer);
+      break;
+    case google::protobuf::Field::TYPE_UINT64:
+      input_->ReadVarint64(&buffer64);
+      end = FastUInt64ToBufferLeft(buffer64, buffer);
+      break;
+    case google::protobuf::Field::TYPE_SINT32:
+      input_->ReadVarint32(&buffer32);
+      end = FastInt32ToBufferLeft(WireFormatLite::ZigZagDecode32(buffer32),
+                                  buffer);
+      break;
+    case google::protobuf::Field::TYPE_SINT64:
+      input_->ReadVarint64(&buffer64);
+      end = FastInt64ToBufferLeft(WireFormatLite::ZigZagDecode64(buffer64),
+                                  buffer);
+      break;
+    case google::protobuf::Field::TYPE_SFIXED32:
+      input_->ReadLittleEndian32(&buffer32);
+      end = FastInt32ToBufferLeft(bit_cast<int32_t>(buffer32), buffer);
+      break;
+    case google::protobuf::Field::TYPE_SFIXED64:
+      input_->ReadLittleEndian64(&buffer64);
+      end = FastInt64ToBufferLeft(bit_cast<int64_t>(buffer64), buffer);
+      break;
+    case google::protobuf::Field::TYPE_FIXED32:
+      input_->ReadLittleEndian32(&buffer32);
+      end = FastUInt32ToBufferLeft(buffer32, buffer);
+      break;
+    case google::protobuf::Field::TYPE_FIXED64:
+      input_->ReadLittleEndian64(&buffer64);
+      end = FastUInt64ToBufferLeft(buffer64, buffer);
+      break;
+    case google::protobuf::Field::TYPE_FLOAT:
+      input_->ReadLittleEndian32(&buffer32);
+      key->assign(SimpleFtoa(bit_cast<float>(buffer32)));
+      return;
+    case google::protobuf::Field::TYPE_DOUBLE:
+      input_->ReadLittleEndian64(&buffer64);
+      key->assign(SimpleDtoa(bit_cast<double>(buffer64)));
+      return;
+    case google::protobuf::Field::TYPE_ENUM: {
+      input_->ReadVarint32(&buffer32);
+      key->clear();
+      if (entry.enum_values == nullptr) return;
+      const int32_t number = bit_cast<int32_t>(buffer32);
+      auto it = std::lower_bound(
+          entry.enum_values->begin(), entry.enum_values->end(), number,
+          [](const std::pair<int32_t, StringPiece>& a, int32_t b) {
+            return a.first < b;
+          });
+      if (it != entry.enum_values->end() && it->first == number) {
+        key->assign(it->second.data(), it->second.size());
+      }
+      return;
+    }
+    case google::protobuf::Field::TYPE_STRING:
+    case google::protobuf::Field::TYPE_BYTES:
+      // ReadString() keeps the capacity of key.
+      input_->ReadVarint32(&buffer32);
+      input_->ReadString(key, static_cast<int>(buffer32));
+      return;
+    default:
+      break;
+  }
+  key->assign(buffer, end);
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
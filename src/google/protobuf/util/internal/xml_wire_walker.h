@@ -0,0 +1,247 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_WIRE_WALKER_H__
+#define GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_WIRE_WALKER_H__
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/type.pb.h>
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/statusor.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/internal/protostream_objectsource.h>
+#include <google/protobuf/util/internal/type_info.h>
+#include <google/protobuf/util/internal/xml_objectwriter.h>
+#include <google/protobuf/util/internal/xml_well_known_types.h>
+#include <google/protobuf/util/type_resolver.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// clang-format off
+#include <google/protobuf/port_def.inc>
+// clang-format on
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// Decodes protobuf binary straight into an XmlObjectWriter. It produces the
+// same calls as ProtoStreamObjectSource, and hence the same XML, but does less
+// work per field:
+//   - The fields of every message type are looked up in a table built the
+//     first time the type is seen, indexed by field number, holding the name
+//     to render, the expected wire type and, for enums, the value names
+//     sorted by number.
+//   - Packed fields are decoded in one loop per field kind instead of
+//     dispatching on the kind for every value.
+//   - Values go to the XmlObjectWriter methods directly, not through the
+//     virtual ObjectWriter interface.
+//   - Timestamps, durations, wrappers, field masks and the Struct types are
+//     rendered here, timestamps and durations formatted into a stack buffer.
+//     Their forms and errors are those of ProtoStreamObjectSource's
+//     renderers, which still render the other well-known types, e.g. Any.
+//
+// A walker may be reused for any number of messages of its type, keeping its
+// tables; it is not thread-safe.
+//
+// Sample usage:
+//   XmlWireWalker walker(resolver, type, XmlWireWalker::Options());
+//   XmlObjectWriter writer("", &out_stream);
+//   util::Status status = walker.WriteTo(&in_stream, &writer);
+class PROTOBUF_EXPORT XmlWireWalker {
+ public:
+  struct Options {
+    // Same as in ProtoStreamObjectSource::RenderOptions.
+    bool use_ints_for_enums;
+    bool preserve_proto_field_names;
+    // Maximum nesting depth of messages, as for ProtoStreamObjectSource.
+    int max_recursion_depth;
+
+    Options()
+        : use_ints_for_enums(false),
+          preserve_proto_field_names(false),
+          max_recursion_depth(64) {}
+  };
+
+  // |type| must outlive the walker.
+  XmlWireWalker(TypeResolver* type_resolver,
+                const google::protobuf::Type& type, const Options& options);
+  ~XmlWireWalker();
+
+  // Reads one message of the walker's type from |input|, up to its end or
+  // current limit, and writes it to |writer| as the root object.
+  util::Status WriteTo(io::CodedInputStream* input, XmlObjectWriter* writer);
+
+  // For writing one message in pieces, e.g. on several threads. The XML of an
+  // item of a list of messages does not depend on the items before it, except
+  // for the first item of the list, so the items of a top-level repeated
+  // message field can be written by separate writers and their XML joined.
+  //
+  // Returns the name of the list of the top-level field with |tag| if its
+  // items may be written that way, and an empty name otherwise: for maps,
+  // scalars and well-known types, whose items depend on the item before.
+  StringPiece SplittableListName(uint32_t tag);
+  // Reads fields of the walker's type from |input|, up to its current limit,
+  // and writes them into the root object open in |writer|. Consecutive values
+  // of a repeated field must not be split between two calls.
+  util::Status WriteFields(io::CodedInputStream* input,
+                           XmlObjectWriter* writer);
+  // Reads values of the top-level field with |tag|, for which
+  // SplittableListName() is not empty, from |input| up to its current limit,
+  // and writes them as items of the list open in |writer|.
+  util::Status WriteListItems(io::CodedInputStream* input, uint32_t tag,
+                              XmlObjectWriter* writer);
+
+ private:
+  struct MessageTable;
+
+  // Enum values sorted by number; among aliases the first declared comes
+  // first.
+  typedef std::vector<std::pair<int32_t, StringPiece>> EnumTable;
+
+  // What is needed to decode and render one field.
+  struct FieldEntry {
+    const google::protobuf::Field* field;
+    // Name passed to the writer.
+    StringPiece name;
+    google::protobuf::Field::Kind kind;
+    // Wire type of a single, unpacked value.
+    uint32_t wire_type;
+    bool repeated;
+    // Whether the field may also arrive as a packed, length delimited list.
+    bool packable;
+    bool map;
+    // For enums: whether it is google.protobuf.NullValue, and the values of
+    // the enum or null if the enum type is unknown.
+    bool null_value;
+    const EnumTable* enum_values;
+    // For messages and maps: the type of the message or map entry, set on
+    // first use since types may be recursive.
+    mutable const MessageTable* message;
+  };
+
+  struct MessageTable {
+    const google::protobuf::Type* type;
+    XmlWellKnownType well_known_type;
+    std::vector<FieldEntry> fields;
+    // Index into fields plus one for the field numbers below dense.size(),
+    // zero for unused numbers.
+    std::vector<uint32_t> dense;
+    // Field number and index into fields of the others, sorted by number.
+    std::vector<std::pair<uint32_t, uint32_t>> sparse;
+  };
+
+  // Returns the table of |type|, building it on first use.
+  const MessageTable* GetMessageTable(const google::protobuf::Type* type);
+  // Returns the table of the message type of |entry|, or null if the type
+  // cannot be resolved.
+  const MessageTable* GetMessageTable(const FieldEntry& entry);
+  const EnumTable* GetEnumTable(const google::protobuf::Enum* type);
+
+  // Returns the field with the number of |tag| if it may have the wire type
+  // of |tag|, and null otherwise.
+  static const FieldEntry* FindAndVerifyField(const MessageTable& table,
+                                              uint32_t tag);
+  static const FieldEntry* FindField(const MessageTable& table,
+                                     uint32_t number);
+
+  // Writes the fields of a message up to the current limit, as an object
+  // named |name|.
+  util::Status WriteMessage(const MessageTable& table, StringPiece name);
+  // Writes the fields of a message up to the current limit into the object
+  // open in writer_.
+  util::Status WriteFields(const MessageTable& table);
+  util::Status WriteWellKnownType(const MessageTable& table, StringPiece name);
+
+  // Renderers of the well-known types, reading up to the current limit.
+  util::Status RenderTimestamp(StringPiece name);
+  util::Status RenderDuration(StringPiece name);
+  void RenderWrapper(const MessageTable& table, StringPiece name);
+  util::Status RenderFieldMask(StringPiece name);
+  util::Status RenderStruct(const MessageTable& table, StringPiece name);
+  util::Status RenderStructValue(const MessageTable& table, StringPiece name);
+  util::Status RenderStructListValue(const MessageTable& table,
+                                     StringPiece name);
+  // Reads the fields of a Timestamp or Duration; the last of each wins.
+  void ReadSecondsAndNanos(int64_t* seconds, int32_t* nanos);
+
+  // Render the field starting at the current position. The list and map
+  // variants consume all consecutive values with tag |list_tag| and return
+  // the tag that follows them.
+  util::Status RenderField(const FieldEntry& entry, StringPiece name);
+  util::Status RenderMessageField(const FieldEntry& entry, StringPiece name);
+  void RenderScalarField(const FieldEntry& entry, StringPiece name);
+  void RenderEnum(const FieldEntry& entry, StringPiece name, uint32_t value);
+  util::StatusOr<uint32_t> RenderList(const FieldEntry& entry,
+                                      StringPiece name, uint32_t list_tag);
+  void RenderPacked(const FieldEntry& entry);
+  util::StatusOr<uint32_t> RenderMap(const FieldEntry& entry,
+                                     uint32_t list_tag);
+
+  // Reads a map key into |key| as its string form.
+  void ReadMapKey(const FieldEntry& entry, std::string* key);
+
+  TypeResolver* type_resolver_;
+  std::unique_ptr<TypeInfo> type_info_;
+  const google::protobuf::Type& type_;
+  const Options options_;
+  std::map<const google::protobuf::Type*, std::unique_ptr<MessageTable>>
+      message_tables_;
+  std::map<const google::protobuf::Enum*, std::unique_ptr<EnumTable>>
+      enum_tables_;
+
+  // State of the current WriteTo() call.
+  io::CodedInputStream* input_;
+  XmlObjectWriter* writer_;
+  int depth_;
+  // Sources for the other well-known types met, reading from input_.
+  std::map<const google::protobuf::Type*,
+           std::unique_ptr<ProtoStreamObjectSource>>
+      well_known_sources_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(XmlWireWalker);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_INTERNAL_XML_WIRE_WALKER_H__
@@ -0,0 +1,446 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <google/protobuf/util/internal/xml_wire_walker.h>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/internal/protostream_objectsource.h>
+#include <google/protobuf/util/internal/xml_objectwriter.h>
+#include <google/protobuf/util/json_format_proto3.pb.h>
+#include <google/protobuf/util/type_resolver.h>
+#include <google/protobuf/util/type_resolver_util.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+namespace {
+
+using ::proto3::TestAny;
+using ::proto3::TestDuration;
+using ::proto3::TestFieldMask;
+using ::proto3::TestListValue;
+using ::proto3::TestMap;
+using ::proto3::TestMessage;
+using ::proto3::TestOneof;
+using ::proto3::TestStruct;
+using ::proto3::TestTimestamp;
+using ::proto3::TestValue;
+using ::proto3::TestWrapper;
+
+const char kTypeUrlPrefix[] = "type.googleapis.com";
+
+// The walker must produce exactly what ProtoStreamObjectSource produces, so
+// every test converts the same binary both ways and compares.
+class XmlWireWalkerTest : public ::testing::Test {
+ protected:
+  XmlWireWalkerTest()
+      : resolver_(NewTypeResolverForDescriptorPool(
+            kTypeUrlPrefix, DescriptorPool::generated_pool())) {}
+
+  google::protobuf::Type ResolveType(const Descriptor* descriptor) {
+    google::protobuf::Type type;
+    EXPECT_TRUE(resolver_
+                    ->ResolveMessageType(
+                        StrCat(kTypeUrlPrefix, "/", descriptor->full_name()),
+                        &type)
+                    .ok());
+    return type;
+  }
+
+  util::Status ToXmlWithWalker(XmlWireWalker* walker, const std::string& binary,
+                               const std::string& indent,
+                               std::string* output) {
+    io::CodedInputStream input(
+        reinterpret_cast<const uint8_t*>(binary.data()),
+        static_cast<int>(binary.size()));
+    io::StringOutputStream output_stream(output);
+    io::CodedOutputStream out(&output_stream);
+    XmlObjectWriter writer(indent, &out);
+    return walker->WriteTo(&input, &writer);
+  }
+
+  util::Status ToXmlWithSource(const google::protobuf::Type& type,
+                               const XmlWireWalker::Options& options,
+                               const std::string& binary,
+                               const std::string& indent,
+                               std::string* output) {
+    io::CodedInputStream input(
+        reinterpret_cast<const uint8_t*>(binary.data()),
+        static_cast<int>(binary.size()));
+    ProtoStreamObjectSource::RenderOptions render_options;
+    render_options.use_ints_for_enums = options.use_ints_for_enums;
+    render_options.preserve_proto_field_names =
+        options.preserve_proto_field_names;
+    ProtoStreamObjectSource source(&input, resolver_.get(), type,
+                                   render_options);
+    io::StringOutputStream output_stream(output);
+    io::CodedOutputStream out(&output_stream);
+    XmlObjectWriter writer(indent, &out);
+    return source.WriteTo(&writer);
+  }
+
+  void ExpectSameXml(const Descriptor* descriptor, const std::string& binary,
+                     const XmlWireWalker::Options& options) {
+    const google::protobuf::Type type = ResolveType(descriptor);
+    XmlWireWalker walker(resolver_.get(), type, options);
+    for (const char* indent : {"", " "}) {
+      std::string expected;
+      const util::Status expected_status =
+          ToXmlWithSource(type, options, binary, indent, &expected);
+      // Twice, the second time with the tables already built.
+      for (int i = 0; i < 2; ++i) {
+        std::string actual;
+        const util::Status status =
+            ToXmlWithWalker(&walker, binary, indent, &actual);
+        EXPECT_EQ(expected_status, status);
+        EXPECT_EQ(expected, actual);
+      }
+    }
+  }
+
+  void ExpectSameXml(const Message& message) {
+    XmlWireWalker::Options options;
+    ExpectSameXml(message.GetDescriptor(), message.SerializeAsString(),
+                  options);
+    options.preserve_proto_field_names = true;
+    ExpectSameXml(message.GetDescriptor(), message.SerializeAsString(),
+                  options);
+    options.use_ints_for_enums = true;
+    ExpectSameXml(message.GetDescriptor(), message.SerializeAsString(),
+                  options);
+  }
+
+  static TestMessage AllFields() {
+    TestMessage message;
+    message.set_bool_value(true);
+    message.set_int32_value(-1234567);
+    message.set_int64_value(-9876543210123LL);
+    message.set_uint32_value(4000000000u);
+    message.set_uint64_value(18000000000000000000ULL);
+    message.set_float_value(1.5f);
+    message.set_double_value(-2.25);
+    message.set_string_value("a <string> & \"quotes\"");
+    message.set_bytes_value(std::string("a\0b\xff", 4));
+    message.set_enum_value(proto3::BAR);
+    message.mutable_message_value()->set_value(2048);
+    for (int i = -3; i < 100; i += 7) {
+      message.add_repeated_bool_value(i % 2 == 0);
+      message.add_repeated_int32_value(i * 1000);
+      message.add_repeated_int64_value(i * 100000000000LL);
+      message.add_repeated_uint32_value(static_cast<uint32_t>(i));
+      message.add_repeated_uint64_value(static_cast<uint64_t>(i) * 3);
+      message.add_repeated_float_value(i / 8.0f);
+      message.add_repeated_double_value(i / 3.0);
+      message.add_repeated_string_value(StrCat("s", i));
+      message.add_repeated_bytes_value(StrCat("b", i));
+      message.add_repeated_enum_value(i % 2 == 0 ? proto3::FOO : proto3::BAR);
+      message.add_repeated_message_value()->set_value(i);
+    }
+    return message;
+  }
+
+  std::unique_ptr<TypeResolver> resolver_;
+};
+
+TEST_F(XmlWireWalkerTest, EmptyMessage) { ExpectSameXml(TestMessage()); }
+
+TEST_F(XmlWireWalkerTest, AllFieldKinds) { ExpectSameXml(AllFields()); }
+
+TEST_F(XmlWireWalkerTest, UnknownEnumValues) {
+  TestMessage message;
+  message.set_enum_value(static_cast<proto3::EnumType>(42));
+  message.add_repeated_enum_value(proto3::BAR);
+  message.add_repeated_enum_value(static_cast<proto3::EnumType>(-7));
+  ExpectSameXml(message);
+}
+
+TEST_F(XmlWireWalkerTest, Maps) {
+  TestMap message;
+  (*message.mutable_bool_map())[true] = 1;
+  (*message.mutable_bool_map())[false] = 2;
+  (*message.mutable_int32_map())[-5] = 3;
+  (*message.mutable_int32_map())[0] = 4;
+  (*message.mutable_string_map())["hello"] = 5;
+  (*message.mutable_string_map())[""] = 6;
+  ExpectSameXml(message);
+}
+
+TEST_F(XmlWireWalkerTest, MapEntriesWithMissingKeyOrValue) {
+  const Descriptor* descriptor = TestMap::descriptor();
+  const int number = descriptor->FindFieldByName("int32_map")->number();
+  std::string binary;
+  {
+    io::StringOutputStream output_stream(&binary);
+    io::CodedOutputStream out(&output_stream);
+    // Value only: rendered under the default key.
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        number, internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    out.WriteVarint32(2);
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        2, internal::WireFormatLite::WIRETYPE_VARINT));
+    out.WriteVarint32(7);
+    // Key only: not rendered at all.
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        number, internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    out.WriteVarint32(2);
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        1, internal::WireFormatLite::WIRETYPE_VARINT));
+    out.WriteVarint32(9);
+  }
+  ExpectSameXml(descriptor, binary, XmlWireWalker::Options());
+}
+
+TEST_F(XmlWireWalkerTest, UnknownFieldsAndSplitLists) {
+  const TestMessage message = AllFields();
+  const Descriptor* descriptor = TestMessage::descriptor();
+  const int packed = descriptor->FindFieldByName("repeated_int32_value")
+                         ->number();
+  const int int32 = descriptor->FindFieldByName("int32_value")->number();
+  std::string binary = message.SerializeAsString();
+  {
+    io::StringOutputStream output_stream(&binary);
+    io::CodedOutputStream out(&output_stream);
+    // Unknown fields are skipped.
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        999, internal::WireFormatLite::WIRETYPE_VARINT));
+    out.WriteVarint64(12345);
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        998, internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    out.WriteVarint32(3);
+    out.WriteRaw("abc", 3);
+    // So is a known field with the wrong wire type.
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        int32, internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    out.WriteVarint32(1);
+    out.WriteRaw("z", 1);
+    // A packed field may also arrive unpacked; every run is its own list.
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        packed, internal::WireFormatLite::WIRETYPE_VARINT));
+    out.WriteVarint32(11);
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        packed, internal::WireFormatLite::WIRETYPE_VARINT));
+    out.WriteVarint32(12);
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        packed, internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    out.WriteVarint32(2);
+    out.WriteVarint32(1);
+    out.WriteVarint32(2);
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        packed, internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    out.WriteVarint32(1);
+    out.WriteVarint32(3);
+  }
+  ExpectSameXml(descriptor, binary, XmlWireWalker::Options());
+}
+
+TEST_F(XmlWireWalkerTest, TruncatedInput) {
+  const std::string binary = AllFields().SerializeAsString();
+  for (size_t size = 0; size < binary.size(); size += 13) {
+    ExpectSameXml(TestMessage::descriptor(), binary.substr(0, size),
+                  XmlWireWalker::Options());
+  }
+}
+
+TEST_F(XmlWireWalkerTest, WellKnownTypes) {
+  TestAny any;
+  any.mutable_value()->PackFrom(AllFields());
+  ExpectSameXml(any);
+
+  TestTimestamp timestamp;
+  timestamp.mutable_value()->set_seconds(1234567890);
+  timestamp.mutable_value()->set_nanos(5000);
+  ExpectSameXml(timestamp);
+
+  TestWrapper wrapper;
+  wrapper.mutable_bool_value()->set_value(true);
+  wrapper.mutable_int32_value();
+  ExpectSameXml(wrapper);
+
+  TestStruct message;
+  (*message.mutable_value()->mutable_fields())["number"].set_number_value(1);
+  (*message.mutable_value()->mutable_fields())["string"].set_string_value(
+      "text");
+  ExpectSameXml(message);
+}
+
+TEST_F(XmlWireWalkerTest, TimestampsAndDurations) {
+  TestTimestamp timestamp;
+  timestamp.mutable_value()->set_seconds(-62135596800LL);
+  for (int32_t nanos : {0, 1, 120000000, 120001000, 999999999}) {
+    google::protobuf::Timestamp* value = timestamp.add_repeated_value();
+    value->set_seconds(253402300799LL);
+    value->set_nanos(nanos);
+  }
+  ExpectSameXml(timestamp);
+
+  TestDuration duration;
+  duration.mutable_value()->set_seconds(-1);
+  duration.mutable_value()->set_nanos(-500000000);
+  for (int32_t nanos : {0, -1, 120000, 999999999}) {
+    google::protobuf::Duration* value = duration.add_repeated_value();
+    value->set_seconds(nanos > 0 ? 315576000000LL : 0);
+    value->set_nanos(nanos);
+  }
+  ExpectSameXml(duration);
+
+  // Out of range values fail like they do in ProtoStreamObjectSource.
+  timestamp.mutable_value()->set_seconds(253402300800LL);
+  ExpectSameXml(timestamp);
+  timestamp.mutable_value()->set_seconds(0);
+  timestamp.mutable_value()->set_nanos(-1);
+  ExpectSameXml(timestamp);
+  duration.mutable_value()->set_seconds(-1);
+  duration.mutable_value()->set_nanos(1);
+  ExpectSameXml(duration);
+  duration.mutable_value()->set_seconds(1);
+  duration.mutable_value()->set_nanos(-5);
+  ExpectSameXml(duration);
+}
+
+TEST_F(XmlWireWalkerTest, WrappersAndFieldMasks) {
+  TestWrapper wrapper;
+  wrapper.mutable_bool_value();
+  wrapper.mutable_int32_value()->set_value(-7);
+  wrapper.mutable_int64_value()->set_value(-9876543210123LL);
+  wrapper.mutable_uint32_value()->set_value(4000000000u);
+  wrapper.mutable_uint64_value();
+  wrapper.mutable_float_value()->set_value(1.5f);
+  wrapper.mutable_double_value()->set_value(-2.25);
+  wrapper.mutable_string_value()->set_value("a <string>");
+  wrapper.mutable_bytes_value()->set_value(std::string("a\0b\xff", 4));
+  wrapper.add_repeated_int32_value()->set_value(1);
+  wrapper.add_repeated_int32_value();
+  ExpectSameXml(wrapper);
+
+  TestFieldMask mask;
+  mask.mutable_value()->add_paths("foo_bar.baz_qux");
+  mask.mutable_value()->add_paths("");
+  mask.mutable_value()->add_paths("a");
+  ExpectSameXml(mask);
+
+  // Bytes after the value of a wrapper, and fields other than paths in a
+  // field mask, are errors.
+  const Descriptor* descriptor = TestWrapper::descriptor();
+  const int int32 = descriptor->FindFieldByName("int32_value")->number();
+  std::string binary;
+  {
+    io::StringOutputStream output_stream(&binary);
+    io::CodedOutputStream out(&output_stream);
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        int32, internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    out.WriteVarint32(4);
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        1, internal::WireFormatLite::WIRETYPE_VARINT));
+    out.WriteVarint32(1);
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        1, internal::WireFormatLite::WIRETYPE_VARINT));
+    out.WriteVarint32(2);
+  }
+  ExpectSameXml(descriptor, binary, XmlWireWalker::Options());
+  binary.clear();
+  {
+    io::StringOutputStream output_stream(&binary);
+    io::CodedOutputStream out(&output_stream);
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        1, internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    out.WriteVarint32(2);
+    out.WriteTag(internal::WireFormatLite::MakeTag(
+        2, internal::WireFormatLite::WIRETYPE_VARINT));
+    out.WriteVarint32(1);
+  }
+  ExpectSameXml(TestFieldMask::descriptor(), binary,
+                XmlWireWalker::Options());
+}
+
+TEST_F(XmlWireWalkerTest, StructValues) {
+  TestStruct message;
+  auto& fields = *message.mutable_value()->mutable_fields();
+  fields["null"].set_null_value(google::protobuf::NULL_VALUE);
+  fields["bool"].set_bool_value(false);
+  fields["string"].set_string_value("text");
+  fields["empty"];
+  (*fields["object"].mutable_struct_value()->mutable_fields())["inner"];
+  google::protobuf::ListValue* list = fields["list"].mutable_list_value();
+  list->add_values()->set_number_value(0.25);
+  list->add_values();
+  list->add_values()->mutable_list_value();
+  message.add_repeated_value();
+  ExpectSameXml(message);
+
+  TestValue value;
+  value.mutable_value()->mutable_list_value();
+  value.add_repeated_value()->set_string_value("x");
+  value.add_repeated_value();
+  value.add_repeated_value()->mutable_struct_value();
+  ExpectSameXml(value);
+
+  TestListValue list_value;
+  list_value.mutable_value();
+  list_value.add_repeated_value()->add_values()->set_bool_value(true);
+  ExpectSameXml(list_value);
+}
+
+TEST_F(XmlWireWalkerTest, Oneof) {
+  TestOneof message;
+  message.set_oneof_int32_value(7);
+  ExpectSameXml(message);
+}
+
+TEST_F(XmlWireWalkerTest, RecursionLimit) {
+  TestMessage message;
+  message.mutable_message_value()->set_value(1);
+  const std::string binary = message.SerializeAsString();
+  XmlWireWalker::Options options;
+  options.max_recursion_depth = 0;
+  const google::protobuf::Type type = ResolveType(TestMessage::descriptor());
+  XmlWireWalker walker(resolver_.get(), type, options);
+  std::string output;
+  const util::Status status =
+      ToXmlWithWalker(&walker, binary, "", &output);
+  EXPECT_EQ(util::StatusCode::kInvalidArgument, status.code());
+  EXPECT_NE(std::string::npos,
+            std::string(status.message()).find("Message too deep"));
+}
+
+}  // namespace
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,712 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/xml_benchmark_util.h>
+
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/type_resolver_util.h>
+#include <google/protobuf/util/xml_benchmark.pb.h>
+#include <google/protobuf/util/xml_corpus_generator.h>
+#include <google/protobuf/util/xml_util.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // __linux__
+
+namespace {
+thread_local int64_t thread_allocation_count = 0;
+}  // namespace
+
+// Replace the global allocation functions so benchmarks can report
+// allocations per operation. Only the count is added; storage still comes
+// from malloc.
+void* operator new(size_t size) {
+  ++thread_allocation_count;
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) { return ::operator new(size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  ++thread_allocation_count;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+  return ::operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+
+using ::proto_util_xml_benchmark::AddressBook;
+using ::proto_util_xml_benchmark::AnyEnvelope;
+using ::proto_util_xml_benchmark::BytesHeavy;
+using ::proto_util_xml_benchmark::DeepNested;
+using ::proto_util_xml_benchmark::DeepNestedList;
+using ::proto_util_xml_benchmark::EventTelemetry;
+using ::proto_util_xml_benchmark::LargeMap;
+using ::proto_util_xml_benchmark::MapHeavy;
+using ::proto_util_xml_benchmark::NumericHeavy;
+using ::proto_util_xml_benchmark::Person;
+using ::proto_util_xml_benchmark::StringHeavy;
+using ::proto_util_xml_benchmark::WideFlat;
+using ::proto_util_xml_benchmark::WideFlatList;
+
+namespace {
+
+const char kTypeUrlPrefix[] = "type.googleapis.com";
+
+// Depth of each DeepNested chain. ProtoStreamObjectSource refuses messages
+// nested deeper than 64 levels.
+const int kDeepNestingDepth = 48;
+
+// A tiny deterministic generator so every run sees identical corpora.
+class Lcg {
+ public:
+  explicit Lcg(uint64_t seed) : state_(seed) {}
+
+  uint32_t Next() {
+    state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    return static_cast<uint32_t>(state_ >> 33);
+  }
+
+  uint32_t Uniform(uint32_t n) { return Next() % n; }
+
+  // Alphanumeric text with single spaces. Avoids characters that would be
+  // escaped or that the XML parser rejects in text nodes, so the XML form
+  // round-trips.
+  std::string Text(int length) {
+    static const char kAlphabet[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    std::string result;
+    result.reserve(length);
+    for (int i = 0; i < length; ++i) {
+      if (i > 0 && i + 1 < length && Uniform(8) == 0) {
+        result.push_back(' ');
+      } else {
+        result.push_back(kAlphabet[Uniform(sizeof(kAlphabet) - 1)]);
+      }
+    }
+    return result;
+  }
+
+  // A valid XML attribute / tag name, used for map keys.
+  std::string Key(int index) { return StrCat("k", index, "_", Text(6)); }
+
+  std::string Bytes(int length) {
+    std::string result(length, '\0');
+    for (int i = 0; i < length; ++i) {
+      result[i] = static_cast<char>(Next() & 0xff);
+    }
+    return result;
+  }
+
+ private:
+  uint64_t state_;
+};
+
+std::unique_ptr<Message> MakeAddressBook(Lcg* rng, int people) {
+  std::unique_ptr<AddressBook> book(new AddressBook);
+  for (int i = 0; i < people; ++i) {
+    Person* person = book->add_people();
+    person->set_name(rng->Text(8 + rng->Uniform(16)));
+    person->set_id(static_cast<int32_t>(rng->Next() & 0x7fffffff));
+    person->set_email(StrCat(rng->Text(10), "@example.com"));
+    int phones = rng->Uniform(4);
+    for (int j = 0; j < phones; ++j) {
+      Person::PhoneNumber* phone = person->add_phones();
+      phone->set_number(StrCat(1000000000ULL + rng->Next()));
+      phone->set_type(static_cast<Person::PhoneType>(rng->Uniform(3)));
+    }
+  }
+  return book;
+}
+
+std::unique_ptr<Message> MakeDeepNesting(Lcg* rng) {
+  std::unique_ptr<DeepNestedList> list(new DeepNestedList);
+  for (int i = 0; i < 200; ++i) {
+    DeepNested* node = list->add_chains();
+    for (int depth = 0; depth < kDeepNestingDepth; ++depth) {
+      node->set_depth(depth);
+      node->set_label(rng->Text(4));
+      if (depth + 1 < kDeepNestingDepth) node = node->mutable_child();
+    }
+  }
+  return list;
+}
+
+std::unique_ptr<Message> MakeWideFlat(Lcg* rng) {
+  std::unique_ptr<WideFlatList> list(new WideFlatList);
+  for (int i = 0; i < 500; ++i) {
+    WideFlat* row = list->add_rows();
+    row->set_f_int32_1(static_cast<int32_t>(rng->Next()));
+    row->set_f_int32_2(static_cast<int32_t>(rng->Uniform(1000)));
+    row->set_f_int32_3(-static_cast<int32_t>(rng->Uniform(1000000)));
+    row->set_f_int32_4(static_cast<int32_t>(rng->Next()));
+    row->set_f_int64_1((static_cast<int64_t>(rng->Next()) << 31) | rng->Next());
+    row->set_f_int64_2(rng->Uniform(100));
+    row->set_f_int64_3(-static_cast<int64_t>(rng->Next()));
+    row->set_f_int64_4(static_cast<int64_t>(rng->Next()) << 20);
+    row->set_f_uint32_1(rng->Next());
+    row->set_f_uint32_2(rng->Uniform(256));
+    row->set_f_uint64_1((static_cast<uint64_t>(rng->Next()) << 32) |
+                        rng->Next());
+    row->set_f_uint64_2(rng->Next());
+    row->set_f_sint32_1(static_cast<int32_t>(rng->Next()));
+    row->set_f_sint64_1(-static_cast<int64_t>(rng->Next()) * 1000);
+    row->set_f_fixed32_1(rng->Next());
+    row->set_f_fixed64_1((static_cast<uint64_t>(rng->Next()) << 32) |
+                         rng->Next());
+    row->set_f_double_1(rng->Next() / 3.0);
+    row->set_f_double_2(-1.0 / (1 + rng->Uniform(1000)));
+    row->set_f_float_1(rng->Next() / 7.0f);
+    row->set_f_float_2(rng->Uniform(100) / 4.0f);
+    row->set_f_bool_1(rng->Uniform(2) == 0);
+    row->set_f_bool_2(true);
+    row->set_f_string_1(rng->Text(4));
+    row->set_f_string_2(rng->Text(12));
+    row->set_f_string_3(rng->Text(20));
+    row->set_f_string_4(rng->Text(1));
+    row->set_f_enum_1(static_cast<Person::PhoneType>(1 + rng->Uniform(2)));
+    row->set_f_enum_2(Person::WORK);
+  }
+  return list;
+}
+
+std::unique_ptr<Message> MakeStringHeavy(Lcg* rng) {
+  std::unique_ptr<StringHeavy> message(new StringHeavy);
+  message->set_title(rng->Text(1024));
+  for (int i = 0; i < 512; ++i) {
+    message->add_values(rng->Text(64 + rng->Uniform(512)));
+  }
+  return message;
+}
+
+std::unique_ptr<Message> MakeBytesHeavy(Lcg* rng) {
+  std::unique_ptr<BytesHeavy> message(new BytesHeavy);
+  for (int i = 0; i < 128; ++i) {
+    message->add_blobs(rng->Bytes(256 + rng->Uniform(2048)));
+  }
+  return message;
+}
+
+std::unique_ptr<Message> MakeNumericHeavy(Lcg* rng) {
+  std::unique_ptr<NumericHeavy> message(new NumericHeavy);
+  for (int i = 0; i < 4000; ++i) {
+    message->add_int32_values(static_cast<int32_t>(rng->Next()));
+    message->add_int64_values((static_cast<int64_t>(rng->Next()) << 30) ^
+                              rng->Next());
+    message->add_sint32_values(-static_cast<int32_t>(rng->Uniform(100000)));
+    message->add_fixed32_values(rng->Next());
+    message->add_double_values(rng->Next() / 1000.0);
+    message->add_float_values(rng->Uniform(1 << 20) / 64.0f);
+  }
+  return message;
+}
+
+std::unique_ptr<Message> MakeMapHeavy(Lcg* rng) {
+  std::unique_ptr<MapHeavy> message(new MapHeavy);
+  for (int i = 0; i < 2000; ++i) {
+    (*message->mutable_counters())[rng->Key(i)] =
+        static_cast<int32_t>(rng->Uniform(100000));
+    (*message->mutable_labels())[rng->Key(i)] = rng->Text(16);
+    MapHeavy::Item& item = (*message->mutable_items())[rng->Key(i)];
+    item.set_label(rng->Text(8));
+    item.set_count(static_cast<int32_t>(rng->Uniform(1000)));
+  }
+  return message;
+}
+
+std::unique_ptr<Message> MakeLargeMap(Lcg* rng) {
+  std::unique_ptr<LargeMap> message(new LargeMap);
+  for (int i = 0; i < 128 * 1024; ++i) {
+    (*message->mutable_counters())[rng->Key(i)] =
+        static_cast<int64_t>(rng->Next()) << 8;
+    (*message->mutable_labels())[rng->Key(i)] = rng->Text(12);
+  }
+  return message;
+}
+
+std::unique_ptr<Message> MakeEventTelemetry(Lcg* rng) {
+  std::unique_ptr<EventTelemetry> message(new EventTelemetry);
+  int64_t seconds = 1600000000;
+  for (int i = 0; i < 2000; ++i) {
+    EventTelemetry::Event* event = message->add_events();
+    event->set_name(rng->Text(8));
+    seconds += rng->Uniform(60);
+    // Whole seconds, milliseconds and nanoseconds, as clocks report them.
+    int32_t nanos = 0;
+    if (i % 3 == 1) nanos = rng->Uniform(1000) * 1000000;
+    if (i % 3 == 2) nanos = rng->Uniform(1000000000);
+    event->mutable_start_time()->set_seconds(seconds);
+    event->mutable_start_time()->set_nanos(nanos);
+    const int32_t latency_nanos = rng->Uniform(1000000000);
+    event->mutable_end_time()->set_seconds(seconds + 1);
+    event->mutable_end_time()->set_nanos(latency_nanos);
+    event->mutable_latency()->set_seconds(rng->Uniform(2));
+    event->mutable_latency()->set_nanos(latency_nanos);
+    event->mutable_sequence()->set_value(i);
+    event->mutable_host()->set_value(rng->Text(12));
+  }
+  return message;
+}
+
+std::unique_ptr<Message> MakeAnyEnvelope(Lcg* rng) {
+  std::unique_ptr<AnyEnvelope> message(new AnyEnvelope);
+  for (int i = 0; i < 2000; ++i) {
+    AnyEnvelope::Record* record = message->add_records();
+    // A few payload types, so that most are resolved from the cache.
+    if (i % 2 == 0) {
+      record->set_topic("people");
+      Person person;
+      person.set_name(rng->Text(12));
+      person.set_id(i);
+      person.set_email(rng->Text(16));
+      Person::PhoneNumber* phone = person.add_phones();
+      phone->set_number(rng->Text(10));
+      phone->set_type(Person::WORK);
+      record->mutable_payload()->PackFrom(person);
+    } else {
+      record->set_topic("rows");
+      WideFlat row;
+      row.set_f_int32_1(static_cast<int32_t>(rng->Uniform(100000)));
+      row.set_f_int64_1(static_cast<int64_t>(rng->Uniform(1000000000)));
+      row.set_f_double_1(rng->Uniform(1000000) / 1000.0);
+      row.set_f_bool_1(i % 3 == 0);
+      row.set_f_string_1(rng->Text(8));
+      row.set_f_enum_1(Person::HOME);
+      record->mutable_payload()->PackFrom(row);
+    }
+  }
+  return message;
+}
+
+// Generates the custom corpus described by the XML_BENCHMARK_* environment
+// variables into |corpus|. The descriptor pool, factory and resolver it
+// creates live as long as the corpus, i.e. until the process exits.
+void BuildCustomCorpus(Corpus* corpus) {
+  const char* message_name = std::getenv("XML_BENCHMARK_MESSAGE");
+  GOOGLE_CHECK(message_name != nullptr) << "XML_BENCHMARK_MESSAGE is not set";
+  const DescriptorPool* pool = DescriptorPool::generated_pool();
+  MessageFactory* factory = MessageFactory::generated_factory();
+  corpus->resolver = GetBenchmarkTypeResolver();
+  const char* descriptor_set = std::getenv("XML_BENCHMARK_DESCRIPTOR_SET");
+  if (descriptor_set != nullptr) {
+    DescriptorPool* custom_pool = new DescriptorPool;
+    util::Status status = LoadDescriptorSet(descriptor_set, custom_pool);
+    GOOGLE_CHECK(status.ok()) << status;
+    pool = custom_pool;
+    factory = new DynamicMessageFactory(custom_pool);
+    corpus->resolver =
+        NewTypeResolverForDescriptorPool(kTypeUrlPrefix, custom_pool);
+  }
+  const Descriptor* descriptor = pool->FindMessageTypeByName(message_name);
+  GOOGLE_CHECK(descriptor != nullptr)
+      << "Unknown message type " << message_name;
+
+  CorpusSpec spec;
+  const char* spec_text = std::getenv("XML_BENCHMARK_CORPUS_SPEC");
+  if (spec_text != nullptr) {
+    util::Status status = ParseCorpusSpec(spec_text, &spec);
+    GOOGLE_CHECK(status.ok()) << status;
+  }
+  corpus->name = "custom";
+  corpus->message.reset(factory->GetPrototype(descriptor)->New());
+  GenerateMessage(spec, corpus->message.get());
+}
+
+// Counts the start and empty-element tags of |xml|.
+int64_t CountElements(const std::string& xml) {
+  int64_t elements = 0;
+  for (size_t i = xml.find('<'); i != std::string::npos && i + 1 < xml.size();
+       i = xml.find('<', i + 1)) {
+    const char next = xml[i + 1];
+    if (next != '/' && next != '?' && next != '!') ++elements;
+  }
+  return elements;
+}
+
+Corpus* BuildCorpus(CorpusShape shape) {
+  Corpus* corpus = new Corpus;
+  corpus->resolver = GetBenchmarkTypeResolver();
+  Lcg rng(static_cast<uint64_t>(shape) + 1);
+  switch (shape) {
+    case CorpusShape::kAddressBook:
+      corpus->name = "address_book";
+      corpus->message = MakeAddressBook(&rng, 2000);
+      break;
+    case CorpusShape::kLargeAddressBook:
+      corpus->name = "large_address_book";
+      corpus->message = MakeAddressBook(&rng, 1000000);
+      break;
+    case CorpusShape::kDeepNesting:
+      corpus->name = "deep_nesting";
+      corpus->message = MakeDeepNesting(&rng);
+      break;
+    case CorpusShape::kWideFlat:
+      corpus->name = "wide_flat";
+      corpus->message = MakeWideFlat(&rng);
+      break;
+    case CorpusShape::kStringHeavy:
+      corpus->name = "string_heavy";
+      corpus->message = MakeStringHeavy(&rng);
+      break;
+    case CorpusShape::kBytesHeavy:
+      corpus->name = "bytes_heavy";
+      corpus->message = MakeBytesHeavy(&rng);
+      break;
+    case CorpusShape::kNumericHeavy:
+      corpus->name = "numeric_heavy";
+      corpus->message = MakeNumericHeavy(&rng);
+      break;
+    case CorpusShape::kMapHeavy:
+      corpus->name = "map_heavy";
+      corpus->message = MakeMapHeavy(&rng);
+      break;
+    case CorpusShape::kLargeMap:
+      corpus->name = "large_map";
+      corpus->message = MakeLargeMap(&rng);
+      break;
+    case CorpusShape::kEventTelemetry:
+      corpus->name = "event_telemetry";
+      corpus->message = MakeEventTelemetry(&rng);
+      break;
+    case CorpusShape::kAnyEnvelope:
+      corpus->name = "any_envelope";
+      corpus->message = MakeAnyEnvelope(&rng);
+      break;
+    case CorpusShape::kCustom:
+      BuildCustomCorpus(corpus);
+      break;
+  }
+  corpus->type_url = StrCat(kTypeUrlPrefix, "/",
+                            corpus->message->GetDescriptor()->full_name());
+  corpus->binary = corpus->message->SerializeAsString();
+  util::Status status = MessageToXmlString(*corpus->message, &corpus->xml);
+  GOOGLE_CHECK(status.ok()) << corpus->name << ": " << status;
+  corpus->elements = CountElements(corpus->xml);
+  return corpus;
+}
+
+}  // namespace
+
+const Corpus& GetCorpus(CorpusShape shape) {
+  static Corpus* corpora[static_cast<int>(CorpusShape::kCustom) + 1] = {};
+  // Multi-threaded benchmarks look up their corpora from every thread.
+  static std::mutex* mutex = new std::mutex;
+  std::lock_guard<std::mutex> lock(*mutex);
+  Corpus*& corpus = corpora[static_cast<int>(shape)];
+  if (corpus == nullptr) corpus = BuildCorpus(shape);
+  return *corpus;
+}
+
+TypeResolver* GetBenchmarkTypeResolver() {
+  static TypeResolver* resolver = NewTypeResolverForDescriptorPool(
+      kTypeUrlPrefix, DescriptorPool::generated_pool());
+  return resolver;
+}
+
+bool HasCustomCorpus() {
+  return std::getenv("XML_BENCHMARK_MESSAGE") != nullptr;
+}
+
+SegmentedZeroCopyInputStream::SegmentedZeroCopyInputStream(
+    StringPiece data, std::vector<int> segment_lengths)
+    : data_(data),
+      segment_lengths_(std::move(segment_lengths)),
+      next_segment_(0),
+      position_(0),
+      backed_up_(0) {}
+
+bool SegmentedZeroCopyInputStream::Next(const void** data, int* size) {
+  if (backed_up_ > 0) {
+    *data = data_.data() + position_;
+    *size = backed_up_;
+    position_ += backed_up_;
+    backed_up_ = 0;
+    return true;
+  }
+  if (position_ >= static_cast<int64_t>(data_.size())) return false;
+  int length = next_segment_ < segment_lengths_.size()
+                   ? segment_lengths_[next_segment_++]
+                   : static_cast<int>(data_.size() - position_);
+  length = std::min<int64_t>(length, data_.size() - position_);
+  *data = data_.data() + position_;
+  *size = length;
+  position_ += length;
+  return true;
+}
+
+void SegmentedZeroCopyInputStream::BackUp(int count) {
+  GOOGLE_CHECK_LE(count, position_);
+  position_ -= count;
+  backed_up_ += count;
+}
+
+bool SegmentedZeroCopyInputStream::Skip(int count) {
+  const void* data;
+  int size;
+  while (count > 0) {
+    if (!Next(&data, &size)) return false;
+    if (size > count) {
+      BackUp(size - count);
+      return true;
+    }
+    count -= size;
+  }
+  return true;
+}
+
+std::vector<int> RandomSegmentation(size_t total, int max_segment,
+                                    uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> log_length(
+      0.0, std::log(static_cast<double>(max_segment) + 1));
+  std::vector<int> lengths;
+  size_t covered = 0;
+  while (covered < total) {
+    int length = static_cast<int>(std::exp(log_length(rng)));
+    length = std::max(1, std::min(length, max_segment));
+    lengths.push_back(length);
+    covered += length;
+  }
+  return lengths;
+}
+
+int64_t ThreadAllocationCount() { return thread_allocation_count; }
+
+namespace {
+
+// Returns the value of a "<field>:  <n> kB" line of /proc/self/status in
+// bytes, or -1.
+int64_t ReadProcStatusBytes(const std::string& field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (!HasPrefixString(line, field + ":")) continue;
+    int64_t kilobytes;
+    std::istringstream value(line.substr(field.size() + 1));
+    if (!(value >> kilobytes)) return -1;
+    return kilobytes * 1024;
+  }
+  return -1;
+}
+
+}  // namespace
+
+int64_t CurrentRssBytes() { return ReadProcStatusBytes("VmRSS"); }
+
+int64_t PeakRssBytes() { return ReadProcStatusBytes("VmHWM"); }
+
+bool ResetPeakRss() {
+  // Writing 5 to clear_refs resets VmHWM to the current RSS.
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  clear_refs.close();
+  return !clear_refs.fail();
+}
+
+namespace {
+
+#ifdef __linux__
+struct EventConfig {
+  uint32_t type;
+  uint64_t config;
+};
+
+const EventConfig kEventConfigs[HardwareCounters::NUM_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+
+// Opens a counter for |config| on the calling thread, on any CPU. Returns -1
+// on failure.
+int OpenEvent(const EventConfig& config) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = config.type;
+  attr.config = config.config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int>(
+      syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+#endif  // __linux__
+
+}  // namespace
+
+HardwareCounters::HardwareCounters() {
+  for (int i = 0; i < NUM_EVENTS; ++i) {
+    fds_[i] = -1;
+    values_[i] = 0;
+    started_[i] = 0;
+#ifdef __linux__
+    if (Enabled()) fds_[i] = OpenEvent(kEventConfigs[i]);
+#endif  // __linux__
+  }
+}
+
+HardwareCounters::~HardwareCounters() {
+#ifdef __linux__
+  for (int i = 0; i < NUM_EVENTS; ++i) {
+    if (fds_[i] >= 0) close(fds_[i]);
+  }
+#endif  // __linux__
+}
+
+bool HardwareCounters::Enabled() {
+  static const bool enabled = [] {
+    const char* value = std::getenv("XML_BENCHMARK_PERF_COUNTERS");
+    return value != nullptr && strcmp(value, "1") == 0;
+  }();
+  return enabled;
+}
+
+const char* HardwareCounters::EventName(Event event) {
+  switch (event) {
+    case INSTRUCTIONS:
+      return "instructions";
+    case CYCLES:
+      return "cycles";
+    case BRANCH_MISSES:
+      return "branch_misses";
+    case L1D_READ_MISSES:
+      return "l1d_misses";
+    case LLC_MISSES:
+      return "llc_misses";
+    case NUM_EVENTS:
+      break;
+  }
+  return "unknown";
+}
+
+void HardwareCounters::Start() {
+  for (int i = 0; i < NUM_EVENTS; ++i) {
+    if (fds_[i] >= 0) started_[i] = Read(static_cast<Event>(i));
+  }
+}
+
+void HardwareCounters::Stop() {
+  for (int i = 0; i < NUM_EVENTS; ++i) {
+    if (fds_[i] >= 0) values_[i] += Read(static_cast<Event>(i)) - started_[i];
+  }
+}
+
+int64_t HardwareCounters::Read(Event event) const {
+#ifdef __linux__
+  // Laid out as requested by read_format.
+  uint64_t data[3];
+  if (read(fds_[event], data, sizeof(data)) != sizeof(data)) return 0;
+  const uint64_t value = data[0];
+  const uint64_t enabled = data[1];
+  const uint64_t running = data[2];
+  if (running == 0) return 0;
+  if (running == enabled) return static_cast<int64_t>(value);
+  return static_cast<int64_t>(static_cast<double>(value) *
+                              static_cast<double>(enabled) /
+                              static_cast<double>(running));
+#else
+  return 0;
+#endif  // __linux__
+}
+
+void ReportHardwareCounters(const HardwareCounters& counters,
+                            int64_t bytes_per_iteration,
+                            int64_t elements_per_iteration,
+                            benchmark::State& state) {
+  const double iterations = static_cast<double>(state.iterations());
+  if (iterations == 0) return;
+  for (int i = 0; i < HardwareCounters::NUM_EVENTS; ++i) {
+    const HardwareCounters::Event event =
+        static_cast<HardwareCounters::Event>(i);
+    if (!counters.available(event)) continue;
+    const double value = static_cast<double>(counters.value(event));
+    const std::string name = HardwareCounters::EventName(event);
+    if (bytes_per_iteration > 0) {
+      state.counters[name + "/byte"] =
+          value / (iterations * static_cast<double>(bytes_per_iteration));
+    }
+    if (elements_per_iteration > 0) {
+      state.counters[name + "/elem"] =
+          value / (iterations * static_cast<double>(elements_per_iteration));
+    }
+  }
+  if (counters.available(HardwareCounters::INSTRUCTIONS) &&
+      counters.available(HardwareCounters::CYCLES) &&
+      counters.value(HardwareCounters::CYCLES) > 0) {
+    state.counters["ipc"] =
+        static_cast<double>(counters.value(HardwareCounters::INSTRUCTIONS)) /
+        static_cast<double>(counters.value(HardwareCounters::CYCLES));
+  }
+}
+
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
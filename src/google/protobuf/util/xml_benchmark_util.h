@@ -0,0 +1,266 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Shared helpers for the xml_util benchmarks: representative corpora for the
+// message shapes in xml_benchmark.proto, a per-thread allocation counter and
+// optional hardware performance counters.
+#ifndef GOOGLE_PROTOBUF_UTIL_XML_BENCHMARK_UTIL_H__
+#define GOOGLE_PROTOBUF_UTIL_XML_BENCHMARK_UTIL_H__
+
+#include <benchmark/benchmark.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/stubs/stringpiece.h>
+#include <google/protobuf/util/internal/object_writer.h>
+#include <google/protobuf/util/type_resolver.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+
+enum class CorpusShape {
+  kAddressBook,
+  kDeepNesting,
+  kWideFlat,
+  kStringHeavy,
+  kBytesHeavy,
+  kNumericHeavy,
+  kMapHeavy,
+  kLargeMap,
+  kEventTelemetry,
+  kAnyEnvelope,
+  // An address book of a million people, about 60 MB of binary, for the
+  // parallel conversion.
+  kLargeAddressBook,
+  // Generated from the type and spec named in the environment; see
+  // HasCustomCorpus().
+  kCustom,
+};
+
+// A message together with its binary and XML encodings. The XML is produced
+// by MessageToXmlString() with default options, so it round-trips through
+// XmlStringToMessage().
+struct Corpus {
+  std::string name;
+  std::string type_url;
+  std::unique_ptr<Message> message;
+  std::string binary;
+  std::string xml;
+  // Number of elements in |xml|, counting start and empty-element tags.
+  int64_t elements;
+  // Resolves type_url. Owned by the corpus' descriptor pool setup and never
+  // deleted.
+  TypeResolver* resolver;
+};
+
+// Returns the corpus for |shape|. Corpora are built on first use and live
+// until the process exits. Thread-safe. Each one is between 64KB and 512KB of
+// XML.
+const Corpus& GetCorpus(CorpusShape shape);
+
+// A TypeResolver over the generated pool, shared by all benchmarks.
+TypeResolver* GetBenchmarkTypeResolver();
+
+// Whether a custom corpus is configured. Benchmarks register a "custom" case
+// for CorpusShape::kCustom only when it is. The corpus is generated by
+// GenerateMessage() (see xml_corpus_generator.h) from these environment
+// variables:
+//   XML_BENCHMARK_MESSAGE         Full name of the message type. Required.
+//   XML_BENCHMARK_DESCRIPTOR_SET  FileDescriptorSet that defines the type.
+//                                 The generated pool is used when unset.
+//   XML_BENCHMARK_CORPUS_SPEC     CorpusSpec in ParseCorpusSpec() syntax.
+// For example, to reproduce an issue with your own schema offline:
+//   protoc --include_imports --descriptor_set_out=/tmp/my.desc my.proto
+//   export XML_BENCHMARK_DESCRIPTOR_SET=/tmp/my.desc
+//   export XML_BENCHMARK_MESSAGE=my.Document
+//   export XML_BENCHMARK_CORPUS_SPEC=seed=3,target_bytes=8388608
+//   bazel run -c opt :xml_util_benchmark -- --benchmark_filter=custom
+bool HasCustomCorpus();
+
+// A ZeroCopyInputStream that hands out |data| in segments of the given
+// lengths, in order. Used to reproduce how network and Cord inputs arrive.
+class SegmentedZeroCopyInputStream : public io::ZeroCopyInputStream {
+ public:
+  SegmentedZeroCopyInputStream(StringPiece data,
+                               std::vector<int> segment_lengths);
+
+  bool Next(const void** data, int* size) override;
+  void BackUp(int count) override;
+  bool Skip(int count) override;
+  int64_t ByteCount() const override { return position_; }
+
+ private:
+  StringPiece data_;
+  std::vector<int> segment_lengths_;
+  size_t next_segment_;
+  int64_t position_;
+  // Bytes backed up from the last segment and not yet returned again.
+  int backed_up_;
+};
+
+// Accepts and discards all events, so that only the producer of the events
+// is measured.
+class NullObjectWriter : public converter::ObjectWriter {
+ public:
+  NullObjectWriter() {}
+
+  ObjectWriter* StartObject(StringPiece name) override { return this; }
+  ObjectWriter* EndObject() override { return this; }
+  ObjectWriter* StartList(StringPiece name) override { return this; }
+  ObjectWriter* EndList() override { return this; }
+  ObjectWriter* RenderBool(StringPiece name, bool value) override {
+    return this;
+  }
+  ObjectWriter* RenderInt32(StringPiece name, int32_t value) override {
+    return this;
+  }
+  ObjectWriter* RenderUint32(StringPiece name, uint32_t value) override {
+    return this;
+  }
+  ObjectWriter* RenderInt64(StringPiece name, int64_t value) override {
+    return this;
+  }
+  ObjectWriter* RenderUint64(StringPiece name, uint64_t value) override {
+    return this;
+  }
+  ObjectWriter* RenderDouble(StringPiece name, double value) override {
+    return this;
+  }
+  ObjectWriter* RenderFloat(StringPiece name, float value) override {
+    return this;
+  }
+  ObjectWriter* RenderString(StringPiece name, StringPiece value) override {
+    return this;
+  }
+  ObjectWriter* RenderBytes(StringPiece name, StringPiece value) override {
+    return this;
+  }
+  ObjectWriter* RenderNull(StringPiece name) override { return this; }
+
+ private:
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(NullObjectWriter);
+};
+
+// Splits |total| bytes into segments whose lengths are drawn log-uniformly
+// from [1, max_segment]. Deterministic for a given |seed|.
+std::vector<int> RandomSegmentation(size_t total, int max_segment,
+                                    uint64_t seed);
+
+// Number of operator new calls made by the calling thread since it started.
+// Only counts allocations made through the replaceable global operator new,
+// which is what std::string and the converter classes use.
+int64_t ThreadAllocationCount();
+
+// Resident set size of the process and its peak since the last successful
+// ResetPeakRss(), in bytes, or -1 where /proc/self/status is unavailable.
+int64_t CurrentRssBytes();
+int64_t PeakRssBytes();
+
+// Resets the peak reported by PeakRssBytes() to the current RSS. Returns
+// false if the platform does not support it (Linux 4.0 or later does).
+bool ResetPeakRss();
+
+// Counts CPU events of the calling thread with Linux perf_event_open(2), to
+// tell whether a case is bound by instructions, branch mispredictions or
+// cache misses. Collection is opt-in, because it needs a PMU and permission
+// (kernel.perf_event_paranoid <= 2, or CAP_PERFMON): it is enabled when the
+// environment variable XML_BENCHMARK_PERF_COUNTERS is set to 1. Events the
+// kernel or the virtual machine does not support are left out, so
+// available() may be true for some events only.
+//
+// Usage:
+//   HardwareCounters counters;
+//   counters.Start();
+//   for (auto _ : state) { ... }
+//   counters.Stop();
+//   ReportHardwareCounters(counters, bytes, elements, state);
+class HardwareCounters {
+ public:
+  enum Event {
+    INSTRUCTIONS,
+    CYCLES,
+    BRANCH_MISSES,
+    L1D_READ_MISSES,
+    LLC_MISSES,
+    NUM_EVENTS,
+  };
+
+  // Opens the counters if collection is enabled.
+  HardwareCounters();
+  ~HardwareCounters();
+
+  // Whether XML_BENCHMARK_PERF_COUNTERS enables collection.
+  static bool Enabled();
+  // Short name of |event|, used as the counter name prefix.
+  static const char* EventName(Event event);
+
+  // Whether |event| is being counted.
+  bool available(Event event) const { return fds_[event] >= 0; }
+
+  // Counting accumulates between Start() and Stop() calls. Counts are scaled
+  // up when the kernel had to multiplex the PMU between events.
+  void Start();
+  void Stop();
+
+  // Count of |event| over all Start()/Stop() intervals.
+  int64_t value(Event event) const { return values_[event]; }
+
+ private:
+  // Returns the scaled count of |event| since it was opened.
+  int64_t Read(Event event) const;
+
+  int fds_[NUM_EVENTS];
+  int64_t values_[NUM_EVENTS];
+  int64_t started_[NUM_EVENTS];
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(HardwareCounters);
+};
+
+// Adds the available events of |counters| to |state| as "<event>/byte", per
+// byte of |bytes_per_iteration|, and, if |elements_per_iteration| is
+// positive, as "<event>/elem", plus "ipc" when both instructions and cycles
+// were counted. Must be called after the benchmark loop.
+void ReportHardwareCounters(const HardwareCounters& counters,
+                            int64_t bytes_per_iteration,
+                            int64_t elements_per_iteration,
+                            benchmark::State& state);
+
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#endif  // GOOGLE_PROTOBUF_UTIL_XML_BENCHMARK_UTIL_H__
@@ -0,0 +1,162 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Measures how XmlToBinaryStream throughput depends on the way the input
+// ZeroCopyInputStream is split into chunks.
+//
+// XmlStreamParser copies unparsed bytes into leftover_ (and then into
+// chunk_storage_) whenever a token straddles a chunk boundary, and rescans
+// the token from its start on the next chunk. Small or irregular chunks
+// therefore cost more than large ones; plotting bytes_per_second against the
+// block size (e.g. with --benchmark_format=csv) makes such pathologies show
+// up as a visible bend in the curve.
+//
+//   BM_XmlToBinaryStream_FixedBlocks/<shape>/<block size>
+//     Every chunk has the same size, from 1 byte to 1MB.
+//   BM_XmlToBinaryStream_RandomBlocks/<shape>/<max block size>
+//     Chunk sizes drawn log-uniformly from [1, max block size] with a fixed
+//     seed, like the segmented streams in xml_util_test.cc.
+//
+// With XML_BENCHMARK_PERF_COUNTERS=1 every case also reports hardware
+// counters per XML byte and per element (see HardwareCounters).
+
+#include <benchmark/benchmark.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/util/xml_benchmark_util.h>
+#include <google/protobuf/util/xml_util.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+const int kMinBlockSize = 1;
+const int kMaxBlockSize = 1 << 20;
+const uint64_t kSegmentationSeed = 20220601;
+
+void Transcode(const Corpus& corpus, io::ZeroCopyInputStream* input,
+               std::string* output) {
+  output->clear();
+  io::StringOutputStream output_stream(output);
+  util::Status status = XmlToBinaryStream(
+      corpus.resolver, corpus.type_url, input, &output_stream);
+  GOOGLE_CHECK(status.ok()) << corpus.name << ": " << status;
+}
+
+void ReportCounters(benchmark::State& state, const Corpus& corpus,
+                    size_t chunks, const HardwareCounters& counters) {
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(corpus.xml.size()));
+  state.counters["chunks"] = static_cast<double>(chunks);
+  ReportHardwareCounters(counters, static_cast<int64_t>(corpus.xml.size()),
+                         corpus.elements, state);
+}
+
+void BM_XmlToBinaryStream_FixedBlocks(benchmark::State& state,
+                                      CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  const int block_size = static_cast<int>(state.range(0));
+  std::string output;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    io::ArrayInputStream input(corpus.xml.data(),
+                               static_cast<int>(corpus.xml.size()),
+                               block_size);
+    Transcode(corpus, &input, &output);
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  ReportCounters(state, corpus,
+                 (corpus.xml.size() + block_size - 1) / block_size, counters);
+}
+
+void BM_XmlToBinaryStream_RandomBlocks(benchmark::State& state,
+                                       CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  const std::vector<int> segments = RandomSegmentation(
+      corpus.xml.size(), static_cast<int>(state.range(0)), kSegmentationSeed);
+  std::string output;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    SegmentedZeroCopyInputStream input(corpus.xml, segments);
+    Transcode(corpus, &input, &output);
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  ReportCounters(state, corpus, segments.size(), counters);
+}
+
+#define XML_CHUNKING_BENCHMARK(fn, shape_name, shape) \
+  BENCHMARK_CAPTURE(fn, shape_name, shape)            \
+      ->RangeMultiplier(4)                            \
+      ->Range(kMinBlockSize, kMaxBlockSize)
+
+#define XML_CHUNKING_BENCHMARK_ALL_SHAPES(fn)                                \
+  XML_CHUNKING_BENCHMARK(fn, address_book, CorpusShape::kAddressBook);       \
+  XML_CHUNKING_BENCHMARK(fn, deep_nesting, CorpusShape::kDeepNesting);       \
+  XML_CHUNKING_BENCHMARK(fn, wide_flat, CorpusShape::kWideFlat);             \
+  XML_CHUNKING_BENCHMARK(fn, string_heavy, CorpusShape::kStringHeavy);       \
+  XML_CHUNKING_BENCHMARK(fn, bytes_heavy, CorpusShape::kBytesHeavy);         \
+  XML_CHUNKING_BENCHMARK(fn, numeric_heavy, CorpusShape::kNumericHeavy);     \
+  XML_CHUNKING_BENCHMARK(fn, map_heavy, CorpusShape::kMapHeavy)
+
+XML_CHUNKING_BENCHMARK_ALL_SHAPES(BM_XmlToBinaryStream_FixedBlocks);
+XML_CHUNKING_BENCHMARK_ALL_SHAPES(BM_XmlToBinaryStream_RandomBlocks);
+
+// The custom corpus is only known at run time, so its cases are registered
+// dynamically.
+const bool custom_benchmarks_registered = [] {
+  if (!HasCustomCorpus()) return false;
+  benchmark::RegisterBenchmark("BM_XmlToBinaryStream_FixedBlocks/custom",
+                               BM_XmlToBinaryStream_FixedBlocks,
+                               CorpusShape::kCustom)
+      ->RangeMultiplier(4)
+      ->Range(kMinBlockSize, kMaxBlockSize);
+  benchmark::RegisterBenchmark("BM_XmlToBinaryStream_RandomBlocks/custom",
+                               BM_XmlToBinaryStream_RandomBlocks,
+                               CorpusShape::kCustom)
+      ->RangeMultiplier(4)
+      ->Range(kMinBlockSize, kMaxBlockSize);
+  return true;
+}();
+
+}  // namespace
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,434 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/xml_corpus_generator.h>
+
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/stubs/strutil.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+// Wraps std::mt19937_64, whose output is fully specified by the standard.
+// Values are derived from it by hand instead of through the std
+// distributions, which differ between standard library implementations and
+// would make corpora depend on the toolchain.
+class Rng {
+ public:
+  explicit Rng(uint64_t seed) : engine_(seed) {}
+
+  // Uniform in [lo, hi]. Returns lo if hi < lo.
+  int64_t Int(int64_t lo, int64_t hi) {
+    if (hi <= lo) return lo;
+    const uint64_t range =
+        static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo) + 1;
+    uint64_t r = engine_();
+    // range wraps to 0 when [lo, hi] covers all 64-bit values.
+    if (range != 0) r %= range;
+    return static_cast<int64_t>(static_cast<uint64_t>(lo) + r);
+  }
+
+  // Uniform in [lo, hi).
+  double Real(double lo, double hi) {
+    const double unit = (engine_() >> 11) * (1.0 / 9007199254740992.0);
+    return lo + (hi - lo) * unit;
+  }
+
+  bool Chance(double probability) { return Real(0, 1) < probability; }
+
+  // Alphanumeric text with single inner spaces, which needs no escaping and
+  // is accepted by the XML parser in attribute values and text nodes.
+  std::string Text(int length) {
+    static const char kAlphabet[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    std::string result;
+    result.reserve(length);
+    for (int i = 0; i < length; ++i) {
+      if (i > 0 && i + 1 < length && result.back() != ' ' && Int(0, 7) == 0) {
+        result.push_back(' ');
+      } else {
+        result.push_back(kAlphabet[Int(0, sizeof(kAlphabet) - 2)]);
+      }
+    }
+    return result;
+  }
+
+  // Alphanumeric text without spaces, usable inside an XML name.
+  std::string Word(int length) {
+    static const char kAlphabet[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    std::string result(length, '\0');
+    for (int i = 0; i < length; ++i) {
+      result[i] = kAlphabet[Int(0, sizeof(kAlphabet) - 2)];
+    }
+    return result;
+  }
+
+  std::string Bytes(int length) {
+    std::string result(length, '\0');
+    for (int i = 0; i < length; ++i) {
+      result[i] = static_cast<char>(engine_() & 0xff);
+    }
+    return result;
+  }
+
+ private:
+  std::mt19937_64 engine_;
+};
+
+int64_t Clamp(int64_t value, int64_t lo, int64_t hi) {
+  return std::max(lo, std::min(value, hi));
+}
+
+// Well-known types whose values must follow a format the generator does not
+// know how to produce. Fields of these types are left unset.
+bool IsUnsupportedWellKnownType(const Descriptor* descriptor) {
+  const std::string& name = descriptor->full_name();
+  return name == "google.protobuf.Any" || name == "google.protobuf.Struct" ||
+         name == "google.protobuf.Value" ||
+         name == "google.protobuf.ListValue" ||
+         name == "google.protobuf.FieldMask";
+}
+
+bool IsSkipped(const FieldDescriptor* field, int depth, int max_depth) {
+  if (field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) return false;
+  if (IsUnsupportedWellKnownType(field->message_type())) return true;
+  return depth >= max_depth && !field->is_required();
+}
+
+class Generator {
+ public:
+  explicit Generator(const CorpusSpec& spec)
+      : spec_(spec), rng_(spec.seed), next_key_(0) {}
+
+  // Fills all fields of |message|, which sits |depth| levels below the root.
+  void Fill(Message* message, int depth) {
+    const Descriptor* descriptor = message->GetDescriptor();
+    if (FillWellKnownType(message)) return;
+    for (int i = 0; i < descriptor->field_count(); ++i) {
+      const FieldDescriptor* field = descriptor->field(i);
+      if (field->real_containing_oneof() != nullptr) continue;
+      if (IsSkipped(field, depth, spec_.max_depth)) continue;
+      if (field->is_repeated()) {
+        const int64_t count = rng_.Int(spec_.min_repeated, spec_.max_repeated);
+        for (int64_t j = 0; j < count; ++j) {
+          AddValue(message, field, depth);
+        }
+      } else if (field->is_required() ||
+                 !rng_.Chance(spec_.default_fraction)) {
+        AddValue(message, field, depth);
+      }
+    }
+    for (int i = 0; i < descriptor->real_oneof_decl_count(); ++i) {
+      const OneofDescriptor* oneof = descriptor->oneof_decl(i);
+      if (rng_.Chance(spec_.default_fraction)) continue;
+      const FieldDescriptor* field =
+          oneof->field(rng_.Int(0, oneof->field_count() - 1));
+      if (IsSkipped(field, depth, spec_.max_depth)) continue;
+      AddValue(message, field, depth);
+    }
+  }
+
+  // Sets |field| of |message| to a generated value, or appends one if the
+  // field is repeated.
+  void AddValue(Message* message, const FieldDescriptor* field, int depth) {
+    const Reflection* reflection = message->GetReflection();
+    const bool repeated = field->is_repeated();
+    if (field->is_map()) {
+      Message* entry = reflection->AddMessage(message, field);
+      const FieldDescriptor* key = field->message_type()->map_key();
+      if (key->cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+        // Keys become XML attribute or tag names, so they must start with a
+        // letter. The counter keeps them unique.
+        entry->GetReflection()->SetString(
+            entry, key, StrCat("k", next_key_++, "_", rng_.Word(6)));
+      } else {
+        AddValue(entry, key, depth + 1);
+      }
+      AddValue(entry, field->message_type()->map_value(), depth + 1);
+      return;
+    }
+    switch (field->cpp_type()) {
+      case FieldDescriptor::CPPTYPE_INT32: {
+        const int32_t value = static_cast<int32_t>(rng_.Int(
+            Clamp(spec_.min_int, std::numeric_limits<int32_t>::min(),
+                  std::numeric_limits<int32_t>::max()),
+            Clamp(spec_.max_int, std::numeric_limits<int32_t>::min(),
+                  std::numeric_limits<int32_t>::max())));
+        repeated ? reflection->AddInt32(message, field, value)
+                 : reflection->SetInt32(message, field, value);
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_INT64: {
+        const int64_t value = rng_.Int(spec_.min_int, spec_.max_int);
+        repeated ? reflection->AddInt64(message, field, value)
+                 : reflection->SetInt64(message, field, value);
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_UINT32: {
+        const uint32_t value = static_cast<uint32_t>(
+            rng_.Int(Clamp(spec_.min_int, 0,
+                           std::numeric_limits<uint32_t>::max()),
+                     Clamp(spec_.max_int, 0,
+                           std::numeric_limits<uint32_t>::max())));
+        repeated ? reflection->AddUInt32(message, field, value)
+                 : reflection->SetUInt32(message, field, value);
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_UINT64: {
+        const uint64_t value = static_cast<uint64_t>(
+            rng_.Int(std::max<int64_t>(spec_.min_int, 0),
+                     std::max<int64_t>(spec_.max_int, 0)));
+        repeated ? reflection->AddUInt64(message, field, value)
+                 : reflection->SetUInt64(message, field, value);
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_DOUBLE: {
+        const double value = rng_.Real(spec_.min_double, spec_.max_double);
+        repeated ? reflection->AddDouble(message, field, value)
+                 : reflection->SetDouble(message, field, value);
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_FLOAT: {
+        const double max = std::numeric_limits<float>::max();
+        const float value = static_cast<float>(
+            rng_.Real(std::max(spec_.min_double, -max),
+                      std::min(spec_.max_double, max)));
+        repeated ? reflection->AddFloat(message, field, value)
+                 : reflection->SetFloat(message, field, value);
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_BOOL: {
+        const bool value = rng_.Chance(0.5);
+        repeated ? reflection->AddBool(message, field, value)
+                 : reflection->SetBool(message, field, value);
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_ENUM: {
+        const EnumDescriptor* enum_type = field->enum_type();
+        const EnumValueDescriptor* value =
+            enum_type->value(rng_.Int(0, enum_type->value_count() - 1));
+        repeated ? reflection->AddEnum(message, field, value)
+                 : reflection->SetEnum(message, field, value);
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_STRING: {
+        std::string value =
+            field->type() == FieldDescriptor::TYPE_BYTES
+                ? rng_.Bytes(rng_.Int(spec_.min_bytes_length,
+                                      spec_.max_bytes_length))
+                : rng_.Text(rng_.Int(spec_.min_string_length,
+                                     spec_.max_string_length));
+        repeated ? reflection->AddString(message, field, std::move(value))
+                 : reflection->SetString(message, field, std::move(value));
+        break;
+      }
+      case FieldDescriptor::CPPTYPE_MESSAGE:
+        Fill(repeated ? reflection->AddMessage(message, field)
+                      : reflection->MutableMessage(message, field),
+             depth + 1);
+        break;
+    }
+  }
+
+ private:
+  // Generates Timestamp and Duration values within the ranges the XML
+  // converter accepts. Returns false for other types.
+  bool FillWellKnownType(Message* message) {
+    const Descriptor* descriptor = message->GetDescriptor();
+    const bool is_timestamp =
+        descriptor->full_name() == "google.protobuf.Timestamp";
+    const bool is_duration =
+        descriptor->full_name() == "google.protobuf.Duration";
+    if (!is_timestamp && !is_duration) return false;
+    const Reflection* reflection = message->GetReflection();
+    // Timestamps between 1970 and 2100, durations within a year.
+    const int64_t seconds = is_timestamp
+                                ? rng_.Int(0, 4102444800LL)
+                                : rng_.Int(-31536000LL, 31536000LL);
+    const int32_t nanos = static_cast<int32_t>(rng_.Int(0, 999999999));
+    reflection->SetInt64(message, descriptor->FindFieldByName("seconds"),
+                         seconds);
+    // Duration nanos must have the sign of seconds.
+    reflection->SetInt32(message, descriptor->FindFieldByName("nanos"),
+                         seconds < 0 ? -nanos : nanos);
+    return true;
+  }
+
+  const CorpusSpec& spec_;
+  Rng rng_;
+  int64_t next_key_;
+};
+
+bool ParseInt64Range(const std::string& value, int64_t* lo, int64_t* hi) {
+  std::vector<std::string> parts = Split(value, ":", false);
+  return parts.size() == 2 && safe_strto64(parts[0], lo) &&
+         safe_strto64(parts[1], hi) && *lo <= *hi;
+}
+
+bool ParseIntRange(const std::string& value, int* lo, int* hi) {
+  int64_t lo64;
+  int64_t hi64;
+  if (!ParseInt64Range(value, &lo64, &hi64) || lo64 < 0 ||
+      hi64 > std::numeric_limits<int>::max()) {
+    return false;
+  }
+  *lo = static_cast<int>(lo64);
+  *hi = static_cast<int>(hi64);
+  return true;
+}
+
+bool ParseDoubleRange(const std::string& value, double* lo, double* hi) {
+  std::vector<std::string> parts = Split(value, ":", false);
+  return parts.size() == 2 && safe_strtod(parts[0], lo) &&
+         safe_strtod(parts[1], hi) && *lo <= *hi;
+}
+
+}  // namespace
+
+util::Status ParseCorpusSpec(StringPiece text, CorpusSpec* spec) {
+  for (const std::string& setting : Split(text, ",", true)) {
+    const std::string::size_type equals = setting.find('=');
+    if (equals == std::string::npos) {
+      return util::InvalidArgumentError(
+          StrCat("Expected key=value in corpus spec: ", setting));
+    }
+    const std::string key = setting.substr(0, equals);
+    const std::string value = setting.substr(equals + 1);
+    bool ok;
+    if (key == "seed") {
+      ok = safe_strtou64(value, &spec->seed);
+    } else if (key == "target_bytes") {
+      ok = safe_strto64(value, &spec->target_bytes) && spec->target_bytes >= 0;
+    } else if (key == "repeated") {
+      ok = ParseIntRange(value, &spec->min_repeated, &spec->max_repeated);
+    } else if (key == "string_length") {
+      ok = ParseIntRange(value, &spec->min_string_length,
+                         &spec->max_string_length);
+    } else if (key == "bytes_length") {
+      ok = ParseIntRange(value, &spec->min_bytes_length,
+                         &spec->max_bytes_length);
+    } else if (key == "int") {
+      ok = ParseInt64Range(value, &spec->min_int, &spec->max_int);
+    } else if (key == "double") {
+      ok = ParseDoubleRange(value, &spec->min_double, &spec->max_double);
+    } else if (key == "depth") {
+      ok = safe_strto32(value, &spec->max_depth) && spec->max_depth >= 0;
+    } else if (key == "default_fraction") {
+      ok = safe_strtod(value, &spec->default_fraction) &&
+           spec->default_fraction >= 0 && spec->default_fraction <= 1;
+    } else {
+      return util::InvalidArgumentError(
+          StrCat("Unknown corpus spec setting: ", key));
+    }
+    if (!ok) {
+      return util::InvalidArgumentError(
+          StrCat("Invalid value for corpus spec setting ", key, ": ", value));
+    }
+  }
+  return util::Status();
+}
+
+void GenerateMessage(const CorpusSpec& spec, Message* message) {
+  Generator generator(spec);
+  generator.Fill(message, 0);
+  if (spec.target_bytes == 0) return;
+
+  // Grow the message to the target size by appending to the repeated fields
+  // of the root in turn. The number of elements still needed is extrapolated
+  // from the average element size so far, which keeps the number of
+  // ByteSizeLong() calls small.
+  const Descriptor* descriptor = message->GetDescriptor();
+  std::vector<const FieldDescriptor*> growable;
+  for (int i = 0; i < descriptor->field_count(); ++i) {
+    const FieldDescriptor* field = descriptor->field(i);
+    if (field->is_repeated() && !IsSkipped(field, 0, spec.max_depth)) {
+      growable.push_back(field);
+    }
+  }
+  if (growable.empty()) return;
+  const int64_t base_size = static_cast<int64_t>(message->ByteSizeLong());
+  int64_t size = base_size;
+  int64_t added = 0;
+  size_t next_field = 0;
+  while (size < spec.target_bytes) {
+    int64_t batch = 1;
+    if (added > 0 && size > base_size) {
+      const int64_t average = std::max<int64_t>(1, (size - base_size) / added);
+      batch = std::max<int64_t>(
+          1, (spec.target_bytes - size + average - 1) / average);
+    }
+    for (int64_t i = 0; i < batch; ++i) {
+      generator.AddValue(message, growable[next_field], 0);
+      next_field = (next_field + 1) % growable.size();
+    }
+    added += batch;
+    size = static_cast<int64_t>(message->ByteSizeLong());
+  }
+}
+
+util::Status LoadDescriptorSet(const std::string& path, DescriptorPool* pool) {
+  std::ifstream input(path, std::ios::in | std::ios::binary);
+  if (!input) {
+    return util::NotFoundError(StrCat("Cannot open ", path));
+  }
+  const std::string data((std::istreambuf_iterator<char>(input)),
+                         std::istreambuf_iterator<char>());
+  FileDescriptorSet file_set;
+  if (!file_set.ParseFromString(data)) {
+    return util::InvalidArgumentError(
+        StrCat(path, " is not a serialized FileDescriptorSet"));
+  }
+  // protoc writes the files of a descriptor set in dependency order.
+  for (const FileDescriptorProto& file : file_set.file()) {
+    if (pool->BuildFile(file) == nullptr) {
+      return util::InvalidArgumentError(
+          StrCat("Cannot build ", file.name(), " from ", path));
+    }
+  }
+  return util::Status();
+}
+
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,127 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Generates synthetic messages of any type from its Descriptor, so the
+// xml_util benchmarks can run on realistic inputs for a schema without
+// shipping real data. Generation is driven by a CorpusSpec and is
+// deterministic for a given descriptor and spec, including its seed.
+#ifndef GOOGLE_PROTOBUF_UTIL_XML_CORPUS_GENERATOR_H__
+#define GOOGLE_PROTOBUF_UTIL_XML_CORPUS_GENERATOR_H__
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/stringpiece.h>
+
+#include <cstdint>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+
+// The distribution generated values are drawn from. All ranges are inclusive
+// and sampled uniformly.
+struct CorpusSpec {
+  // Seed of the random generator.
+  uint64_t seed;
+  // Approximate size of the generated message in binary form. Once the
+  // message has been filled in, elements are appended to its repeated fields
+  // until it reaches this size. Zero disables growing.
+  int64_t target_bytes;
+  // Number of elements of each repeated field and entries of each map.
+  int min_repeated;
+  int max_repeated;
+  // Lengths of string and bytes values.
+  int min_string_length;
+  int max_string_length;
+  int min_bytes_length;
+  int max_bytes_length;
+  // Values of integer fields, clamped to the range of each field's type.
+  int64_t min_int;
+  int64_t max_int;
+  // Values of double and float fields.
+  double min_double;
+  double max_double;
+  // Message fields more than this many levels below the root are left unset,
+  // except proto2 required ones.
+  int max_depth;
+  // Probability in [0, 1] of leaving a singular field unset, or at its
+  // default value for proto3 scalars.
+  double default_fraction;
+
+  CorpusSpec()
+      : seed(1),
+        target_bytes(1 << 20),
+        min_repeated(0),
+        max_repeated(8),
+        min_string_length(0),
+        max_string_length(32),
+        min_bytes_length(0),
+        max_bytes_length(64),
+        min_int(-1000),
+        max_int(1000),
+        min_double(-1e6),
+        max_double(1e6),
+        max_depth(8),
+        default_fraction(0.1) {}
+};
+
+// Parses a comma separated list of settings into |spec|, leaving settings that
+// are not mentioned untouched. Ranges are written "min:max". For example:
+//
+//   seed=7,target_bytes=4194304,repeated=1:16,string_length=4:64,
+//   bytes_length=0:256,int=-100000:100000,double=-1:1,depth=6,
+//   default_fraction=0.25
+util::Status ParseCorpusSpec(StringPiece text, CorpusSpec* spec);
+
+// Fills |message|, which must be empty, with generated values.
+//
+// String values are alphanumeric text with spaces and string map keys are
+// valid XML names, so the XML form of the message can be parsed back.
+// Well-known types that require a specific format are either generated in
+// that format (Timestamp, Duration) or left unset (Any, Struct, Value,
+// ListValue, FieldMask). Maps with non-string keys are generated as well, but
+// their XML form cannot be parsed back; such types are only useful for
+// printing benchmarks.
+void GenerateMessage(const CorpusSpec& spec, Message* message);
+
+// Reads a serialized FileDescriptorSet, such as the output of
+// `protoc --include_imports --descriptor_set_out=FILE`, and builds all of its
+// files into |pool|.
+util::Status LoadDescriptorSet(const std::string& path, DescriptorPool* pool);
+
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#endif  // GOOGLE_PROTOBUF_UTIL_XML_CORPUS_GENERATOR_H__
@@ -0,0 +1,175 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// Writes a generated message to disk in binary and XML form, so the same
+// synthetic corpus can be fed to other tools or checked in as a fixture.
+//
+//   xml_corpus_generator --message=my.package.MyMessage
+//       --descriptor_set=my_protos.pb --spec=seed=7,target_bytes=4194304
+//       --output=/tmp/corpus
+//
+// writes /tmp/corpus.bin and /tmp/corpus.xml. Without --descriptor_set the
+// message type is looked up among the types linked into the binary.
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/type_resolver.h>
+#include <google/protobuf/util/type_resolver_util.h>
+#include <google/protobuf/util/xml_corpus_generator.h>
+#include <google/protobuf/util/xml_util.h>
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+const char kTypeUrlPrefix[] = "type.googleapis.com";
+
+const char kUsage[] =
+    "Usage: xml_corpus_generator --message=TYPE --output=PREFIX\n"
+    "                            [--descriptor_set=FILE] [--spec=SPEC]\n";
+
+// Stores the value of |arg| in |value| if it is the flag |name|.
+bool ParseFlag(const std::string& arg, const std::string& name,
+               std::string* value) {
+  const std::string prefix = "--" + name + "=";
+  if (!HasPrefixString(arg, prefix)) return false;
+  *value = arg.substr(prefix.size());
+  return true;
+}
+
+bool WriteFile(const std::string& path, const std::string& contents) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(contents.data(), contents.size());
+  file.close();
+  return !file.fail();
+}
+
+int Run(int argc, char* argv[]) {
+  std::string message_name;
+  std::string descriptor_set;
+  std::string spec_text;
+  std::string output;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (ParseFlag(arg, "message", &message_name) ||
+        ParseFlag(arg, "descriptor_set", &descriptor_set) ||
+        ParseFlag(arg, "spec", &spec_text) ||
+        ParseFlag(arg, "output", &output)) {
+      continue;
+    }
+    std::cerr << "Unknown flag: " << arg << "\n" << kUsage;
+    return 1;
+  }
+  if (message_name.empty() || output.empty()) {
+    std::cerr << kUsage;
+    return 1;
+  }
+
+  const DescriptorPool* pool = DescriptorPool::generated_pool();
+  MessageFactory* factory = MessageFactory::generated_factory();
+  DescriptorPool custom_pool;
+  std::unique_ptr<DynamicMessageFactory> dynamic_factory;
+  if (!descriptor_set.empty()) {
+    util::Status status = LoadDescriptorSet(descriptor_set, &custom_pool);
+    if (!status.ok()) {
+      std::cerr << status << std::endl;
+      return 1;
+    }
+    pool = &custom_pool;
+    dynamic_factory.reset(new DynamicMessageFactory(&custom_pool));
+    factory = dynamic_factory.get();
+  }
+  const Descriptor* descriptor = pool->FindMessageTypeByName(message_name);
+  if (descriptor == nullptr) {
+    std::cerr << "Unknown message type " << message_name << std::endl;
+    return 1;
+  }
+
+  CorpusSpec spec;
+  util::Status status = ParseCorpusSpec(spec_text, &spec);
+  if (!status.ok()) {
+    std::cerr << status << std::endl;
+    return 1;
+  }
+  std::unique_ptr<Message> message(factory->GetPrototype(descriptor)->New());
+  GenerateMessage(spec, message.get());
+
+  // Map entries are otherwise serialized in hash order, which would make the
+  // output differ between runs for the same seed.
+  std::string binary;
+  {
+    io::StringOutputStream string_stream(&binary);
+    io::CodedOutputStream coded_stream(&string_stream);
+    coded_stream.SetSerializationDeterministic(true);
+    message->SerializeToCodedStream(&coded_stream);
+  }
+  std::unique_ptr<TypeResolver> resolver(
+      NewTypeResolverForDescriptorPool(kTypeUrlPrefix, pool));
+  std::string xml;
+  status = BinaryToXmlString(
+      resolver.get(), StrCat(kTypeUrlPrefix, "/", descriptor->full_name()),
+      binary, &xml);
+  if (!status.ok()) {
+    std::cerr << status << std::endl;
+    return 1;
+  }
+
+  if (!WriteFile(output + ".bin", binary) ||
+      !WriteFile(output + ".xml", xml)) {
+    std::cerr << "Failed to write " << output << ".{bin,xml}" << std::endl;
+    return 1;
+  }
+  std::cout << "Wrote " << binary.size() << " binary bytes and " << xml.size()
+            << " XML bytes" << std::endl;
+  return 0;
+}
+
+}  // namespace
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+int main(int argc, char* argv[]) {
+  return google::protobuf::util::xml_benchmark::Run(argc, argv);
+}
@@ -0,0 +1,106 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/xml_fuzz_util.h>
+
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/xml_benchmark_util.h>
+
+#include <cstdlib>
+#include <ctime>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+void OverrideFromEnvironment(const char* name, int64_t* value) {
+  const char* text = std::getenv(name);
+  if (text == nullptr) return;
+  GOOGLE_CHECK(safe_strto64(text, value) && *value >= 0)
+      << name << " must be a non-negative integer, got " << text;
+}
+
+int64_t ThreadCpuNanos() {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+}  // namespace
+
+const FuzzLimits& FuzzLimits::Get() {
+  static const FuzzLimits* limits = [] {
+    FuzzLimits* limits = new FuzzLimits;
+    OverrideFromEnvironment("XML_FUZZ_BASE_NANOS", &limits->base_nanos);
+    OverrideFromEnvironment("XML_FUZZ_NANOS_PER_BYTE",
+                            &limits->nanos_per_byte);
+    OverrideFromEnvironment("XML_FUZZ_BASE_ALLOCATIONS",
+                            &limits->base_allocations);
+    OverrideFromEnvironment("XML_FUZZ_ALLOCATIONS_PER_BYTE",
+                            &limits->allocations_per_byte);
+    return limits;
+  }();
+  return *limits;
+}
+
+ResourceBudget::ResourceBudget(size_t input_bytes, const FuzzCost& fixed_cost)
+    : input_bytes_(input_bytes),
+      fixed_cost_(fixed_cost),
+      start_nanos_(ThreadCpuNanos()),
+      start_allocations_(ThreadAllocationCount()) {}
+
+FuzzCost ResourceBudget::Spent() const {
+  FuzzCost cost;
+  cost.nanos = ThreadCpuNanos() - start_nanos_;
+  cost.allocations = ThreadAllocationCount() - start_allocations_;
+  return cost;
+}
+
+void ResourceBudget::Check(const char* what) const {
+  const FuzzCost spent = Spent();
+  const FuzzLimits& limits = FuzzLimits::Get();
+  const int64_t bytes = static_cast<int64_t>(input_bytes_);
+  GOOGLE_CHECK_LE(spent.nanos, fixed_cost_.nanos + limits.base_nanos +
+                                   limits.nanos_per_byte * bytes)
+      << what << " took " << spent.nanos << "ns for " << bytes << " bytes";
+  GOOGLE_CHECK_LE(spent.allocations, fixed_cost_.allocations +
+                                         limits.base_allocations +
+                                         limits.allocations_per_byte * bytes)
+      << what << " made " << spent.allocations << " allocations for " << bytes
+      << " bytes";
+}
+
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
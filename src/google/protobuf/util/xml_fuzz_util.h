@@ -0,0 +1,117 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Resource budget shared by the xml_util fuzz targets. Besides crashes, the
+// fuzzers look for inputs whose cost grows faster than their size, such as
+// repeated rescans of a token that straddles many chunks. Each input is
+// allowed a fixed base cost plus a per byte cost; exceeding either limit
+// aborts, so libFuzzer saves the input as a crash.
+#ifndef GOOGLE_PROTOBUF_UTIL_XML_FUZZ_UTIL_H__
+#define GOOGLE_PROTOBUF_UTIL_XML_FUZZ_UTIL_H__
+
+#include <google/protobuf/stubs/common.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+
+// Limits applied to every fuzzer input. The defaults leave enough room for
+// sanitizer builds; each one can be overridden from the environment:
+//   XML_FUZZ_BASE_NANOS              base_nanos
+//   XML_FUZZ_NANOS_PER_BYTE          nanos_per_byte
+//   XML_FUZZ_BASE_ALLOCATIONS        base_allocations
+//   XML_FUZZ_ALLOCATIONS_PER_BYTE    allocations_per_byte
+struct FuzzLimits {
+  // CPU time of the calling thread.
+  int64_t base_nanos;
+  int64_t nanos_per_byte;
+  // Calls to the global operator new made by the calling thread.
+  int64_t base_allocations;
+  int64_t allocations_per_byte;
+
+  FuzzLimits()
+      : base_nanos(50 * 1000 * 1000),
+        nanos_per_byte(20 * 1000),
+        base_allocations(1000),
+        allocations_per_byte(8) {}
+
+  // Returns the defaults updated from the environment. Read once.
+  static const FuzzLimits& Get();
+};
+
+// CPU time and allocations spent on some work.
+struct FuzzCost {
+  int64_t nanos;
+  int64_t allocations;
+
+  FuzzCost() : nanos(0), allocations(0) {}
+};
+
+// Measures the CPU time and allocations spent by the calling thread between
+// construction and Check().
+//
+//   ResourceBudget budget(size);
+//   ... convert the input ...
+//   budget.Check("XmlToBinaryString");
+//
+// Work whose cost does not depend on the input, such as resolving the types
+// of a large schema, can be measured once on a trivial input and passed as
+// |fixed_cost|; it is added to the base limits.
+class ResourceBudget {
+ public:
+  explicit ResourceBudget(size_t input_bytes,
+                          const FuzzCost& fixed_cost = FuzzCost());
+
+  // Cost measured so far.
+  FuzzCost Spent() const;
+
+  // Aborts, naming |what| and the costs measured, if the input used more
+  // than FuzzLimits::Get() allows for its size.
+  void Check(const char* what) const;
+
+ private:
+  const size_t input_bytes_;
+  const FuzzCost fixed_cost_;
+  const int64_t start_nanos_;
+  const int64_t start_allocations_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ResourceBudget);
+};
+
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#endif  // GOOGLE_PROTOBUF_UTIL_XML_FUZZ_UTIL_H__
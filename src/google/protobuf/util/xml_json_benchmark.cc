@@ -0,0 +1,252 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Runs the XML and JSON converters head to head on the same corpora, using
+// json_util as the reference for what xml_util should be able to reach.
+//
+// Every iteration converts the corpus once with each converter, back to back.
+// The iteration time reported to the framework is the XML time, so the
+// standard columns describe xml_util; next to them each case reports:
+//   json_ns:    average time of the equivalent json_util call,
+//   slowdown:   XML time / JSON time (1.0 means parity),
+//   size_ratio: XML bytes / JSON bytes for the corpus.
+//
+// The string_heavy, bytes_heavy, numeric_heavy and map_heavy shapes are each
+// dominated by a single kind of field, so their rows show per field type where
+// the XML path lags.
+//
+// Example (from src/google/protobuf/util):
+//   bazel run -c opt :xml_json_benchmark -- --benchmark_filter=Parse
+
+#include <benchmark/benchmark.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/util/json_util.h>
+#include <google/protobuf/util/xml_benchmark_util.h>
+#include <google/protobuf/util/xml_util.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+// Returns the JSON encoding of the corpus for |shape|, printed with default
+// options so it parses back with JsonStringToMessage().
+const std::string& GetJson(CorpusShape shape) {
+  static std::map<CorpusShape, std::string>* json =
+      new std::map<CorpusShape, std::string>;
+  auto it = json->find(shape);
+  if (it == json->end()) {
+    std::string output;
+    util::Status status = MessageToJsonString(*GetCorpus(shape).message,
+                                              &output);
+    GOOGLE_CHECK(status.ok()) << status;
+    it = json->emplace(shape, std::move(output)).first;
+  }
+  return it->second;
+}
+
+// Times |xml| and |json| in every iteration and reports the XML time as the
+// iteration time. Both must be callables taking no arguments.
+template <typename XmlFn, typename JsonFn>
+void RunHeadToHead(benchmark::State& state, CorpusShape shape, XmlFn xml,
+                   JsonFn json) {
+  typedef std::chrono::steady_clock Clock;
+  const size_t xml_size = GetCorpus(shape).xml.size();
+  const size_t json_size = GetJson(shape).size();
+  double xml_seconds = 0;
+  double json_seconds = 0;
+  for (auto _ : state) {
+    const Clock::time_point start = Clock::now();
+    xml();
+    const Clock::time_point middle = Clock::now();
+    json();
+    const Clock::time_point end = Clock::now();
+    const double iteration_seconds =
+        std::chrono::duration<double>(middle - start).count();
+    state.SetIterationTime(iteration_seconds);
+    xml_seconds += iteration_seconds;
+    json_seconds += std::chrono::duration<double>(end - middle).count();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(xml_size));
+  state.counters["json_ns"] = benchmark::Counter(
+      json_seconds * 1e9, benchmark::Counter::kAvgIterations);
+  state.counters["slowdown"] =
+      json_seconds > 0 ? xml_seconds / json_seconds : 0.0;
+  state.counters["size_ratio"] =
+      static_cast<double>(xml_size) / static_cast<double>(json_size);
+}
+
+void BM_PrintMessage(benchmark::State& state, CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  std::string output;
+  RunHeadToHead(
+      state, shape,
+      [&] {
+        output.clear();
+        util::Status status = MessageToXmlString(*corpus.message, &output);
+        GOOGLE_CHECK(status.ok()) << status;
+        benchmark::DoNotOptimize(output.data());
+      },
+      [&] {
+        output.clear();
+        util::Status status = MessageToJsonString(*corpus.message, &output);
+        GOOGLE_CHECK(status.ok()) << status;
+        benchmark::DoNotOptimize(output.data());
+      });
+}
+
+void BM_ParseMessage(benchmark::State& state, CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  const std::string& json = GetJson(shape);
+  std::unique_ptr<Message> message(corpus.message->New());
+  RunHeadToHead(
+      state, shape,
+      [&] {
+        message->Clear();
+        util::Status status = XmlStringToMessage(corpus.xml, message.get());
+        GOOGLE_CHECK(status.ok()) << status;
+        benchmark::DoNotOptimize(message.get());
+      },
+      [&] {
+        message->Clear();
+        util::Status status = JsonStringToMessage(json, message.get());
+        GOOGLE_CHECK(status.ok()) << status;
+        benchmark::DoNotOptimize(message.get());
+      });
+}
+
+// The stream variants leave out message serialization and parsing, so they
+// compare the transcoders alone.
+void BM_PrintStream(benchmark::State& state, CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  TypeResolver* resolver = corpus.resolver;
+  std::string output;
+  RunHeadToHead(
+      state, shape,
+      [&] {
+        output.clear();
+        io::ArrayInputStream input_stream(corpus.binary.data(),
+                                          corpus.binary.size());
+        io::StringOutputStream output_stream(&output);
+        util::Status status = BinaryToXmlStream(resolver, corpus.type_url,
+                                                &input_stream, &output_stream);
+        GOOGLE_CHECK(status.ok()) << status;
+        benchmark::DoNotOptimize(output.data());
+      },
+      [&] {
+        output.clear();
+        io::ArrayInputStream input_stream(corpus.binary.data(),
+                                          corpus.binary.size());
+        io::StringOutputStream output_stream(&output);
+        util::Status status = BinaryToJsonStream(
+            resolver, corpus.type_url, &input_stream, &output_stream);
+        GOOGLE_CHECK(status.ok()) << status;
+        benchmark::DoNotOptimize(output.data());
+      });
+}
+
+void BM_ParseStream(benchmark::State& state, CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  const std::string& json = GetJson(shape);
+  TypeResolver* resolver = corpus.resolver;
+  std::string output;
+  RunHeadToHead(
+      state, shape,
+      [&] {
+        output.clear();
+        io::ArrayInputStream input_stream(corpus.xml.data(),
+                                          corpus.xml.size());
+        io::StringOutputStream output_stream(&output);
+        util::Status status = XmlToBinaryStream(resolver, corpus.type_url,
+                                                &input_stream, &output_stream);
+        GOOGLE_CHECK(status.ok()) << status;
+        benchmark::DoNotOptimize(output.data());
+      },
+      [&] {
+        output.clear();
+        io::ArrayInputStream input_stream(json.data(), json.size());
+        io::StringOutputStream output_stream(&output);
+        util::Status status = JsonToBinaryStream(
+            resolver, corpus.type_url, &input_stream, &output_stream);
+        GOOGLE_CHECK(status.ok()) << status;
+        benchmark::DoNotOptimize(output.data());
+      });
+}
+
+#define XML_JSON_BENCHMARK(fn, shape_name, shape) \
+  BENCHMARK_CAPTURE(fn, shape_name, shape)->UseManualTime()
+
+#define XML_JSON_BENCHMARK_ALL_SHAPES(fn)                                \
+  XML_JSON_BENCHMARK(fn, address_book, CorpusShape::kAddressBook);       \
+  XML_JSON_BENCHMARK(fn, deep_nesting, CorpusShape::kDeepNesting);       \
+  XML_JSON_BENCHMARK(fn, wide_flat, CorpusShape::kWideFlat);             \
+  XML_JSON_BENCHMARK(fn, string_heavy, CorpusShape::kStringHeavy);       \
+  XML_JSON_BENCHMARK(fn, bytes_heavy, CorpusShape::kBytesHeavy);         \
+  XML_JSON_BENCHMARK(fn, numeric_heavy, CorpusShape::kNumericHeavy);     \
+  XML_JSON_BENCHMARK(fn, map_heavy, CorpusShape::kMapHeavy)
+
+XML_JSON_BENCHMARK_ALL_SHAPES(BM_PrintMessage);
+XML_JSON_BENCHMARK_ALL_SHAPES(BM_ParseMessage);
+XML_JSON_BENCHMARK_ALL_SHAPES(BM_PrintStream);
+XML_JSON_BENCHMARK_ALL_SHAPES(BM_ParseStream);
+
+// The custom corpus is only known at run time, so its cases are registered
+// dynamically.
+const bool custom_benchmarks_registered = [] {
+  if (!HasCustomCorpus()) return false;
+  benchmark::RegisterBenchmark("BM_PrintMessage/custom", BM_PrintMessage,
+                               CorpusShape::kCustom)
+      ->UseManualTime();
+  benchmark::RegisterBenchmark("BM_ParseMessage/custom", BM_ParseMessage,
+                               CorpusShape::kCustom)
+      ->UseManualTime();
+  benchmark::RegisterBenchmark("BM_PrintStream/custom", BM_PrintStream,
+                               CorpusShape::kCustom)
+      ->UseManualTime();
+  benchmark::RegisterBenchmark("BM_ParseStream/custom", BM_ParseStream,
+                               CorpusShape::kCustom)
+      ->UseManualTime();
+  return true;
+}();
+
+}  // namespace
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,399 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Microbenchmarks for the kernels that dominate XmlObjectWriter and
+// XmlStreamParser, each on controlled inputs, so that an optimization of a
+// kernel can be measured apart from the end-to-end conversion.
+//
+// Writer kernels:
+//   BM_JsonEscape/<text>/<length>     JsonEscaping::Escape of string values.
+//   BM_FormatInt32/<magnitude>        StrCat of int32 values.
+//   BM_FormatInt64/<magnitude>        StrCat of int64 values.
+//   BM_SimpleDtoa/<magnitude>         SimpleDtoa of double values.
+//   BM_SimpleFtoa/<magnitude>         SimpleFtoa of float values.
+//   BM_Base64Escape/<length>          Base64Escape of bytes values.
+//   BM_WebSafeBase64Escape/<length>   WebSafeBase64EscapeWithPadding.
+// Parser kernels:
+//   BM_UTF8SpnStructurallyValid/<text>/<length>
+//   BM_ParseText/<text>/<length>      Text nodes, scanned by ConsumeText().
+//   BM_ParseAttribute/<text>/<length> Quoted attribute values, unescaped by
+//                                     ParseStringHelper().
+// The parser kernels are private to XmlStreamParser, so they are measured
+// through it on documents made of one kind of token, with the events going
+// to a NullObjectWriter.
+//
+// <text> is one of
+//   ascii:     letters, digits and spaces only,
+//   escapes:   about one character in four needs escaping,
+//   multibyte: two, three and four byte UTF-8 sequences,
+// and <length> is the length of each value before escaping, small (16 bytes)
+// or large (64KB). The parser inputs hold the values escaped the way
+// XmlObjectWriter writes them. bytes_per_second counts value bytes only.
+//
+// With XML_BENCHMARK_PERF_COUNTERS=1 every case also reports hardware
+// counters per value byte and, where there are several values per
+// iteration, per value (see HardwareCounters).
+//
+// Example (from src/google/protobuf/util):
+//   bazel run -c opt :xml_kernels_benchmark -- --benchmark_filter=Escape
+
+#include <benchmark/benchmark.h>
+#include <google/protobuf/stubs/bytestream.h>
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/internal/json_escaping.h>
+#include <google/protobuf/util/internal/xml_stream_parser.h>
+#include <google/protobuf/util/xml_benchmark_util.h>
+
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+using converter::JsonEscaping;
+using converter::XmlStreamParser;
+
+const int kSmallLength = 16;
+const int kLargeLength = 64 * 1024;
+// Number of values each iteration formats, and the minimum number of bytes
+// each parser iteration parses.
+const int kValueCount = 1024;
+const int kDocumentBytes = 256 * 1024;
+
+enum class TextKind {
+  kAscii,
+  kEscapes,
+  kMultibyte,
+};
+
+enum class Magnitude {
+  kSmall,
+  kLarge,
+  // For floating point: values with a fraction and many significant digits.
+  kFraction,
+};
+
+// Returns |length| bytes of |kind| text, cut at a character boundary and
+// padded with ASCII.
+std::string MakeText(TextKind kind, int length, uint64_t seed) {
+  static const char kAscii[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 ";
+  static const char* const kEscapes[] = {"\"", "\\", "\n", "\t",
+                                         "\x01", "<", ">"};
+  static const char* const kMultibyte[] = {"\xc3\xa9", "\xd0\x96",
+                                           "\xe4\xb8\xad", "\xe2\x82\xac",
+                                           "\xf0\x9f\x98\x80"};
+  std::mt19937_64 rng(seed);
+  std::string text;
+  while (static_cast<int>(text.size()) < length) {
+    const uint64_t r = rng();
+    std::string next(1, kAscii[r % (sizeof(kAscii) - 1)]);
+    if (kind == TextKind::kMultibyte) {
+      next = kMultibyte[r % 5];
+    } else if (kind == TextKind::kEscapes && r % 4 == 0) {
+      next = kEscapes[(r >> 8) % 7];
+    }
+    if (static_cast<int>(text.size() + next.size()) > length) break;
+    text += next;
+  }
+  text.resize(length, 'x');
+  return text;
+}
+
+// Returns |text| as XmlObjectWriter writes it.
+std::string Escape(const std::string& text) {
+  std::string escaped;
+  strings::StringByteSink sink(&escaped);
+  JsonEscaping::Escape(text, &sink);
+  return escaped;
+}
+
+// BM_JsonEscape -------------------------------------------------------------
+
+void BM_JsonEscape(benchmark::State& state, TextKind kind) {
+  const int length = static_cast<int>(state.range(0));
+  const std::string value = MakeText(kind, length, 1);
+  std::string output;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    output.clear();
+    strings::StringByteSink sink(&output);
+    JsonEscaping::Escape(value, &sink);
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * length);
+  ReportHardwareCounters(counters, length, 0, state);
+}
+
+// Number formatting --------------------------------------------------------
+
+template <typename T>
+std::vector<T> MakeIntegers(Magnitude magnitude) {
+  std::mt19937_64 rng(2);
+  std::vector<T> values;
+  for (int i = 0; i < kValueCount; ++i) {
+    const uint64_t r = rng();
+    T value = static_cast<T>(r % 100);
+    if (magnitude == Magnitude::kLarge) {
+      value = std::numeric_limits<T>::max() - static_cast<T>(r % 1000);
+    }
+    values.push_back(i % 2 == 0 ? value : -value);
+  }
+  return values;
+}
+
+template <typename T>
+std::vector<T> MakeFloatingPoint(Magnitude magnitude) {
+  std::mt19937_64 rng(3);
+  std::uniform_real_distribution<double> fraction(0, 1);
+  std::vector<T> values;
+  for (int i = 0; i < kValueCount; ++i) {
+    const double r = fraction(rng);
+    double value = 0;
+    switch (magnitude) {
+      case Magnitude::kSmall:
+        value = static_cast<int>(r * 100);
+        break;
+      case Magnitude::kLarge:
+        value = r * std::numeric_limits<T>::max();
+        break;
+      case Magnitude::kFraction:
+        value = r;
+        break;
+    }
+    values.push_back(static_cast<T>(i % 2 == 0 ? value : -value));
+  }
+  return values;
+}
+
+template <typename T, typename Format>
+void RunFormat(benchmark::State& state, const std::vector<T>& values,
+               Format format) {
+  int64_t bytes = 0;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    for (T value : values) {
+      std::string text = format(value);
+      bytes += text.size();
+      benchmark::DoNotOptimize(text.data());
+    }
+  }
+  counters.Stop();
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          kValueCount);
+  state.SetBytesProcessed(bytes);
+  ReportHardwareCounters(counters,
+                         bytes / static_cast<int64_t>(state.iterations()),
+                         kValueCount, state);
+}
+
+void BM_FormatInt32(benchmark::State& state, Magnitude magnitude) {
+  RunFormat(state, MakeIntegers<int32_t>(magnitude),
+            [](int32_t value) { return StrCat(value); });
+}
+
+void BM_FormatInt64(benchmark::State& state, Magnitude magnitude) {
+  RunFormat(state, MakeIntegers<int64_t>(magnitude),
+            [](int64_t value) { return StrCat(value); });
+}
+
+void BM_SimpleDtoa(benchmark::State& state, Magnitude magnitude) {
+  RunFormat(state, MakeFloatingPoint<double>(magnitude),
+            [](double value) { return SimpleDtoa(value); });
+}
+
+void BM_SimpleFtoa(benchmark::State& state, Magnitude magnitude) {
+  RunFormat(state, MakeFloatingPoint<float>(magnitude),
+            [](float value) { return SimpleFtoa(value); });
+}
+
+// Base64 --------------------------------------------------------------------
+
+std::string MakeBytes(int length) {
+  std::mt19937_64 rng(4);
+  std::string bytes(length, '\0');
+  for (char& c : bytes) c = static_cast<char>(rng());
+  return bytes;
+}
+
+void BM_Base64Escape(benchmark::State& state) {
+  const std::string value = MakeBytes(static_cast<int>(state.range(0)));
+  std::string output;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    output.clear();
+    Base64Escape(value, &output);
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(value.size()));
+  ReportHardwareCounters(counters, static_cast<int64_t>(value.size()), 0,
+                         state);
+}
+
+void BM_WebSafeBase64Escape(benchmark::State& state) {
+  const std::string value = MakeBytes(static_cast<int>(state.range(0)));
+  std::string output;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    output.clear();
+    WebSafeBase64EscapeWithPadding(value, &output);
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(value.size()));
+  ReportHardwareCounters(counters, static_cast<int64_t>(value.size()), 0,
+                         state);
+}
+
+// Parser kernels ------------------------------------------------------------
+
+void BM_UTF8SpnStructurallyValid(benchmark::State& state, TextKind kind) {
+  const int length = static_cast<int>(state.range(0));
+  const std::string value = MakeText(kind, length, 5);
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(internal::UTF8SpnStructurallyValid(value));
+  }
+  counters.Stop();
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * length);
+  ReportHardwareCounters(counters, length, 0, state);
+}
+
+// Returns a document of at least kDocumentBytes that is a list of
+// |open| value |close| items. The values are different texts of |length|
+// bytes, escaped the way XmlObjectWriter escapes them. Also returns the
+// number of values and of value bytes in the document.
+std::string MakeListDocument(TextKind kind, int length,
+                             const std::string& open, const std::string& close,
+                             int64_t* values, int64_t* value_bytes) {
+  std::string document = "<root><_list_t>";
+  *values = 0;
+  *value_bytes = 0;
+  for (uint64_t seed = 0; static_cast<int>(document.size()) < kDocumentBytes;
+       ++seed) {
+    const std::string value = Escape(MakeText(kind, length, seed));
+    document += open;
+    document += value;
+    document += close;
+    ++*values;
+    *value_bytes += value.size();
+  }
+  document += "</_list_t></root>";
+  return document;
+}
+
+void RunParse(benchmark::State& state, const std::string& document,
+              int64_t values, int64_t value_bytes) {
+  NullObjectWriter writer;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    XmlStreamParser parser(&writer);
+    util::Status status = parser.Parse(document);
+    if (status.ok()) status = parser.FinishParse();
+    GOOGLE_CHECK(status.ok()) << status;
+  }
+  counters.Stop();
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          value_bytes);
+  ReportHardwareCounters(counters, value_bytes, values, state);
+}
+
+void BM_ParseText(benchmark::State& state, TextKind kind) {
+  int64_t values;
+  int64_t value_bytes;
+  const std::string document =
+      MakeListDocument(kind, static_cast<int>(state.range(0)), "<t>", "</t>",
+                       &values, &value_bytes);
+  RunParse(state, document, values, value_bytes);
+}
+
+void BM_ParseAttribute(benchmark::State& state, TextKind kind) {
+  int64_t values;
+  int64_t value_bytes;
+  const std::string document =
+      MakeListDocument(kind, static_cast<int>(state.range(0)), "<t a=\"",
+                       "\"></t>", &values, &value_bytes);
+  RunParse(state, document, values, value_bytes);
+}
+
+#define XML_KERNEL_TEXT_BENCHMARK(fn)                                  \
+  BENCHMARK_CAPTURE(fn, ascii, TextKind::kAscii)                       \
+      ->Arg(kSmallLength)                                              \
+      ->Arg(kLargeLength);                                             \
+  BENCHMARK_CAPTURE(fn, escapes, TextKind::kEscapes)                   \
+      ->Arg(kSmallLength)                                              \
+      ->Arg(kLargeLength);                                             \
+  BENCHMARK_CAPTURE(fn, multibyte, TextKind::kMultibyte)               \
+      ->Arg(kSmallLength)                                              \
+      ->Arg(kLargeLength)
+
+XML_KERNEL_TEXT_BENCHMARK(BM_JsonEscape);
+XML_KERNEL_TEXT_BENCHMARK(BM_UTF8SpnStructurallyValid);
+XML_KERNEL_TEXT_BENCHMARK(BM_ParseText);
+XML_KERNEL_TEXT_BENCHMARK(BM_ParseAttribute);
+
+BENCHMARK_CAPTURE(BM_FormatInt32, small, Magnitude::kSmall);
+BENCHMARK_CAPTURE(BM_FormatInt32, large, Magnitude::kLarge);
+BENCHMARK_CAPTURE(BM_FormatInt64, small, Magnitude::kSmall);
+BENCHMARK_CAPTURE(BM_FormatInt64, large, Magnitude::kLarge);
+BENCHMARK_CAPTURE(BM_SimpleDtoa, small, Magnitude::kSmall);
+BENCHMARK_CAPTURE(BM_SimpleDtoa, large, Magnitude::kLarge);
+BENCHMARK_CAPTURE(BM_SimpleDtoa, fraction, Magnitude::kFraction);
+BENCHMARK_CAPTURE(BM_SimpleFtoa, small, Magnitude::kSmall);
+BENCHMARK_CAPTURE(BM_SimpleFtoa, large, Magnitude::kLarge);
+BENCHMARK_CAPTURE(BM_SimpleFtoa, fraction, Magnitude::kFraction);
+
+BENCHMARK(BM_Base64Escape)->RangeMultiplier(16)->Range(16, 1 << 20);
+BENCHMARK(BM_WebSafeBase64Escape)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+}  // namespace
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
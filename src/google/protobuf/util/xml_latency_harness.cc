@@ -0,0 +1,421 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// Replays a service-style mix of requests through MessageToXmlString and
+// XmlStringToMessage at a fixed request rate and reports the latency
+// distribution, because averages hide the tail that SLOs are about.
+//
+// Requests are issued open-loop: request i is due at start + i / qps, and
+// its latency is measured from that time, so a slow request also delays the
+// ones queued behind it (no coordinated omission). Each request picks a
+// message size and a direction at random, with the given weights. Messages
+// are AddressBooks generated by xml_corpus_generator.
+//
+// For every direction and size the harness prints p50, p99, p99.9 and max
+// from an HDR-style histogram, then the slowest requests with the number of
+// allocations they made and how often their output buffer grew, next to the
+// medians of the group. Tail requests that allocate far more than the median
+// point at allocation spikes; growths in particular come from std::string
+// reallocation behind StringOutputStream. --reuse_buffers keeps the output
+// string and message across requests, like a server with pooled buffers, to
+// compare.
+//
+// Flags (defaults in brackets):
+//   --qps=N                 Requests per second [200].
+//   --duration_seconds=N    Length of the run [10].
+//   --sizes=B1,B2,...       Approximate binary message sizes
+//                           [1024,16384,262144].
+//   --weights=W1,W2,...     Relative frequency of each size [70,25,5].
+//   --directions=D1,...     print, parse or both [print,parse].
+//   --reuse_buffers         Reuse outputs across requests [false].
+//   --outliers=N            Slowest requests listed per group [5].
+//   --seed=N                Seed of the request mix and messages [1].
+//
+// Example (from src/google/protobuf/util):
+//   bazel run -c opt :xml_latency_harness -- --qps=1000 --duration_seconds=60
+
+#include <google/protobuf/message.h>
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/xml_benchmark.pb.h>
+#include <google/protobuf/util/xml_benchmark_util.h>
+#include <google/protobuf/util/xml_corpus_generator.h>
+#include <google/protobuf/util/xml_util.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+using ::proto_util_xml_benchmark::AddressBook;
+
+// Latency histogram with logarithmic buckets, each split into linear
+// sub-buckets, as in HdrHistogram: values are recorded with a relative error
+// below 1 / kSubBuckets over the whole int64 range, in constant memory.
+class LatencyHistogram {
+ public:
+  LatencyHistogram()
+      : counts_(kExactValues + (63 - kSubBucketBits) * kSubBuckets),
+        total_(0),
+        max_(0) {}
+
+  void Record(int64_t nanos) {
+    nanos = std::max<int64_t>(nanos, 0);
+    ++counts_[Index(nanos)];
+    ++total_;
+    max_ = std::max(max_, nanos);
+  }
+
+  int64_t count() const { return total_; }
+  int64_t max() const { return max_; }
+
+  // Returns an upper bound of the |percentile|th value, 0 < percentile <= 100.
+  int64_t Percentile(double percentile) const {
+    const int64_t rank = std::max<int64_t>(
+        1, static_cast<int64_t>(
+               std::ceil(percentile / 100 * static_cast<double>(total_))));
+    int64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+      seen += counts_[i];
+      if (seen >= rank) return std::min(UpperBound(static_cast<int>(i)), max_);
+    }
+    return max_;
+  }
+
+ private:
+  static const int kSubBucketBits = 6;
+  static const int kSubBuckets = 1 << kSubBucketBits;
+  // Values below this are recorded exactly.
+  static const int kExactValues = 2 * kSubBuckets;
+
+  // A value whose highest set bit is |msb| >= kSubBucketBits + 1 falls in
+  // one of kSubBuckets equal steps of [2^msb, 2^(msb + 1)).
+  static int Index(int64_t value) {
+    if (value < kExactValues) return static_cast<int>(value);
+    int msb = kSubBucketBits + 1;
+    while ((value >> (msb + 1)) != 0) ++msb;
+    const int shift = msb - kSubBucketBits;
+    const int step = static_cast<int>(value >> shift) - kSubBuckets;
+    return kExactValues + (msb - kSubBucketBits - 1) * kSubBuckets + step;
+  }
+
+  static int64_t UpperBound(int index) {
+    if (index < kExactValues) return index;
+    const int msb = kSubBucketBits + 1 + (index - kExactValues) / kSubBuckets;
+    const int step = (index - kExactValues) % kSubBuckets;
+    const int shift = msb - kSubBucketBits;
+    return ((static_cast<int64_t>(kSubBuckets + step) + 1) << shift) - 1;
+  }
+
+  std::vector<int64_t> counts_;
+  int64_t total_;
+  int64_t max_;
+};
+
+enum Direction { PRINT, PARSE };
+
+const char* DirectionName(Direction direction) {
+  return direction == PRINT ? "print" : "parse";
+}
+
+struct Flags {
+  double qps = 200;
+  double duration_seconds = 10;
+  std::vector<int64_t> sizes = {1024, 16384, 262144};
+  std::vector<int64_t> weights = {70, 25, 5};
+  std::vector<Direction> directions = {PRINT, PARSE};
+  bool reuse_buffers = false;
+  int outliers = 5;
+  uint64_t seed = 1;
+};
+
+bool ParseIntList(const std::string& text, std::vector<int64_t>* values) {
+  values->clear();
+  for (const std::string& item : Split(text, ",", true)) {
+    int64_t value;
+    if (!safe_strto64(item, &value) || value <= 0) return false;
+    values->push_back(value);
+  }
+  return !values->empty();
+}
+
+bool ParseDirections(const std::string& text,
+                     std::vector<Direction>* directions) {
+  directions->clear();
+  for (const std::string& item : Split(text, ",", true)) {
+    if (item == "print") {
+      directions->push_back(PRINT);
+    } else if (item == "parse") {
+      directions->push_back(PARSE);
+    } else {
+      return false;
+    }
+  }
+  return !directions->empty();
+}
+
+// Parses one flag into |flags|. Returns false for unknown or invalid flags.
+bool ParseFlag(const std::string& arg, Flags* flags) {
+  const std::string::size_type equals = arg.find('=');
+  const std::string name = arg.substr(0, equals);
+  const std::string value =
+      equals == std::string::npos ? "" : arg.substr(equals + 1);
+  if (name == "--qps") {
+    return safe_strtod(value, &flags->qps) && flags->qps > 0;
+  } else if (name == "--duration_seconds") {
+    return safe_strtod(value, &flags->duration_seconds) &&
+           flags->duration_seconds > 0;
+  } else if (name == "--sizes") {
+    return ParseIntList(value, &flags->sizes);
+  } else if (name == "--weights") {
+    return ParseIntList(value, &flags->weights);
+  } else if (name == "--directions") {
+    return ParseDirections(value, &flags->directions);
+  } else if (name == "--reuse_buffers") {
+    flags->reuse_buffers = value.empty() || value == "true";
+    return value.empty() || value == "true" || value == "false";
+  } else if (name == "--outliers") {
+    return safe_strto32(value, &flags->outliers) && flags->outliers >= 0;
+  } else if (name == "--seed") {
+    return safe_strtou64(value, &flags->seed);
+  }
+  return false;
+}
+
+// One message in both forms.
+struct Payload {
+  std::unique_ptr<Message> message;
+  std::string xml;
+};
+
+struct Sample {
+  int64_t nanos;
+  int64_t allocations;
+  // Times an output or parser buffer had to grow; see XmlParseStats and
+  // XmlPrintStats.
+  int64_t growths;
+};
+
+// The latencies of one direction and size.
+struct Group {
+  LatencyHistogram histogram;
+  std::vector<Sample> samples;
+};
+
+class Harness {
+ public:
+  explicit Harness(const Flags& flags) : flags_(flags), rng_(flags.seed) {
+    for (size_t i = 0; i < flags.sizes.size(); ++i) {
+      CorpusSpec spec;
+      spec.seed = flags.seed + i;
+      spec.target_bytes = flags.sizes[i];
+      Payload payload;
+      payload.message.reset(new AddressBook);
+      GenerateMessage(spec, payload.message.get());
+      util::Status status = MessageToXmlString(*payload.message, &payload.xml);
+      GOOGLE_CHECK(status.ok()) << status;
+      payloads_.push_back(std::move(payload));
+    }
+    groups_.resize(2 * payloads_.size());
+    reused_message_.reset(new AddressBook);
+  }
+
+  void Run() {
+    std::discrete_distribution<int> pick_size(flags_.weights.begin(),
+                                              flags_.weights.end());
+    std::uniform_int_distribution<int> pick_direction(
+        0, static_cast<int>(flags_.directions.size()) - 1);
+    const std::chrono::nanoseconds interval(
+        static_cast<int64_t>(1e9 / flags_.qps));
+    const int64_t requests =
+        static_cast<int64_t>(flags_.qps * flags_.duration_seconds);
+    const auto start = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < requests; ++i) {
+      const int size = pick_size(rng_);
+      const Direction direction = flags_.directions[pick_direction(rng_)];
+      const auto due = start + i * interval;
+      std::this_thread::sleep_until(due);
+      Sample sample = Serve(direction, payloads_[size]);
+      sample.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - due)
+                         .count();
+      Group& group = groups_[2 * size + direction];
+      group.histogram.Record(sample.nanos);
+      group.samples.push_back(sample);
+    }
+  }
+
+  void Report() const {
+    std::printf("%-6s %10s %8s %10s %10s %10s %10s\n", "dir", "size",
+                "count", "p50_us", "p99_us", "p99.9_us", "max_us");
+    for (size_t size = 0; size < payloads_.size(); ++size) {
+      for (Direction direction : {PRINT, PARSE}) {
+        const LatencyHistogram& histogram =
+            groups_[2 * size + direction].histogram;
+        if (histogram.count() == 0) continue;
+        std::printf("%-6s %10lld %8lld %10.1f %10.1f %10.1f %10.1f\n",
+                    DirectionName(direction),
+                    static_cast<long long>(flags_.sizes[size]),
+                    static_cast<long long>(histogram.count()),
+                    histogram.Percentile(50) / 1e3,
+                    histogram.Percentile(99) / 1e3,
+                    histogram.Percentile(99.9) / 1e3, histogram.max() / 1e3);
+      }
+    }
+    if (flags_.outliers == 0) return;
+    for (size_t size = 0; size < payloads_.size(); ++size) {
+      for (Direction direction : {PRINT, PARSE}) {
+        ReportOutliers(direction, size, groups_[2 * size + direction]);
+      }
+    }
+  }
+
+ private:
+  // Converts |payload| in |direction| the way a request handler would, and
+  // returns the allocations and buffer growths it caused.
+  Sample Serve(Direction direction, const Payload& payload) {
+    Sample sample = {0, 0, 0};
+    const int64_t allocations = ThreadAllocationCount();
+    util::Status status;
+    if (direction == PRINT) {
+      XmlPrintStats stats;
+      std::string fresh_output;
+      std::string* output = &fresh_output;
+      if (flags_.reuse_buffers) {
+        reused_output_.clear();
+        output = &reused_output_;
+      }
+      XmlPrintOptions options;
+      options.stats = &stats;
+      status = MessageToXmlString(*payload.message, output, options);
+      sample.growths = stats.allocations;
+    } else {
+      XmlParseStats stats;
+      std::unique_ptr<Message> fresh_message;
+      Message* message = reused_message_.get();
+      if (!flags_.reuse_buffers) {
+        fresh_message.reset(payload.message->New());
+        message = fresh_message.get();
+      }
+      XmlParseOptions options;
+      options.stats = &stats;
+      status = XmlStringToMessage(payload.xml, message, options);
+      sample.growths = stats.allocations;
+    }
+    GOOGLE_CHECK(status.ok()) << status;
+    sample.allocations = ThreadAllocationCount() - allocations;
+    return sample;
+  }
+
+  void ReportOutliers(Direction direction, size_t size,
+                      const Group& group) const {
+    if (group.samples.empty()) return;
+    std::vector<Sample> samples = group.samples;
+    auto median = [&samples](int64_t Sample::*field) {
+      std::vector<int64_t> values;
+      for (const Sample& sample : samples) values.push_back(sample.*field);
+      std::nth_element(values.begin(), values.begin() + values.size() / 2,
+                       values.end());
+      return values[values.size() / 2];
+    };
+    const int64_t median_allocations = median(&Sample::allocations);
+    const int64_t median_growths = median(&Sample::growths);
+    std::sort(samples.begin(), samples.end(),
+              [](const Sample& a, const Sample& b) {
+                return a.nanos > b.nanos;
+              });
+    std::printf(
+        "\nslowest %s requests of size %lld (median: %lld allocations, "
+        "%lld growths)\n",
+        DirectionName(direction), static_cast<long long>(flags_.sizes[size]),
+        static_cast<long long>(median_allocations),
+        static_cast<long long>(median_growths));
+    const size_t count =
+        std::min(samples.size(), static_cast<size_t>(flags_.outliers));
+    for (size_t i = 0; i < count; ++i) {
+      std::printf("  %10.1f us %8lld allocations %4lld growths\n",
+                  samples[i].nanos / 1e3,
+                  static_cast<long long>(samples[i].allocations),
+                  static_cast<long long>(samples[i].growths));
+    }
+  }
+
+  const Flags flags_;
+  std::mt19937_64 rng_;
+  std::vector<Payload> payloads_;
+  // Indexed by 2 * size + direction.
+  std::vector<Group> groups_;
+  std::string reused_output_;
+  std::unique_ptr<Message> reused_message_;
+};
+
+int Run(int argc, char* argv[]) {
+  Flags flags;
+  for (int i = 1; i < argc; ++i) {
+    if (!ParseFlag(argv[i], &flags)) {
+      std::cerr << "Invalid flag: " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+  if (flags.sizes.size() != flags.weights.size()) {
+    std::cerr << "--sizes and --weights must have the same length"
+              << std::endl;
+    return 1;
+  }
+  Harness harness(flags);
+  harness.Run();
+  harness.Report();
+  return 0;
+}
+
+}  // namespace
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+int main(int argc, char* argv[]) {
+  return google::protobuf::util::xml_benchmark::Run(argc, argv);
+}
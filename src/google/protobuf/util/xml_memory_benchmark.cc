@@ -0,0 +1,408 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Checks that streaming conversions of multi-gigabyte documents run in
+// bounded memory, and reports how much they use.
+//
+// Inputs are generated on the fly: a ZeroCopyInputStream repeats one element
+// of a benchmark corpus' repeated field until the document reaches the
+// requested size (1, 2 and 4GB of XML), and the output goes to a stream that
+// discards it. Neither side is ever held in memory, so whatever the process
+// gains in RSS is working memory of the conversion itself.
+//
+// Every case reports:
+//   peak_rss_mb:      peak resident set size during the conversion,
+//   rss_growth_mb:    peak minus the RSS before the conversion,
+//   bound_mb:         the documented bound on rss_growth_mb, see below,
+//   parser_buffer_kb: high-water mark of XmlStreamParser's internal buffers
+//                     (XmlToBinaryStream only).
+// and fails if rss_growth_mb exceeds bound_mb.
+//
+// The expected bounds, for every shape:
+//   BinaryToXmlStream  O(1): ProtoStreamObjectSource reads one field at a
+//                      time and XmlObjectWriter only keeps the stack of open
+//                      elements, so memory depends on the nesting depth and
+//                      the largest field, not the input size.
+//   XmlToBinaryStream  O(output): XmlStreamParser itself only buffers the
+//                      token that straddles a chunk boundary (asserted
+//                      separately), but ProtoStreamObjectWriter keeps the
+//                      whole root message in memory to compute the length
+//                      prefixes of nested messages. That is the encoded
+//                      message (up to 2x after string doubling) plus one
+//                      8-byte size record per nested message.
+// map_heavy is left out because its elements cannot be repeated: map keys
+// must be unique.
+//
+// The cases take tens of seconds each and need several GB of RAM, so run
+// them on their own (from src/google/protobuf/util):
+//   bazel run -c opt :xml_memory_benchmark -- --benchmark_filter=address_book
+//
+// Peak RSS is read from /proc and reset through /proc/self/clear_refs, so
+// the cases are skipped on platforms other than Linux.
+
+#include <benchmark/benchmark.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/stringpiece.h>
+#include <google/protobuf/util/xml_benchmark_util.h>
+#include <google/protobuf/util/xml_util.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+const int64_t kGigabyte = int64_t{1} << 30;
+const int64_t kMegabyte = int64_t{1} << 20;
+// Size of the blocks handed out by the input and output streams.
+const int kBlockSize = 64 * 1024;
+// Allowance for everything that does not depend on the input: type
+// resolution, stream buffers, allocator slack.
+const int64_t kFixedOverhead = 64 * kMegabyte;
+
+// A document made of |prefix|, |count| copies of |unit| and |suffix|.
+struct RepeatedDocument {
+  std::string prefix;
+  std::string unit;
+  std::string suffix;
+  int64_t count;
+
+  int64_t size() const {
+    return static_cast<int64_t>(prefix.size() + suffix.size()) +
+           count * static_cast<int64_t>(unit.size());
+  }
+};
+
+// Streams a RepeatedDocument in blocks of about kBlockSize bytes, without
+// materializing it.
+class RepeatedDocumentInputStream : public io::ZeroCopyInputStream {
+ public:
+  explicit RepeatedDocumentInputStream(const RepeatedDocument* document)
+      : document_(document),
+        units_per_block_(std::max<int64_t>(
+            1, kBlockSize / std::max<size_t>(1, document->unit.size()))),
+        next_piece_(0),
+        units_left_(document->count),
+        last_data_(nullptr),
+        last_size_(0),
+        backed_up_(0),
+        position_(0) {
+    for (int64_t i = 0; i < units_per_block_; ++i) block_ += document->unit;
+  }
+
+  bool Next(const void** data, int* size) override {
+    if (backed_up_ > 0) {
+      *data = last_data_ + last_size_ - backed_up_;
+      *size = backed_up_;
+      position_ += backed_up_;
+      backed_up_ = 0;
+      return true;
+    }
+    StringPiece piece;
+    while (piece.empty()) {
+      if (next_piece_ == 0) {
+        piece = document_->prefix;
+        ++next_piece_;
+      } else if (next_piece_ == 1 && units_left_ > 0) {
+        const int64_t units = std::min(units_left_, units_per_block_);
+        piece = StringPiece(block_.data(), units * document_->unit.size());
+        units_left_ -= units;
+      } else if (next_piece_ == 1) {
+        piece = document_->suffix;
+        ++next_piece_;
+      } else {
+        return false;
+      }
+    }
+    last_data_ = piece.data();
+    last_size_ = static_cast<int>(piece.size());
+    *data = last_data_;
+    *size = last_size_;
+    position_ += last_size_;
+    return true;
+  }
+
+  void BackUp(int count) override {
+    backed_up_ = count;
+    position_ -= count;
+  }
+
+  bool Skip(int count) override {
+    const void* data;
+    int size;
+    while (count > 0) {
+      if (!Next(&data, &size)) return false;
+      if (size > count) {
+        BackUp(size - count);
+        return true;
+      }
+      count -= size;
+    }
+    return true;
+  }
+
+  int64_t ByteCount() const override { return position_; }
+
+ private:
+  const RepeatedDocument* document_;
+  const int64_t units_per_block_;
+  std::string block_;
+  // 0: prefix, 1: units then suffix, 2: end.
+  int next_piece_;
+  int64_t units_left_;
+  const char* last_data_;
+  int last_size_;
+  int backed_up_;
+  int64_t position_;
+};
+
+// Counts and discards everything written to it.
+class DiscardingOutputStream : public io::ZeroCopyOutputStream {
+ public:
+  DiscardingOutputStream() : buffer_(new char[kBlockSize]), position_(0) {}
+
+  bool Next(void** data, int* size) override {
+    *data = buffer_.get();
+    *size = kBlockSize;
+    position_ += kBlockSize;
+    return true;
+  }
+
+  void BackUp(int count) override { position_ -= count; }
+
+  int64_t ByteCount() const override { return position_; }
+
+ private:
+  std::unique_ptr<char[]> buffer_;
+  int64_t position_;
+};
+
+// The repeated field of each shape whose elements are repeated.
+const char* RepeatedFieldName(CorpusShape shape) {
+  switch (shape) {
+    case CorpusShape::kAddressBook:
+      return "people";
+    case CorpusShape::kDeepNesting:
+      return "chains";
+    case CorpusShape::kWideFlat:
+      return "rows";
+    case CorpusShape::kStringHeavy:
+      return "values";
+    case CorpusShape::kBytesHeavy:
+      return "blobs";
+    case CorpusShape::kNumericHeavy:
+      return "int64_values";
+    default:
+      GOOGLE_LOG(FATAL) << "Shape has no repeatable field";
+      return nullptr;
+  }
+}
+
+// The binary and XML encodings of the corpus message reduced to a single
+// element of its repeated field, split so that the element can be repeated.
+struct DocumentTemplates {
+  RepeatedDocument binary;
+  RepeatedDocument xml;
+};
+
+DocumentTemplates MakeTemplates(const Corpus& corpus, CorpusShape shape) {
+  const Descriptor* descriptor = corpus.message->GetDescriptor();
+  const FieldDescriptor* field =
+      descriptor->FindFieldByName(RepeatedFieldName(shape));
+  GOOGLE_CHECK(field != nullptr && field->is_repeated());
+  std::unique_ptr<Message> single(corpus.message->New());
+  single->CopyFrom(*corpus.message);
+  const Reflection* reflection = single->GetReflection();
+  for (int i = 0; i < descriptor->field_count(); ++i) {
+    if (descriptor->field(i) != field) {
+      reflection->ClearField(single.get(), descriptor->field(i));
+    }
+  }
+  while (reflection->FieldSize(*single, field) > 1) {
+    reflection->RemoveLast(single.get(), field);
+  }
+
+  DocumentTemplates templates;
+  // With only one field set, the whole encoding is one element, and
+  // concatenated elements form a valid encoding of more elements.
+  templates.binary.unit = single->SerializeAsString();
+  templates.binary.count = 0;
+
+  std::string xml;
+  util::Status status = MessageToXmlString(*single, &xml);
+  GOOGLE_CHECK(status.ok()) << status;
+  const std::string open_tag = "<_list_" + field->json_name() + ">";
+  const std::string close_tag = "</_list_" + field->json_name() + ">";
+  const size_t begin = xml.find(open_tag);
+  const size_t end = xml.rfind(close_tag);
+  GOOGLE_CHECK(begin != std::string::npos && end != std::string::npos) << xml;
+  const size_t unit_begin = begin + open_tag.size();
+  templates.xml.prefix = xml.substr(0, unit_begin);
+  templates.xml.unit = xml.substr(unit_begin, end - unit_begin);
+  templates.xml.suffix = xml.substr(end);
+  templates.xml.count = 0;
+  return templates;
+}
+
+// Sizes both documents so that the XML one is about |xml_bytes| long.
+DocumentTemplates MakeDocuments(const Corpus& corpus, CorpusShape shape,
+                                int64_t xml_bytes) {
+  DocumentTemplates documents = MakeTemplates(corpus, shape);
+  const int64_t fixed = static_cast<int64_t>(documents.xml.prefix.size() +
+                                             documents.xml.suffix.size());
+  const int64_t unit = static_cast<int64_t>(documents.xml.unit.size());
+  const int64_t count = std::max<int64_t>(1, (xml_bytes - fixed) / unit);
+  documents.xml.count = count;
+  documents.binary.count = count;
+  return documents;
+}
+
+// Measures the peak RSS of |convert| and reports the counters described at
+// the top of the file. Returns the RSS growth, or -1 if it was not measured.
+template <typename Convert>
+int64_t MeasurePeakRss(benchmark::State& state, Convert convert) {
+  const int64_t baseline = CurrentRssBytes();
+  if (baseline < 0 || !ResetPeakRss()) {
+    state.SkipWithError("Peak RSS cannot be measured on this platform");
+    return -1;
+  }
+  convert();
+  const int64_t peak = PeakRssBytes();
+  state.counters["peak_rss_mb"] = static_cast<double>(peak) / kMegabyte;
+  state.counters["rss_growth_mb"] =
+      static_cast<double>(peak - baseline) / kMegabyte;
+  return peak - baseline;
+}
+
+void CheckBound(benchmark::State& state, const char* name, int64_t growth,
+                int64_t bound) {
+  state.counters["bound_mb"] = static_cast<double>(bound) / kMegabyte;
+  GOOGLE_CHECK_LE(growth, bound)
+      << name << " used " << growth / kMegabyte << "MB, more than its "
+      << bound / kMegabyte << "MB bound";
+}
+
+void BM_BinaryToXmlStream_Memory(benchmark::State& state, CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  const DocumentTemplates documents =
+      MakeDocuments(corpus, shape, state.range(0));
+  if (documents.binary.size() > INT_MAX) {
+    state.SkipWithError("Binary input exceeds the 2GB message size limit");
+    return;
+  }
+  for (auto _ : state) {
+    int64_t output_bytes = 0;
+    const int64_t growth = MeasurePeakRss(state, [&] {
+      RepeatedDocumentInputStream input(&documents.binary);
+      DiscardingOutputStream output;
+      util::Status status = BinaryToXmlStream(corpus.resolver, corpus.type_url,
+                                              &input, &output);
+      GOOGLE_CHECK(status.ok()) << status;
+      output_bytes = output.ByteCount();
+    });
+    if (growth < 0) return;
+    CheckBound(state, "BinaryToXmlStream", growth, kFixedOverhead);
+    state.SetBytesProcessed(output_bytes);
+  }
+}
+
+void BM_XmlToBinaryStream_Memory(benchmark::State& state, CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  const DocumentTemplates documents =
+      MakeDocuments(corpus, shape, state.range(0));
+  if (documents.binary.size() > INT_MAX) {
+    state.SkipWithError("Binary output exceeds the 2GB message size limit");
+    return;
+  }
+  for (auto _ : state) {
+    XmlParseStats stats;
+    XmlParseOptions options;
+    options.stats = &stats;
+    const int64_t growth = MeasurePeakRss(state, [&] {
+      RepeatedDocumentInputStream input(&documents.xml);
+      DiscardingOutputStream output;
+      util::Status status = XmlToBinaryStream(
+          corpus.resolver, corpus.type_url, &input, &output, options);
+      GOOGLE_CHECK(status.ok()) << status;
+    });
+    if (growth < 0) return;
+    // Nested messages are at least two bytes (tag and length), so there are
+    // at most output / 2 size records, each 8 bytes in a vector that may
+    // have doubled.
+    const int64_t size_records = stats.output_bytes / 2;
+    CheckBound(state, "XmlToBinaryStream", growth,
+               kFixedOverhead + 2 * stats.output_bytes + 2 * 8 * size_records);
+    // The parser holds at most the chunk being parsed plus one token carried
+    // over from the previous chunk, each possibly at twice its size after
+    // string growth.
+    const int64_t parser_bound =
+        4 * (kBlockSize + static_cast<int64_t>(documents.xml.unit.size()));
+    state.counters["parser_buffer_kb"] =
+        static_cast<double>(stats.parser_storage_high_water) / 1024;
+    GOOGLE_CHECK_LE(stats.parser_storage_high_water, parser_bound)
+        << "XmlStreamParser buffered more than one chunk and token";
+    state.SetBytesProcessed(stats.input_bytes);
+  }
+}
+
+#define XML_MEMORY_BENCHMARK(fn, shape_name, shape) \
+  BENCHMARK_CAPTURE(fn, shape_name, shape)          \
+      ->ArgName("xml_bytes")                        \
+      ->Arg(1 * kGigabyte)                          \
+      ->Arg(2 * kGigabyte)                          \
+      ->Arg(4 * kGigabyte)                          \
+      ->Iterations(1)                               \
+      ->Unit(benchmark::kSecond)
+
+#define XML_MEMORY_BENCHMARK_ALL_SHAPES(fn)                                \
+  XML_MEMORY_BENCHMARK(fn, address_book, CorpusShape::kAddressBook);       \
+  XML_MEMORY_BENCHMARK(fn, deep_nesting, CorpusShape::kDeepNesting);       \
+  XML_MEMORY_BENCHMARK(fn, wide_flat, CorpusShape::kWideFlat);             \
+  XML_MEMORY_BENCHMARK(fn, string_heavy, CorpusShape::kStringHeavy);       \
+  XML_MEMORY_BENCHMARK(fn, bytes_heavy, CorpusShape::kBytesHeavy);         \
+  XML_MEMORY_BENCHMARK(fn, numeric_heavy, CorpusShape::kNumericHeavy)
+
+XML_MEMORY_BENCHMARK_ALL_SHAPES(BM_BinaryToXmlStream_Memory);
+XML_MEMORY_BENCHMARK_ALL_SHAPES(BM_XmlToBinaryStream_Memory);
+
+}  // namespace
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
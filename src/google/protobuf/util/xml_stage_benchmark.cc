@@ -0,0 +1,263 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// Times the four stages of the XML conversion pipelines one at a time:
+//
+//   BinaryToXmlStream: ProtoStreamObjectSource -> XmlObjectWriter
+//   XmlToBinaryStream: XmlStreamParser         -> ProtoStreamObjectWriter
+//
+// The events each producer emits for a corpus are recorded once with a
+// RecordingObjectWriter. Producers are then timed writing into a
+// NullObjectWriter, and consumers are timed on a replay of the recording, so
+// that e.g. tokenizing can be told apart from encoding:
+//
+//   BM_Stage_ProtoSource/<shape>  Decoding the binary, events discarded.
+//   BM_Stage_XmlWriter/<shape>    Rendering the recorded events to XML.
+//   BM_Stage_XmlParser/<shape>    Tokenizing the XML, events discarded.
+//   BM_Stage_ProtoWriter/<shape>  Encoding the recorded events to binary.
+//   BM_Stage_Replay/<shape>       Replaying into a NullObjectWriter: the
+//                                 overhead included in the consumer cases.
+//
+// bytes_per_second counts the bytes of the side of the stage that is binary
+// or XML, and events/op the ObjectWriter events of one conversion. With
+// XML_BENCHMARK_PERF_COUNTERS=1 hardware counters are reported as well (see
+// HardwareCounters). The custom corpus (see HasCustomCorpus()) allows the
+// stages to be measured on captured traffic.
+//
+// Example (from src/google/protobuf/util):
+//   bazel run -c opt :xml_stage_benchmark -- --benchmark_filter=address_book
+
+#include <benchmark/benchmark.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/stubs/bytestream.h>
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/type.pb.h>
+#include <google/protobuf/util/internal/error_listener.h>
+#include <google/protobuf/util/internal/protostream_objectsource.h>
+#include <google/protobuf/util/internal/protostream_objectwriter.h>
+#include <google/protobuf/util/internal/recording_objectwriter.h>
+#include <google/protobuf/util/internal/xml_objectwriter.h>
+#include <google/protobuf/util/internal/xml_stream_parser.h>
+#include <google/protobuf/util/xml_benchmark_util.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+using converter::RecordingObjectWriter;
+
+// A corpus with its resolved type and the events of both producers.
+struct StageCorpus {
+  const Corpus* corpus;
+  google::protobuf::Type type;
+  // Events of ProtoStreamObjectSource on corpus->binary.
+  RecordingObjectWriter source_events;
+  // Events of XmlStreamParser on corpus->xml.
+  RecordingObjectWriter parser_events;
+};
+
+// Decodes |binary| as |type| into |ow|.
+void RunProtoSource(const Corpus& corpus, const google::protobuf::Type& type,
+                    converter::ObjectWriter* ow) {
+  io::ArrayInputStream input_stream(corpus.binary.data(),
+                                    static_cast<int>(corpus.binary.size()));
+  io::CodedInputStream in_stream(&input_stream);
+  converter::ProtoStreamObjectSource source(
+      &in_stream, corpus.resolver, type,
+      converter::ProtoStreamObjectSource::RenderOptions());
+  util::Status status = source.WriteTo(ow);
+  GOOGLE_CHECK(status.ok()) << corpus.name << ": " << status;
+}
+
+// Tokenizes the XML of |corpus| into |ow|.
+void RunXmlParser(const Corpus& corpus, converter::ObjectWriter* ow) {
+  converter::XmlStreamParser parser(ow);
+  util::Status status = parser.Parse(corpus.xml);
+  if (status.ok()) status = parser.FinishParse();
+  GOOGLE_CHECK(status.ok()) << corpus.name << ": " << status;
+}
+
+// Returns the StageCorpus for |shape|, built on first use. Thread-safe.
+const StageCorpus& GetStageCorpus(CorpusShape shape) {
+  static StageCorpus* corpora[static_cast<int>(CorpusShape::kCustom) + 1] = {};
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+  StageCorpus*& stage = corpora[static_cast<int>(shape)];
+  if (stage == nullptr) {
+    stage = new StageCorpus;
+    stage->corpus = &GetCorpus(shape);
+    util::Status status = stage->corpus->resolver->ResolveMessageType(
+        stage->corpus->type_url, &stage->type);
+    GOOGLE_CHECK(status.ok()) << stage->corpus->name << ": " << status;
+    RunProtoSource(*stage->corpus, stage->type, &stage->source_events);
+    RunXmlParser(*stage->corpus, &stage->parser_events);
+  }
+  return *stage;
+}
+
+void ReportCounters(benchmark::State& state, const Corpus& corpus,
+                    int64_t bytes, const RecordingObjectWriter& events,
+                    const HardwareCounters& counters) {
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * bytes);
+  state.counters["events/op"] = static_cast<double>(events.events());
+  ReportHardwareCounters(counters, bytes, corpus.elements, state);
+}
+
+void BM_Stage_ProtoSource(benchmark::State& state, CorpusShape shape) {
+  const StageCorpus& stage = GetStageCorpus(shape);
+  NullObjectWriter writer;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    RunProtoSource(*stage.corpus, stage.type, &writer);
+  }
+  counters.Stop();
+  ReportCounters(state, *stage.corpus,
+                 static_cast<int64_t>(stage.corpus->binary.size()),
+                 stage.source_events, counters);
+}
+
+void BM_Stage_XmlWriter(benchmark::State& state, CorpusShape shape) {
+  const StageCorpus& stage = GetStageCorpus(shape);
+  std::string output;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    output.clear();
+    io::StringOutputStream output_stream(&output);
+    io::CodedOutputStream out_stream(&output_stream);
+    converter::XmlObjectWriter writer("", &out_stream);
+    stage.source_events.Replay(&writer);
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  ReportCounters(state, *stage.corpus,
+                 static_cast<int64_t>(stage.corpus->xml.size()),
+                 stage.source_events, counters);
+}
+
+void BM_Stage_XmlParser(benchmark::State& state, CorpusShape shape) {
+  const StageCorpus& stage = GetStageCorpus(shape);
+  NullObjectWriter writer;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    RunXmlParser(*stage.corpus, &writer);
+  }
+  counters.Stop();
+  ReportCounters(state, *stage.corpus,
+                 static_cast<int64_t>(stage.corpus->xml.size()),
+                 stage.parser_events, counters);
+}
+
+void BM_Stage_ProtoWriter(benchmark::State& state, CorpusShape shape) {
+  const StageCorpus& stage = GetStageCorpus(shape);
+  std::string output;
+  converter::NoopErrorListener listener;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    output.clear();
+    strings::StringByteSink sink(&output);
+    converter::ProtoStreamObjectWriter writer(
+        stage.corpus->resolver, stage.type, &sink, &listener,
+        converter::ProtoStreamObjectWriter::Options());
+    stage.parser_events.Replay(&writer);
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  ReportCounters(state, *stage.corpus,
+                 static_cast<int64_t>(stage.corpus->binary.size()),
+                 stage.parser_events, counters);
+}
+
+void BM_Stage_Replay(benchmark::State& state, CorpusShape shape) {
+  const StageCorpus& stage = GetStageCorpus(shape);
+  NullObjectWriter writer;
+  HardwareCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    stage.source_events.Replay(&writer);
+  }
+  counters.Stop();
+  ReportCounters(state, *stage.corpus,
+                 static_cast<int64_t>(stage.corpus->xml.size()),
+                 stage.source_events, counters);
+  state.counters["recording_kb"] =
+      static_cast<double>(stage.source_events.SpaceUsed()) / 1024;
+}
+
+#define XML_STAGE_BENCHMARK_ALL_SHAPES(fn)                            \
+  BENCHMARK_CAPTURE(fn, address_book, CorpusShape::kAddressBook);     \
+  BENCHMARK_CAPTURE(fn, deep_nesting, CorpusShape::kDeepNesting);     \
+  BENCHMARK_CAPTURE(fn, wide_flat, CorpusShape::kWideFlat);           \
+  BENCHMARK_CAPTURE(fn, string_heavy, CorpusShape::kStringHeavy);     \
+  BENCHMARK_CAPTURE(fn, bytes_heavy, CorpusShape::kBytesHeavy);       \
+  BENCHMARK_CAPTURE(fn, numeric_heavy, CorpusShape::kNumericHeavy);   \
+  BENCHMARK_CAPTURE(fn, map_heavy, CorpusShape::kMapHeavy)
+
+XML_STAGE_BENCHMARK_ALL_SHAPES(BM_Stage_ProtoSource);
+XML_STAGE_BENCHMARK_ALL_SHAPES(BM_Stage_XmlWriter);
+XML_STAGE_BENCHMARK_ALL_SHAPES(BM_Stage_XmlParser);
+XML_STAGE_BENCHMARK_ALL_SHAPES(BM_Stage_ProtoWriter);
+XML_STAGE_BENCHMARK_ALL_SHAPES(BM_Stage_Replay);
+
+// The custom corpus is only known at run time, so its cases are registered
+// dynamically.
+const bool custom_benchmarks_registered = [] {
+  if (!HasCustomCorpus()) return false;
+  benchmark::RegisterBenchmark("BM_Stage_ProtoSource/custom",
+                               BM_Stage_ProtoSource, CorpusShape::kCustom);
+  benchmark::RegisterBenchmark("BM_Stage_XmlWriter/custom", BM_Stage_XmlWriter,
+                               CorpusShape::kCustom);
+  benchmark::RegisterBenchmark("BM_Stage_XmlParser/custom", BM_Stage_XmlParser,
+                               CorpusShape::kCustom);
+  benchmark::RegisterBenchmark("BM_Stage_ProtoWriter/custom",
+                               BM_Stage_ProtoWriter, CorpusShape::kCustom);
+  benchmark::RegisterBenchmark("BM_Stage_Replay/custom", BM_Stage_Replay,
+                               CorpusShape::kCustom);
+  return true;
+}();
+
+}  // namespace
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,91 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// libFuzzer target for XmlStreamParser. The first eight bytes of each input
+// seed how the rest is split into chunks, so the fuzzer explores chunk
+// boundaries inside every kind of token as well as the XML itself. Besides
+// crashes, inputs whose parse time or allocations grow faster than their size
+// are reported; see xml_fuzz_util.h.
+
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/stringpiece.h>
+#include <google/protobuf/util/internal/xml_stream_parser.h>
+#include <google/protobuf/util/xml_benchmark_util.h>
+#include <google/protobuf/util/xml_fuzz_util.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+using converter::XmlStreamParser;
+
+// Largest chunk is 1 << kMaxChunkShift bytes.
+const int kMaxChunkShift = 12;
+
+void ParseInChunks(const uint8_t* data, size_t size) {
+  uint64_t seed = 0;
+  const size_t seed_size = size < sizeof(seed) ? size : sizeof(seed);
+  memcpy(&seed, data, seed_size);
+  StringPiece xml(reinterpret_cast<const char*>(data) + seed_size,
+                  size - seed_size);
+  const int max_chunk = 1 << (seed % (kMaxChunkShift + 1));
+
+  ResourceBudget budget(xml.size());
+  NullObjectWriter writer;
+  XmlStreamParser parser(&writer);
+  util::Status status;
+  size_t offset = 0;
+  for (int length : RandomSegmentation(xml.size(), max_chunk, seed)) {
+    status = parser.Parse(xml.substr(offset, length));
+    if (!status.ok()) break;
+    offset += length;
+  }
+  if (status.ok()) status = parser.FinishParse();
+  budget.Check("XmlStreamParser");
+}
+
+}  // namespace
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  google::protobuf::util::xml_benchmark::ParseInChunks(data, size);
+  return 0;
+}
@@ -0,0 +1,256 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Measures how conversion throughput scales with the number of threads
+// converting concurrently, to expose contention on shared state such as the
+// global resolver behind MessageToXmlString() and the generated pool's
+// locks.
+//
+//   BM_<path>/<sharing>/threads:<n>
+//
+// <path> is MessageToXmlString or XmlStringToMessage, which use the shared
+// generated type resolver, or BinaryToXmlString or XmlToBinaryString with a
+// resolver private to each thread, which isolates contention in the
+// resolver from the rest. <sharing> is one of
+//   shared_type:    all threads convert the same message type,
+//   distinct_types: thread i converts corpus shape i modulo the number of
+//                   shapes, so threads touch different descriptors.
+//
+// Every case reports:
+//   bytes_per_second: aggregate XML bytes over all threads,
+//   efficiency:       average over threads of each thread's throughput
+//                     divided by the single-threaded throughput for its
+//                     shape. 1 means perfect scaling; falling values point
+//                     at contention.
+//
+// Example (from src/google/protobuf/util):
+//   bazel run -c opt :xml_thread_scaling_benchmark --
+//       --benchmark_filter=shared_type
+
+#include <benchmark/benchmark.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/util/type_resolver.h>
+#include <google/protobuf/util/type_resolver_util.h>
+#include <google/protobuf/util/xml_benchmark_util.h>
+#include <google/protobuf/util/xml_util.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+// The built-in shapes, cycled through by distinct_types.
+const CorpusShape kShapes[] = {
+    CorpusShape::kAddressBook, CorpusShape::kDeepNesting,
+    CorpusShape::kWideFlat,    CorpusShape::kStringHeavy,
+    CorpusShape::kBytesHeavy,  CorpusShape::kNumericHeavy,
+    CorpusShape::kMapHeavy,
+};
+const int kNumShapes = sizeof(kShapes) / sizeof(kShapes[0]);
+
+// How long single-threaded throughput is measured for the efficiency
+// baseline.
+const std::chrono::milliseconds kCalibrationTime(200);
+
+enum class Path {
+  kMessageToXmlString,
+  kXmlStringToMessage,
+  kBinaryToXmlString,
+  kXmlToBinaryString,
+};
+
+enum class Sharing {
+  kSharedType,
+  kDistinctTypes,
+};
+
+// The state one thread converts with. Nothing in it is shared with other
+// threads, except for the corpus, which is only read.
+class Converter {
+ public:
+  Converter(Path path, const Corpus& corpus)
+      : path_(path), corpus_(corpus), parsed_(corpus.message->New()) {
+    if (path == Path::kBinaryToXmlString ||
+        path == Path::kXmlToBinaryString) {
+      resolver_.reset(NewTypeResolverForDescriptorPool(
+          "type.googleapis.com",
+          corpus.message->GetDescriptor()->file()->pool()));
+    }
+  }
+
+  void Convert() {
+    util::Status status;
+    switch (path_) {
+      case Path::kMessageToXmlString:
+        output_.clear();
+        status = MessageToXmlString(*corpus_.message, &output_);
+        break;
+      case Path::kXmlStringToMessage:
+        status = XmlStringToMessage(corpus_.xml, parsed_.get());
+        break;
+      case Path::kBinaryToXmlString:
+        output_.clear();
+        status = BinaryToXmlString(resolver_.get(), corpus_.type_url,
+                                   corpus_.binary, &output_);
+        break;
+      case Path::kXmlToBinaryString:
+        output_.clear();
+        status = XmlToBinaryString(resolver_.get(), corpus_.type_url,
+                                   corpus_.xml, &output_);
+        break;
+    }
+    GOOGLE_CHECK(status.ok()) << corpus_.name << ": " << status;
+    benchmark::DoNotOptimize(output_.data());
+  }
+
+ private:
+  const Path path_;
+  const Corpus& corpus_;
+  std::unique_ptr<Message> parsed_;
+  std::unique_ptr<TypeResolver> resolver_;
+  std::string output_;
+};
+
+// Returns the single-threaded throughput of |path| on |shape| in XML bytes
+// per second, measuring it on first use.
+double SingleThreadRate(Path path, CorpusShape shape) {
+  static std::mutex* mutex = new std::mutex;
+  static auto* rates = new std::map<std::pair<Path, CorpusShape>, double>;
+  std::lock_guard<std::mutex> lock(*mutex);
+  auto it = rates->find(std::make_pair(path, shape));
+  if (it != rates->end()) return it->second;
+
+  const Corpus& corpus = GetCorpus(shape);
+  Converter converter(path, corpus);
+  converter.Convert();  // Warm up.
+  const auto start = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::duration elapsed;
+  int64_t conversions = 0;
+  do {
+    converter.Convert();
+    ++conversions;
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed < kCalibrationTime);
+  const double rate = conversions * static_cast<double>(corpus.xml.size()) /
+                      std::chrono::duration<double>(elapsed).count();
+  (*rates)[std::make_pair(path, shape)] = rate;
+  return rate;
+}
+
+CorpusShape ShapeOfThread(const benchmark::State& state, Sharing sharing) {
+  if (sharing == Sharing::kSharedType) return CorpusShape::kAddressBook;
+  return kShapes[state.thread_index() % kNumShapes];
+}
+
+void RunScaling(benchmark::State& state, Path path, Sharing sharing) {
+  // Thread 0 measures the baselines for every thread before the timed loop,
+  // whose start waits for all threads, so the calibration runs alone.
+  if (state.thread_index() == 0) {
+    for (int i = 0; i < state.threads(); ++i) {
+      const CorpusShape shape = sharing == Sharing::kSharedType
+                                    ? CorpusShape::kAddressBook
+                                    : kShapes[i % kNumShapes];
+      SingleThreadRate(path, shape);
+    }
+  }
+  const CorpusShape shape = ShapeOfThread(state, sharing);
+  const Corpus& corpus = GetCorpus(shape);
+  Converter converter(path, corpus);
+
+  std::chrono::steady_clock::time_point start;
+  bool started = false;
+  for (auto _ : state) {
+    if (!started) {
+      start = std::chrono::steady_clock::now();
+      started = true;
+    }
+    converter.Convert();
+  }
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  const int64_t bytes = static_cast<int64_t>(state.iterations()) *
+                        static_cast<int64_t>(corpus.xml.size());
+  state.SetBytesProcessed(bytes);
+  state.counters["efficiency"] = benchmark::Counter(
+      bytes / seconds / SingleThreadRate(path, shape),
+      benchmark::Counter::kAvgThreads);
+}
+
+void BM_MessageToXmlString(benchmark::State& state, Sharing sharing) {
+  RunScaling(state, Path::kMessageToXmlString, sharing);
+}
+
+void BM_XmlStringToMessage(benchmark::State& state, Sharing sharing) {
+  RunScaling(state, Path::kXmlStringToMessage, sharing);
+}
+
+void BM_BinaryToXmlString(benchmark::State& state, Sharing sharing) {
+  RunScaling(state, Path::kBinaryToXmlString, sharing);
+}
+
+void BM_XmlToBinaryString(benchmark::State& state, Sharing sharing) {
+  RunScaling(state, Path::kXmlToBinaryString, sharing);
+}
+
+const int kMaxThreads =
+    std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+#define XML_SCALING_BENCHMARK(fn)                                  \
+  BENCHMARK_CAPTURE(fn, shared_type, Sharing::kSharedType)         \
+      ->ThreadRange(1, kMaxThreads)                                \
+      ->UseRealTime();                                             \
+  BENCHMARK_CAPTURE(fn, distinct_types, Sharing::kDistinctTypes)   \
+      ->ThreadRange(1, kMaxThreads)                                \
+      ->UseRealTime()
+
+XML_SCALING_BENCHMARK(BM_MessageToXmlString);
+XML_SCALING_BENCHMARK(BM_XmlStringToMessage);
+XML_SCALING_BENCHMARK(BM_BinaryToXmlString);
+XML_SCALING_BENCHMARK(BM_XmlToBinaryString);
+
+}  // namespace
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
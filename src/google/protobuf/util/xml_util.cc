@@ -30,22 +30,42 @@
 
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/stubs/bytestream.h>
 #include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/mutex.h>
 #include <google/protobuf/stubs/once.h>
 #include <google/protobuf/stubs/status.h>
 #include <google/protobuf/stubs/status_macros.h>
 #include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/internal/backpatching_objectwriter.h>
 #include <google/protobuf/util/internal/default_value_objectwriter.h>
 #include <google/protobuf/util/internal/error_listener.h>
+#include <google/protobuf/util/internal/object_writer.h>
 #include <google/protobuf/util/internal/protostream_objectsource.h>
 #include <google/protobuf/util/internal/protostream_objectwriter.h>
+#include <google/protobuf/util/internal/streaming_default_value_objectwriter.h>
+#include <google/protobuf/util/internal/type_info.h>
+#include <google/protobuf/util/internal/utility.h>
+#include <google/protobuf/util/internal/xml_incremental_printer.h>
 #include <google/protobuf/util/internal/xml_objectwriter.h>
+#include <google/protobuf/util/internal/xml_parallel_printer.h>
 #include <google/protobuf/util/internal/xml_stream_parser.h>
+#include <google/protobuf/util/internal/xml_wire_walker.h>
 #include <google/protobuf/util/type_resolver.h>
 #include <google/protobuf/util/type_resolver_util.h>
 #include <google/protobuf/util/xml_util.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 // clang-format off
 #include <google/protobuf/port_def.inc>
 // clang-format on
@@ -83,34 +103,728 @@ void ZeroCopyStreamByteSink::Append(const char* bytes, size_t len) {
 }
 }  // namespace xml_internal
 
+XmlFieldProfile::XmlFieldProfile() : sample_period_(kDefaultSamplePeriod) {}
+
+XmlFieldProfile::XmlFieldProfile(int sample_period)
+    : sample_period_(std::max(1, sample_period)) {}
+
+std::vector<XmlFieldProfile::Field> XmlFieldProfile::Fields() const {
+  std::vector<Field> fields;
+  fields.reserve(fields_.size());
+  for (const auto& entry : fields_) fields.push_back(entry.second);
+  std::sort(fields.begin(), fields.end(), [](const Field& a, const Field& b) {
+    if (a.nanos != b.nanos) return a.nanos > b.nanos;
+    if (a.bytes != b.bytes) return a.bytes > b.bytes;
+    return a.path < b.path;
+  });
+  return fields;
+}
+
+std::string XmlFieldProfile::Report() const {
+  const std::vector<Field> fields = Fields();
+  int64_t total_nanos = 0;
+  int64_t total_bytes = 0;
+  for (const Field& field : fields) {
+    total_nanos += field.nanos;
+    total_bytes += field.bytes;
+  }
+  auto percent = [](int64_t part, int64_t total) {
+    return total > 0 ? 100.0 * part / total : 0.0;
+  };
+  char line[64];
+  snprintf(line, sizeof(line), "%7s %7s %12s %14s  ", "time%", "bytes%",
+           "events", "bytes");
+  std::string report = StrCat(line, "path\n");
+  for (const Field& field : fields) {
+    snprintf(line, sizeof(line), "%7.1f %7.1f %12lld %14lld  ",
+             percent(field.nanos, total_nanos),
+             percent(field.bytes, total_bytes),
+             static_cast<long long>(field.events),
+             static_cast<long long>(field.bytes));
+    StrAppend(&report, line, field.path.empty() ? "(root)" : field.path,
+              "\n");
+  }
+  return report;
+}
+
+void XmlFieldProfile::Add(const std::string& path, int64_t bytes,
+                          int64_t nanos) {
+  auto it = fields_.find(path);
+  if (it == fields_.end()) {
+    it = fields_.emplace(path, Field()).first;
+    it->second.path = path;
+  }
+  ++it->second.events;
+  it->second.bytes += bytes;
+  it->second.nanos += nanos;
+}
+
+namespace {
+// Adds the wall time between construction and destruction to *nanos. Does
+// nothing, not even reading the clock, when nanos is null.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(int64_t* nanos) : nanos_(nanos) {
+    if (nanos_ != nullptr) start_ = std::chrono::steady_clock::now();
+  }
+  ~ScopedTimer() {
+    if (nanos_ != nullptr) {
+      *nanos_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start_)
+                     .count();
+    }
+  }
+
+ private:
+  int64_t* nanos_;
+  std::chrono::steady_clock::time_point start_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ScopedTimer);
+};
+
+// Forwards all events to another ObjectWriter, counting the XML elements,
+// attributes and text nodes they correspond to. Only used when the caller
+// asked for statistics.
+class StatsObjectWriter : public converter::ObjectWriter {
+ public:
+  explicit StatsObjectWriter(converter::ObjectWriter* ow)
+      : ow_(ow), elements_(0), attributes_(0), text_nodes_(0), max_depth_(0) {}
+  ~StatsObjectWriter() override {}
+
+  StatsObjectWriter* StartObject(StringPiece name) override {
+    Push(false);
+    ow_->StartObject(name);
+    return this;
+  }
+  StatsObjectWriter* EndObject() override {
+    in_list_.pop_back();
+    ow_->EndObject();
+    return this;
+  }
+  StatsObjectWriter* StartList(StringPiece name) override {
+    Push(true);
+    ow_->StartList(name);
+    return this;
+  }
+  StatsObjectWriter* EndList() override {
+    in_list_.pop_back();
+    ow_->EndList();
+    return this;
+  }
+  StatsObjectWriter* RenderBool(StringPiece name, bool value) override {
+    CountValue(name);
+    ow_->RenderBool(name, value);
+    return this;
+  }
+  StatsObjectWriter* RenderInt32(StringPiece name, int32_t value) override {
+    CountValue(name);
+    ow_->RenderInt32(name, value);
+    return this;
+  }
+  StatsObjectWriter* RenderUint32(StringPiece name, uint32_t value) override {
+    CountValue(name);
+    ow_->RenderUint32(name, value);
+    return this;
+  }
+  StatsObjectWriter* RenderInt64(StringPiece name, int64_t value) override {
+    CountValue(name);
+    ow_->RenderInt64(name, value);
+    return this;
+  }
+  StatsObjectWriter* RenderUint64(StringPiece name, uint64_t value) override {
+    CountValue(name);
+    ow_->RenderUint64(name, value);
+    return this;
+  }
+  StatsObjectWriter* RenderDouble(StringPiece name, double value) override {
+    CountValue(name);
+    ow_->RenderDouble(name, value);
+    return this;
+  }
+  StatsObjectWriter* RenderFloat(StringPiece name, float value) override {
+    CountValue(name);
+    ow_->RenderFloat(name, value);
+    return this;
+  }
+  StatsObjectWriter* RenderString(StringPiece name,
+                                  StringPiece value) override {
+    CountValue(name);
+    ow_->RenderString(name, value);
+    return this;
+  }
+  StatsObjectWriter* RenderBytes(StringPiece name, StringPiece value) override {
+    CountValue(name);
+    ow_->RenderBytes(name, value);
+    return this;
+  }
+  StatsObjectWriter* RenderNull(StringPiece name) override {
+    CountValue(name);
+    ow_->RenderNull(name);
+    return this;
+  }
+
+  // Adds the counters to an XmlParseStats or XmlPrintStats.
+  template <typename Stats>
+  void AddTo(Stats* stats) const {
+    stats->elements += elements_;
+    stats->attributes += attributes_;
+    stats->text_nodes += text_nodes_;
+    stats->max_depth = std::max(stats->max_depth, max_depth_);
+  }
+
+ private:
+  void Push(bool is_list) {
+    ++elements_;
+    in_list_.push_back(is_list);
+    max_depth_ = std::max(max_depth_, static_cast<int>(in_list_.size()));
+  }
+
+  void CountValue(StringPiece name) {
+    if (!name.empty()) {
+      ++attributes_;
+      return;
+    }
+    ++text_nodes_;
+    // Unnamed values in a list are each written as an <anonymous> element.
+    if (!in_list_.empty() && in_list_.back()) {
+      ++elements_;
+      max_depth_ = std::max(max_depth_, static_cast<int>(in_list_.size()) + 1);
+    }
+  }
+
+  converter::ObjectWriter* ow_;
+  // One entry per open element, true for lists.
+  std::vector<bool> in_list_;
+  int64_t elements_;
+  int64_t attributes_;
+  int64_t text_nodes_;
+  int max_depth_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(StatsObjectWriter);
+};
+
+// Forwards all events to another ObjectWriter, charging each of them to its
+// field in an XmlFieldProfile. Only used when the caller asked for a profile.
+// The byte counts come from the XML output when printing and from the
+// parser's input position when parsing, so exactly one of set_output() and
+// set_parser() must be called before the first event.
+class ProfilingObjectWriter : public converter::ObjectWriter {
+ public:
+  ProfilingObjectWriter(converter::ObjectWriter* ow, TypeResolver* resolver,
+                        const google::protobuf::Type& type,
+                        XmlFieldProfile* profile)
+      : ow_(ow),
+        type_info_(converter::TypeInfo::NewTypeInfo(resolver)),
+        root_type_(&type),
+        profile_(profile),
+        output_(nullptr),
+        parser_(nullptr),
+        position_(0),
+        events_(0),
+        sampling_(false) {}
+  ~ProfilingObjectWriter() override {}
+
+  void set_output(const io::CodedOutputStream* output) {
+    output_ = output;
+    position_ = output->ByteCount();
+  }
+  void set_parser(const converter::XmlStreamParser* parser) {
+    parser_ = parser;
+    position_ = parser->position();
+  }
+
+  ProfilingObjectWriter* StartObject(StringPiece name) override {
+    ow_->StartObject(name);
+    Push(name, false);
+    return this;
+  }
+  ProfilingObjectWriter* EndObject() override {
+    ow_->EndObject();
+    Pop();
+    return this;
+  }
+  ProfilingObjectWriter* StartList(StringPiece name) override {
+    ow_->StartList(name);
+    Push(name, true);
+    return this;
+  }
+  ProfilingObjectWriter* EndList() override {
+    ow_->EndList();
+    Pop();
+    return this;
+  }
+  ProfilingObjectWriter* RenderBool(StringPiece name, bool value) override {
+    ow_->RenderBool(name, value);
+    ChargeValue(name);
+    return this;
+  }
+  ProfilingObjectWriter* RenderInt32(StringPiece name,
+                                     int32_t value) override {
+    ow_->RenderInt32(name, value);
+    ChargeValue(name);
+    return this;
+  }
+  ProfilingObjectWriter* RenderUint32(StringPiece name,
+                                      uint32_t value) override {
+    ow_->RenderUint32(name, value);
+    ChargeValue(name);
+    return this;
+  }
+  ProfilingObjectWriter* RenderInt64(StringPiece name,
+                                     int64_t value) override {
+    ow_->RenderInt64(name, value);
+    ChargeValue(name);
+    return this;
+  }
+  ProfilingObjectWriter* RenderUint64(StringPiece name,
+                                      uint64_t value) override {
+    ow_->RenderUint64(name, value);
+    ChargeValue(name);
+    return this;
+  }
+  ProfilingObjectWriter* RenderDouble(StringPiece name,
+                                      double value) override {
+    ow_->RenderDouble(name, value);
+    ChargeValue(name);
+    return this;
+  }
+  ProfilingObjectWriter* RenderFloat(StringPiece name, float value) override {
+    ow_->RenderFloat(name, value);
+    ChargeValue(name);
+    return this;
+  }
+  ProfilingObjectWriter* RenderString(StringPiece name,
+                                      StringPiece value) override {
+    ow_->RenderString(name, value);
+    ChargeValue(name);
+    return this;
+  }
+  ProfilingObjectWriter* RenderBytes(StringPiece name,
+                                     StringPiece value) override {
+    ow_->RenderBytes(name, value);
+    ChargeValue(name);
+    return this;
+  }
+  ProfilingObjectWriter* RenderNull(StringPiece name) override {
+    ow_->RenderNull(name);
+    ChargeValue(name);
+    return this;
+  }
+
+ private:
+  // An open object or list.
+  struct Frame {
+    std::string path;
+    // Type of the objects at this path (for lists, of their items), or null
+    // if unknown.
+    const google::protobuf::Type* type;
+    // Whether the names of the children are map or Struct keys.
+    bool keyed;
+  };
+
+  struct Cost {
+    int64_t bytes;
+    int64_t nanos;
+  };
+
+  static bool IsStruct(const google::protobuf::Type* type) {
+    return type != nullptr && type->name() == "google.protobuf.Struct";
+  }
+
+  static int64_t NowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // Returns the cost of the event that just ended, and starts the next one.
+  Cost EndEvent() {
+    Cost cost;
+    const int64_t position =
+        output_ != nullptr ? output_->ByteCount() : parser_->position();
+    cost.bytes = position - position_;
+    position_ = position;
+    cost.nanos = 0;
+    int64_t now = 0;
+    if (sampling_) {
+      now = NowNanos();
+      cost.nanos = (now - sample_start_) * profile_->sample_period();
+    }
+    sampling_ = ++events_ % profile_->sample_period() == 0;
+    if (sampling_) sample_start_ = now != 0 ? now : NowNanos();
+    return cost;
+  }
+
+  // Sets |path| to the path of the child |name| of the innermost frame.
+  void ChildPath(StringPiece name, std::string* path) const {
+    const Frame& parent = frames_.back();
+    if (name.empty()) {
+      // An item of a list.
+      *path = parent.path;
+      return;
+    }
+    *path = parent.path;
+    if (!path->empty()) path->push_back('.');
+    if (parent.keyed) {
+      path->push_back('*');
+    } else {
+      path->append(name.data(), name.size());
+    }
+  }
+
+  // Returns the type of the objects named |name| in the innermost frame, and
+  // whether their children are keyed.
+  const google::protobuf::Type* ChildType(StringPiece name,
+                                          bool* keyed) const {
+    *keyed = false;
+    const Frame& parent = frames_.back();
+    if (name.empty()) {
+      *keyed = IsStruct(parent.type);
+      return parent.type;
+    }
+    if (parent.type == nullptr) {
+      // Everything below a Struct is keyed.
+      *keyed = parent.keyed;
+      return nullptr;
+    }
+    const google::protobuf::Field* field =
+        parent.keyed ? converter::FindFieldInTypeOrNull(parent.type, "value")
+                     : type_info_->FindField(parent.type, name);
+    if (field == nullptr ||
+        field->kind() != google::protobuf::Field::TYPE_MESSAGE) {
+      return nullptr;
+    }
+    const google::protobuf::Type* type =
+        type_info_->GetTypeByTypeUrl(field->type_url());
+    if (type == nullptr) return nullptr;
+    *keyed = (!parent.keyed && converter::IsMap(*field, *type)) ||
+             IsStruct(type);
+    return type;
+  }
+
+  void Push(StringPiece name, bool is_list) {
+    const Cost cost = EndEvent();
+    Frame frame;
+    if (frames_.empty()) {
+      frame.type = root_type_;
+      frame.keyed = IsStruct(root_type_);
+    } else {
+      ChildPath(name, &frame.path);
+      frame.type = ChildType(name, &frame.keyed);
+      // The items of a list are not keyed, even if the list holds maps.
+      if (is_list) frame.keyed = false;
+    }
+    frames_.push_back(std::move(frame));
+    profile_->Add(frames_.back().path, cost.bytes, cost.nanos);
+  }
+
+  void Pop() {
+    const Cost cost = EndEvent();
+    if (frames_.empty()) return;
+    profile_->Add(frames_.back().path, cost.bytes, cost.nanos);
+    frames_.pop_back();
+  }
+
+  void ChargeValue(StringPiece name) {
+    const Cost cost = EndEvent();
+    if (frames_.empty()) {
+      scratch_.clear();
+    } else {
+      ChildPath(name, &scratch_);
+    }
+    profile_->Add(scratch_, cost.bytes, cost.nanos);
+  }
+
+  converter::ObjectWriter* ow_;
+  std::unique_ptr<converter::TypeInfo> type_info_;
+  const google::protobuf::Type* root_type_;
+  XmlFieldProfile* profile_;
+  const io::CodedOutputStream* output_;
+  const converter::XmlStreamParser* parser_;
+  // Byte count at the end of the last event.
+  int64_t position_;
+  int64_t events_;
+  // Whether the current event is timed, and since when.
+  bool sampling_;
+  int64_t sample_start_;
+  std::vector<Frame> frames_;
+  // Path of the last value.
+  std::string scratch_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ProfilingObjectWriter);
+};
+
+// Forwards to the ZeroCopyOutputStream writing into *target, counting how
+// often *target had to grow.
+class GrowthCountingOutputStream : public io::ZeroCopyOutputStream {
+ public:
+  GrowthCountingOutputStream(io::ZeroCopyOutputStream* stream,
+                             const std::string* target)
+      : stream_(stream), target_(target), growths_(0) {}
+
+  bool Next(void** data, int* size) override {
+    const size_t capacity = target_->capacity();
+    const bool result = stream_->Next(data, size);
+    if (target_->capacity() > capacity) ++growths_;
+    return result;
+  }
+  void BackUp(int count) override { stream_->BackUp(count); }
+  int64_t ByteCount() const override { return stream_->ByteCount(); }
+
+  int64_t growths() const { return growths_; }
+
+ private:
+  io::ZeroCopyOutputStream* stream_;
+  const std::string* target_;
+  int64_t growths_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(GrowthCountingOutputStream);
+};
+
+// Reports an event to |observer|, stamped with the current time.
+void Notify(XmlConversionObserver* observer,
+            XmlConversionObserver::Phase phase, int64_t input_bytes,
+            int64_t output_bytes) {
+  XmlConversionObserver::Event event;
+  event.phase = phase;
+  event.timestamp_nanos =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+  event.input_bytes = input_bytes;
+  event.output_bytes = output_bytes;
+  observer->OnEvent(event);
+}
+
+// Forwards to the transcoder's input stream, reporting FIRST_BYTE and PROGRESS
+// events as chunks are handed out. Only put in front of the input when an
+// observer is set; constructing one with a null observer is free.
+class ObservingInputStream : public io::ZeroCopyInputStream {
+ public:
+  ObservingInputStream(io::ZeroCopyInputStream* stream,
+                       const io::ZeroCopyOutputStream* output,
+                       XmlConversionObserver* observer)
+      : stream_(stream),
+        output_(output),
+        observer_(observer),
+        input_start_(observer != nullptr ? stream->ByteCount() : 0),
+        output_start_(observer != nullptr ? output->ByteCount() : 0),
+        interval_(observer != nullptr
+                      ? std::max<int64_t>(1,
+                                          observer->progress_interval_bytes())
+                      : 0),
+        next_progress_(interval_),
+        started_(false) {}
+
+  bool Next(const void** data, int* size) override {
+    if (!stream_->Next(data, size)) return false;
+    if (!started_) {
+      started_ = true;
+      Notify(observer_, XmlConversionObserver::FIRST_BYTE, 0, output_bytes());
+    }
+    const int64_t consumed = input_bytes();
+    if (consumed >= next_progress_) {
+      Notify(observer_, XmlConversionObserver::PROGRESS, consumed,
+             output_bytes());
+      next_progress_ = (consumed / interval_ + 1) * interval_;
+    }
+    return true;
+  }
+  void BackUp(int count) override { stream_->BackUp(count); }
+  bool Skip(int count) override { return stream_->Skip(count); }
+  int64_t ByteCount() const override { return stream_->ByteCount(); }
+
+  // Bytes handed out since construction, and written to the output stream
+  // since construction.
+  int64_t input_bytes() const { return stream_->ByteCount() - input_start_; }
+  int64_t output_bytes() const { return output_->ByteCount() - output_start_; }
+
+ private:
+  io::ZeroCopyInputStream* stream_;
+  const io::ZeroCopyOutputStream* output_;
+  XmlConversionObserver* observer_;
+  const int64_t input_start_;
+  const int64_t output_start_;
+  const int64_t interval_;
+  int64_t next_progress_;
+  bool started_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ObservingInputStream);
+};
+
+// Writes the message read from in_stream to writer with the default values
+// of its missing fields filled in.
+util::Status WriteWithDefaults(
+    TypeResolver* resolver, const google::protobuf::Type& type,
+    io::CodedInputStream* in_stream,
+    const converter::ProtoStreamObjectSource::RenderOptions& render_options,
+    const XmlPrintOptions& options, converter::ObjectWriter* writer) {
+  // The streaming writer does not hold the message back, but it only writes
+  // what DefaultValueObjectWriter would for types it orders the same way and
+  // binaries whose fields come in field number order. The binary is read
+  // whole to check the latter, as it is smaller than the message
+  // DefaultValueObjectWriter builds.
+  converter::StreamingDefaultValueObjectWriter streaming_writer(resolver, type,
+                                                                writer);
+  streaming_writer.set_preserve_proto_field_names(
+      options.preserve_proto_field_names);
+  streaming_writer.set_print_enums_as_ints(options.always_print_enums_as_ints);
+  std::string binary;
+  std::unique_ptr<io::CodedInputStream> binary_stream;
+  bool streaming = false;
+  if (streaming_writer.MatchesDefaultValueObjectWriter()) {
+    const void* data;
+    int size;
+    while (in_stream->GetDirectBufferPointer(&data, &size)) {
+      binary.append(static_cast<const char*>(data), size);
+      in_stream->Skip(size);
+    }
+    binary_stream.reset(new io::CodedInputStream(
+        reinterpret_cast<const uint8_t*>(binary.data()),
+        static_cast<int>(binary.size())));
+    streaming = streaming_writer.MatchesDefaultValueObjectWriter(binary);
+  }
+  converter::ProtoStreamObjectSource proto_source(
+      binary_stream != nullptr ? binary_stream.get() : in_stream, resolver,
+      type, render_options);
+  if (streaming) return proto_source.WriteTo(&streaming_writer);
+  converter::DefaultValueObjectWriter default_value_writer(resolver, type,
+                                                           writer);
+  default_value_writer.set_preserve_proto_field_names(
+      options.preserve_proto_field_names);
+  default_value_writer.set_print_enums_as_ints(
+      options.always_print_enums_as_ints);
+  return proto_source.WriteTo(&default_value_writer);
+}
+
+// Transcodes the binary read from binary_input as a message of the given type
+// into XML written to xml_output.
+util::Status TranscodeBinaryToXml(TypeResolver* resolver,
+                                  const google::protobuf::Type& type,
+                                  io::ZeroCopyInputStream* binary_input,
+                                  io::ZeroCopyOutputStream* xml_output,
+                                  const XmlPrintOptions& options,
+                                  XmlPrintStats* stats) {
+  XmlConversionObserver* observer = options.observer;
+  ScopedTimer timer(stats != nullptr ? &stats->transcode_nanos : nullptr);
+  ObservingInputStream observing_input(binary_input, xml_output, observer);
+  io::CodedInputStream in_stream(observer != nullptr ? &observing_input
+                                                     : binary_input);
+  io::CodedOutputStream out_stream(xml_output);
+  converter::XmlObjectWriter xml_writer(options.add_whitespace ? " " : "",
+                                        &out_stream);
+  StatsObjectWriter stats_writer(&xml_writer);
+  converter::ObjectWriter* writer = &xml_writer;
+  if (stats != nullptr) writer = &stats_writer;
+  std::unique_ptr<ProfilingObjectWriter> profiling_writer;
+  if (options.field_profile != nullptr) {
+    profiling_writer.reset(new ProfilingObjectWriter(writer, resolver, type,
+                                                     options.field_profile));
+    profiling_writer->set_output(&out_stream);
+    writer = profiling_writer.get();
+  }
+  // The binary is decoded by one of two engines. XmlWireWalker is used
+  // whenever nothing sits between the source and the XML writer, which
+  // includes conversions with an observer: it only watches the streams.
+  // The walker calls XmlObjectWriter's methods directly, not through the
+  // ObjectWriter interface; that is what makes it fast. It therefore cannot
+  // feed the writers that stats, field_profile and
+  // always_print_primitive_fields put in front of the XML writer:
+  // StatsObjectWriter, ProfilingObjectWriter and the default value writers.
+  // Those conversions use ProtoStreamObjectSource, and
+  // xml_wire_walker_test.cc checks that both engines write the same XML.
+  util::Status status;
+  if (writer == &xml_writer && !options.always_print_primitive_fields) {
+    converter::XmlWireWalker::Options walker_options;
+    walker_options.use_ints_for_enums = options.always_print_enums_as_ints;
+    walker_options.preserve_proto_field_names =
+        options.preserve_proto_field_names;
+    converter::XmlWireWalker walker(resolver, type, walker_options);
+    status = walker.WriteTo(&in_stream, &xml_writer);
+  } else {
+    converter::ProtoStreamObjectSource::RenderOptions render_options;
+    render_options.use_ints_for_enums = options.always_print_enums_as_ints;
+    render_options.preserve_proto_field_names =
+        options.preserve_proto_field_names;
+    if (options.always_print_primitive_fields) {
+      status = WriteWithDefaults(resolver, type, &in_stream, render_options,
+                                 options, writer);
+    } else {
+      converter::ProtoStreamObjectSource proto_source(&in_stream, resolver,
+                                                      type, render_options);
+      status = proto_source.WriteTo(writer);
+    }
+  }
+  if (stats != nullptr) {
+    stats_writer.AddTo(stats);
+    stats->input_bytes += in_stream.CurrentPosition();
+    stats->output_bytes += out_stream.ByteCount();
+  }
+  if (observer != nullptr) {
+    Notify(observer, XmlConversionObserver::TRANSCODE_FINISHED,
+           in_stream.CurrentPosition(), out_stream.ByteCount());
+  }
+  return status;
+}
+
+// Counts the bytes written to it, handing out the same scratch buffer over
+// and over, so that the size of a conversion's output can be computed without
+// keeping the output.
+class CountingOutputStream : public io::ZeroCopyOutputStream {
+ public:
+  CountingOutputStream() : byte_count_(0) {}
+
+  bool Next(void** data, int* size) override {
+    *data = buffer_;
+    *size = sizeof(buffer_);
+    byte_count_ += sizeof(buffer_);
+    return true;
+  }
+  void BackUp(int count) override { byte_count_ -= count; }
+  int64_t ByteCount() const override { return byte_count_; }
+
+ private:
+  char buffer_[4096];
+  int64_t byte_count_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(CountingOutputStream);
+};
+
+// Returns the size of the XML the binary converts to, with the given options
+// but neither observing nor profiling the conversion.
+util::Status ComputeXmlByteSize(TypeResolver* resolver,
+                                const google::protobuf::Type& type,
+                                const std::string& binary_input,
+                                const XmlPrintOptions& options, size_t* size) {
+  XmlPrintOptions sizing_options = options;
+  sizing_options.observer = nullptr;
+  sizing_options.field_profile = nullptr;
+  io::ArrayInputStream input_stream(binary_input.data(), binary_input.size());
+  CountingOutputStream counting_stream;
+  RETURN_IF_ERROR(TranscodeBinaryToXml(resolver, type, &input_stream,
+                                       &counting_stream, sizing_options,
+                                       nullptr));
+  *size = static_cast<size_t>(counting_stream.ByteCount());
+  return util::Status();
+}
+}  // namespace
+
 util::Status BinaryToXmlStream(TypeResolver* resolver,
                                const std::string& type_url,
                                io::ZeroCopyInputStream* binary_input,
                                io::ZeroCopyOutputStream* xml_output,
                                const XmlPrintOptions& options) {
-  io::CodedInputStream in_stream(binary_input);
+  XmlPrintStats* stats = options.stats;
   google::protobuf::Type type;
-  RETURN_IF_ERROR(resolver->ResolveMessageType(type_url, &type));
-  converter::ProtoStreamObjectSource::RenderOptions render_options;
-  render_options.use_ints_for_enums = options.always_print_enums_as_ints;
-  render_options.preserve_proto_field_names =
-      options.preserve_proto_field_names;
-  converter::ProtoStreamObjectSource proto_source(&in_stream, resolver, type,
-                                                  render_options);
-  io::CodedOutputStream out_stream(xml_output);
-  converter::XmlObjectWriter xml_writer(options.add_whitespace ? " " : "",
-                                        &out_stream);
-  if (options.always_print_primitive_fields) {
-    converter::DefaultValueObjectWriter default_value_writer(resolver, type,
-                                                             &xml_writer);
-    default_value_writer.set_preserve_proto_field_names(
-        options.preserve_proto_field_names);
-    default_value_writer.set_print_enums_as_ints(
-        options.always_print_enums_as_ints);
-    return proto_source.WriteTo(&default_value_writer);
-  } else {
-    return proto_source.WriteTo(&xml_writer);
+  {
+    ScopedTimer timer(stats != nullptr ? &stats->resolve_nanos : nullptr);
+    RETURN_IF_ERROR(resolver->ResolveMessageType(type_url, &type));
   }
+  if (options.observer != nullptr) {
+    Notify(options.observer, XmlConversionObserver::TYPE_RESOLVED, 0, 0);
+  }
+  return TranscodeBinaryToXml(resolver, type, binary_input, xml_output,
+                              options, stats);
 }
 
 util::Status BinaryToXmlString(TypeResolver* resolver,
@@ -118,10 +832,131 @@ util::Status BinaryToXmlString(TypeResolver* resolver,
                                const std::string& binary_input,
                                std::string* xml_output,
                                const XmlPrintOptions& options) {
+  XmlPrintStats* stats = options.stats;
+  if (options.max_threads > 1 && stats == nullptr &&
+      options.observer == nullptr && options.field_profile == nullptr &&
+      !options.always_print_primitive_fields && !options.presize_output &&
+      binary_input.size() <=
+          static_cast<size_t>(std::numeric_limits<int>::max())) {
+    google::protobuf::Type type;
+    RETURN_IF_ERROR(resolver->ResolveMessageType(type_url, &type));
+    converter::XmlParallelPrinter::Options printer_options;
+    printer_options.walker_options.use_ints_for_enums =
+        options.always_print_enums_as_ints;
+    printer_options.walker_options.preserve_proto_field_names =
+        options.preserve_proto_field_names;
+    printer_options.indent_string = options.add_whitespace ? " " : "";
+    printer_options.max_threads = options.max_threads;
+    converter::XmlParallelPrinter printer(resolver, type, printer_options);
+    return printer.Print(binary_input, xml_output);
+  }
   io::ArrayInputStream input_stream(binary_input.data(), binary_input.size());
+  if (options.presize_output) {
+    google::protobuf::Type type;
+    {
+      ScopedTimer timer(stats != nullptr ? &stats->resolve_nanos : nullptr);
+      RETURN_IF_ERROR(resolver->ResolveMessageType(type_url, &type));
+    }
+    if (options.observer != nullptr) {
+      Notify(options.observer, XmlConversionObserver::TYPE_RESOLVED, 0, 0);
+    }
+    size_t size;
+    {
+      ScopedTimer timer(stats != nullptr ? &stats->transcode_nanos : nullptr);
+      RETURN_IF_ERROR(
+          ComputeXmlByteSize(resolver, type, binary_input, options, &size));
+    }
+    const size_t start = xml_output->size();
+    const size_t capacity = xml_output->capacity();
+    util::Status status;
+    if (size <= static_cast<size_t>(std::numeric_limits<int>::max())) {
+      xml_output->resize(start + size);
+      io::ArrayOutputStream output_stream(&(*xml_output)[start],
+                                          static_cast<int>(size));
+      status = TranscodeBinaryToXml(resolver, type, &input_stream,
+                                    &output_stream, options, stats);
+      // Only shorter on failure.
+      xml_output->resize(start + output_stream.ByteCount());
+    } else {
+      // Too large for an array stream; the string stream does not need to
+      // grow the string once it has the capacity.
+      xml_output->reserve(start + size);
+      io::StringOutputStream output_stream(xml_output);
+      status = TranscodeBinaryToXml(resolver, type, &input_stream,
+                                    &output_stream, options, stats);
+    }
+    if (stats != nullptr && xml_output->capacity() > capacity) {
+      ++stats->allocations;
+    }
+    return status;
+  }
   io::StringOutputStream output_stream(xml_output);
-  return BinaryToXmlStream(resolver, type_url, &input_stream, &output_stream,
-                           options);
+  if (stats == nullptr) {
+    return BinaryToXmlStream(resolver, type_url, &input_stream,
+                             &output_stream, options);
+  }
+  GrowthCountingOutputStream counting_stream(&output_stream, xml_output);
+  util::Status status = BinaryToXmlStream(
+      resolver, type_url, &input_stream, &counting_stream, options);
+  stats->allocations += counting_stream.growths();
+  return status;
+}
+
+util::Status XmlByteSize(TypeResolver* resolver, const std::string& type_url,
+                         const std::string& binary_input,
+                         const XmlPrintOptions& options, size_t* size) {
+  google::protobuf::Type type;
+  RETURN_IF_ERROR(resolver->ResolveMessageType(type_url, &type));
+  return ComputeXmlByteSize(resolver, type, binary_input, options, size);
+}
+
+BinaryToXmlPrinter::BinaryToXmlPrinter(TypeResolver* resolver,
+                                       const std::string& type_url,
+                                       StringPiece binary_input,
+                                       const XmlPrintOptions& options)
+    : type_(new google::protobuf::Type) {
+  if (options.always_print_primitive_fields) {
+    status_ = util::InvalidArgumentError(
+        "BinaryToXmlPrinter does not support always_print_primitive_fields.");
+    return;
+  }
+  if (options.observer != nullptr || options.field_profile != nullptr ||
+      options.stats != nullptr) {
+    status_ = util::InvalidArgumentError(
+        "BinaryToXmlPrinter does not support observer, field_profile or "
+        "stats.");
+    return;
+  }
+  if (binary_input.size() >
+      static_cast<size_t>(std::numeric_limits<int>::max())) {
+    status_ = util::InvalidArgumentError("Binary input is too large.");
+    return;
+  }
+  status_ = resolver->ResolveMessageType(type_url, type_.get());
+  if (!status_.ok()) return;
+  converter::XmlIncrementalPrinter::Options printer_options;
+  printer_options.walker_options.use_ints_for_enums =
+      options.always_print_enums_as_ints;
+  printer_options.walker_options.preserve_proto_field_names =
+      options.preserve_proto_field_names;
+  printer_options.indent_string = options.add_whitespace ? " " : "";
+  printer_.reset(new converter::XmlIncrementalPrinter(
+      resolver, *type_, printer_options, binary_input));
+}
+
+BinaryToXmlPrinter::~BinaryToXmlPrinter() {}
+
+util::Status BinaryToXmlPrinter::Step(size_t max_output_bytes,
+                                      std::string* xml_output) {
+  RETURN_IF_ERROR(status_);
+  if (max_output_bytes == 0) {
+    return util::InvalidArgumentError("max_output_bytes must be positive.");
+  }
+  return printer_->Step(max_output_bytes, xml_output);
+}
+
+bool BinaryToXmlPrinter::done() const {
+  return !status_.ok() || printer_->done();
 }
 
 namespace {
@@ -169,15 +1004,15 @@ class StatusErrorListener : public converter::ErrorListener {
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(StatusErrorListener);
 };
-}  // namespace
 
-util::Status XmlToBinaryStream(TypeResolver* resolver,
-                               const std::string& type_url,
-                               io::ZeroCopyInputStream* xml_input,
-                               io::ZeroCopyOutputStream* binary_output,
-                               const XmlParseOptions& options) {
-  google::protobuf::Type type;
-  RETURN_IF_ERROR(resolver->ResolveMessageType(type_url, &type));
+// Transcodes the XML read from xml_input as a message of the given type into
+// binary written to binary_output.
+util::Status TranscodeXmlToBinary(TypeResolver* resolver,
+                                  const google::protobuf::Type& type,
+                                  io::ZeroCopyInputStream* xml_input,
+                                  io::ZeroCopyOutputStream* binary_output,
+                                  const XmlParseOptions& options,
+                                  XmlParseStats* stats) {
   xml_internal::ZeroCopyStreamByteSink sink(binary_output);
   StatusErrorListener listener;
   converter::ProtoStreamObjectWriter::Options proto_writer_options;
@@ -186,31 +1021,117 @@ util::Status XmlToBinaryStream(TypeResolver* resolver,
       options.ignore_unknown_fields;
   proto_writer_options.case_insensitive_enum_parsing =
       options.case_insensitive_enum_parsing;
-  converter::ProtoStreamObjectWriter proto_writer(
-      resolver, type, &sink, &listener, proto_writer_options);
+  std::unique_ptr<converter::ObjectWriter> proto_writer;
+  if (options.backpatch_message_lengths) {
+    converter::BackpatchingObjectWriter* backpatching_writer =
+        new converter::BackpatchingObjectWriter(resolver, type, &sink,
+                                                &listener,
+                                                proto_writer_options);
+    backpatching_writer->set_compact_lengths(options.compact_message_lengths);
+    proto_writer.reset(backpatching_writer);
+  } else {
+    proto_writer.reset(new converter::ProtoStreamObjectWriter(
+        resolver, type, &sink, &listener, proto_writer_options));
+  }
 
-  converter::XmlStreamParser parser(&proto_writer);
+  StatsObjectWriter stats_writer(proto_writer.get());
+  converter::ObjectWriter* writer = proto_writer.get();
+  if (stats != nullptr) writer = &stats_writer;
+  std::unique_ptr<ProfilingObjectWriter> profiling_writer;
+  if (options.field_profile != nullptr) {
+    profiling_writer.reset(new ProfilingObjectWriter(writer, resolver, type,
+                                                     options.field_profile));
+    writer = profiling_writer.get();
+  }
+  converter::XmlStreamParser parser(writer);
+  if (profiling_writer != nullptr) profiling_writer->set_parser(&parser);
+  converter::XmlStreamParser::Stats parser_stats;
+  if (stats != nullptr) parser.set_stats(&parser_stats);
+  util::Status status;
+  int64_t input_bytes = 0;
   const void* buffer;
   int length;
-  while (xml_input->Next(&buffer, &length)) {
+  while (status.ok() && xml_input->Next(&buffer, &length)) {
     if (length == 0) continue;
-    RETURN_IF_ERROR(
-        parser.Parse(StringPiece(static_cast<const char*>(buffer), length)));
+    input_bytes += length;
+    status =
+        parser.Parse(StringPiece(static_cast<const char*>(buffer), length));
   }
-  RETURN_IF_ERROR(parser.FinishParse());
+  if (status.ok()) status = parser.FinishParse();
 
+  if (stats != nullptr) {
+    stats_writer.AddTo(stats);
+    stats->input_bytes += input_bytes;
+    stats->leftover_bytes_copied += parser_stats.leftover_bytes_copied;
+    stats->parsed_storage_bytes_copied +=
+        parser_stats.parsed_storage_bytes_copied;
+    stats->resumptions += parser_stats.resumptions;
+    stats->allocations += parser_stats.buffer_growths;
+    stats->parser_storage_high_water =
+        std::max(stats->parser_storage_high_water,
+                 parser_stats.storage_high_water);
+  }
+  RETURN_IF_ERROR(status);
   return listener.GetStatus();
 }
+}  // namespace
+
+util::Status XmlToBinaryStream(TypeResolver* resolver,
+                               const std::string& type_url,
+                               io::ZeroCopyInputStream* xml_input,
+                               io::ZeroCopyOutputStream* binary_output,
+                               const XmlParseOptions& options) {
+  XmlParseStats* stats = options.stats;
+  XmlConversionObserver* observer = options.observer;
+  google::protobuf::Type type;
+  {
+    ScopedTimer timer(stats != nullptr ? &stats->resolve_nanos : nullptr);
+    RETURN_IF_ERROR(resolver->ResolveMessageType(type_url, &type));
+  }
+  if (stats == nullptr && observer == nullptr) {
+    return TranscodeXmlToBinary(resolver, type, xml_input, binary_output,
+                                options, nullptr);
+  }
+  if (observer != nullptr) {
+    Notify(observer, XmlConversionObserver::TYPE_RESOLVED, 0, 0);
+  }
+  // The sink inside TranscodeXmlToBinary() backs up the unused part of its
+  // buffer when destroyed, so count the output only after it returns.
+  const int64_t output_start = binary_output->ByteCount();
+  ObservingInputStream observing_input(xml_input, binary_output, observer);
+  util::Status status;
+  {
+    ScopedTimer timer(stats != nullptr ? &stats->transcode_nanos : nullptr);
+    status = TranscodeXmlToBinary(
+        resolver, type, observer != nullptr ? &observing_input : xml_input,
+        binary_output, options, stats);
+  }
+  const int64_t output_bytes = binary_output->ByteCount() - output_start;
+  if (stats != nullptr) stats->output_bytes += output_bytes;
+  if (observer != nullptr) {
+    Notify(observer, XmlConversionObserver::TRANSCODE_FINISHED,
+           observing_input.input_bytes(), output_bytes);
+  }
+  return status;
+}
 
 util::Status XmlToBinaryString(TypeResolver* resolver,
                                const std::string& type_url,
                                StringPiece xml_input,
                                std::string* binary_output,
                                const XmlParseOptions& options) {
+  XmlParseStats* stats = options.stats;
   io::ArrayInputStream input_stream(xml_input.data(), xml_input.size());
   io::StringOutputStream output_stream(binary_output);
-  return XmlToBinaryStream(resolver, type_url, &input_stream, &output_stream,
-                           options);
+  if (stats == nullptr) {
+    return XmlToBinaryStream(resolver, type_url, &input_stream,
+                             &output_stream, options);
+  }
+  GrowthCountingOutputStream counting_stream(&output_stream, binary_output);
+  util::Status status = XmlToBinaryStream(
+      resolver, type_url, &input_stream, &counting_stream, options);
+  stats->allocations += counting_stream.growths();
+  return status;
 }
 
 namespace {
@@ -238,18 +1159,118 @@ TypeResolver* GetGeneratedTypeResolver() {
                                              InitGeneratedTypeResolver);
   return generated_type_resolver_;
 }
+
+// Strings kept by a thread between conversions so that their capacity is
+// reused. A conversion started from an observer callback takes a string of
+// its own, hence more than one.
+class ScratchBufferPool {
+ public:
+  ScratchBufferPool() : bytes_(0) { buffers_.reserve(kMaxBuffers); }
+
+  std::string Acquire() {
+    if (buffers_.empty()) return std::string();
+    std::string buffer = std::move(buffers_.back());
+    buffers_.pop_back();
+    bytes_ -= buffer.capacity();
+    return buffer;
+  }
+
+  // Keeps |buffer| unless the pool would then hold more than |max_bytes| in
+  // all.
+  void Release(std::string* buffer, size_t max_bytes) {
+    if (buffers_.size() == kMaxBuffers ||
+        bytes_ + buffer->capacity() > max_bytes) {
+      return;
+    }
+    buffer->clear();
+    bytes_ += buffer->capacity();
+    buffers_.push_back(std::move(*buffer));
+  }
+
+ private:
+  static const size_t kMaxBuffers = 4;
+
+  std::vector<std::string> buffers_;
+  // Capacity of buffers_, in total.
+  size_t bytes_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ScratchBufferPool);
+};
+
+ScratchBufferPool* GetScratchBufferPool() {
+#if defined(GOOGLE_PROTOBUF_NO_THREADLOCAL)
+  static PROTOBUF_NAMESPACE_ID::internal::ThreadLocalStorage<
+      ScratchBufferPool>* pools =
+      new PROTOBUF_NAMESPACE_ID::internal::ThreadLocalStorage<
+          ScratchBufferPool>();
+  return pools->Get();
+#else
+  static thread_local ScratchBufferPool pool;
+  return &pool;
+#endif
+}
+
+// A string from the pool of the calling thread, returned to it on
+// destruction if the pool then holds at most max_bytes.
+class ScratchBuffer {
+ public:
+  explicit ScratchBuffer(size_t max_bytes)
+      : max_bytes_(max_bytes),
+        buffer_(max_bytes > 0 ? GetScratchBufferPool()->Acquire()
+                              : std::string()) {}
+  ~ScratchBuffer() {
+    if (max_bytes_ > 0) GetScratchBufferPool()->Release(&buffer_, max_bytes_);
+  }
+
+  std::string* get() { return &buffer_; }
+
+ private:
+  const size_t max_bytes_;
+  std::string buffer_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ScratchBuffer);
+};
 }  // namespace
 
 util::Status MessageToXmlString(const Message& message, std::string* output,
                                 const XmlOptions& options) {
+  XmlPrintStats* stats = options.stats;
   const DescriptorPool* pool = message.GetDescriptor()->file()->pool();
   TypeResolver* resolver =
       pool == DescriptorPool::generated_pool()
           ? GetGeneratedTypeResolver()
           : NewTypeResolverForDescriptorPool(kTypeUrlPrefix, pool);
+  ScratchBuffer binary(options.max_scratch_buffer_bytes);
+  const size_t capacity = binary.get()->capacity();
+  {
+    ScopedTimer timer(stats != nullptr ? &stats->serialize_nanos : nullptr);
+    message.SerializeToString(binary.get());
+  }
+  if (stats != nullptr && binary.get()->capacity() > capacity) {
+    ++stats->allocations;
+  }
+  if (options.observer != nullptr) {
+    Notify(options.observer, XmlConversionObserver::MESSAGE_SERIALIZED, 0, 0);
+  }
+  util::Status result = BinaryToXmlString(resolver, GetTypeUrl(message),
+                                          *binary.get(), output, options);
+  if (pool != DescriptorPool::generated_pool()) {
+    delete resolver;
+  }
+  return result;
+}
+
+util::Status XmlByteSize(const Message& message,
+                         const XmlPrintOptions& options, size_t* size) {
+  const DescriptorPool* pool = message.GetDescriptor()->file()->pool();
+  TypeResolver* resolver =
+      pool == DescriptorPool::generated_pool()
+          ? GetGeneratedTypeResolver()
+          : NewTypeResolverForDescriptorPool(kTypeUrlPrefix, pool);
+  ScratchBuffer binary(options.max_scratch_buffer_bytes);
+  message.SerializeToString(binary.get());
   util::Status result =
-      BinaryToXmlString(resolver, GetTypeUrl(message),
-                        message.SerializeAsString(), output, options);
+      XmlByteSize(resolver, GetTypeUrl(message), *binary.get(), options, size);
   if (pool != DescriptorPool::generated_pool()) {
     delete resolver;
   }
@@ -258,17 +1279,26 @@ util::Status MessageToXmlString(const Message& message, std::string* output,
 
 util::Status XmlStringToMessage(StringPiece input, Message* message,
                                 const XmlParseOptions& options) {
+  XmlParseStats* stats = options.stats;
   const DescriptorPool* pool = message->GetDescriptor()->file()->pool();
   TypeResolver* resolver =
       pool == DescriptorPool::generated_pool()
           ? GetGeneratedTypeResolver()
           : NewTypeResolverForDescriptorPool(kTypeUrlPrefix, pool);
-  std::string binary;
+  ScratchBuffer binary(options.max_scratch_buffer_bytes);
   util::Status result = XmlToBinaryString(resolver, GetTypeUrl(*message), input,
-                                          &binary, options);
-  if (result.ok() && !message->ParseFromString(binary)) {
-    result = util::InvalidArgumentError(
-        "XML transcoder produced invalid protobuf output.");
+                                          binary.get(), options);
+  if (result.ok()) {
+    ScopedTimer timer(stats != nullptr ? &stats->message_parse_nanos
+                                       : nullptr);
+    if (!message->ParseFromString(*binary.get())) {
+      result = util::InvalidArgumentError(
+          "XML transcoder produced invalid protobuf output.");
+    }
+  }
+  if (result.ok() && options.observer != nullptr) {
+    Notify(options.observer, XmlConversionObserver::MESSAGE_PARSED,
+           input.size(), binary.get()->size());
   }
   if (pool != DescriptorPool::generated_pool()) {
     delete resolver;
@@ -39,16 +39,230 @@
 #include <google/protobuf/stubs/strutil.h>
 #include <google/protobuf/util/type_resolver.h>
 
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 // Must be included last.
 #include <google/protobuf/port_def.inc>
 
 namespace google {
 namespace protobuf {
+class Type;
 namespace io {
 class ZeroCopyInputStream;
 class ZeroCopyOutputStream;
 }  // namespace io
 namespace util {
+namespace converter {
+class XmlIncrementalPrinter;
+}  // namespace converter
+
+// Receives callbacks at the phase boundaries of a conversion, e.g. to attribute
+// conversion latency inside a distributed trace. Set it through the observer
+// field of XmlParseOptions or XmlPrintOptions. Callbacks are made on the
+// converting thread; the observer must outlive the call.
+class PROTOBUF_EXPORT XmlConversionObserver {
+ public:
+  enum Phase {
+    // The message type has been resolved.
+    TYPE_RESOLVED,
+    // MessageToXmlString() has serialized the message to binary.
+    MESSAGE_SERIALIZED,
+    // The first chunk of input has been handed to the transcoder.
+    FIRST_BYTE,
+    // Another progress_interval_bytes() of input have been handed to the
+    // transcoder.
+    PROGRESS,
+    // Transcoding between binary and XML has finished, successfully or not.
+    TRANSCODE_FINISHED,
+    // XmlStringToMessage() has parsed the binary into the message.
+    MESSAGE_PARSED,
+  };
+
+  struct Event {
+    Phase phase;
+    // std::chrono::steady_clock time of the event, in nanoseconds.
+    int64_t timestamp_nanos;
+    // Transcoder input consumed and output produced so far: XML and binary
+    // bytes when parsing, binary and XML bytes when printing. Before
+    // TRANSCODE_FINISHED the output count may include buffer space that has
+    // been reserved but not yet written.
+    int64_t input_bytes;
+    int64_t output_bytes;
+  };
+
+  virtual ~XmlConversionObserver() {}
+
+  virtual void OnEvent(const Event& event) = 0;
+
+  // Input bytes between two PROGRESS events. Progress is checked whenever the
+  // transcoder pulls a chunk from its input stream, so events are as far
+  // apart as the chunks are large.
+  virtual int64_t progress_interval_bytes() const { return 1 << 20; }
+};
+
+// Attributes the cost of conversions to the fields of the message, to find
+// the fields that make a message type slow to convert. Set it through the
+// field_profile field of XmlParseOptions or XmlPrintOptions; the costs of all
+// conversions sharing a profile are added up. Not thread-safe.
+//
+// Fields are identified by their path from the root message, e.g.
+// "people.phones.number". Items of a list share the path of the list, and
+// the keys of maps and google.protobuf.Struct are replaced by "*". Each
+// field is charged with the XML bytes produced (printing) or consumed
+// (parsing) for it, and with the time between the end of the previous event
+// and the end of its own, which covers decoding it from the source as well as
+// writing it. Reading the clock for every event would distort the profile,
+// so time is only measured for one event in sample_period and scaled up.
+//
+// With always_print_primitive_fields set, messages of some types, and
+// binaries whose fields are not in field number order, are buffered before
+// they are written, and the time spent decoding them is then charged to the
+// root.
+//
+// Example:
+//   XmlFieldProfile profile;
+//   XmlPrintOptions options;
+//   options.field_profile = &profile;
+//   for (...) MessageToXmlString(message, &output, options);
+//   std::cerr << profile.Report();
+class PROTOBUF_EXPORT XmlFieldProfile {
+ public:
+  struct Field {
+    std::string path;
+    // Number of events: objects, lists and values.
+    int64_t events;
+    int64_t bytes;
+    // Estimated from the sampled events.
+    int64_t nanos;
+
+    Field() : events(0), bytes(0), nanos(0) {}
+  };
+
+  static const int kDefaultSamplePeriod = 16;
+
+  XmlFieldProfile();
+  explicit XmlFieldProfile(int sample_period);
+
+  int sample_period() const { return sample_period_; }
+
+  // Returns the fields sorted by decreasing time, then decreasing bytes.
+  std::vector<Field> Fields() const;
+
+  // Returns a table of the fields in Fields() order, with their share of the
+  // total time and bytes.
+  std::string Report() const;
+
+  void Clear() { fields_.clear(); }
+
+  // Adds one event of the field at |path|. |nanos| is the measured time of
+  // the event, already scaled by the sample period, or 0 if it was not
+  // sampled. Called by the conversion functions.
+  void Add(const std::string& path, int64_t bytes, int64_t nanos);
+
+ private:
+  const int sample_period_;
+  std::map<std::string, Field> fields_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(XmlFieldProfile);
+};
+
+// Statistics about a single XML to binary conversion. Point the stats field of
+// XmlParseOptions at one of these to have it filled in; when it is null
+// nothing is measured. Counters are added to, so a struct can also accumulate
+// over several calls.
+//
+// An "element" is a start tag: objects, lists and the <anonymous> items of
+// lists of primitives. Attributes and text nodes count the values carried by
+// those elements.
+struct XmlParseStats {
+  // Bytes of XML consumed and of protobuf binary produced.
+  int64_t input_bytes;
+  int64_t output_bytes;
+
+  int64_t elements;
+  int64_t attributes;
+  int64_t text_nodes;
+  // Deepest element nesting seen, the root element being depth 1.
+  int max_depth;
+
+  // Bytes the parser copied into its leftover buffer because a token
+  // straddled two input chunks.
+  int64_t leftover_bytes_copied;
+  // Bytes copied into the parser's string storage while unescaping values or
+  // keeping a partial value across chunks.
+  int64_t parsed_storage_bytes_copied;
+  // Number of times the parser stopped in the middle of a token at the end of
+  // a chunk and resumed on the next one.
+  int64_t resumptions;
+  // Number of times an internal buffer (parser storage, or the output string
+  // of the string-based functions) had to grow.
+  int64_t allocations;
+  // Largest capacity the parser's internal buffers reached. Unlike the other
+  // counters this is a maximum, not a sum, over the calls sharing the struct.
+  int64_t parser_storage_high_water;
+
+  // Wall time spent resolving the message type, transcoding XML to binary
+  // and, for XmlStringToMessage() only, parsing the binary into the message.
+  int64_t resolve_nanos;
+  int64_t transcode_nanos;
+  int64_t message_parse_nanos;
+
+  XmlParseStats()
+      : input_bytes(0),
+        output_bytes(0),
+        elements(0),
+        attributes(0),
+        text_nodes(0),
+        max_depth(0),
+        leftover_bytes_copied(0),
+        parsed_storage_bytes_copied(0),
+        resumptions(0),
+        allocations(0),
+        parser_storage_high_water(0),
+        resolve_nanos(0),
+        transcode_nanos(0),
+        message_parse_nanos(0) {}
+};
+
+// Statistics about a single binary to XML conversion. Same conventions as
+// XmlParseStats.
+struct XmlPrintStats {
+  // Bytes of protobuf binary consumed and of XML produced.
+  int64_t input_bytes;
+  int64_t output_bytes;
+
+  int64_t elements;
+  int64_t attributes;
+  int64_t text_nodes;
+  int max_depth;
+
+  // Number of times the output buffer had to grow. Only measured by the
+  // string-based functions; MessageToXmlString() also counts the buffer the
+  // message is serialized into.
+  int64_t allocations;
+
+  // Wall time spent serializing the message (MessageToXmlString() only),
+  // resolving the message type and transcoding binary to XML.
+  int64_t serialize_nanos;
+  int64_t resolve_nanos;
+  int64_t transcode_nanos;
+
+  XmlPrintStats()
+      : input_bytes(0),
+        output_bytes(0),
+        elements(0),
+        attributes(0),
+        text_nodes(0),
+        max_depth(0),
+        allocations(0),
+        serialize_nanos(0),
+        resolve_nanos(0),
+        transcode_nanos(0) {}
+};
 
 struct XmlParseOptions {
   // Whether to ignore unknown XML fields during parsing
@@ -61,8 +275,57 @@ struct XmlParseOptions {
   // allow_alias instead.
   bool case_insensitive_enum_parsing;
 
+  // If set, notified at the phase boundaries of the conversion. When null,
+  // none of the observing code runs.
+  XmlConversionObserver* observer;
+
+  // If set, the cost of every field is added to it. When null, none of the
+  // profiling code runs.
+  XmlFieldProfile* field_profile;
+
+  // If set, statistics about the conversion are added to it. When null,
+  // nothing is measured.
+  XmlParseStats* stats;
+
+  // If true, the length of every nested message is written into a reserved
+  // five byte slot right before its contents and filled in when the message
+  // ends, so no message sizes are tracked. With compact_message_lengths, one
+  // more pass then shrinks the lengths. The root message is still held in
+  // memory until it ends, as without this option. The payloads of Any fields
+  // whose @type attribute comes first are written the same way; without this
+  // option they are buffered until the end of the Any. Their types are cached
+  // for one conversion only, as ProtoStreamObjectWriter does, so every call
+  // resolves them again. Other messages of well-known types are still encoded
+  // the usual way.
+  //
+  // Timestamps, durations and wrappers given as a single value are parsed by
+  // the fixed-format parsers of xml_well_known_types.h and written in place
+  // only with this option. Without it they go through ProtoStreamObjectWriter
+  // like any other message, so parsing gets none of that speedup by default;
+  // printing them does.
+  bool backpatch_message_lengths;
+
+  // With backpatch_message_lengths, whether to shrink the lengths to minimal
+  // varints before the output is written. Without it the output is still
+  // valid, but not canonical: every nested message length takes five bytes.
+  bool compact_message_lengths;
+
+  // XmlStringToMessage() transcodes into a scratch string taken from a pool
+  // kept by the calling thread, so that its capacity is reused by the next
+  // call. A string is freed instead of being returned to the pool if the
+  // strings of the pool would then hold more than this many bytes in all;
+  // 0 disables the pooling.
+  size_t max_scratch_buffer_bytes;
+
   XmlParseOptions()
-      : ignore_unknown_fields(false), case_insensitive_enum_parsing(false) {}
+      : ignore_unknown_fields(false),
+        case_insensitive_enum_parsing(false),
+        observer(nullptr),
+        field_profile(nullptr),
+        stats(nullptr),
+        backpatch_message_lengths(false),
+        compact_message_lengths(true),
+        max_scratch_buffer_bytes(1 << 20) {}
 };
 
 struct XmlPrintOptions {
@@ -79,12 +342,48 @@ struct XmlPrintOptions {
   bool always_print_enums_as_ints;
   // Whether to preserve proto field names
   bool preserve_proto_field_names;
+  // If set, notified at the phase boundaries of the conversion. When null,
+  // none of the observing code runs.
+  XmlConversionObserver* observer;
+  // If set, the cost of every field is added to it. When null, none of the
+  // profiling code runs.
+  XmlFieldProfile* field_profile;
+  // If set, statistics about the conversion are added to it. When null,
+  // nothing is measured.
+  XmlPrintStats* stats;
+  // If true, MessageToXmlString() and BinaryToXmlString() compute the size of
+  // the output with XmlByteSize() first, grow the output string once and
+  // write into it in place, instead of letting the string regrow and copy
+  // itself as the output is produced. The input is converted twice, so this
+  // only pays off for large outputs. Ignored by BinaryToXmlStream().
+  bool presize_output;
+  // If greater than 1, MessageToXmlString() and BinaryToXmlString() may
+  // render the items of the largest top-level repeated message field, e.g.
+  // the people of an address book, on up to this many threads, counting the
+  // calling thread. The XML is the same. Only inputs with at least 64 KiB of
+  // such items per thread are split. Not used together with
+  // always_print_primitive_fields, observer, field_profile, presize_output or
+  // stats, nor by BinaryToXmlStream(), which reads its input once.
+  int max_threads;
+  // MessageToXmlString() and XmlByteSize() serialize the message into a
+  // scratch string taken from a pool kept by the calling thread, so that its
+  // capacity is reused by the next call. A string is freed instead of being
+  // returned to the pool if the strings of the pool would then hold more
+  // than this many bytes in all; 0 disables the pooling. The pool is shared
+  // with parsing.
+  size_t max_scratch_buffer_bytes;
 
   XmlPrintOptions()
       : add_whitespace(false),
         always_print_primitive_fields(false),
         always_print_enums_as_ints(false),
-        preserve_proto_field_names(false) {}
+        preserve_proto_field_names(false),
+        observer(nullptr),
+        field_profile(nullptr),
+        stats(nullptr),
+        presize_output(false),
+        max_threads(1),
+        max_scratch_buffer_bytes(1 << 20) {}
 };
 
 // DEPRECATED. Use XmlPrintOptions instead.
@@ -102,6 +401,15 @@ inline util::Status MessageToXmlString(const Message& message,
   return MessageToXmlString(message, output, XmlOptions());
 }
 
+// Computes the exact number of bytes MessageToXmlString() would append to
+// its output for |message| and |options|, without producing the XML. Like
+// Message::ByteSizeLong(), this walks the whole message: the conversion is
+// run into a small scratch buffer that is overwritten as it fills up.
+// options.observer and options.field_profile are not used.
+PROTOBUF_EXPORT util::Status XmlByteSize(const Message& message,
+                                         const XmlPrintOptions& options,
+                                         size_t* size);
+
 // Converts from XML to protobuf message. This is a simple wrapper of
 // XmlStringToBinary(). It will use the DescriptorPool of the passed-in
 // message to resolve Any types.
@@ -146,6 +454,61 @@ inline util::Status BinaryToXmlString(TypeResolver* resolver,
                            XmlPrintOptions());
 }
 
+// Computes the exact number of bytes BinaryToXmlString() would append to its
+// output for |binary_input| and |options|. Fails where BinaryToXmlString()
+// fails. options.observer and options.field_profile are not used.
+PROTOBUF_EXPORT util::Status XmlByteSize(TypeResolver* resolver,
+                                         const std::string& type_url,
+                                         const std::string& binary_input,
+                                         const XmlPrintOptions& options,
+                                         size_t* size);
+
+// Converts protobuf binary data to XML a step at a time, for callers that must
+// not block for the whole conversion of a large message, e.g. an event loop
+// serving other connections. Each Step() call produces the next piece of the
+// XML that BinaryToXmlString() would produce, and returns, keeping its place
+// in the binary and the state of the XML for the next call.
+//
+// A step decodes fields until it has its XML, so it takes time in proportion
+// to its output, plus at most one top-level field, or one item when the field
+// is a list of messages. The binary is read in place and must be in memory
+// until the printer is destroyed. options.always_print_primitive_fields,
+// observer, field_profile and stats are not supported: every step fails if
+// one is set. presize_output and max_threads are not used.
+//
+// Sample usage:
+//   BinaryToXmlPrinter printer(resolver, type_url, binary, options);
+//   while (!printer.done()) {
+//     std::string chunk;
+//     util::Status status = printer.Step(64 * 1024, &chunk);
+//     if (!status.ok()) return status;
+//     ... write chunk, then yield to the event loop ...
+//   }
+class PROTOBUF_EXPORT BinaryToXmlPrinter {
+ public:
+  // |resolver| and |binary_input| must outlive the printer.
+  BinaryToXmlPrinter(TypeResolver* resolver, const std::string& type_url,
+                     StringPiece binary_input, const XmlPrintOptions& options);
+  ~BinaryToXmlPrinter();
+
+  // Appends the next |max_output_bytes| bytes of the XML to |xml_output|,
+  // fewer only at the end. Fails with InvalidArgumentError, and does nothing,
+  // if |max_output_bytes| is 0. After any other failure, every later step
+  // fails the same way.
+  util::Status Step(size_t max_output_bytes, std::string* xml_output);
+
+  // Whether all of the XML has been produced, or a step has failed.
+  bool done() const;
+
+ private:
+  std::unique_ptr<google::protobuf::Type> type_;
+  std::unique_ptr<converter::XmlIncrementalPrinter> printer_;
+  // Why the conversion cannot start, if it cannot.
+  util::Status status_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(BinaryToXmlPrinter);
+};
+
 // Converts XML data to protobuf binary format.
 // The conversion will fail if:
 //   1. TypeResolver fails to resolve a type.
@@ -0,0 +1,320 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Allocation budgets for the xml_util conversion paths.
+//
+// Each path converts the same message shape repeatedly, reusing its output
+// string or message the way a server handling a stream of requests would.
+// After warm-up, the number of operator new calls made by a conversion must
+// be stable from call to call, and must fit a budget of
+//
+//   fixed + per_unit * units
+//
+// where a unit is one repetition of the shape's element (a Person, one value
+// of each numeric list, one entry of each map). The fixed part covers type
+// resolution and per-call setup; per_unit covers XmlObjectWriter,
+// XmlStreamParser and the proto stream reader/writer. Both are measured by
+// converting the shape at two sizes.
+//
+// The budgets leave some headroom over the measured counts. When a change
+// legitimately needs more, the failure message shows the measured values to
+// update them with.
+//
+// This binary replaces the global operator new to count calls, so it is a
+// separate test from xml_util_test.
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/util/type_resolver.h>
+#include <google/protobuf/util/type_resolver_util.h>
+#include <google/protobuf/util/xml_benchmark.pb.h>
+#include <google/protobuf/util/xml_util.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+
+namespace {
+thread_local int64_t thread_allocation_count = 0;
+}  // namespace
+
+// Same counting hooks as xml_benchmark_util.cc, which this test does not link
+// so that it does not depend on the benchmark corpora.
+void* operator new(size_t size) {
+  ++thread_allocation_count;
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) { return ::operator new(size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  ++thread_allocation_count;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+  return ::operator new(size, tag);
+}
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace {
+
+using ::proto_util_xml_benchmark::AddressBook;
+using ::proto_util_xml_benchmark::MapHeavy;
+using ::proto_util_xml_benchmark::NumericHeavy;
+using ::proto_util_xml_benchmark::Person;
+
+// Units in the smaller of the two messages; the larger one has twice as
+// many.
+const int kUnits = 64;
+const int kWarmUpCalls = 3;
+const int kMeasuredCalls = 3;
+// Upper bound of the fixed part for every shape and path.
+const int64_t kFixedBudget = 2048;
+
+std::unique_ptr<Message> MakeAddressBook(int units) {
+  std::unique_ptr<AddressBook> book(new AddressBook);
+  for (int i = 0; i < units; ++i) {
+    Person* person = book->add_people();
+    person->set_name("Person " + std::to_string(i));
+    person->set_id(i);
+    person->set_email("person" + std::to_string(i) + "@example.com");
+    Person::PhoneNumber* phone = person->add_phones();
+    phone->set_number("555-" + std::to_string(1000 + i));
+    phone->set_type(Person::HOME);
+    phone = person->add_phones();
+    phone->set_number("555-" + std::to_string(2000 + i));
+    phone->set_type(Person::WORK);
+  }
+  return book;
+}
+
+std::unique_ptr<Message> MakeNumericHeavy(int units) {
+  std::unique_ptr<NumericHeavy> numbers(new NumericHeavy);
+  for (int i = 0; i < units; ++i) {
+    numbers->add_int32_values(i * 7919);
+    numbers->add_int64_values(int64_t{i} * 1000000007);
+    numbers->add_sint32_values(-i);
+    numbers->add_fixed32_values(i * 31u);
+    numbers->add_double_values(i / 3.0);
+    numbers->add_float_values(i / 7.0f);
+  }
+  return numbers;
+}
+
+std::unique_ptr<Message> MakeMapHeavy(int units) {
+  std::unique_ptr<MapHeavy> maps(new MapHeavy);
+  for (int i = 0; i < units; ++i) {
+    const std::string key = "key" + std::to_string(i);
+    (*maps->mutable_counters())[key] = i;
+    (*maps->mutable_labels())[key] = "label" + std::to_string(i);
+    MapHeavy::Item& item = (*maps->mutable_items())[key];
+    item.set_label("item" + std::to_string(i));
+    item.set_count(i);
+  }
+  return maps;
+}
+
+struct Shape {
+  const char* name;
+  std::unique_ptr<Message> (*make)(int units);
+  // Budgets per unit for printing (binary or message to XML) and parsing
+  // (XML to binary or message).
+  int64_t print_budget;
+  int64_t parse_budget;
+};
+
+const Shape kShapes[] = {
+    {"AddressBook", MakeAddressBook, 24, 48},
+    {"NumericHeavy", MakeNumericHeavy, 16, 24},
+    {"MapHeavy", MakeMapHeavy, 32, 64},
+};
+
+enum Path {
+  MESSAGE_TO_XML_STRING,
+  BINARY_TO_XML_STRING,
+  BINARY_TO_XML_STREAM,
+  XML_STRING_TO_MESSAGE,
+  XML_TO_BINARY_STRING,
+  XML_TO_BINARY_STREAM,
+};
+
+const char* PathName(Path path) {
+  switch (path) {
+    case MESSAGE_TO_XML_STRING:
+      return "MessageToXmlString";
+    case BINARY_TO_XML_STRING:
+      return "BinaryToXmlString";
+    case BINARY_TO_XML_STREAM:
+      return "BinaryToXmlStream";
+    case XML_STRING_TO_MESSAGE:
+      return "XmlStringToMessage";
+    case XML_TO_BINARY_STRING:
+      return "XmlToBinaryString";
+    case XML_TO_BINARY_STREAM:
+      return "XmlToBinaryStream";
+  }
+  return "";
+}
+
+bool IsParse(Path path) { return path >= XML_STRING_TO_MESSAGE; }
+
+// One message in all of its forms, plus the outputs that repeated
+// conversions reuse.
+class Conversion {
+ public:
+  Conversion(const Shape& shape, int units)
+      : message_(shape.make(units)),
+        parsed_(message_->New()),
+        resolver_(NewTypeResolverForDescriptorPool(
+            "type.googleapis.com", DescriptorPool::generated_pool())),
+        type_url_("type.googleapis.com/" +
+                  message_->GetDescriptor()->full_name()) {
+    binary_ = message_->SerializeAsString();
+    EXPECT_TRUE(MessageToXmlString(*message_, &xml_).ok());
+  }
+
+  // Runs |path| once and returns the number of allocations it made.
+  int64_t Run(Path path) {
+    output_.clear();
+    const int64_t before = thread_allocation_count;
+    util::Status status;
+    switch (path) {
+      case MESSAGE_TO_XML_STRING:
+        status = MessageToXmlString(*message_, &output_);
+        break;
+      case BINARY_TO_XML_STRING:
+        status = BinaryToXmlString(resolver_.get(), type_url_, binary_,
+                                   &output_);
+        break;
+      case BINARY_TO_XML_STREAM: {
+        io::ArrayInputStream input(binary_.data(), binary_.size());
+        io::StringOutputStream output(&output_);
+        status = BinaryToXmlStream(resolver_.get(), type_url_, &input,
+                                   &output);
+        break;
+      }
+      case XML_STRING_TO_MESSAGE:
+        status = XmlStringToMessage(xml_, parsed_.get());
+        break;
+      case XML_TO_BINARY_STRING:
+        status = XmlToBinaryString(resolver_.get(), type_url_, xml_, &output_);
+        break;
+      case XML_TO_BINARY_STREAM: {
+        io::ArrayInputStream input(xml_.data(), xml_.size());
+        io::StringOutputStream output(&output_);
+        status = XmlToBinaryStream(resolver_.get(), type_url_, &input,
+                                   &output);
+        break;
+      }
+    }
+    const int64_t allocations = thread_allocation_count - before;
+    EXPECT_TRUE(status.ok()) << PathName(path) << ": " << status;
+    return allocations;
+  }
+
+  // Warms up |path| and returns the allocations of a steady-state call,
+  // checking that every measured call made the same number.
+  int64_t SteadyState(Path path) {
+    for (int i = 0; i < kWarmUpCalls; ++i) Run(path);
+    const int64_t allocations = Run(path);
+    for (int i = 1; i < kMeasuredCalls; ++i) {
+      EXPECT_EQ(allocations, Run(path))
+          << PathName(path) << " does not reach a steady state";
+    }
+    return allocations;
+  }
+
+ private:
+  std::unique_ptr<Message> message_;
+  std::unique_ptr<Message> parsed_;
+  std::unique_ptr<TypeResolver> resolver_;
+  const std::string type_url_;
+  std::string binary_;
+  std::string xml_;
+  std::string output_;
+};
+
+void CheckBudget(Path path) {
+  for (const Shape& shape : kShapes) {
+    Conversion small(shape, kUnits);
+    Conversion large(shape, 2 * kUnits);
+    const int64_t small_allocations = small.SteadyState(path);
+    const int64_t large_allocations = large.SteadyState(path);
+    const int64_t per_unit =
+        (large_allocations - small_allocations + kUnits - 1) / kUnits;
+    const int64_t fixed = small_allocations - per_unit * kUnits;
+    const int64_t budget = IsParse(path) ? shape.parse_budget
+                                         : shape.print_budget;
+    EXPECT_LE(per_unit, budget)
+        << PathName(path) << "(" << shape.name << "): " << per_unit
+        << " allocations per unit, " << fixed << " fixed";
+    EXPECT_LE(fixed, kFixedBudget)
+        << PathName(path) << "(" << shape.name << "): " << per_unit
+        << " allocations per unit, " << fixed << " fixed";
+  }
+}
+
+TEST(XmlUtilAllocationTest, MessageToXmlString) {
+  CheckBudget(MESSAGE_TO_XML_STRING);
+}
+
+TEST(XmlUtilAllocationTest, BinaryToXmlString) {
+  CheckBudget(BINARY_TO_XML_STRING);
+}
+
+TEST(XmlUtilAllocationTest, BinaryToXmlStream) {
+  CheckBudget(BINARY_TO_XML_STREAM);
+}
+
+TEST(XmlUtilAllocationTest, XmlStringToMessage) {
+  CheckBudget(XML_STRING_TO_MESSAGE);
+}
+
+TEST(XmlUtilAllocationTest, XmlToBinaryString) {
+  CheckBudget(XML_TO_BINARY_STRING);
+}
+
+TEST(XmlUtilAllocationTest, XmlToBinaryStream) {
+  CheckBudget(XML_TO_BINARY_STREAM);
+}
+
+}  // namespace
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,274 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmarks for the xml_util conversion functions.
+//
+// Every case reports:
+//   bytes_per_second: XML bytes produced or consumed per second,
+//   items_per_second: messages converted per second,
+//   allocs/op:        operator new calls per conversion,
+// and, with XML_BENCHMARK_PERF_COUNTERS=1, hardware counters per XML byte and
+// per element (see HardwareCounters).
+//
+// Example (from src/google/protobuf/util):
+//   bazel run -c opt :xml_util_benchmark -- --benchmark_filter=StringToMessage
+
+#include <benchmark/benchmark.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/util/xml_benchmark_util.h>
+#include <google/protobuf/util/xml_util.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+// Sets the throughput counters shared by all cases. Must be called after the
+// benchmark loop.
+void ReportCounters(benchmark::State& state, const Corpus& corpus,
+                    int64_t allocations, const HardwareCounters& counters) {
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(corpus.xml.size()));
+  state.SetItemsProcessed(state.iterations());
+  state.counters["allocs/op"] = benchmark::Counter(
+      static_cast<double>(allocations), benchmark::Counter::kAvgIterations);
+  ReportHardwareCounters(counters, static_cast<int64_t>(corpus.xml.size()),
+                         corpus.elements, state);
+}
+
+void BM_MessageToXmlString(benchmark::State& state, CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  std::string output;
+  HardwareCounters counters;
+  int64_t allocations = -ThreadAllocationCount();
+  counters.Start();
+  for (auto _ : state) {
+    output.clear();
+    util::Status status = MessageToXmlString(*corpus.message, &output);
+    GOOGLE_CHECK(status.ok()) << status;
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  allocations += ThreadAllocationCount();
+  ReportCounters(state, corpus, allocations, counters);
+}
+
+// Converts into a new string every time, as a server building a response
+// does, so that the cost of growing the string is included.
+void MessageToNewXmlString(benchmark::State& state, CorpusShape shape,
+                           const XmlPrintOptions& options) {
+  const Corpus& corpus = GetCorpus(shape);
+  HardwareCounters counters;
+  int64_t allocations = -ThreadAllocationCount();
+  counters.Start();
+  for (auto _ : state) {
+    std::string output;
+    util::Status status = MessageToXmlString(*corpus.message, &output, options);
+    GOOGLE_CHECK(status.ok()) << status;
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  allocations += ThreadAllocationCount();
+  ReportCounters(state, corpus, allocations, counters);
+}
+
+void BM_MessageToNewXmlString(benchmark::State& state, CorpusShape shape) {
+  MessageToNewXmlString(state, shape, XmlPrintOptions());
+}
+
+// Same, with the output sized by XmlByteSize() and allocated once.
+void BM_MessageToNewXmlStringPresized(benchmark::State& state,
+                                      CorpusShape shape) {
+  XmlPrintOptions options;
+  options.presize_output = true;
+  MessageToNewXmlString(state, shape, options);
+}
+
+void BM_XmlStringToMessage(benchmark::State& state, CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  std::unique_ptr<Message> message(corpus.message->New());
+  HardwareCounters counters;
+  int64_t allocations = -ThreadAllocationCount();
+  counters.Start();
+  for (auto _ : state) {
+    message->Clear();
+    util::Status status = XmlStringToMessage(corpus.xml, message.get());
+    GOOGLE_CHECK(status.ok()) << status;
+    benchmark::DoNotOptimize(message.get());
+  }
+  counters.Stop();
+  allocations += ThreadAllocationCount();
+  ReportCounters(state, corpus, allocations, counters);
+}
+
+void BM_BinaryToXmlStream(benchmark::State& state, CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  TypeResolver* resolver = corpus.resolver;
+  std::string output;
+  HardwareCounters counters;
+  int64_t allocations = -ThreadAllocationCount();
+  counters.Start();
+  for (auto _ : state) {
+    output.clear();
+    io::ArrayInputStream input_stream(corpus.binary.data(),
+                                      corpus.binary.size());
+    io::StringOutputStream output_stream(&output);
+    util::Status status = BinaryToXmlStream(resolver, corpus.type_url,
+                                            &input_stream, &output_stream);
+    GOOGLE_CHECK(status.ok()) << status;
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  allocations += ThreadAllocationCount();
+  ReportCounters(state, corpus, allocations, counters);
+}
+
+void XmlToBinaryStream(benchmark::State& state, CorpusShape shape,
+                       const XmlParseOptions& options) {
+  const Corpus& corpus = GetCorpus(shape);
+  TypeResolver* resolver = corpus.resolver;
+  std::string output;
+  HardwareCounters counters;
+  int64_t allocations = -ThreadAllocationCount();
+  counters.Start();
+  for (auto _ : state) {
+    output.clear();
+    io::ArrayInputStream input_stream(corpus.xml.data(), corpus.xml.size());
+    io::StringOutputStream output_stream(&output);
+    util::Status status = util::XmlToBinaryStream(
+        resolver, corpus.type_url, &input_stream, &output_stream, options);
+    GOOGLE_CHECK(status.ok()) << status;
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  allocations += ThreadAllocationCount();
+  ReportCounters(state, corpus, allocations, counters);
+}
+
+void BM_XmlToBinaryStream(benchmark::State& state, CorpusShape shape) {
+  XmlToBinaryStream(state, shape, XmlParseOptions());
+}
+
+// Same, with nested message lengths backpatched instead of buffered; compare
+// with BM_XmlToBinaryStream, especially for deep_nesting, large_map and
+// any_envelope.
+void BM_XmlToBinaryStreamBackpatched(benchmark::State& state,
+                                     CorpusShape shape) {
+  XmlParseOptions options;
+  options.backpatch_message_lengths = true;
+  XmlToBinaryStream(state, shape, options);
+}
+
+// A single conversion split over state.range(0) threads; compare with /1.
+void BM_BinaryToXmlStringParallel(benchmark::State& state, CorpusShape shape) {
+  const Corpus& corpus = GetCorpus(shape);
+  XmlPrintOptions options;
+  options.max_threads = static_cast<int>(state.range(0));
+  std::string output;
+  HardwareCounters counters;
+  int64_t allocations = -ThreadAllocationCount();
+  counters.Start();
+  for (auto _ : state) {
+    output.clear();
+    util::Status status = BinaryToXmlString(corpus.resolver, corpus.type_url,
+                                            corpus.binary, &output, options);
+    GOOGLE_CHECK(status.ok()) << status;
+    benchmark::DoNotOptimize(output.data());
+  }
+  counters.Stop();
+  allocations += ThreadAllocationCount();
+  ReportCounters(state, corpus, allocations, counters);
+}
+
+#define XML_BENCHMARK_ALL_SHAPES(fn)                                    \
+  BENCHMARK_CAPTURE(fn, address_book, CorpusShape::kAddressBook);       \
+  BENCHMARK_CAPTURE(fn, deep_nesting, CorpusShape::kDeepNesting);       \
+  BENCHMARK_CAPTURE(fn, wide_flat, CorpusShape::kWideFlat);             \
+  BENCHMARK_CAPTURE(fn, string_heavy, CorpusShape::kStringHeavy);       \
+  BENCHMARK_CAPTURE(fn, bytes_heavy, CorpusShape::kBytesHeavy);         \
+  BENCHMARK_CAPTURE(fn, numeric_heavy, CorpusShape::kNumericHeavy);     \
+  BENCHMARK_CAPTURE(fn, map_heavy, CorpusShape::kMapHeavy);             \
+  BENCHMARK_CAPTURE(fn, large_map, CorpusShape::kLargeMap);             \
+  BENCHMARK_CAPTURE(fn, event_telemetry, CorpusShape::kEventTelemetry); \
+  BENCHMARK_CAPTURE(fn, any_envelope, CorpusShape::kAnyEnvelope)
+
+XML_BENCHMARK_ALL_SHAPES(BM_MessageToXmlString);
+XML_BENCHMARK_ALL_SHAPES(BM_MessageToNewXmlString);
+XML_BENCHMARK_ALL_SHAPES(BM_MessageToNewXmlStringPresized);
+XML_BENCHMARK_ALL_SHAPES(BM_XmlStringToMessage);
+XML_BENCHMARK_ALL_SHAPES(BM_BinaryToXmlStream);
+XML_BENCHMARK_ALL_SHAPES(BM_XmlToBinaryStream);
+XML_BENCHMARK_ALL_SHAPES(BM_XmlToBinaryStreamBackpatched);
+
+BENCHMARK_CAPTURE(BM_BinaryToXmlStringParallel, address_book,
+                  CorpusShape::kAddressBook)
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_BinaryToXmlStringParallel, large_address_book,
+                  CorpusShape::kLargeAddressBook)
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->UseRealTime();
+
+// The custom corpus is only known at run time, so its cases are registered
+// dynamically.
+const bool custom_benchmarks_registered = [] {
+  if (!HasCustomCorpus()) return false;
+  benchmark::RegisterBenchmark("BM_MessageToXmlString/custom",
+                               BM_MessageToXmlString, CorpusShape::kCustom);
+  benchmark::RegisterBenchmark("BM_MessageToNewXmlString/custom",
+                               BM_MessageToNewXmlString, CorpusShape::kCustom);
+  benchmark::RegisterBenchmark("BM_MessageToNewXmlStringPresized/custom",
+                               BM_MessageToNewXmlStringPresized,
+                               CorpusShape::kCustom);
+  benchmark::RegisterBenchmark("BM_XmlStringToMessage/custom",
+                               BM_XmlStringToMessage, CorpusShape::kCustom);
+  benchmark::RegisterBenchmark("BM_BinaryToXmlStream/custom",
+                               BM_BinaryToXmlStream, CorpusShape::kCustom);
+  benchmark::RegisterBenchmark("BM_XmlToBinaryStream/custom",
+                               BM_XmlToBinaryStream, CorpusShape::kCustom);
+  benchmark::RegisterBenchmark("BM_XmlToBinaryStreamBackpatched/custom",
+                               BM_XmlToBinaryStreamBackpatched,
+                               CorpusShape::kCustom);
+  return true;
+}();
+
+}  // namespace
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,115 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// libFuzzer target for XmlToBinaryString. The first byte of each input picks
+// one of the message types in xml_benchmark.proto and the rest is converted
+// as XML of that type. Besides crashes, inputs whose conversion time or
+// allocations grow faster than their size are reported; see xml_fuzz_util.h.
+
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/status.h>
+#include <google/protobuf/stubs/stringpiece.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/util/xml_benchmark_util.h>
+#include <google/protobuf/util/xml_fuzz_util.h>
+#include <google/protobuf/util/xml_util.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace xml_benchmark {
+namespace {
+
+const char* const kMessageTypes[] = {
+    "proto_util_xml_benchmark.AddressBook",
+    "proto_util_xml_benchmark.DeepNestedList",
+    "proto_util_xml_benchmark.WideFlatList",
+    "proto_util_xml_benchmark.StringHeavy",
+    "proto_util_xml_benchmark.BytesHeavy",
+    "proto_util_xml_benchmark.NumericHeavy",
+    "proto_util_xml_benchmark.MapHeavy",
+};
+const int kNumMessageTypes = sizeof(kMessageTypes) / sizeof(kMessageTypes[0]);
+
+std::string TypeUrl(int type) {
+  return StrCat("type.googleapis.com/", kMessageTypes[type]);
+}
+
+// Every conversion resolves its types again, which costs the same for any
+// input of a given type. Measure it on an empty message so that only the
+// cost that depends on the input counts against the budget.
+FuzzCost FixedCost(int type) {
+  static FuzzCost* costs = [] {
+    FuzzCost* costs = new FuzzCost[kNumMessageTypes];
+    for (int i = 0; i < kNumMessageTypes; ++i) {
+      std::string binary;
+      // The first conversion also builds the resolver's caches.
+      for (int run = 0; run < 2; ++run) {
+        binary.clear();
+        ResourceBudget budget(0);
+        util::Status status = XmlToBinaryString(
+            GetBenchmarkTypeResolver(), TypeUrl(i), "<root/>", &binary);
+        GOOGLE_CHECK(status.ok()) << kMessageTypes[i] << ": " << status;
+        costs[i] = budget.Spent();
+      }
+    }
+    return costs;
+  }();
+  return costs[type];
+}
+
+void Convert(const uint8_t* data, size_t size) {
+  if (size == 0) return;
+  const int type = data[0] % kNumMessageTypes;
+  StringPiece xml(reinterpret_cast<const char*>(data) + 1, size - 1);
+  const std::string type_url = TypeUrl(type);
+  const FuzzCost fixed_cost = FixedCost(type);
+
+  std::string binary;
+  ResourceBudget budget(xml.size(), fixed_cost);
+  util::Status status =
+      XmlToBinaryString(GetBenchmarkTypeResolver(), type_url, xml, &binary);
+  budget.Check(kMessageTypes[type]);
+}
+
+}  // namespace
+}  // namespace xml_benchmark
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  google::protobuf::util::xml_benchmark::Convert(data, size);
+  return 0;
+}
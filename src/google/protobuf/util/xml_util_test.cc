@@ -48,6 +48,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <string>
+#include <thread>
 #include <vector>
 
 // Must be included last.
@@ -222,6 +223,70 @@ TEST(XmlUtilTest, TestDefaultValues) {
           "</root>"));
 }
 
+TEST(XmlUtilTest, TestDefaultValuesInNestedMessages) {
+  TestMessage m;
+  m.mutable_message_value();
+  m.add_repeated_message_value()->set_value(40);
+  m.add_repeated_message_value();
+
+  XmlPrintOptions options;
+  options.always_print_primitive_fields = true;
+  EXPECT_THAT(
+      ToXml(m, options),
+      IsOkAndHolds("<root boolValue=\"false\""
+                   " int32Value=\"0\""
+                   " int64Value=\"0\""
+                   " uint32Value=\"0\""
+                   " uint64Value=\"0\""
+                   " floatValue=\"0\""
+                   " doubleValue=\"0\""
+                   " stringValue=\"\""
+                   " bytesValue=\"\""
+                   " enumValue=\"FOO\">"
+                   "<messageValue value=\"0\"></messageValue>"
+                   "<_list_repeatedBoolValue></_list_repeatedBoolValue>"
+                   "<_list_repeatedInt32Value></_list_repeatedInt32Value>"
+                   "<_list_repeatedInt64Value></_list_repeatedInt64Value>"
+                   "<_list_repeatedUint32Value></_list_repeatedUint32Value>"
+                   "<_list_repeatedUint64Value></_list_repeatedUint64Value>"
+                   "<_list_repeatedFloatValue></_list_repeatedFloatValue>"
+                   "<_list_repeatedDoubleValue></_list_repeatedDoubleValue>"
+                   "<_list_repeatedStringValue></_list_repeatedStringValue>"
+                   "<_list_repeatedBytesValue></_list_repeatedBytesValue>"
+                   "<_list_repeatedEnumValue></_list_repeatedEnumValue>"
+                   "<_list_repeatedMessageValue>"
+                   "<repeatedMessageValue value=\"40\"></repeatedMessageValue>"
+                   "<repeatedMessageValue value=\"0\"></repeatedMessageValue>"
+                   "</_list_repeatedMessageValue>"
+                   "</root>"));
+}
+
+TEST(XmlUtilTest, TestDefaultValuesOfConcatenatedMessages) {
+  // The binary has int32_value after string_value, and int32_value and
+  // message_value twice: each field is written once, like the merged message.
+  TestMessage first;
+  first.set_string_value("x");
+  first.mutable_message_value()->set_value(1);
+  TestMessage second;
+  second.set_int32_value(2);
+  second.mutable_message_value()->set_value(3);
+  TestMessage merged = first;
+  merged.MergeFrom(second);
+
+  XmlPrintOptions options;
+  options.always_print_primitive_fields = true;
+  std::string expected;
+  ASSERT_OK(MessageToXmlString(merged, &expected, options));
+  auto* resolver = NewTypeResolverForDescriptorPool(
+      "type.googleapis.com", DescriptorPool::generated_pool());
+  std::string xml;
+  ASSERT_OK(BinaryToXmlString(
+      resolver, "type.googleapis.com/proto3.TestMessage",
+      first.SerializeAsString() + second.SerializeAsString(), &xml, options));
+  delete resolver;
+  EXPECT_EQ(expected, xml);
+}
+
 TEST(XmlUtilTest, TestPreserveProtoFieldNames) {
   TestMessage m;
   m.mutable_message_value();
@@ -333,6 +398,527 @@ TEST(XmlUtilTest, ParseMessage) {
   EXPECT_EQ(m.repeated_message_value(1).value(), 96);
 }
 
+TestMessage MakeStatsTestMessage() {
+  TestMessage m;
+  m.set_int32_value(1);
+  m.add_repeated_int32_value(1);
+  m.add_repeated_int32_value(2);
+  m.mutable_message_value()->set_value(2048);
+  m.add_repeated_message_value()->set_value(40);
+  m.add_repeated_message_value()->set_value(96);
+  return m;
+}
+
+TEST(XmlUtilTest, PrintStats) {
+  TestMessage m = MakeStatsTestMessage();
+  std::string xml;
+  XmlPrintStats stats;
+  XmlPrintOptions options;
+  options.stats = &stats;
+  ASSERT_OK(MessageToXmlString(m, &xml, options));
+
+  EXPECT_EQ(stats.input_bytes, static_cast<int64_t>(m.ByteSizeLong()));
+  EXPECT_EQ(stats.output_bytes, static_cast<int64_t>(xml.size()));
+  // <root>, two lists, two <anonymous>, <messageValue> and two
+  // <repeatedMessageValue>.
+  EXPECT_EQ(stats.elements, 8);
+  EXPECT_EQ(stats.attributes, 4);
+  EXPECT_EQ(stats.text_nodes, 2);
+  EXPECT_EQ(stats.max_depth, 3);
+  EXPECT_GT(stats.allocations, 0);
+  EXPECT_GT(stats.transcode_nanos, 0);
+}
+
+TEST(XmlUtilTest, XmlByteSize) {
+  TestMessage m = MakeStatsTestMessage();
+  m.set_string_value("<escaped & \"quoted\">");
+  m.add_repeated_string_value(std::string(10000, 'x'));
+  XmlPrintOptions options;
+  for (bool add_whitespace : {false, true}) {
+    for (bool always_print_primitive_fields : {false, true}) {
+      options.add_whitespace = add_whitespace;
+      options.always_print_primitive_fields = always_print_primitive_fields;
+      std::string xml;
+      ASSERT_OK(MessageToXmlString(m, &xml, options));
+      size_t size = 0;
+      ASSERT_OK(XmlByteSize(m, options, &size));
+      EXPECT_EQ(xml.size(), size);
+    }
+  }
+}
+
+TEST(XmlUtilTest, PresizeOutput) {
+  TestMessage m = MakeStatsTestMessage();
+  m.add_repeated_string_value(std::string(10000, 'x'));
+  std::string expected = "prefix";
+  ASSERT_OK(MessageToXmlString(m, &expected));
+
+  XmlPrintOptions options;
+  options.presize_output = true;
+  // Not from a scratch buffer left by an earlier call.
+  options.max_scratch_buffer_bytes = 0;
+  std::string xml = "prefix";
+  XmlPrintStats stats;
+  options.stats = &stats;
+  ASSERT_OK(MessageToXmlString(m, &xml, options));
+  EXPECT_EQ(expected, xml);
+  // The message is serialized into one buffer and the XML into another.
+  EXPECT_EQ(stats.allocations, 2);
+  EXPECT_EQ(stats.output_bytes, static_cast<int64_t>(xml.size() - 6));
+
+  // Errors leave the output as it was.
+  auto* resolver = NewTypeResolverForDescriptorPool(
+      "type.googleapis.com", DescriptorPool::generated_pool());
+  xml = "prefix";
+  EXPECT_FALSE(BinaryToXmlString(resolver, "type.googleapis.com/proto3.Nope",
+                                 m.SerializeAsString(), &xml, options)
+                   .ok());
+  delete resolver;
+  EXPECT_EQ("prefix", xml);
+}
+
+// Converts a message from inside the conversion it observes, so that two
+// scratch buffers are in use at once.
+class NestedConversionObserver : public XmlConversionObserver {
+ public:
+  NestedConversionObserver(const TestMessage& message,
+                           const XmlPrintOptions& options)
+      : message_(message), options_(options) {
+    xml_.reserve(1 << 20);
+  }
+
+  void OnEvent(const Event& event) override {
+    if (event.phase != MESSAGE_SERIALIZED) return;
+    xml_.clear();
+    stats_ = XmlPrintStats();
+    XmlPrintOptions options = options_;
+    options.stats = &stats_;
+    EXPECT_OK(MessageToXmlString(message_, &xml_, options));
+  }
+
+  // Of the last nested conversion.
+  const XmlPrintStats& stats() const { return stats_; }
+
+ private:
+  const TestMessage& message_;
+  const XmlPrintOptions options_;
+  std::string xml_;
+  XmlPrintStats stats_;
+};
+
+// Run on a thread of its own, whose pool is empty at first.
+void CheckScratchBuffers() {
+  TestMessage m = MakeStatsTestMessage();
+  m.add_repeated_string_value(std::string(10000, 'x'));
+  std::string xml;
+  ASSERT_OK(MessageToXmlString(m, &xml));
+
+  // The serialized message fits in the scratch buffer of the first call.
+  XmlPrintOptions options;
+  XmlPrintStats stats;
+  options.stats = &stats;
+  xml.clear();
+  ASSERT_OK(MessageToXmlString(m, &xml, options));
+  EXPECT_EQ(stats.allocations, 0);
+
+  // Without pooling, it is serialized into a new buffer every time.
+  options.max_scratch_buffer_bytes = 0;
+  for (int i = 0; i < 2; ++i) {
+    stats = XmlPrintStats();
+    xml.clear();
+    ASSERT_OK(MessageToXmlString(m, &xml, options));
+    EXPECT_EQ(stats.allocations, 1);
+  }
+
+  // Buffers above the cap are freed, so the next call allocates again.
+  options.max_scratch_buffer_bytes = 1000;
+  ASSERT_OK(MessageToXmlString(m, &xml, options));
+  stats = XmlPrintStats();
+  xml.clear();
+  ASSERT_OK(MessageToXmlString(m, &xml, options));
+  EXPECT_EQ(stats.allocations, 1);
+
+  // The cap is on the pool as a whole: with two buffers in use at once, only
+  // the one returned first is kept, so the nested conversion always
+  // allocates.
+  options.max_scratch_buffer_bytes = 15000;
+  NestedConversionObserver observer(m, options);
+  XmlPrintOptions outer_options = options;
+  outer_options.observer = &observer;
+  for (int i = 0; i < 3; ++i) {
+    xml.clear();
+    ASSERT_OK(MessageToXmlString(m, &xml, outer_options));
+    EXPECT_EQ(observer.stats().allocations, 1);
+  }
+  // Within a larger cap, both are kept.
+  options.max_scratch_buffer_bytes = 1 << 20;
+  NestedConversionObserver large_observer(m, options);
+  outer_options = options;
+  outer_options.observer = &large_observer;
+  for (int i = 0; i < 2; ++i) {
+    xml.clear();
+    ASSERT_OK(MessageToXmlString(m, &xml, outer_options));
+  }
+  EXPECT_EQ(large_observer.stats().allocations, 0);
+
+  // Parsing takes its binary buffer from the pool as well.
+  TestMessage parsed;
+  ASSERT_OK(XmlStringToMessage(xml, &parsed));
+  XmlParseStats parse_stats;
+  XmlParseOptions parse_options;
+  parse_options.stats = &parse_stats;
+  ASSERT_OK(XmlStringToMessage(xml, &parsed, parse_options));
+  EXPECT_EQ(m.DebugString(), parsed.DebugString());
+}
+
+TEST(XmlUtilTest, ScratchBuffers) {
+  std::thread thread(CheckScratchBuffers);
+  thread.join();
+}
+
+TEST(XmlUtilTest, MaxThreads) {
+  TestMessage m = MakeStatsTestMessage();
+  // Large enough to be split between four threads.
+  for (int i = 0; i < 100000; ++i) {
+    m.add_repeated_message_value()->set_value(i);
+  }
+  XmlPrintOptions options;
+  for (bool add_whitespace : {false, true}) {
+    options.add_whitespace = add_whitespace;
+    options.max_threads = 1;
+    std::string expected = "prefix";
+    ASSERT_OK(MessageToXmlString(m, &expected, options));
+    options.max_threads = 4;
+    std::string xml = "prefix";
+    ASSERT_OK(MessageToXmlString(m, &xml, options));
+    EXPECT_EQ(expected, xml);
+  }
+}
+
+TEST(XmlUtilTest, BinaryToXmlPrinter) {
+  TestMessage m = MakeStatsTestMessage();
+  for (int i = 0; i < 100; ++i) {
+    m.add_repeated_message_value()->set_value(i);
+  }
+  const std::string binary = m.SerializeAsString();
+  auto* resolver = NewTypeResolverForDescriptorPool(
+      "type.googleapis.com", DescriptorPool::generated_pool());
+  const std::string type_url = "type.googleapis.com/proto3.TestMessage";
+  XmlPrintOptions options;
+  for (bool add_whitespace : {false, true}) {
+    options.add_whitespace = add_whitespace;
+    std::string expected;
+    ASSERT_OK(BinaryToXmlString(resolver, type_url, binary, &expected,
+                                options));
+    BinaryToXmlPrinter printer(resolver, type_url, binary, options);
+    std::string xml;
+    int steps = 0;
+    while (!printer.done()) {
+      ASSERT_OK(printer.Step(100, &xml));
+      ++steps;
+    }
+    EXPECT_EQ(expected, xml);
+    EXPECT_EQ((expected.size() + 99) / 100, steps);
+  }
+
+  BinaryToXmlPrinter unknown_type(
+      resolver, "type.googleapis.com/proto3.Nope", binary, options);
+  std::string xml;
+  EXPECT_FALSE(unknown_type.Step(100, &xml).ok());
+  EXPECT_TRUE(unknown_type.done());
+  EXPECT_EQ("", xml);
+
+  // A step of no bytes is refused, and the printer can still be used.
+  BinaryToXmlPrinter printer(resolver, type_url, binary, options);
+  EXPECT_TRUE(util::IsInvalidArgument(printer.Step(0, &xml)));
+  EXPECT_FALSE(printer.done());
+  ASSERT_OK(printer.Step(100, &xml));
+  EXPECT_EQ(xml.size(), 100u);
+
+  // Options the printer cannot honor are refused rather than ignored.
+  XmlPrintStats stats;
+  options.stats = &stats;
+  BinaryToXmlPrinter with_stats(resolver, type_url, binary, options);
+  xml.clear();
+  EXPECT_TRUE(util::IsInvalidArgument(with_stats.Step(100, &xml)));
+  EXPECT_TRUE(with_stats.done());
+  EXPECT_EQ("", xml);
+  delete resolver;
+}
+
+TEST(XmlUtilTest, ParseStats) {
+  TestMessage m = MakeStatsTestMessage();
+  std::string xml;
+  ASSERT_OK(MessageToXmlString(m, &xml));
+
+  TestMessage parsed;
+  XmlParseStats stats;
+  XmlParseOptions options;
+  options.stats = &stats;
+  ASSERT_OK(XmlStringToMessage(xml, &parsed, options));
+  EXPECT_EQ(parsed.DebugString(), m.DebugString());
+
+  EXPECT_EQ(stats.input_bytes, static_cast<int64_t>(xml.size()));
+  EXPECT_EQ(stats.output_bytes, static_cast<int64_t>(m.ByteSizeLong()));
+  EXPECT_EQ(stats.elements, 8);
+  EXPECT_EQ(stats.attributes, 4);
+  EXPECT_EQ(stats.text_nodes, 2);
+  EXPECT_EQ(stats.max_depth, 3);
+  // The whole document is a single chunk, so no slow paths are taken.
+  EXPECT_EQ(stats.leftover_bytes_copied, 0);
+  EXPECT_EQ(stats.resumptions, 0);
+  EXPECT_GT(stats.transcode_nanos, 0);
+}
+
+TEST(XmlUtilTest, ParseStatsCountChunkBoundaries) {
+  TestMessage m = MakeStatsTestMessage();
+  std::string xml;
+  ASSERT_OK(MessageToXmlString(m, &xml));
+
+  auto* resolver = NewTypeResolverForDescriptorPool(
+      "type.googleapis.com", DescriptorPool::generated_pool());
+  // Feed the XML three bytes at a time.
+  io::ArrayInputStream input_stream(xml.data(), xml.size(), 3);
+  std::string binary;
+  io::StringOutputStream output_stream(&binary);
+  XmlParseStats stats;
+  XmlParseOptions options;
+  options.stats = &stats;
+  ASSERT_OK(XmlToBinaryStream(resolver,
+                              "type.googleapis.com/proto3.TestMessage",
+                              &input_stream, &output_stream, options));
+  delete resolver;
+
+  EXPECT_EQ(stats.input_bytes, static_cast<int64_t>(xml.size()));
+  EXPECT_EQ(stats.elements, 8);
+  EXPECT_GT(stats.leftover_bytes_copied, 0);
+  EXPECT_GT(stats.resumptions, 0);
+}
+
+TEST(XmlUtilTest, BackpatchMessageLengths) {
+  TestMessage m = MakeStatsTestMessage();
+  m.set_string_value(std::string(300, 'x'));
+  m.mutable_message_value()->set_value(-1);
+  std::string xml;
+  ASSERT_OK(MessageToXmlString(m, &xml));
+
+  auto* resolver = NewTypeResolverForDescriptorPool(
+      "type.googleapis.com", DescriptorPool::generated_pool());
+  const std::string type_url = "type.googleapis.com/proto3.TestMessage";
+  std::string expected;
+  ASSERT_OK(XmlToBinaryString(resolver, type_url, xml, &expected));
+
+  XmlParseOptions options;
+  options.backpatch_message_lengths = true;
+  std::string binary;
+  ASSERT_OK(XmlToBinaryString(resolver, type_url, xml, &binary, options));
+  EXPECT_EQ(expected, binary);
+
+  // Five byte lengths make a larger, but equivalent, encoding.
+  options.compact_message_lengths = false;
+  std::string loose;
+  ASSERT_OK(XmlToBinaryString(resolver, type_url, xml, &loose, options));
+  delete resolver;
+  EXPECT_GT(loose.size(), binary.size());
+  TestMessage parsed;
+  ASSERT_TRUE(parsed.ParseFromString(loose));
+  EXPECT_EQ(m.DebugString(), parsed.DebugString());
+}
+
+// Returns the profiled field at |path|, or a field with no events.
+XmlFieldProfile::Field FindProfiledField(const XmlFieldProfile& profile,
+                                         const std::string& path) {
+  for (const XmlFieldProfile::Field& field : profile.Fields()) {
+    if (field.path == path) return field;
+  }
+  return XmlFieldProfile::Field();
+}
+
+TEST(XmlUtilTest, FieldProfilePrint) {
+  TestMessage m = MakeStatsTestMessage();
+  XmlFieldProfile profile(1);
+  XmlPrintOptions options;
+  options.field_profile = &profile;
+  std::string xml;
+  ASSERT_OK(MessageToXmlString(m, &xml, options));
+
+  int64_t bytes = 0;
+  int64_t nanos = 0;
+  for (const XmlFieldProfile::Field& field : profile.Fields()) {
+    bytes += field.bytes;
+    nanos += field.nanos;
+  }
+  EXPECT_EQ(bytes, static_cast<int64_t>(xml.size()));
+  EXPECT_GT(nanos, 0);
+  // Start and end of the root.
+  EXPECT_EQ(FindProfiledField(profile, "").events, 2);
+  EXPECT_EQ(FindProfiledField(profile, "int32Value").events, 1);
+  // Start and end of the list, and its two items.
+  EXPECT_EQ(FindProfiledField(profile, "repeatedInt32Value").events, 4);
+  // Start and end of the list, and start and end of its two items.
+  EXPECT_EQ(FindProfiledField(profile, "repeatedMessageValue").events, 6);
+  EXPECT_EQ(FindProfiledField(profile, "repeatedMessageValue.value").events,
+            2);
+  EXPECT_EQ(FindProfiledField(profile, "messageValue.value").events, 1);
+  EXPECT_NE(profile.Report().find("repeatedMessageValue.value"),
+            std::string::npos);
+
+  // Profiles accumulate over conversions.
+  ASSERT_OK(MessageToXmlString(m, &xml, options));
+  EXPECT_EQ(FindProfiledField(profile, "int32Value").events, 2);
+}
+
+TEST(XmlUtilTest, FieldProfileParse) {
+  TestMessage m = MakeStatsTestMessage();
+  std::string xml;
+  ASSERT_OK(MessageToXmlString(m, &xml));
+
+  XmlFieldProfile profile(1);
+  XmlParseOptions options;
+  options.field_profile = &profile;
+  TestMessage parsed;
+  ASSERT_OK(XmlStringToMessage(xml, &parsed, options));
+  EXPECT_EQ(parsed.DebugString(), m.DebugString());
+
+  int64_t bytes = 0;
+  for (const XmlFieldProfile::Field& field : profile.Fields()) {
+    bytes += field.bytes;
+  }
+  EXPECT_GT(bytes, 0);
+  EXPECT_LE(bytes, static_cast<int64_t>(xml.size()));
+  EXPECT_EQ(FindProfiledField(profile, "repeatedMessageValue.value").events,
+            2);
+  EXPECT_GT(FindProfiledField(profile, "repeatedMessageValue.value").bytes,
+            0);
+}
+
+TEST(XmlUtilTest, FieldProfileCollapsesMapKeys) {
+  TestMap message;
+  (*message.mutable_string_map())["a"] = 1;
+  (*message.mutable_string_map())["b"] = 2;
+  (*message.mutable_string_map())["c"] = 3;
+  XmlFieldProfile profile;
+  XmlPrintOptions options;
+  options.field_profile = &profile;
+  std::string xml;
+  ASSERT_OK(MessageToXmlString(message, &xml, options));
+
+  EXPECT_EQ(FindProfiledField(profile, "stringMap.*").events, 3);
+  EXPECT_EQ(FindProfiledField(profile, "stringMap.a").events, 0);
+}
+
+class RecordingObserver : public XmlConversionObserver {
+ public:
+  explicit RecordingObserver(int64_t progress_interval_bytes)
+      : progress_interval_bytes_(progress_interval_bytes) {}
+
+  void OnEvent(const Event& event) override { events_.push_back(event); }
+  int64_t progress_interval_bytes() const override {
+    return progress_interval_bytes_;
+  }
+
+  std::vector<Phase> phases() const {
+    std::vector<Phase> phases;
+    for (const Event& event : events_) {
+      if (phases.empty() || phases.back() != event.phase) {
+        phases.push_back(event.phase);
+      }
+    }
+    return phases;
+  }
+
+  const std::vector<Event>& events() const { return events_; }
+
+ private:
+  int64_t progress_interval_bytes_;
+  std::vector<Event> events_;
+};
+
+void ExpectMonotonic(const std::vector<XmlConversionObserver::Event>& events) {
+  for (size_t i = 1; i < events.size(); ++i) {
+    EXPECT_LE(events[i - 1].timestamp_nanos, events[i].timestamp_nanos);
+    EXPECT_LE(events[i - 1].input_bytes, events[i].input_bytes);
+  }
+}
+
+TEST(XmlUtilTest, ObserverPrintPhases) {
+  TestMessage m = MakeStatsTestMessage();
+  RecordingObserver observer(1 << 20);
+  XmlPrintOptions options;
+  options.observer = &observer;
+  std::string xml;
+  ASSERT_OK(MessageToXmlString(m, &xml, options));
+
+  EXPECT_EQ(observer.phases(),
+            std::vector<XmlConversionObserver::Phase>(
+                {XmlConversionObserver::MESSAGE_SERIALIZED,
+                 XmlConversionObserver::TYPE_RESOLVED,
+                 XmlConversionObserver::FIRST_BYTE,
+                 XmlConversionObserver::TRANSCODE_FINISHED}));
+  ExpectMonotonic(observer.events());
+  EXPECT_EQ(observer.events().back().input_bytes,
+            static_cast<int64_t>(m.ByteSizeLong()));
+  EXPECT_EQ(observer.events().back().output_bytes,
+            static_cast<int64_t>(xml.size()));
+}
+
+TEST(XmlUtilTest, ObserverParsePhases) {
+  TestMessage m = MakeStatsTestMessage();
+  std::string xml;
+  ASSERT_OK(MessageToXmlString(m, &xml));
+
+  // Report progress every 16 bytes.
+  RecordingObserver observer(16);
+  XmlParseOptions options;
+  options.observer = &observer;
+  TestMessage parsed;
+  ASSERT_OK(XmlStringToMessage(xml, &parsed, options));
+  EXPECT_EQ(parsed.DebugString(), m.DebugString());
+
+  // The whole XML string is a single chunk, so there is exactly one PROGRESS
+  // event.
+  EXPECT_EQ(observer.phases(),
+            std::vector<XmlConversionObserver::Phase>(
+                {XmlConversionObserver::TYPE_RESOLVED,
+                 XmlConversionObserver::FIRST_BYTE,
+                 XmlConversionObserver::PROGRESS,
+                 XmlConversionObserver::TRANSCODE_FINISHED,
+                 XmlConversionObserver::MESSAGE_PARSED}));
+  ExpectMonotonic(observer.events());
+  EXPECT_EQ(observer.events().back().input_bytes,
+            static_cast<int64_t>(xml.size()));
+  EXPECT_EQ(observer.events().back().output_bytes,
+            static_cast<int64_t>(m.ByteSizeLong()));
+}
+
+TEST(XmlUtilTest, ObserverReportsProgressPerInterval) {
+  TestMessage m = MakeStatsTestMessage();
+  std::string xml;
+  ASSERT_OK(MessageToXmlString(m, &xml));
+
+  auto* resolver = NewTypeResolverForDescriptorPool(
+      "type.googleapis.com", DescriptorPool::generated_pool());
+  // Chunks of 8 bytes and an interval of 32 bytes: one PROGRESS event every
+  // fourth chunk.
+  io::ArrayInputStream input_stream(xml.data(), xml.size(), 8);
+  std::string binary;
+  io::StringOutputStream output_stream(&binary);
+  RecordingObserver observer(32);
+  XmlParseOptions options;
+  options.observer = &observer;
+  ASSERT_OK(XmlToBinaryStream(resolver,
+                              "type.googleapis.com/proto3.TestMessage",
+                              &input_stream, &output_stream, options));
+  delete resolver;
+
+  int progress_events = 0;
+  for (const XmlConversionObserver::Event& event : observer.events()) {
+    if (event.phase == XmlConversionObserver::PROGRESS) ++progress_events;
+  }
+  EXPECT_EQ(progress_events, static_cast<int>(xml.size() / 32));
+  ExpectMonotonic(observer.events());
+}
+
 TEST(XmlUtilTest, ParseMap) {
   TestMap message;
   (*message.mutable_string_map())["hello"] = 1234;